@@ -11,5 +11,6 @@ void GwMasterModbus_init(uart_port_t uartPort, int txPin, int rxPin, bool usesRs
 void GwMasterModbus_stop();
 bool GwMasterModbus_saveConfigToFlash();
 ModbusError GwMasterModbus_forwardMbReqToSlaves(TrackleModbusFunction function, uint8_t slaveAddr, uint16_t regId, uint16_t size, void *value);
+void GwMasterModbus_dumpModbusTrace();
 
 #endif
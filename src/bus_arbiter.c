@@ -0,0 +1,415 @@
+#include "bus_arbiter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "sem_utils.h"
+#include "bus_timing.h"
+#include "slave_health.h"
+#include "mb_trace.h"
+
+#define BUS_TASK_NAME "mb-bus-task%d"
+#define BUS_WORKER_TASK_NAME "mb-bus-task%d.%d"
+#define BUS_TASK_NAME_LEN 16
+#define BUS_TASK_STACKSIZE 4096
+#define BUS_TASK_PRIORITY (tskIDLE_PRIORITY + 7) // Above every task that uses a bus, so that it's never kept waiting by them
+
+#define STOP_FUNCTION 0 // Not a Modbus function: the arbiter stops taking requests
+
+#define SHARED_READS_NUM 4         // Distinct reads that can be shared at the same time
+#define SHARED_READ_MAX_REGS 16    // Longer reads are never shared
+#define SHARED_READ_MAX_WAITERS 16 // Requesters that can wait for the same read, besides the one that executes it
+
+// Read being executed on behalf of all the requesters of the same registers
+typedef struct SharedRead_s
+{
+    bool inUse;     // Read is waiting for the bus or being executed, or waiters didn't copy its result yet
+    bool completed; // Result is valid: new requesters can't join anymore
+    BusPriority_t priority;
+    uint8_t bus;
+    uint8_t function;
+    uint8_t slaveAddr;
+    uint16_t regId;
+    uint16_t regNumber;
+    uint16_t words[SHARED_READ_MAX_REGS];
+    ModbusError result;
+    int waitersNum;
+    SemaphoreHandle_t done; // Given once for each waiter when the read is completed
+    StaticSemaphore_t doneBuffer;
+} SharedRead_t;
+
+// Tasks that own a bus, and the requests waiting for it
+typedef struct Bus_s
+{
+    BusTransport_t transport;
+
+    // A queue for each priority. Pending requests are counted, so that the bus task sleeps until any queue has one.
+    QueueHandle_t requestsQueues[BusPriority_NUM];
+    StaticQueue_t requestsQueuesBuffers[BusPriority_NUM];
+    uint8_t requestsQueuesStorage[BusPriority_NUM][BUS_ARBITER_QUEUE_LEN * sizeof(BusRequest_t *)];
+    SemaphoreHandle_t pendingRequests;
+    StaticSemaphore_t pendingRequestsBuffer;
+
+    // Serial buses have a single task. Buses that can have several transactions in flight (Modbus TCP) have a task for each
+    // of them. Stacks are allocated only for buses that are started.
+    int workersNum;
+    TaskHandle_t taskHandles[BUS_ARBITER_MAX_WORKERS];
+    StackType_t *taskStacks[BUS_ARBITER_MAX_WORKERS];
+    StaticTask_t taskBuffers[BUS_ARBITER_MAX_WORKERS];
+
+    // Written by the bus tasks, under statsLock. Readers may get counters updated by different requests, that's fine for reporting.
+    BusLatencyStats_t latencyStats[BusPriority_NUM];
+} Bus_t;
+
+static ModbusError trackleTransport(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, void *value);
+
+// The primary bus is driven by the Trackle library, even before its task is started. Other buses get their transport when started.
+static Bus_t buses[MB_BUSES_NUM] = {[MB_PRIMARY_BUS] = {.transport = trackleTransport}};
+
+static SharedRead_t sharedReads[SHARED_READS_NUM];
+static SemaphoreHandle_t sharedReadsMutex = NULL;
+static StaticSemaphore_t sharedReadsMutexBuffer;
+
+static uint32_t latencyTargetsUs[BusPriority_NUM] = {0};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static ModbusError trackleTransport(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, void *value)
+{
+    return Trackle_Modbus_execute_command(function, slaveAddr, regId, regNumber, value);
+}
+
+// Execute a Modbus transaction, after the bus has been silent long enough for the slave, and record it in the trace. Words
+// are recorded if they're known to be registers: the ones written, or the ones read if the read succeeded.
+static ModbusError executeCommand(const BusRequest_t *req)
+{
+    const BusTransport_t transport = buses[req->bus].transport;
+    if (transport == NULL)
+        return MB_BUS_ERR_NOT_RUNNING;
+
+    BusTiming_waitGap(req->bus, req->slaveAddr);
+    const int64_t startUs = esp_timer_get_time();
+    const ModbusError err = transport(req->bus, req->function, req->slaveAddr, req->regId, req->regNumber, req->value);
+    BusTiming_frameDone(req->bus, req->slaveAddr, MB_BUS_ANSWERED(err), startUs);
+    SlaveHealth_record(req->bus, req->slaveAddr, err);
+    const bool isRead = req->function >= 1 && req->function <= 4;
+    const uint16_t wordsNum = req->valueIsWords && (err == MODBUS_OK || !isRead) ? req->regNumber : 0;
+    MbTrace_record(req->bus, req->function, req->slaveAddr, req->regId, req->regNumber, (const uint16_t *)req->value, wordsNum, err,
+                   startUs, esp_timer_get_time() - startUs);
+    return err;
+}
+
+// Most urgent pending request. There's always one, since requests are counted after being queued.
+static BusRequest_t *nextRequest(Bus_t *bus)
+{
+    BusRequest_t *req = NULL;
+    for (int p = 0; p < BusPriority_NUM; p++)
+    {
+        if (xQueueReceive(bus->requestsQueues[p], &req, 0) == pdTRUE)
+            return req;
+    }
+    return NULL;
+}
+
+static void recordWait(Bus_t *bus, const BusRequest_t *req, int64_t startUs)
+{
+    BusLatencyStats_t *stats = &bus->latencyStats[req->priority];
+    const uint32_t waitUs = (uint32_t)(startUs - req->submitUs);
+    portENTER_CRITICAL(&statsLock);
+    stats->requests++;
+    stats->totalWaitUs += waitUs;
+    if (waitUs > stats->maxWaitUs)
+        stats->maxWaitUs = waitUs;
+    if (latencyTargetsUs[req->priority] > 0 && waitUs > latencyTargetsUs[req->priority])
+        stats->missed++;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+// Only tasks that access their bus: each executes a transaction at a time. Whenever a task is free, it takes the most urgent
+// request; requests with the same priority are taken in the order they were submitted.
+static void busTask(void *args)
+{
+    Bus_t *bus = (Bus_t *)args;
+    for (;;)
+    {
+        if (xSemaphoreTake(bus->pendingRequests, portMAX_DELAY) != pdTRUE)
+            continue;
+        BusRequest_t *req = nextRequest(bus);
+        if (req == NULL)
+            continue;
+
+        if (req->function == STOP_FUNCTION)
+        {
+            xSemaphoreGive(req->done);
+            vTaskSuspend(NULL);
+        }
+
+        recordWait(bus, req, esp_timer_get_time());
+        req->result = executeCommand(req);
+        QueueHandle_t completions = req->completions; // The request may be reused as soon as it's done
+        xSemaphoreGive(req->done);
+        if (completions != NULL)
+            xQueueSend(completions, &req, portMAX_DELAY);
+    }
+}
+
+// Wait for a read joined by the caller, then copy its result. The last waiter frees it.
+static ModbusError waitSharedRead(SharedRead_t *read, uint16_t *words)
+{
+    if (xSemaphoreTake(read->done, portMAX_DELAY) != pdTRUE)
+        abort();
+
+    BLOCKING_LOCK_OR_ABORT(sharedReadsMutex);
+    memcpy(words, read->words, read->regNumber * sizeof(uint16_t));
+    const ModbusError err = read->result;
+    if (--read->waitersNum == 0)
+        read->inUse = false;
+    UNLOCK_OR_ABORT(sharedReadsMutex);
+    return err;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+// Start the tasks that own a bus, pinned to the given core: as many as the transactions the transport can have in flight (up
+// to BUS_ARBITER_MAX_WORKERS), 1 if it executes them one at a time. Transactions are executed through the given transport,
+// or, on the primary bus, through the Trackle library if it's NULL.
+bool BusArbiter_init(uint8_t bus, BusTransport_t transport, BaseType_t coreId, int workersNum)
+{
+    Bus_t *b = &buses[bus];
+    if (b->workersNum > 0)
+        return true;
+    if (workersNum < 1)
+        workersNum = 1;
+    if (workersNum > BUS_ARBITER_MAX_WORKERS)
+        workersNum = BUS_ARBITER_MAX_WORKERS;
+
+    if (sharedReadsMutex == NULL)
+        sharedReadsMutex = xSemaphoreCreateMutexStatic(&sharedReadsMutexBuffer);
+    if (sharedReadsMutex == NULL)
+        return false;
+    for (int r = 0; r < SHARED_READS_NUM; r++)
+    {
+        if (sharedReads[r].done == NULL)
+            sharedReads[r].done = xSemaphoreCreateCountingStatic(SHARED_READ_MAX_WAITERS, 0, &sharedReads[r].doneBuffer);
+        if (sharedReads[r].done == NULL)
+            return false;
+    }
+
+    for (int p = 0; p < BusPriority_NUM; p++)
+    {
+        if (b->requestsQueues[p] == NULL)
+            b->requestsQueues[p] = xQueueCreateStatic(BUS_ARBITER_QUEUE_LEN, sizeof(BusRequest_t *), b->requestsQueuesStorage[p], &b->requestsQueuesBuffers[p]);
+        if (b->requestsQueues[p] == NULL)
+            return false;
+    }
+    if (b->pendingRequests == NULL)
+        b->pendingRequests = xSemaphoreCreateCountingStatic(BusPriority_NUM * BUS_ARBITER_QUEUE_LEN, 0, &b->pendingRequestsBuffer);
+    if (b->pendingRequests == NULL)
+        return false;
+
+    for (int w = 0; w < workersNum; w++)
+    {
+        if (b->taskStacks[w] == NULL)
+            b->taskStacks[w] = heap_caps_malloc(BUS_TASK_STACKSIZE * sizeof(StackType_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (b->taskStacks[w] == NULL)
+            return false;
+    }
+
+    if (transport != NULL)
+        b->transport = transport;
+
+    for (int w = 0; w < workersNum; w++)
+    {
+        char taskName[BUS_TASK_NAME_LEN] = {0};
+        if (workersNum == 1)
+            snprintf(taskName, BUS_TASK_NAME_LEN, BUS_TASK_NAME, bus);
+        else
+            snprintf(taskName, BUS_TASK_NAME_LEN, BUS_WORKER_TASK_NAME, bus, w);
+        b->taskHandles[w] = xTaskCreateStaticPinnedToCore(busTask,
+                                                          taskName,
+                                                          BUS_TASK_STACKSIZE,
+                                                          b,
+                                                          BUS_TASK_PRIORITY,
+                                                          b->taskStacks[w],
+                                                          &b->taskBuffers[w],
+                                                          coreId);
+        if (b->taskHandles[w] == NULL)
+            return false;
+        b->workersNum = w + 1; // Requests are taken as soon as a task started
+    }
+    return true;
+}
+
+bool BusArbiter_isRunning(uint8_t bus)
+{
+    return buses[bus].workersNum > 0;
+}
+
+// Transactions a bus executes at the same time, 0 if it's not running
+int BusArbiter_workers(uint8_t bus)
+{
+    return buses[bus].workersNum;
+}
+
+void BusArbiter_prepare(BusRequest_t *req, uint8_t bus, BusPriority_t priority, uint8_t function, uint8_t slaveAddr, uint16_t regId,
+                        uint16_t regNumber, void *value, bool valueIsWords)
+{
+    req->bus = bus;
+    req->priority = priority;
+    req->function = function;
+    req->slaveAddr = slaveAddr;
+    req->regId = regId;
+    req->regNumber = regNumber;
+    req->value = value;
+    req->valueIsWords = valueIsWords;
+    req->completions = NULL;
+    req->submitUs = 0;
+    req->result = MODBUS_OK;
+    req->done = xSemaphoreCreateBinaryStatic(&req->doneBuffer);
+    configASSERT(req->done != NULL);
+}
+
+// Queue a prepared request, waiting up to the given time for room in the queue of its priority. Returns false if it wasn't queued.
+bool BusArbiter_submit(BusRequest_t *req, TickType_t wait)
+{
+    Bus_t *bus = &buses[req->bus];
+    if (bus->workersNum == 0)
+        return false;
+
+    req->submitUs = esp_timer_get_time();
+    if (xQueueSend(bus->requestsQueues[req->priority], &req, wait) != pdTRUE)
+        return false;
+    xSemaphoreGive(bus->pendingRequests);
+    return true;
+}
+
+// Wait up to the given time for a submitted request to be completed. Returns true if it was, then its result is valid.
+bool BusArbiter_wait(BusRequest_t *req, TickType_t wait)
+{
+    return xSemaphoreTake(req->done, wait) == pdTRUE;
+}
+
+bool BusArbiter_poll(BusRequest_t *req)
+{
+    return BusArbiter_wait(req, 0);
+}
+
+// Execute a transaction, waiting for it to be completed. If the task of the bus didn't start (e.g. Modbus failed to initialize),
+// the caller executes the transaction itself, on the buses that have a transport.
+ModbusError BusArbiter_execute(uint8_t bus, BusPriority_t priority, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber,
+                               void *value, bool valueIsWords)
+{
+    BusRequest_t req;
+    BusArbiter_prepare(&req, bus, priority, function, slaveAddr, regId, regNumber, value, valueIsWords);
+    if (buses[bus].workersNum == 0)
+        return executeCommand(&req);
+    if (!BusArbiter_submit(&req, portMAX_DELAY) || !BusArbiter_wait(&req, portMAX_DELAY))
+        abort();
+    return req.result;
+}
+
+// Read registers, sharing the transaction with an identical read of the same priority that is waiting for the bus or being
+// executed: all its requesters get the same words and result. If no read can be shared, the transaction is executed as usual.
+ModbusError BusArbiter_sharedRead(uint8_t bus, BusPriority_t priority, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber,
+                                  uint16_t *words)
+{
+    if (buses[bus].workersNum == 0 || regNumber > SHARED_READ_MAX_REGS)
+        return BusArbiter_execute(bus, priority, function, slaveAddr, regId, regNumber, words, true);
+
+    BLOCKING_LOCK_OR_ABORT(sharedReadsMutex);
+    SharedRead_t *available = NULL;
+    for (int r = 0; r < SHARED_READS_NUM; r++)
+    {
+        SharedRead_t *read = &sharedReads[r];
+        if (!read->inUse)
+        {
+            if (available == NULL)
+                available = read;
+            continue;
+        }
+        if (read->completed || read->bus != bus || read->priority != priority || read->function != function || read->slaveAddr != slaveAddr ||
+            read->regId != regId || read->regNumber != regNumber || read->waitersNum >= SHARED_READ_MAX_WAITERS)
+            continue;
+
+        read->waitersNum++;
+        UNLOCK_OR_ABORT(sharedReadsMutex);
+        return waitSharedRead(read, words);
+    }
+    if (available == NULL)
+    {
+        UNLOCK_OR_ABORT(sharedReadsMutex);
+        return BusArbiter_execute(bus, priority, function, slaveAddr, regId, regNumber, words, true);
+    }
+    SharedRead_t *read = available;
+    read->inUse = true;
+    read->completed = false;
+    read->bus = bus;
+    read->priority = priority;
+    read->function = function;
+    read->slaveAddr = slaveAddr;
+    read->regId = regId;
+    read->regNumber = regNumber;
+    read->waitersNum = 0;
+    UNLOCK_OR_ABORT(sharedReadsMutex);
+
+    const ModbusError err = BusArbiter_execute(bus, priority, function, slaveAddr, regId, regNumber, read->words, true);
+
+    BLOCKING_LOCK_OR_ABORT(sharedReadsMutex);
+    read->result = err;
+    read->completed = true;
+    memcpy(words, read->words, regNumber * sizeof(uint16_t));
+    const int waitersNum = read->waitersNum;
+    read->inUse = waitersNum > 0;
+    UNLOCK_OR_ABORT(sharedReadsMutex);
+
+    for (int w = 0; w < waitersNum; w++)
+        xSemaphoreGive(read->done);
+    return err;
+}
+
+// Number of requests waiting for a bus
+int BusArbiter_queued(uint8_t bus)
+{
+    if (buses[bus].workersNum == 0)
+        return 0;
+
+    int queued = 0;
+    for (int p = 0; p < BusPriority_NUM; p++)
+        queued += uxQueueMessagesWaiting(buses[bus].requestsQueues[p]);
+    return queued;
+}
+
+// Requests of a priority that wait for their bus longer than the target are counted as missed. 0 disables the target.
+void BusArbiter_setLatencyTargetMs(BusPriority_t priority, uint16_t targetMs)
+{
+    latencyTargetsUs[priority] = (uint32_t)targetMs * 1000;
+}
+
+void BusArbiter_getLatencyStats(uint8_t bus, BusPriority_t priority, BusLatencyStats_t *stats)
+{
+    portENTER_CRITICAL(&statsLock);
+    *stats = buses[bus].latencyStats[priority];
+    portEXIT_CRITICAL(&statsLock);
+    stats->targetUs = latencyTargetsUs[priority];
+}
+
+// Wait for requests submitted so far to a bus to be completed (the more urgent ones first), then stop taking new ones: their
+// submitters wait forever. Each task of the bus stops when it takes a stop request.
+void BusArbiter_stop(uint8_t bus)
+{
+    for (int w = 0; w < buses[bus].workersNum; w++)
+    {
+        BusRequest_t req;
+        BusArbiter_prepare(&req, bus, BusPriority_POLLING, STOP_FUNCTION, 0, 0, 0, NULL, false);
+        if (!BusArbiter_submit(&req, portMAX_DELAY) || !BusArbiter_wait(&req, portMAX_DELAY))
+            abort();
+    }
+}
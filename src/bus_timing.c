@@ -0,0 +1,167 @@
+#include "bus_timing.h"
+
+#include <esp_rom_sys.h>
+#include <esp_timer.h>
+#include <driver/uart.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define SLAVES_NUM 256
+
+#define HIGH_BAUDRATE 19200
+#define HIGH_BAUDRATE_GAP_US 1750 // Above 19200 baud, the Modbus over serial line specification fixes the silent interval
+
+#define GAP_STEP_US 1000             // Min increase of the gap of a slave that failed right after a previous frame
+#define SUCCESSES_TO_SHRINK_GAP 256 // Consecutive successes after which the gap of a slave is reduced by 1/8
+
+// Functions about a serial bus are only called by the task that holds it, so that state needs no locks. Buses that aren't
+// paced (Modbus TCP, whose tasks run at the same time) have no state to update.
+
+typedef struct BusGaps_s
+{
+    bool paced;
+    uint32_t minGapUs; // Silent interval of 3.5 chars at the configured serial settings
+    uint32_t maxGapUs; // Configured delay between commands: the only gap if not adaptive, the max one otherwise
+
+    // Gap each slave was learned to need before receiving a frame, and successes since it last changed
+    uint32_t slaveGapUs[SLAVES_NUM];
+    uint16_t slaveSuccesses[SLAVES_NUM];
+
+    int64_t lastFrameEndUs;
+} BusGaps_t;
+
+static BusGaps_t buses[MB_BUSES_NUM];
+static bool adaptive = false;
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+// Length of a char in half bits: start bit, data bits, parity bit, stop bits (1, 1.5 or 2)
+static uint32_t charHalfBits(uint8_t serialDataBits, uint8_t serialParity, uint8_t serialStopBits)
+{
+    const uint32_t dataBits = 5 + (serialDataBits - UART_DATA_5_BITS);
+    const uint32_t parityBits = serialParity != UART_PARITY_DISABLE ? 1 : 0;
+    uint32_t stopHalfBits = 2;
+    if (serialStopBits == UART_STOP_BITS_1_5)
+        stopHalfBits = 3;
+    else if (serialStopBits == UART_STOP_BITS_2)
+        stopHalfBits = 4;
+    return 2 * (1 + dataBits + parityBits) + stopHalfBits;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+void BusTiming_init(uint8_t bus, int baudrate, uint8_t serialDataBits, uint8_t serialParity, uint8_t serialStopBits, uint16_t interCmdsDelayMs)
+{
+    BusGaps_t *gaps = &buses[bus];
+    gaps->paced = true;
+    if (baudrate > HIGH_BAUDRATE || baudrate <= 0)
+    {
+        gaps->minGapUs = HIGH_BAUDRATE_GAP_US;
+    }
+    else
+    {
+        // 3.5 chars, rounded up
+        const uint64_t halfBitsUs = 7ull * charHalfBits(serialDataBits, serialParity, serialStopBits) * 1000000ull;
+        gaps->minGapUs = (halfBitsUs + 4ull * baudrate - 1) / (4ull * baudrate);
+    }
+    gaps->maxGapUs = (uint32_t)interCmdsDelayMs * 1000;
+
+    for (int s = 0; s < SLAVES_NUM; s++)
+    {
+        gaps->slaveGapUs[s] = gaps->minGapUs;
+        gaps->slaveSuccesses[s] = 0;
+    }
+    gaps->lastFrameEndUs = 0;
+}
+
+// Bus that needs no silence between frames
+void BusTiming_initUnpaced(uint8_t bus)
+{
+    buses[bus] = (BusGaps_t){.paced = false};
+}
+
+void BusTiming_setAdaptive(bool isAdaptive)
+{
+    adaptive = isAdaptive;
+}
+
+bool BusTiming_isAdaptive()
+{
+    return adaptive;
+}
+
+uint32_t BusTiming_minGapUs(uint8_t bus)
+{
+    return buses[bus].minGapUs;
+}
+
+// Gap expected before most frames: the silent interval if adaptive, since most slaves don't need more
+uint32_t BusTiming_typicalGapUs(uint8_t bus)
+{
+    if (!buses[bus].paced)
+        return 0;
+    return adaptive ? buses[bus].minGapUs : buses[bus].maxGapUs;
+}
+
+// Silence needed on the bus before a frame to a slave
+uint32_t BusTiming_gapUs(uint8_t bus, uint8_t slaveAddr)
+{
+    if (!buses[bus].paced)
+        return 0;
+    return adaptive ? buses[bus].slaveGapUs[slaveAddr] : buses[bus].maxGapUs;
+}
+
+// Wait until the bus has been silent long enough to send a frame to a slave. Time spent since previous frame (e.g. decoding
+// values) is part of the gap. Waits shorter than a tick are busy, the others sleep.
+void BusTiming_waitGap(uint8_t bus, uint8_t slaveAddr)
+{
+    const int64_t lastFrameEndUs = buses[bus].lastFrameEndUs;
+    if (lastFrameEndUs == 0)
+        return;
+
+    const int64_t elapsedUs = esp_timer_get_time() - lastFrameEndUs;
+    const int64_t gapUs = BusTiming_gapUs(bus, slaveAddr);
+    if (elapsedUs >= gapUs)
+        return;
+
+    const uint32_t remainingUs = gapUs - elapsedUs;
+    const uint32_t tickUs = portTICK_PERIOD_MS * 1000;
+    if (remainingUs < tickUs)
+        esp_rom_delay_us(remainingUs);
+    else
+        vTaskDelay(remainingUs / tickUs + 1); // First tick may be partial
+}
+
+// Learn from the result of a frame. A slave that fails when addressed right after a previous frame may need more time to be
+// ready: its gap grows (up to the configured delay between commands). Long runs of successes shrink it back, towards the
+// silent interval.
+void BusTiming_frameDone(uint8_t bus, uint8_t slaveAddr, bool ok, int64_t startUs)
+{
+    BusGaps_t *gaps = &buses[bus];
+    if (!gaps->paced)
+        return;
+    const int64_t nowUs = esp_timer_get_time();
+
+    if (adaptive)
+    {
+        const uint32_t capUs = gaps->maxGapUs > gaps->minGapUs ? gaps->maxGapUs : gaps->minGapUs;
+        const bool afterPreviousFrame = gaps->lastFrameEndUs != 0 && startUs - gaps->lastFrameEndUs < (int64_t)gaps->slaveGapUs[slaveAddr] + gaps->minGapUs;
+        uint32_t *gapUs = &gaps->slaveGapUs[slaveAddr];
+
+        if (!ok && afterPreviousFrame)
+        {
+            const uint32_t grownUs = *gapUs * 2 > *gapUs + GAP_STEP_US ? *gapUs * 2 : *gapUs + GAP_STEP_US;
+            *gapUs = grownUs < capUs ? grownUs : capUs;
+            gaps->slaveSuccesses[slaveAddr] = 0;
+        }
+        else if (ok && ++gaps->slaveSuccesses[slaveAddr] >= SUCCESSES_TO_SHRINK_GAP)
+        {
+            const uint32_t shrunkUs = *gapUs - *gapUs / 8;
+            *gapUs = shrunkUs > gaps->minGapUs ? shrunkUs : gaps->minGapUs;
+            gaps->slaveSuccesses[slaveAddr] = 0;
+        }
+    }
+
+    gaps->lastFrameEndUs = nowUs;
+}
@@ -0,0 +1,183 @@
+#include "cbor_writer.h"
+
+#include <string.h>
+
+// Major types (RFC 8949), already shifted to the 3 most significant bits of the initial byte
+#define CBOR_MT_UINT (0 << 5)
+#define CBOR_MT_NEGINT (1 << 5)
+#define CBOR_MT_TEXT (3 << 5)
+#define CBOR_MT_ARRAY (4 << 5)
+#define CBOR_MT_MAP (5 << 5)
+#define CBOR_MT_SIMPLE (7 << 5)
+
+#define CBOR_INDEFINITE 31
+#define CBOR_FALSE (CBOR_MT_SIMPLE | 20)
+#define CBOR_TRUE (CBOR_MT_SIMPLE | 21)
+#define CBOR_NULL (CBOR_MT_SIMPLE | 22)
+#define CBOR_FLOAT32 (CBOR_MT_SIMPLE | 26)
+#define CBOR_FLOAT64 (CBOR_MT_SIMPLE | 27)
+#define CBOR_BREAK 0xFF
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static bool reserve(CborWriter_t *writer, int dataLen)
+{
+    if (writer->overflow)
+        return false;
+
+    if (writer->len + dataLen > writer->capacity)
+    {
+        writer->overflow = true;
+        return false;
+    }
+    return true;
+}
+
+static void appendByte(CborWriter_t *writer, uint8_t byte)
+{
+    if (reserve(writer, 1))
+        writer->buf[writer->len++] = byte;
+}
+
+// Append big endian bytes of value
+static void appendBigEndian(CborWriter_t *writer, uint64_t value, int bytesNum)
+{
+    if (!reserve(writer, bytesNum))
+        return;
+    for (int i = bytesNum - 1; i >= 0; i--)
+        writer->buf[writer->len++] = (value >> (8 * i)) & 0xFF;
+}
+
+// Write initial byte and argument using the shortest encoding
+static void appendHead(CborWriter_t *writer, uint8_t majorType, uint64_t argument)
+{
+    if (argument < 24)
+    {
+        appendByte(writer, majorType | argument);
+    }
+    else if (argument <= UINT8_MAX)
+    {
+        appendByte(writer, majorType | 24);
+        appendBigEndian(writer, argument, 1);
+    }
+    else if (argument <= UINT16_MAX)
+    {
+        appendByte(writer, majorType | 25);
+        appendBigEndian(writer, argument, 2);
+    }
+    else if (argument <= UINT32_MAX)
+    {
+        appendByte(writer, majorType | 26);
+        appendBigEndian(writer, argument, 4);
+    }
+    else
+    {
+        appendByte(writer, majorType | 27);
+        appendBigEndian(writer, argument, 8);
+    }
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+void CborWriter_init(CborWriter_t *writer, uint8_t *buf, int capacity)
+{
+    writer->buf = buf;
+    writer->capacity = capacity;
+    writer->len = 0;
+    writer->overflow = false;
+}
+
+void CborWriter_beginMap(CborWriter_t *writer)
+{
+    appendByte(writer, CBOR_MT_MAP | CBOR_INDEFINITE);
+}
+
+void CborWriter_beginArray(CborWriter_t *writer)
+{
+    appendByte(writer, CBOR_MT_ARRAY | CBOR_INDEFINITE);
+}
+
+void CborWriter_end(CborWriter_t *writer)
+{
+    appendByte(writer, CBOR_BREAK);
+}
+
+void CborWriter_uint(CborWriter_t *writer, uint64_t value)
+{
+    appendHead(writer, CBOR_MT_UINT, value);
+}
+
+void CborWriter_int(CborWriter_t *writer, int64_t value)
+{
+    if (value >= 0)
+        appendHead(writer, CBOR_MT_UINT, value);
+    else
+        appendHead(writer, CBOR_MT_NEGINT, (uint64_t)(-(value + 1)));
+}
+
+void CborWriter_float32(CborWriter_t *writer, float value)
+{
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    appendByte(writer, CBOR_FLOAT32);
+    appendBigEndian(writer, bits, 4);
+}
+
+void CborWriter_float64(CborWriter_t *writer, double value)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    appendByte(writer, CBOR_FLOAT64);
+    appendBigEndian(writer, bits, 8);
+}
+
+// Write a double using single precision, if it can represent it exactly
+void CborWriter_double(CborWriter_t *writer, double value)
+{
+    const float singleValue = (float)value;
+    if ((double)singleValue == value || value != value)
+        CborWriter_float32(writer, singleValue);
+    else
+        CborWriter_float64(writer, value);
+}
+
+void CborWriter_text(CborWriter_t *writer, const char *value, int valueLen)
+{
+    appendHead(writer, CBOR_MT_TEXT, valueLen);
+    if (reserve(writer, valueLen))
+    {
+        memcpy(&writer->buf[writer->len], value, valueLen);
+        writer->len += valueLen;
+    }
+}
+
+void CborWriter_bool(CborWriter_t *writer, bool value)
+{
+    appendByte(writer, value ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void CborWriter_null(CborWriter_t *writer)
+{
+    appendByte(writer, CBOR_NULL);
+}
+
+bool CborWriter_overflowed(const CborWriter_t *writer)
+{
+    return writer->overflow;
+}
+
+int CborWriter_length(const CborWriter_t *writer)
+{
+    return writer->len;
+}
+
+CborWriterMark_t CborWriter_mark(const CborWriter_t *writer)
+{
+    return writer->len;
+}
+
+void CborWriter_rollback(CborWriter_t *writer, CborWriterMark_t mark)
+{
+    writer->len = mark;
+    writer->overflow = false;
+}
@@ -1,8 +1,10 @@
 #include <string.h>
+#include <stdlib.h>
 #include <inttypes.h>
 #include <math.h>
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <driver/uart.h>
 
 #include <trackle_esp32.h>
@@ -12,25 +14,40 @@
 #include "nvs_fw_cfg.h"
 #include "mb_rtu.h"
 #include "str_utils.h"
+#include "json_writer.h"
+#include "mb_trace.h"
+#include "slave_health.h"
+#include "register_map.h"
 
 #include "cloud_cb.h"
 
-#define BOOL2STR(b) \
-    (b ? "true" : "false")
-
 #define JSON_ERROR(e) \
     ("{\"error\":" #e "}")
 
 #define ARGS_BUFSIZE 128
 #define JSON_BUFSIZE 1024
 #define VALUE_STRING_BUFSIZE 128
-#define KEYVALUE_STRING_BUFSIZE 144
+#define BATCH_ARGS_BUFSIZE 1024
 #define MAX_TOKENS_NUM 6
 
 #define INVALID_CONVERSION 127
 
+static const char *BUS_PRIORITIES_NAMES[BusPriority_NUM] = {"control", "forwarded", "interactive", "polling"};
+
 static const char *TAG = "cloud_cb";
 
+// Bus given as optional last argument: the primary one if empty
+static bool parseBus(const char *arg, uint8_t *bus)
+{
+    *bus = MB_PRIMARY_BUS;
+    if (arg == NULL || STREQ(arg, ""))
+        return true;
+    if (!strContainsOnlyDigits(arg) || !strValLessThan(arg, MAX_U8_STR))
+        return false;
+    sscanf(arg, "%" PRIu8, bus);
+    return *bus < MB_BUSES_NUM;
+}
+
 static int postAddRegister(const char *args)
 {
     if (strlen(args) >= ARGS_BUFSIZE)
@@ -250,6 +267,72 @@ static int postSetRegisterMaxPublishDelay(const char *args)
     return 1;
 }
 
+static int postSetRegisterPollInterval(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum != 2)
+            return -4;
+    }
+
+    if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U32_STR))
+        return -5;
+
+    const char *regName = tokens[0];
+
+    Seconds_t interval = 0;
+    sscanf(tokens[1], "%" PRIu32, &interval);
+
+    if (!KnownRegisters_setPollInterval(regName, interval))
+        return -6;
+
+    return 1;
+}
+
+static int postSetRegisterBus(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum != 2)
+            return -4;
+    }
+
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[1], &bus))
+        return -5;
+
+    if (!KnownRegisters_setBus(tokens[0], bus))
+        return -6;
+
+    return 1;
+}
+
 static int postMakeRegisterWritable(const char *args)
 {
     if (strlen(args) >= ARGS_BUFSIZE)
@@ -381,6 +464,47 @@ static int postSetRegisterCoefficients(const char *args)
     return 1;
 }
 
+static int postSetRegisterDeadband(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum != 3)
+            return -4;
+    }
+
+    if (!strContainsValidDouble(tokens[1]))
+        return -5;
+
+    if (!strContainsValidDouble(tokens[2]))
+        return -6;
+
+    const char *regName = tokens[0];
+
+    double deadbandAbs = 0;
+    sscanf(tokens[1], "%lf", &deadbandAbs);
+
+    double deadbandRel = 0;
+    sscanf(tokens[2], "%lf", &deadbandRel);
+
+    if (!KnownRegisters_setDeadband(regName, deadbandAbs, deadbandRel))
+        return -7;
+
+    return 1;
+}
+
 static int postSetRegisterOffset(const char *args)
 {
     if (strlen(args) >= ARGS_BUFSIZE)
@@ -623,7 +747,70 @@ static int postSetMbReadPeriod(const char *args)
     return 1;
 }
 
-static int postWriteRegisterValue(const char *args)
+static int postSetMaxRegisters(const char *args)
+{
+    if (!strContainsOnlyDigits(args) || !strValLessThan(args, MAX_U16_STR))
+        return -1;
+    uint32_t maxRegisters = 0;
+    sscanf(args, "%" PRIu32, &maxRegisters);
+
+    if (!NvsFwCfg_setMaxRegisters(maxRegisters))
+        return -2;
+
+    return 1;
+}
+
+static int postSetPayloadEncoding(const char *args)
+{
+    if (STREQ(args, "json"))
+        NvsFwCfg_setPayloadEncoding(PayloadEncoding_JSON);
+    else if (STREQ(args, "cbor"))
+        NvsFwCfg_setPayloadEncoding(PayloadEncoding_CBOR);
+    else if (STREQ(args, "msgpack"))
+        NvsFwCfg_setPayloadEncoding(PayloadEncoding_MSGPACK);
+    else
+        return -1;
+
+    return 1;
+}
+
+static int postSetCompactKeys(const char *args)
+{
+    if (STREQ(args, "false"))
+        NvsFwCfg_setCompactKeys(false);
+    else if (STREQ(args, "true"))
+        NvsFwCfg_setCompactKeys(true);
+    else
+        return -1;
+
+    return 1;
+}
+
+static int postSetTrimTrailingZeros(const char *args)
+{
+    if (STREQ(args, "false"))
+        NvsFwCfg_setTrimTrailingZeros(false);
+    else if (STREQ(args, "true"))
+        NvsFwCfg_setTrimTrailingZeros(true);
+    else
+        return -1;
+
+    return 1;
+}
+
+static int postSetMbAdaptiveInterCmdsDelay(const char *args)
+{
+    if (STREQ(args, "false"))
+        NvsFwCfg_setAdaptiveInterCmdsDelay(false);
+    else if (STREQ(args, "true"))
+        NvsFwCfg_setAdaptiveInterCmdsDelay(true);
+    else
+        return -1;
+
+    return 1;
+}
+
+static int postSetMbLatencyTarget(const char *args)
 {
     if (strlen(args) >= ARGS_BUFSIZE)
         return -1;
@@ -644,33 +831,22 @@ static int postWriteRegisterValue(const char *args)
             return -4;
     }
 
-    const char *regName = tokens[0];
-    const char *valueString = tokens[1];
-
-    switch (MbRtu_writeTypedRegisterByName(regName, valueString))
-    {
-    case RegError_OK:
-        return 1;
-    case RegError_NOT_FOUND:
+    int priority = 0;
+    while (priority < BusPriority_NUM && !STREQ(tokens[0], BUS_PRIORITIES_NAMES[priority]))
+        priority++;
+    if (priority == BusPriority_NUM)
         return -5;
-    case RegError_MB_NOT_INIT:
+
+    if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U16_STR))
         return -6;
-    case RegError_REG_NOT_WRITABLE:
-        return -7;
-    case RegError_MB_WRITE_ERR:
-        return -8;
-    case RegError_STRING_NOT_DOUBLE:
-        return -9;
-    case RegError_CANT_REPRESENT_WITH_INT16:
-        return -10;
-    case RegError_CANT_REPRESENT_WITH_UINT16:
-        return -11;
-    default:
-        return -12;
-    }
+    uint16_t targetMs = 0;
+    sscanf(tokens[1], "%" PRIu16, &targetMs);
+
+    NvsFwCfg_setLatencyTargetMs(priority, targetMs);
+    return 1;
 }
 
-static int postWriteRawRegisterValue(const char *args)
+static int postSetMbBusConfig(const char *args)
 {
     if (strlen(args) >= ARGS_BUFSIZE)
         return -1;
@@ -687,123 +863,74 @@ static int postWriteRawRegisterValue(const char *args)
     case SplitRes_NULL_STRIN:
         return -3;
     default:
-        if (tokensNum != 4)
+        if (tokensNum < 2)
             return -4;
     }
 
-    if (!strContainsOnlyDigits(tokens[0]) || (atoi(tokens[0]) != 5 && atoi(tokens[0]) != 6 && atoi(tokens[0]) != 15 && atoi(tokens[0]) != 16))
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[0], &bus) || bus == MB_PRIMARY_BUS || MB_BUS_IS_TCP(bus))
         return -5;
-    uint8_t writeFunction = 0;
-    sscanf(tokens[0], "%" PRIu8, &writeFunction);
 
-    if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U8_STR))
+    if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_I32_STR))
         return -6;
-    uint8_t slaveAddr = 0;
-    sscanf(tokens[1], "%" PRIu8, &slaveAddr);
-
-    if (!strContainsOnlyDigits(tokens[2]) || !strValLessThan(tokens[2], MAX_U16_STR))
-        return -7;
-    uint16_t regId = 0;
-    sscanf(tokens[2], "%" PRIu16, &regId);
-
-    if (!strContainsOnlyDigits(tokens[3]) || !strValLessThan(tokens[3], MAX_U16_STR))
-        return -8;
-    uint16_t rawValue = 0;
-    sscanf(tokens[3], "%" PRIu16, &rawValue);
+    int32_t baudrate = 0;
+    sscanf(tokens[1], "%" PRIi32, &baudrate);
 
-    switch (MbRtu_writeRawRegisterByAddr(writeFunction, slaveAddr, regId, rawValue))
+    uart_word_length_t dataBits = UART_DATA_8_BITS;
+    if (tokensNum >= 3)
     {
-    case RegError_OK:
-        return 1;
-    case RegError_MB_NOT_INIT:
-        return -9;
-    case RegError_MB_WRITE_ERR:
-        return -10;
-    default:
-        return -11;
+        int32_t dataBitsInt = 0;
+        if (strContainsOnlyDigits(tokens[2]))
+            sscanf(tokens[2], "%" PRIi32, &dataBitsInt);
+        dataBits = intToDataBits(dataBitsInt);
+        if (dataBits == INVALID_CONVERSION)
+            return -7;
     }
-}
 
-static void *getGetRegistersList(const char *args)
-{
-    static char jsonBuffer[JSON_BUFSIZE] = {0};
-    char *json = jsonBuffer;
-    json += sprintf(json, "[");
+    uart_parity_t parity = UART_PARITY_DISABLE;
+    if (tokensNum >= 4)
+    {
+        parity = stringToParity(tokens[3]);
+        if (parity == INVALID_CONVERSION)
+            return -8;
+    }
 
-    const int knownRegistersNum = KnownRegisters_count();
-    for (int i = 0; i < knownRegistersNum; i++)
+    uart_stop_bits_t stopBits = UART_STOP_BITS_1;
+    if (tokensNum >= 5)
     {
-        RegisterAccessData_t rad = {0};
-        KnownRegisters_at(i, &rad);
-        json += sprintf(json, "\"%s\"", rad.regName);
-        if (i != knownRegistersNum - 1)
-            json += sprintf(json, ",");
+        if (!strContainsValidDouble(tokens[4]))
+            return -9;
+        double stopBitsDouble = 0;
+        sscanf(tokens[4], "%lf", &stopBitsDouble);
+        stopBits = doubleToStopBits(stopBitsDouble);
+        if (stopBits == INVALID_CONVERSION)
+            return -9;
     }
 
-    json += sprintf(json, "]");
+    if (!NvsFwCfg_setBusSerial(bus, baudrate, dataBits, parity, stopBits))
+        return -6;
 
-    return jsonBuffer;
+    return 1;
 }
 
-static void *getGetRegisterDetails(const char *args)
+// Pins are signed: -1 leaves the direction pin unused (bus not on RS485)
+static bool parsePin(const char *arg, int8_t *pin)
 {
-    static char jsonBuffer[JSON_BUFSIZE] = {0};
-    char *json = jsonBuffer;
-    json += sprintf(json, "{");
-
-    const char *regName = args;
-
-    RegisterAccessData_t rad = {0};
-    if (KnownRegisters_find(regName, &rad))
-    {
-        json += sprintf(json, "\"name\":\"%s\",", rad.regName);
-        json += sprintf(json, "\"address\":%" PRIu8 ",", rad.slaveAddr);
-        json += sprintf(json, "\"register\":%" PRIu16 ",", rad.regId);
-        json += sprintf(json, "\"readFunction\":%" PRIu8 ",", rad.readFunction);
-        json += sprintf(json, "\"length\":%" PRIu8 ",", rad.regNumber);
-        switch (rad.type)
-        {
-        case RADType_NUMBER:
-            json += sprintf(json, "\"type\":\"" TYPE_NUMBER_STR "\",");
-            json += sprintf(json, "\"signed\":%s,", BOOL2STR(rad.interpretAsSigned));
-            json += sprintf(json, "\"factor\":%f,", rad.factor);
-            json += sprintf(json, "\"offset\":%f,", rad.offset);
-            json += sprintf(json, "\"decimals\":%" PRIu8 ",", rad.decimals);
-            break;
-        case RADType_RAW:
-            json += sprintf(json, "\"type\":\"" TYPE_RAW_STR "\",");
-            break;
-        case RADType_FLOAT:
-            json += sprintf(json, "\"type\":\"" TYPE_FLOAT_STR "\",");
-            break;
-        case RADType_STRING:
-            json += sprintf(json, "\"type\":\"" TYPE_STRING_STR "\",");
-            break;
-        }
-        json += sprintf(json, "\"monitored\":%s,", BOOL2STR(rad.monitored));
-        if (rad.monitored)
-        {
-            json += sprintf(json, "\"maxPublishDelay\":%" PRIu32 ",", rad.maxPublishDelay);
-            json += sprintf(json, "\"publishOnChange\":%s,", BOOL2STR(rad.publishOnChange));
-            if (rad.publishOnChange)
-                json += sprintf(json, "\"changeCheckInterval\":%" PRIu32 ",", rad.changeCheckInterval);
-        }
-        json += sprintf(json, "\"writable\":%s", BOOL2STR(rad.writable));
-        if (rad.writable)
-            json += sprintf(json, ",\"writeFunction\":%" PRIu8, rad.writeFunction);
+    if (STREQ(arg, "-1"))
+    {
+        *pin = -1;
+        return true;
     }
-
-    json += sprintf(json, "}");
-
-    ESP_LOGE(TAG, "%s", jsonBuffer);
-
-    return jsonBuffer;
+    if (!strContainsOnlyDigits(arg) || !strValLessThan(arg, "128"))
+        return false;
+    sscanf(arg, "%" SCNd8, pin);
+    return true;
 }
 
-static void *getGetRegisterNameByMbDetails(const char *args)
+static int postSetMbBusPins(const char *args)
 {
     if (strlen(args) >= ARGS_BUFSIZE)
-        return JSON_ERROR("arg too long");
+        return -1;
 
     char argsCpy[ARGS_BUFSIZE];
     strcpy(argsCpy, args);
@@ -813,47 +940,644 @@ static void *getGetRegisterNameByMbDetails(const char *args)
     switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
     {
     case SplitRes_TOO_MANY_PARAMS:
-        return JSON_ERROR("too many parameters");
+        return -2;
     case SplitRes_NULL_STRIN:
-        return JSON_ERROR("null string");
-    default:;
+        return -3;
+    default:
+        if (tokensNum != 4 && tokensNum != 5)
+            return -4;
     }
 
-    if (tokensNum != 3)
-        return JSON_ERROR("wrong number of parameters");
-
-    if (!strContainsOnlyDigits(tokens[0]) || strValLessThan(tokens[0], "0") || strValLessThan("5", tokens[0]))
-        return JSON_ERROR("invalid read function");
-    uint8_t readFunction = 0;
-    sscanf(tokens[0], "%" PRIu8, &readFunction);
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[0], &bus) || bus == MB_PRIMARY_BUS || MB_BUS_IS_TCP(bus))
+        return -5;
 
     if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U8_STR))
-        return JSON_ERROR("invalid slave address");
-    uint8_t slaveAddr = 0;
-    sscanf(tokens[1], "%" PRIu8, &slaveAddr);
+        return -6;
+    uint8_t uartPort = 0;
+    sscanf(tokens[1], "%" PRIu8, &uartPort);
 
-    if (!strContainsOnlyDigits(tokens[2]) || !strValLessThan(tokens[2], MAX_U16_STR))
-        return JSON_ERROR("invalid register index");
-    uint16_t regId = 0;
-    sscanf(tokens[2], "%" PRIu16, &regId);
+    int8_t txPin = -1;
+    int8_t rxPin = -1;
+    int8_t dirPin = -1;
+    if (!parsePin(tokens[2], &txPin) || txPin < 0)
+        return -7;
+    if (!parsePin(tokens[3], &rxPin) || rxPin < 0)
+        return -8;
+    if (tokensNum == 5 && !parsePin(tokens[4], &dirPin))
+        return -9;
 
-    static char jsonBuffer[JSON_BUFSIZE] = {0};
-    char *json = jsonBuffer;
-    json += sprintf(json, "{");
+    if (!NvsFwCfg_setBusPins(bus, uartPort, txPin, rxPin, dirPin))
+        return -5;
 
-    RegisterAccessData_t rad = {0};
-    if (KnownRegisters_findByModbus(readFunction, slaveAddr, regId, &rad))
+    return 1;
+}
+
+// IPv4 address in dotted decimal notation
+static bool parseIp(const char *arg, uint8_t ip[4])
+{
+    char ipCpy[sizeof("255.255.255.255")];
+    if (strlen(arg) >= sizeof(ipCpy))
+        return false;
+    strcpy(ipCpy, arg);
+
+    char *octets[MAX_TOKENS_NUM] = {0};
+    int octetsNum = 0;
+    if (splitInPlace(ipCpy, '.', octets, MAX_TOKENS_NUM, &octetsNum) != SplitRes_OK || octetsNum != 4)
+        return false;
+    for (int i = 0; i < 4; i++)
     {
-        json += sprintf(json, "\"name\":\"%s\",", rad.regName);
-        json += sprintf(json, "\"address\":%" PRIu8 ",", rad.slaveAddr);
-        json += sprintf(json, "\"register\":%" PRIu16, rad.regId);
+        if (!strContainsOnlyDigits(octets[i]) || !strValLessThan(octets[i], MAX_U8_STR))
+            return false;
+        sscanf(octets[i], "%" SCNu8, &ip[i]);
     }
+    return true;
+}
 
-    json += sprintf(json, "}");
+// Connections and depth are optional: 1 if not given
+static bool parseTcpCount(const char *arg, uint8_t max, uint8_t *count)
+{
+    *count = 1;
+    if (arg == NULL)
+        return true;
+    if (!strContainsOnlyDigits(arg) || !strValLessThan(arg, MAX_U8_STR))
+        return false;
+    sscanf(arg, "%" SCNu8, count);
+    return *count >= 1 && *count <= max;
+}
+
+static int postSetMbTcpBus(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum < 3 || tokensNum > 5)
+            return -4;
+    }
+
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[0], &bus) || !MB_BUS_IS_TCP(bus))
+        return -5;
+
+    uint8_t ip[4] = {0};
+    if (!parseIp(tokens[1], ip))
+        return -6;
+
+    if (!strContainsOnlyDigits(tokens[2]) || !strValLessThan(tokens[2], MAX_U16_STR) || STREQ(tokens[2], "0"))
+        return -7;
+    uint16_t port = 0;
+    sscanf(tokens[2], "%" SCNu16, &port);
+
+    uint8_t connectionsNum = 1;
+    uint8_t depth = 1;
+    if (!parseTcpCount(tokens[3], MB_TCP_MAX_CONNECTIONS, &connectionsNum))
+        return -8;
+    if (!parseTcpCount(tokens[4], MB_TCP_MAX_DEPTH, &depth))
+        return -9;
+
+    if (!NvsFwCfg_setTcpBus(bus, ip, port, connectionsNum, depth))
+        return -5;
+
+    return 1;
+}
+
+static int postDisableMbBus(const char *args)
+{
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (STREQ(args, "") || !parseBus(args, &bus) || bus == MB_PRIMARY_BUS)
+        return -1;
+
+    NvsFwCfg_disableBus(bus);
+    return 1;
+}
+
+static int postSetMbBusCore(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum != 2)
+            return -4;
+    }
+
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[0], &bus))
+        return -5;
+
+    if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U8_STR))
+        return -6;
+    uint8_t coreId = 0;
+    sscanf(tokens[1], "%" PRIu8, &coreId);
+
+    if (!NvsFwCfg_setBusCore(bus, coreId))
+        return -6;
+
+    return 1;
+}
+
+static int postReleaseQuarantinedRegisters(const char *args)
+{
+    KnownRegisters_releaseQuarantined();
+    return 1;
+}
+
+// Result of a write, as returned by WriteRegisterValue
+static int writeResultToCode(RegError_t regError)
+{
+    switch (regError)
+    {
+    case RegError_OK:
+        return 1;
+    case RegError_NOT_FOUND:
+        return -5;
+    case RegError_MB_NOT_INIT:
+        return -6;
+    case RegError_REG_NOT_WRITABLE:
+        return -7;
+    case RegError_MB_WRITE_ERR:
+        return -8;
+    case RegError_STRING_NOT_DOUBLE:
+        return -9;
+    case RegError_CANT_REPRESENT_WITH_INT16:
+        return -10;
+    case RegError_CANT_REPRESENT_WITH_UINT16:
+        return -11;
+    default:
+        return -12;
+    }
+}
+
+static int postWriteRegisterValue(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum != 2)
+            return -4;
+    }
+
+    const char *regName = tokens[0];
+    const char *valueString = tokens[1];
+
+    return writeResultToCode(MbRtu_writeTypedRegisterByName(regName, valueString));
+}
+
+// Writes of the latest batch. Names and values point into its arguments.
+static char batchArgs[BATCH_ARGS_BUFSIZE];
+static MbRegWrite_t batchWrites[MB_BATCH_WRITE_MAX];
+static int batchWritesNum = 0;
+
+static int postWriteRegistersValues(const char *args)
+{
+    if (strlen(args) >= BATCH_ARGS_BUFSIZE)
+        return -1;
+
+    batchWritesNum = 0;
+    strcpy(batchArgs, args);
+
+    char *tokens[2 * MB_BATCH_WRITE_MAX] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(batchArgs, ',', tokens, 2 * MB_BATCH_WRITE_MAX, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum < 2 || tokensNum % 2 != 0)
+            return -4;
+    }
+
+    batchWritesNum = tokensNum / 2;
+    for (int w = 0; w < batchWritesNum; w++)
+    {
+        batchWrites[w].regName = tokens[2 * w];
+        batchWrites[w].valueString = tokens[2 * w + 1];
+    }
+
+    if (MbRtu_writeTypedRegistersByName(batchWrites, batchWritesNum) == batchWritesNum)
+        return 1;
+
+    // The first failure is returned by the call itself: results kept for GetLatestWriteResults may be replaced by another call
+    for (int w = 0; w < batchWritesNum; w++)
+    {
+        if (batchWrites[w].result != RegError_OK)
+            return -(100 * (w + 1) - writeResultToCode(batchWrites[w].result));
+    }
+    return -5;
+}
+
+// Registers are staged chunk by chunk, and added together by CommitRegistersImport
+static int postImportRegisters(const char *args)
+{
+    if (strlen(args) >= BATCH_ARGS_BUFSIZE)
+        return -1;
+
+    static char chunk[BATCH_ARGS_BUFSIZE];
+    strcpy(chunk, args);
+
+    int invalidRecord = 0;
+    switch (RegisterMap_stageChunk(chunk, &invalidRecord))
+    {
+    case RegisterMapRes_OK:
+        return RegisterMap_stagedCount();
+    case RegisterMapRes_TOO_MANY_RECORDS:
+        return -2;
+    case RegisterMapRes_NO_MEMORY:
+        return -3;
+    case RegisterMapRes_FULL:
+        return -4;
+    default:
+        return -(100 + invalidRecord);
+    }
+}
+
+// A diff computed against a register map is only applied if the map hash is still the one it was computed against
+static int postCommitRegistersImport(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    if (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum) != SplitRes_OK || tokensNum < 1 || tokensNum > 2)
+        return -1;
+
+    const char *mode = tokens[0];
+    if (STREQ(mode, "discard") && tokensNum == 1)
+    {
+        RegisterMap_discard();
+        return 1;
+    }
+    if (!STREQ(mode, "replace") && !STREQ(mode, "merge"))
+        return -1;
+    if (tokensNum == 2 && (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U32_STR)))
+        return -1;
+    if (RegisterMap_stagedCount() == 0)
+        return -2;
+    if (tokensNum == 2 && strtoul(tokens[1], NULL, 10) != KnownRegisters_getMapHash())
+    {
+        RegisterMap_discard();
+        return -4;
+    }
+    return RegisterMap_commit(STREQ(mode, "replace")) ? 1 : -3;
+}
+
+static int postWriteRawRegisterValue(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return -1;
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return -2;
+    case SplitRes_NULL_STRIN:
+        return -3;
+    default:
+        if (tokensNum != 4 && tokensNum != 5)
+            return -4;
+    }
+
+    if (!strContainsOnlyDigits(tokens[0]) || (atoi(tokens[0]) != 5 && atoi(tokens[0]) != 6 && atoi(tokens[0]) != 15 && atoi(tokens[0]) != 16))
+        return -5;
+    uint8_t writeFunction = 0;
+    sscanf(tokens[0], "%" PRIu8, &writeFunction);
+
+    if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U8_STR))
+        return -6;
+    uint8_t slaveAddr = 0;
+    sscanf(tokens[1], "%" PRIu8, &slaveAddr);
+
+    if (!strContainsOnlyDigits(tokens[2]) || !strValLessThan(tokens[2], MAX_U16_STR))
+        return -7;
+    uint16_t regId = 0;
+    sscanf(tokens[2], "%" PRIu16, &regId);
+
+    if (!strContainsOnlyDigits(tokens[3]) || !strValLessThan(tokens[3], MAX_U16_STR))
+        return -8;
+    uint16_t rawValue = 0;
+    sscanf(tokens[3], "%" PRIu16, &rawValue);
+
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[4], &bus))
+        return -12;
+
+    switch (MbRtu_writeRawRegisterByAddr(bus, writeFunction, slaveAddr, regId, rawValue))
+    {
+    case RegError_OK:
+        return 1;
+    case RegError_MB_NOT_INIT:
+        return -9;
+    case RegError_MB_WRITE_ERR:
+        return -10;
+    default:
+        return -11;
+    }
+}
+
+// Result of a GET built with a writer: overflow is reported as an error, instead of returning truncated JSON
+static void *jsonWriterResult(const JsonWriter_t *writer)
+{
+    if (JsonWriter_overflowed(writer))
+        return JSON_ERROR("response too long");
+    return writer->buf;
+}
+
+static bool appendRegisterName(int idx, const RegisterAccessData_t *rad, void *arg)
+{
+    JsonWriter_t *writer = (JsonWriter_t *)arg;
+    JsonWriter_string(writer, rad->regName);
+    return !JsonWriter_overflowed(writer);
+}
+
+static void *getGetRegistersList(const char *args)
+{
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginArray(&writer);
+
+    KnownRegisters_forEach(appendRegisterName, &writer);
+
+    JsonWriter_endArray(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+static void *getGetSlaveRegistersList(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return JSON_ERROR("arg too long");
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return JSON_ERROR("too many parameters");
+    case SplitRes_NULL_STRIN:
+        return JSON_ERROR("null string");
+    default:
+        if (tokensNum != 1 && tokensNum != 2)
+            return JSON_ERROR("wrong number of parameters");
+    }
+
+    if (!strContainsOnlyDigits(tokens[0]) || !strValLessThan(tokens[0], MAX_U8_STR))
+        return JSON_ERROR("invalid slave address");
+    uint8_t slaveAddr = 0;
+    sscanf(tokens[0], "%" PRIu8, &slaveAddr);
+
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[1], &bus))
+        return JSON_ERROR("invalid bus");
+
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginArray(&writer);
+
+    KnownRegisters_forEachOfSlave(bus, slaveAddr, appendRegisterName, &writer);
+
+    JsonWriter_endArray(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+static bool appendRegisterDetails(int idx, const RegisterAccessData_t *rad, void *arg)
+{
+    JsonWriter_t *writer = (JsonWriter_t *)arg;
+    JsonWriter_key(writer, "name");
+    JsonWriter_string(writer, rad->regName);
+    JsonWriter_key(writer, "keyId");
+    JsonWriter_uint(writer, rad->keyId);
+    JsonWriter_key(writer, "bus");
+    JsonWriter_uint(writer, rad->bus);
+    JsonWriter_key(writer, "address");
+    JsonWriter_uint(writer, rad->slaveAddr);
+    JsonWriter_key(writer, "register");
+    JsonWriter_uint(writer, rad->regId);
+    JsonWriter_key(writer, "readFunction");
+    JsonWriter_uint(writer, rad->readFunction);
+    JsonWriter_key(writer, "length");
+    JsonWriter_uint(writer, rad->regNumber);
+    JsonWriter_key(writer, "type");
+    switch (rad->type)
+    {
+    case RADType_NUMBER:
+        JsonWriter_string(writer, TYPE_NUMBER_STR);
+        JsonWriter_key(writer, "signed");
+        JsonWriter_bool(writer, rad->interpretAsSigned);
+        JsonWriter_key(writer, "factor");
+        JsonWriter_double(writer, rad->factor, 6);
+        JsonWriter_key(writer, "offset");
+        JsonWriter_double(writer, rad->offset, 6);
+        JsonWriter_key(writer, "decimals");
+        JsonWriter_uint(writer, rad->decimals);
+        break;
+    case RADType_RAW:
+        JsonWriter_string(writer, TYPE_RAW_STR);
+        break;
+    case RADType_FLOAT:
+        JsonWriter_string(writer, TYPE_FLOAT_STR);
+        break;
+    case RADType_STRING:
+        JsonWriter_string(writer, TYPE_STRING_STR);
+        break;
+    }
+    JsonWriter_key(writer, "monitored");
+    JsonWriter_bool(writer, rad->monitored);
+    if (rad->monitored)
+    {
+        JsonWriter_key(writer, "maxPublishDelay");
+        JsonWriter_uint(writer, rad->maxPublishDelay);
+        JsonWriter_key(writer, "pollInterval");
+        JsonWriter_uint(writer, rad->pollInterval);
+        JsonWriter_key(writer, "publishOnChange");
+        JsonWriter_bool(writer, rad->publishOnChange);
+        if (rad->publishOnChange)
+        {
+            JsonWriter_key(writer, "changeCheckInterval");
+            JsonWriter_uint(writer, rad->changeCheckInterval);
+            JsonWriter_key(writer, "deadbandAbs");
+            JsonWriter_double(writer, rad->deadbandAbs, 6);
+            JsonWriter_key(writer, "deadbandRel");
+            JsonWriter_double(writer, rad->deadbandRel, 6);
+        }
+    }
+    JsonWriter_key(writer, "writable");
+    JsonWriter_bool(writer, rad->writable);
+    if (rad->writable)
+    {
+        JsonWriter_key(writer, "writeFunction");
+        JsonWriter_uint(writer, rad->writeFunction);
+    }
+    return true;
+}
+
+static bool appendDictionaryEntry(int idx, const RegisterAccessData_t *rad, void *arg)
+{
+    JsonWriter_t *writer = (JsonWriter_t *)arg;
+    char keyId[sizeof(MAX_U16_STR)];
+    sprintf(keyId, "%" PRIu16, rad->keyId);
+    JsonWriter_key(writer, keyId);
+    JsonWriter_string(writer, rad->regName);
+    return !JsonWriter_overflowed(writer);
+}
+
+static void *getGetRegistersDictionary(const char *args)
+{
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    const uint32_t version = KnownRegisters_getKeysVersion();
+    JsonWriter_key(&writer, "version");
+    JsonWriter_uint(&writer, version);
+    JsonWriter_key(&writer, "keys");
+    JsonWriter_beginObject(&writer);
+    KnownRegisters_forEach(appendDictionaryEntry, &writer);
+    JsonWriter_endObject(&writer);
+
+    JsonWriter_endObject(&writer);
+
+    // Registers were added or removed while building the dictionary
+    if (version != KnownRegisters_getKeysVersion())
+        return JSON_ERROR("registers changed, retry");
+
+    return jsonWriterResult(&writer);
+}
+
+static void *getGetRegisterDetails(const char *args)
+{
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    const char *regName = args;
+    KnownRegisters_visitByName(regName, appendRegisterDetails, &writer);
+
+    JsonWriter_endObject(&writer);
 
     ESP_LOGE(TAG, "%s", jsonBuffer);
 
-    return jsonBuffer;
+    return jsonWriterResult(&writer);
+}
+
+static bool appendRegisterMbDetails(int idx, const RegisterAccessData_t *rad, void *arg)
+{
+    JsonWriter_t *writer = (JsonWriter_t *)arg;
+    JsonWriter_key(writer, "name");
+    JsonWriter_string(writer, rad->regName);
+    JsonWriter_key(writer, "address");
+    JsonWriter_uint(writer, rad->slaveAddr);
+    JsonWriter_key(writer, "register");
+    JsonWriter_uint(writer, rad->regId);
+    return true;
+}
+
+static void *getGetRegisterNameByMbDetails(const char *args)
+{
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return JSON_ERROR("arg too long");
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return JSON_ERROR("too many parameters");
+    case SplitRes_NULL_STRIN:
+        return JSON_ERROR("null string");
+    default:;
+    }
+
+    if (tokensNum != 3 && tokensNum != 4)
+        return JSON_ERROR("wrong number of parameters");
+
+    if (!strContainsOnlyDigits(tokens[0]) || strValLessThan(tokens[0], "0") || strValLessThan("5", tokens[0]))
+        return JSON_ERROR("invalid read function");
+    uint8_t readFunction = 0;
+    sscanf(tokens[0], "%" PRIu8, &readFunction);
+
+    if (!strContainsOnlyDigits(tokens[1]) || !strValLessThan(tokens[1], MAX_U8_STR))
+        return JSON_ERROR("invalid slave address");
+    uint8_t slaveAddr = 0;
+    sscanf(tokens[1], "%" PRIu8, &slaveAddr);
+
+    if (!strContainsOnlyDigits(tokens[2]) || !strValLessThan(tokens[2], MAX_U16_STR))
+        return JSON_ERROR("invalid register index");
+    uint16_t regId = 0;
+    sscanf(tokens[2], "%" PRIu16, &regId);
+
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[3], &bus))
+        return JSON_ERROR("invalid bus");
+
+    KnownRegisters_visitByModbus(bus, readFunction, slaveAddr, regId, appendRegisterMbDetails, &writer);
+
+    JsonWriter_endObject(&writer);
+
+    ESP_LOGE(TAG, "%s", jsonBuffer);
+
+    return jsonWriterResult(&writer);
 }
 
 static char *parityToString(uint8_t parity)
@@ -906,72 +1630,211 @@ static int dataBitsToInt(uint8_t dataBits)
     return -1;
 }
 
+static void appendLatencyTargets(JsonWriter_t *writer, const uint16_t *latencyTargetsMs)
+{
+    JsonWriter_key(writer, "latencyTargetsMs");
+    JsonWriter_beginObject(writer);
+    for (int p = 0; p < BusPriority_NUM; p++)
+    {
+        JsonWriter_key(writer, BUS_PRIORITIES_NAMES[p]);
+        JsonWriter_uint(writer, latencyTargetsMs[p]);
+    }
+    JsonWriter_endObject(writer);
+}
+
+static void appendBuses(JsonWriter_t *writer, const FirmwareConfig_t *fwConfig, bool withState)
+{
+    JsonWriter_key(writer, "busCores");
+    JsonWriter_beginArray(writer);
+    for (int bus = 0; bus < MB_SERIAL_BUSES_NUM; bus++)
+        JsonWriter_uint(writer, fwConfig->busCores[bus]);
+    JsonWriter_endArray(writer);
+
+    JsonWriter_key(writer, "buses");
+    JsonWriter_beginArray(writer);
+    for (int bus = MB_PRIMARY_BUS + 1; bus < MB_SERIAL_BUSES_NUM; bus++)
+    {
+        const ExtraBusConfig_t *extraBus = &fwConfig->extraBuses[bus - 1];
+        JsonWriter_beginObject(writer);
+        JsonWriter_key(writer, "bus");
+        JsonWriter_uint(writer, bus);
+        JsonWriter_key(writer, "enabled");
+        JsonWriter_bool(writer, extraBus->enabled);
+        if (withState)
+        {
+            JsonWriter_key(writer, "running");
+            JsonWriter_bool(writer, MbRtu_isBusRunning(bus));
+        }
+        JsonWriter_key(writer, "uartPort");
+        JsonWriter_uint(writer, extraBus->serial.uartPort);
+        JsonWriter_key(writer, "txPin");
+        JsonWriter_int(writer, extraBus->serial.txPin);
+        JsonWriter_key(writer, "rxPin");
+        JsonWriter_int(writer, extraBus->serial.rxPin);
+        JsonWriter_key(writer, "dirPin");
+        JsonWriter_int(writer, extraBus->serial.dirPin);
+        JsonWriter_key(writer, "baudrate");
+        JsonWriter_int(writer, extraBus->serial.baudrate);
+        JsonWriter_key(writer, "dataBits");
+        JsonWriter_int(writer, dataBitsToInt(extraBus->serial.dataBits));
+        JsonWriter_key(writer, "stopBits");
+        JsonWriter_double(writer, stopBitsToDouble(extraBus->serial.stopBits), 2);
+        JsonWriter_key(writer, "parity");
+        JsonWriter_string(writer, parityToString(extraBus->serial.parity));
+        JsonWriter_endObject(writer);
+    }
+    JsonWriter_endArray(writer);
+}
+
 static void *getGetActualModbusConfig(const char *args)
 {
     static char jsonBuffer[JSON_BUFSIZE] = {0};
-    char *json = jsonBuffer;
-    json += sprintf(json, "{");
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
 
     FirmwareConfig_t fwConfig = {0};
     NvsFwCfg_getActualFirmwareConfig(&fwConfig);
 
-    json += sprintf(json, "\"running\":%s,", BOOL2STR(MbRtu_wasStartedSuccesfully()));
-    json += sprintf(json, "\"interCmdsDelayMs\":%" PRIu16 ",", fwConfig.modbusInterCmdsDelayMs);
-    json += sprintf(json, "\"baudrate\":%" PRIi32 ",", fwConfig.modbusBaudrate);
-    json += sprintf(json, "\"readPeriod\":%" PRIu8 ",", fwConfig.modbusReadPeriod);
-    json += sprintf(json, "\"dataBits\":%d,", dataBitsToInt(fwConfig.serialDataBits));
-    json += sprintf(json, "\"stopBits\":%.2f,", stopBitsToDouble(fwConfig.serialStopBits));
-    json += sprintf(json, "\"parity\":\"%s\",", parityToString(fwConfig.serialParity));
-    json += sprintf(json, "\"bitPosition\":\"%s\"", bitPositionToString(fwConfig.bitPosition));
-
-    json += sprintf(json, "}");
+    JsonWriter_key(&writer, "running");
+    JsonWriter_bool(&writer, MbRtu_wasStartedSuccesfully());
+    JsonWriter_key(&writer, "interCmdsDelayMs");
+    JsonWriter_uint(&writer, fwConfig.modbusInterCmdsDelayMs);
+    JsonWriter_key(&writer, "baudrate");
+    JsonWriter_int(&writer, fwConfig.modbusBaudrate);
+    JsonWriter_key(&writer, "readPeriod");
+    JsonWriter_uint(&writer, fwConfig.modbusReadPeriod);
+    JsonWriter_key(&writer, "dataBits");
+    JsonWriter_int(&writer, dataBitsToInt(fwConfig.serialDataBits));
+    JsonWriter_key(&writer, "stopBits");
+    JsonWriter_double(&writer, stopBitsToDouble(fwConfig.serialStopBits), 2);
+    JsonWriter_key(&writer, "parity");
+    JsonWriter_string(&writer, parityToString(fwConfig.serialParity));
+    JsonWriter_key(&writer, "bitPosition");
+    JsonWriter_string(&writer, bitPositionToString(fwConfig.bitPosition));
+    JsonWriter_key(&writer, "maxRegisters");
+    JsonWriter_int(&writer, KnownRegisters_capacity());
+    JsonWriter_key(&writer, "payloadEncoding");
+    JsonWriter_string(&writer, PayloadEncoding_name(MbRtu_getPayloadEncoding()));
+    JsonWriter_key(&writer, "compactKeys");
+    JsonWriter_bool(&writer, MbRtu_getCompactKeys());
+    JsonWriter_key(&writer, "trimTrailingZeros");
+    JsonWriter_bool(&writer, MbRtu_getTrimTrailingZeros());
+    JsonWriter_key(&writer, "adaptiveInterCmdsDelay");
+    JsonWriter_bool(&writer, MbRtu_getAdaptiveInterCmdsDelay());
+    JsonWriter_key(&writer, "minInterFrameGapUs");
+    JsonWriter_uint(&writer, MbRtu_getMinInterFrameGapUs());
+    appendLatencyTargets(&writer, fwConfig.latencyTargetsMs);
+    appendBuses(&writer, &fwConfig, true);
+
+    JsonWriter_endObject(&writer);
 
     ESP_LOGE(TAG, "%s", jsonBuffer);
 
-    return jsonBuffer;
+    return jsonWriterResult(&writer);
 }
 
 static void *getGetNextModbusConfig(const char *args)
 {
     static char jsonBuffer[JSON_BUFSIZE] = {0};
-    char *json = jsonBuffer;
-    json += sprintf(json, "{");
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
 
     FirmwareConfig_t fwConfig = {0};
     NvsFwCfg_getNextFirmwareConfig(&fwConfig);
 
-    json += sprintf(json, "\"interCmdsDelayMs\":%" PRIu16 ",", fwConfig.modbusInterCmdsDelayMs);
-    json += sprintf(json, "\"baudrate\":%" PRIi32 ",", fwConfig.modbusBaudrate);
-    json += sprintf(json, "\"readPeriod\":%" PRIu8 ",", fwConfig.modbusReadPeriod);
-    json += sprintf(json, "\"dataBits\":%d,", dataBitsToInt(fwConfig.serialDataBits));
-    json += sprintf(json, "\"stopBits\":%.2f,", stopBitsToDouble(fwConfig.serialStopBits));
-    json += sprintf(json, "\"parity\":\"%s\"", parityToString(fwConfig.serialParity));
-
-    json += sprintf(json, "}");
+    JsonWriter_key(&writer, "interCmdsDelayMs");
+    JsonWriter_uint(&writer, fwConfig.modbusInterCmdsDelayMs);
+    JsonWriter_key(&writer, "baudrate");
+    JsonWriter_int(&writer, fwConfig.modbusBaudrate);
+    JsonWriter_key(&writer, "readPeriod");
+    JsonWriter_uint(&writer, fwConfig.modbusReadPeriod);
+    JsonWriter_key(&writer, "dataBits");
+    JsonWriter_int(&writer, dataBitsToInt(fwConfig.serialDataBits));
+    JsonWriter_key(&writer, "stopBits");
+    JsonWriter_double(&writer, stopBitsToDouble(fwConfig.serialStopBits), 2);
+    JsonWriter_key(&writer, "parity");
+    JsonWriter_string(&writer, parityToString(fwConfig.serialParity));
+    JsonWriter_key(&writer, "maxRegisters");
+    JsonWriter_uint(&writer, fwConfig.maxRegisters > 0 ? fwConfig.maxRegisters : DEFAULT_MAX_REGISTERS_NUM);
+    JsonWriter_key(&writer, "payloadEncoding");
+    JsonWriter_string(&writer, PayloadEncoding_name(fwConfig.payloadEncoding));
+    JsonWriter_key(&writer, "compactKeys");
+    JsonWriter_bool(&writer, fwConfig.compactKeys);
+    JsonWriter_key(&writer, "trimTrailingZeros");
+    JsonWriter_bool(&writer, fwConfig.trimTrailingZeros);
+    JsonWriter_key(&writer, "adaptiveInterCmdsDelay");
+    JsonWriter_bool(&writer, fwConfig.adaptiveInterCmdsDelay);
+    appendLatencyTargets(&writer, fwConfig.latencyTargetsMs);
+    appendBuses(&writer, &fwConfig, false);
+
+    JsonWriter_endObject(&writer);
 
     ESP_LOGE(TAG, "%s", jsonBuffer);
 
-    return jsonBuffer;
+    return jsonWriterResult(&writer);
+}
+
+// Optional max age of cached values, in milliseconds: 0 (always read from slaves) if not given
+static bool parseMaxAgeMs(const char *arg, uint32_t *maxAgeMs)
+{
+    *maxAgeMs = 0;
+    if (arg == NULL || STREQ(arg, ""))
+        return true;
+    if (!strContainsOnlyDigits(arg) || !strValLessThan(arg, MAX_U32_STR))
+        return false;
+    sscanf(arg, "%" PRIu32, maxAgeMs);
+    return true;
 }
 
 static void *getReadRegisterValue(const char *args)
 {
     static char jsonBuffer[JSON_BUFSIZE] = {0};
-    char *json = jsonBuffer;
-    json += sprintf(json, "{");
 
-    const char *regName = args;
+    if (strlen(args) >= ARGS_BUFSIZE)
+        return JSON_ERROR("arg too long");
+
+    char argsCpy[ARGS_BUFSIZE];
+    strcpy(argsCpy, args);
+
+    char *tokens[MAX_TOKENS_NUM] = {0};
+    int tokensNum = 0;
+    switch (splitInPlace(argsCpy, ',', tokens, MAX_TOKENS_NUM, &tokensNum))
+    {
+    case SplitRes_TOO_MANY_PARAMS:
+        return JSON_ERROR("too many parameters");
+    case SplitRes_NULL_STRIN:
+        return JSON_ERROR("null string");
+    default:
+        if (tokensNum != 1 && tokensNum != 2)
+            return JSON_ERROR("wrong number of parameters");
+    }
+
+    char *regName = tokens[0];
+    uint32_t maxAgeMs = 0;
+    if (!parseMaxAgeMs(tokens[1], &maxAgeMs))
+        return JSON_ERROR("invalid max age");
+
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
 
     char valueString[VALUE_STRING_BUFSIZE] = {0};
-    if (MbRtu_readTypedRegisterByName(regName, valueString, VALUE_STRING_BUFSIZE) == RegError_OK)
+    uint32_t ageMs = 0;
+    if (MbRtu_readTypedRegisterByName(regName, maxAgeMs, valueString, VALUE_STRING_BUFSIZE, &ageMs) == RegError_OK)
     {
-        json += sprintf(json, "\"name\":\"%s\",", regName);
-        json += sprintf(json, "\"value\":%s", valueString);
+        JsonWriter_key(&writer, "name");
+        JsonWriter_string(&writer, regName);
+        JsonWriter_key(&writer, "value");
+        JsonWriter_raw(&writer, valueString);
+        JsonWriter_key(&writer, "ageMs");
+        JsonWriter_uint(&writer, ageMs);
     }
 
-    json += sprintf(json, "}");
+    JsonWriter_endObject(&writer);
 
-    return jsonBuffer;
+    return jsonWriterResult(&writer);
 }
 
 static void *getReadRawRegisterValue(const char *args)
@@ -993,7 +1856,7 @@ static void *getReadRawRegisterValue(const char *args)
     case SplitRes_NULL_STRIN:
         return JSON_ERROR("null string");
     default:
-        if (tokensNum != 3)
+        if (tokensNum != 3 && tokensNum != 4)
             return JSON_ERROR("wrong number of parameters");
     }
 
@@ -1012,17 +1875,26 @@ static void *getReadRawRegisterValue(const char *args)
     uint16_t regId = 0;
     sscanf(tokens[2], "%" PRIu16, &regId);
 
-    char *json = jsonBuffer;
-    json += sprintf(json, "{");
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(tokens[3], &bus))
+        return JSON_ERROR("invalid bus");
+
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
 
     uint16_t rawValue = 0;
-    switch (MbRtu_readRawRegisterByAddr(readFunction, slaveAddr, regId, &rawValue))
+    switch (MbRtu_readRawRegisterByAddr(bus, readFunction, slaveAddr, regId, &rawValue))
     {
     case RegError_OK:
-        json += sprintf(json, "\"readFunction\":%" PRIu8 ",", readFunction);
-        json += sprintf(json, "\"address\":%" PRIu8 ",", slaveAddr);
-        json += sprintf(json, "\"register\":%" PRIu16 ",", regId);
-        json += sprintf(json, "\"value\":%" PRIu16, rawValue);
+        JsonWriter_key(&writer, "readFunction");
+        JsonWriter_uint(&writer, readFunction);
+        JsonWriter_key(&writer, "address");
+        JsonWriter_uint(&writer, slaveAddr);
+        JsonWriter_key(&writer, "register");
+        JsonWriter_uint(&writer, regId);
+        JsonWriter_key(&writer, "value");
+        JsonWriter_uint(&writer, rawValue);
         break;
     case RegError_MB_NOT_INIT:
         return JSON_ERROR("modbus not running");
@@ -1032,18 +1904,21 @@ static void *getReadRawRegisterValue(const char *args)
         return JSON_ERROR("internal error");
     }
 
-    json += sprintf(json, "}");
+    JsonWriter_endObject(&writer);
 
-    return jsonBuffer;
+    return jsonWriterResult(&writer);
 }
 
 static void *getReadAllRegistersValues(const char *args)
 {
     static char jsonBuffer[JSON_BUFSIZE] = {0};
-    char *json = jsonBuffer;
 
-    if (!MbRtu_readAllRegistersJson(jsonBuffer, JSON_BUFSIZE))
-        return "{}";
+    uint32_t maxAgeMs = 0;
+    if (!parseMaxAgeMs(args, &maxAgeMs))
+        return JSON_ERROR("invalid max age");
+
+    if (!MbRtu_readAllRegisters(maxAgeMs, jsonBuffer, JSON_BUFSIZE))
+        return JSON_ERROR("response too long");
 
     return jsonBuffer;
 }
@@ -1051,56 +1926,385 @@ static void *getReadAllRegistersValues(const char *args)
 static void *getGetAllMonitoredRegistersLatestValues(const char *args)
 {
     static char jsonBuffer[JSON_BUFSIZE] = {0};
-    const int knownRegistersCount = KnownRegisters_count();
-    jsonBuffer[0] = '\0';
-    strcat(jsonBuffer, "{");
-    int iAdded = 0;
-    int i;
-    for (i = 0; i < knownRegistersCount; i++)
+
+    if (!MbRtu_getLatestPublishedValues(jsonBuffer, JSON_BUFSIZE))
+        return JSON_ERROR("response too long");
+
+    return jsonBuffer;
+}
+
+static void appendTraceEntry(JsonWriter_t *writer, const MbTraceEntry_t *entry)
+{
+    char wordsHex[4 * MB_TRACE_MAX_WORDS + NULL_CHAR_LEN] = {0};
+    for (int w = 0; w < entry->wordsNum; w++)
+        sprintf(&wordsHex[4 * w], "%04" PRIx16, entry->words[w]);
+
+    JsonWriter_beginArray(writer);
+    JsonWriter_uint(writer, entry->seq);
+    JsonWriter_uint(writer, entry->startUs);
+    JsonWriter_uint(writer, entry->durationUs);
+    JsonWriter_uint(writer, entry->function);
+    JsonWriter_uint(writer, entry->slaveAddr);
+    JsonWriter_uint(writer, entry->regId);
+    JsonWriter_uint(writer, entry->regNumber);
+    JsonWriter_int(writer, entry->result);
+    JsonWriter_string(writer, wordsHex);
+    JsonWriter_uint(writer, entry->bus);
+    JsonWriter_endArray(writer);
+}
+
+// Transactions are returned from the requested sequence number (or the oldest available one) for as long as they fit the response
+static void *getGetModbusTrace(const char *args)
+{
+    uint32_t fromSeq = 0;
+    if (!STREQ(args, ""))
     {
-        RegisterAccessData_t rad = {0};
+        if (!strContainsOnlyDigits(args) || !strValLessThan(args, MAX_U32_STR))
+            return JSON_ERROR("invalid sequence number");
+        sscanf(args, "%" PRIu32, &fromSeq);
+    }
 
-        configASSERT(KnownRegisters_at(i, &rad));
+    // Room to close the response with its counters is reserved, so that entries can be appended until they don't fit
+    const int tailLen = CT_STRLEN("],\"next\":4294967295,\"lost\":4294967295}");
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE - tailLen);
+    JsonWriter_beginObject(&writer);
+
+    const uint32_t nextSeq = MbTrace_nextSeq();
+    const uint32_t oldestSeq = MbTrace_oldestSeq();
+    if (STREQ(args, ""))
+        fromSeq = oldestSeq;
+    else if (fromSeq > nextSeq)
+        fromSeq = nextSeq;
+    uint32_t lost = 0;
+    if (fromSeq < oldestSeq)
+    {
+        lost = oldestSeq - fromSeq;
+        fromSeq = oldestSeq;
+    }
 
-        if (!rad.monitored)
+    uint32_t seq = fromSeq;
+    JsonWriter_key(&writer, "entries");
+    JsonWriter_beginArray(&writer);
+    for (; seq != nextSeq; seq++)
+    {
+        MbTraceEntry_t entry;
+        if (!MbTrace_read(seq, &entry))
+        {
+            lost++;
             continue;
+        }
 
-        if (iAdded > 0)
+        const JsonWriterMark_t mark = JsonWriter_mark(&writer);
+        appendTraceEntry(&writer, &entry);
+        if (JsonWriter_overflowed(&writer))
         {
-            if (strlen(jsonBuffer) + CT_STRLEN(",") + NULL_CHAR_LEN > JSON_BUFSIZE)
-                break;
-            strcat(jsonBuffer, ",");
+            JsonWriter_rollback(&writer, mark);
+            break;
         }
+    }
 
-        char *valueString = KnownRegisters_getLatestPublishedValueAt(i);
-        configASSERT(valueString != NULL);
-        Seconds_t latestPublishedTime = 0;
-        configASSERT(KnownRegisters_getLatestPublishedTimeAt(i, &latestPublishedTime));
-        if (latestPublishedTime == 0 || STREQ(valueString, ""))
-            valueString = "null";
+    writer.capacity += tailLen;
+    JsonWriter_endArray(&writer);
+    JsonWriter_key(&writer, "next");
+    JsonWriter_uint(&writer, seq);
+    JsonWriter_key(&writer, "lost");
+    JsonWriter_uint(&writer, lost);
+    JsonWriter_endObject(&writer);
 
-        char keyValueString[KEYVALUE_STRING_BUFSIZE] = {0};
-        const int kvLen = snprintf(keyValueString, KEYVALUE_STRING_BUFSIZE - NULL_CHAR_LEN, "\"%s\":%s", rad.regName, valueString);
-        if (kvLen + NULL_CHAR_LEN > KEYVALUE_STRING_BUFSIZE)
+    return jsonWriterResult(&writer);
+}
+
+static bool appendQuarantinedRegisterName(int idx, const RegisterAccessData_t *rad, void *arg)
+{
+    bool quarantined = false;
+    if (KnownRegisters_getQuarantinedAt(idx, &quarantined) && quarantined)
+        return appendRegisterName(idx, rad, arg);
+    return true;
+}
+
+static void *getGetSlavesHealth(const char *args)
+{
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    const int64_t nowUs = esp_timer_get_time();
+    JsonWriter_key(&writer, "slaves");
+    JsonWriter_beginArray(&writer);
+    for (int slave = 0; slave < MB_BUSES_NUM * (UINT8_MAX + 1) && !JsonWriter_overflowed(&writer); slave++)
+    {
+        const uint8_t bus = slave / (UINT8_MAX + 1);
+        const uint8_t slaveAddr = slave % (UINT8_MAX + 1);
+        SlaveHealth_t health;
+        if (!SlaveHealth_get(bus, slaveAddr, &health))
+            continue;
+        JsonWriter_beginObject(&writer);
+        JsonWriter_key(&writer, "bus");
+        JsonWriter_uint(&writer, bus);
+        JsonWriter_key(&writer, "addr");
+        JsonWriter_uint(&writer, slaveAddr);
+        JsonWriter_key(&writer, "successes");
+        JsonWriter_uint(&writer, health.successes);
+        JsonWriter_key(&writer, "exceptions");
+        JsonWriter_uint(&writer, health.exceptions);
+        JsonWriter_key(&writer, "lastException");
+        JsonWriter_uint(&writer, health.lastException);
+        JsonWriter_key(&writer, "failures");
+        JsonWriter_uint(&writer, health.failures);
+        JsonWriter_key(&writer, "consecutiveFailures");
+        JsonWriter_uint(&writer, health.consecutiveFailures);
+        JsonWriter_key(&writer, "lastError");
+        JsonWriter_int(&writer, health.lastError);
+        JsonWriter_key(&writer, "lastAnswerAgoS");
+        JsonWriter_int(&writer, health.lastAnswerUs != 0 ? (nowUs - health.lastAnswerUs) / 1000000 : -1);
+        JsonWriter_key(&writer, "probeInS");
+        JsonWriter_int(&writer, health.backingOff ? (health.probeAtUs > nowUs ? (health.probeAtUs - nowUs + 999999) / 1000000 : 0) : -1);
+        JsonWriter_endObject(&writer);
+    }
+    JsonWriter_endArray(&writer);
+
+    JsonWriter_key(&writer, "quarantined");
+    JsonWriter_beginArray(&writer);
+    KnownRegisters_forEach(appendQuarantinedRegisterName, &writer);
+    JsonWriter_endArray(&writer);
+
+    JsonWriter_endObject(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+static void *getGetLatestWriteResults(const char *args)
+{
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    JsonWriter_key(&writer, "results");
+    JsonWriter_beginArray(&writer);
+    for (int w = 0; w < batchWritesNum; w++)
+    {
+        JsonWriter_beginObject(&writer);
+        JsonWriter_key(&writer, "name");
+        JsonWriter_string(&writer, batchWrites[w].regName);
+        JsonWriter_key(&writer, "result");
+        JsonWriter_int(&writer, writeResultToCode(batchWrites[w].result));
+        JsonWriter_endObject(&writer);
+    }
+    JsonWriter_endArray(&writer);
+
+    JsonWriter_endObject(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+// Records of the register map from an index, as many as fit the response. "next" is the index to ask for next, equal to
+// "total" when there are no more. Registers added, removed or reconfigured in between change "generation": then the export
+// must be restarted.
+static void *getExportRegisters(const char *args)
+{
+    uint32_t offset = 0;
+    if (strlen(args) > 0)
+    {
+        if (!strContainsOnlyDigits((char *)args) || !strValLessThan((char *)args, MAX_U16_STR))
+            return JSON_ERROR("invalid offset");
+        offset = strtoul(args, NULL, 10);
+    }
+
+    // Room for the other fields, and for the escapes names may need
+    static char records[JSON_BUFSIZE / 2];
+    char record[REGISTER_MAP_RECORD_MAX_LEN + 1];
+    const int total = KnownRegisters_count();
+    const uint32_t generation = KnownRegisters_getGeneration();
+    int len = 0;
+    int next = offset;
+    records[0] = '\0';
+    RegisterAccessData_t rad;
+    for (; next < total && KnownRegisters_at(next, &rad); next++)
+    {
+        const int recordLen = RegisterMap_formatRecord(&rad, record, sizeof(record));
+        if (recordLen < 0)
+            return JSON_ERROR("record too long");
+        const int sepLen = len > 0 ? 1 : 0;
+        if (len + sepLen + recordLen >= (int)sizeof(records))
             break;
+        if (sepLen > 0)
+            records[len++] = REGISTER_MAP_RECORDS_SEPARATOR;
+        strcpy(&records[len], record);
+        len += recordLen;
+    }
+
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+    JsonWriter_key(&writer, "total");
+    JsonWriter_int(&writer, total);
+    JsonWriter_key(&writer, "generation");
+    JsonWriter_uint(&writer, generation);
+    JsonWriter_key(&writer, "next");
+    JsonWriter_int(&writer, next > total ? total : next);
+    JsonWriter_key(&writer, "records");
+    JsonWriter_string(&writer, records);
+    JsonWriter_endObject(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+// Cheap enough to be called at every connection: if nothing changed since the latest sync, no other call is needed
+static void *getGetConfigFingerprint(const char *args)
+{
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    JsonWriter_key(&writer, "registers");
+    JsonWriter_int(&writer, KnownRegisters_count());
+    JsonWriter_key(&writer, "mapHash");
+    JsonWriter_uint(&writer, KnownRegisters_getMapHash());
+    JsonWriter_key(&writer, "keysVersion");
+    JsonWriter_uint(&writer, KnownRegisters_getKeysVersion());
+    JsonWriter_key(&writer, "configHash");
+    JsonWriter_uint(&writer, NvsFwCfg_getNextFirmwareConfigHash());
+
+    JsonWriter_endObject(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+// Hashes of the records of the registers from an index, as many as fit the response, to find the ones that differ. Paged like
+// ExportRegisters.
+static void *getGetRegistersHashes(const char *args)
+{
+    uint32_t offset = 0;
+    if (strlen(args) > 0)
+    {
+        if (!strContainsOnlyDigits((char *)args) || !strValLessThan((char *)args, MAX_U16_STR))
+            return JSON_ERROR("invalid offset");
+        offset = strtoul(args, NULL, 10);
+    }
 
-        if (strlen(jsonBuffer) + strlen(keyValueString) + NULL_CHAR_LEN > JSON_BUFSIZE)
+    // Room to close the response with its counters is reserved, so that hashes can be appended until they don't fit
+    const int tailLen = CT_STRLEN("},\"total\":4096,\"generation\":4294967295,\"next\":4096}");
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE - tailLen);
+    JsonWriter_beginObject(&writer);
+
+    const int total = KnownRegisters_count();
+    const uint32_t generation = KnownRegisters_getGeneration();
+    int next = offset;
+    RegisterAccessData_t rad;
+    JsonWriter_key(&writer, "hashes");
+    JsonWriter_beginObject(&writer);
+    for (; next < total && KnownRegisters_at(next, &rad); next++)
+    {
+        const JsonWriterMark_t mark = JsonWriter_mark(&writer);
+        JsonWriter_key(&writer, rad.regName);
+        JsonWriter_uint(&writer, RegisterMap_recordHash(&rad));
+        if (JsonWriter_overflowed(&writer))
+        {
+            JsonWriter_rollback(&writer, mark);
             break;
-        strcat(jsonBuffer, keyValueString);
+        }
+    }
+
+    writer.capacity += tailLen;
+    JsonWriter_endObject(&writer);
+    JsonWriter_key(&writer, "total");
+    JsonWriter_int(&writer, total);
+    JsonWriter_key(&writer, "generation");
+    JsonWriter_uint(&writer, generation);
+    JsonWriter_key(&writer, "next");
+    JsonWriter_int(&writer, next > total ? total : next);
+    JsonWriter_endObject(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+// Modbus TCP buses have their own call, since config calls have no room left for them
+static void *getGetMbTcpBuses(const char *args)
+{
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    FirmwareConfig_t fwConfig = {0};
+    NvsFwCfg_getNextFirmwareConfig(&fwConfig);
 
-        iAdded++;
+    JsonWriter_key(&writer, "buses");
+    JsonWriter_beginArray(&writer);
+    for (int bus = MB_FIRST_TCP_BUS; bus < MB_BUSES_NUM; bus++)
+    {
+        const TcpBusConfig_t *tcpBus = &fwConfig.tcpBuses[bus - MB_FIRST_TCP_BUS];
+        char ip[sizeof("255.255.255.255")] = {0};
+        snprintf(ip, sizeof(ip), "%u.%u.%u.%u", tcpBus->tcp.ip[0], tcpBus->tcp.ip[1], tcpBus->tcp.ip[2], tcpBus->tcp.ip[3]);
+        JsonWriter_beginObject(&writer);
+        JsonWriter_key(&writer, "bus");
+        JsonWriter_uint(&writer, bus);
+        JsonWriter_key(&writer, "enabled");
+        JsonWriter_bool(&writer, tcpBus->enabled);
+        JsonWriter_key(&writer, "running");
+        JsonWriter_bool(&writer, MbRtu_isBusRunning(bus));
+        JsonWriter_key(&writer, "core");
+        JsonWriter_uint(&writer, tcpBus->coreId);
+        JsonWriter_key(&writer, "ip");
+        JsonWriter_string(&writer, ip);
+        JsonWriter_key(&writer, "port");
+        JsonWriter_uint(&writer, tcpBus->tcp.port);
+        JsonWriter_key(&writer, "connections");
+        JsonWriter_uint(&writer, tcpBus->tcp.connectionsNum);
+        JsonWriter_key(&writer, "depth");
+        JsonWriter_uint(&writer, tcpBus->tcp.depth);
+        JsonWriter_endObject(&writer);
     }
-    bool finalBracketFits = false;
-    if (strlen(jsonBuffer) + CT_STRLEN("}") + NULL_CHAR_LEN <= JSON_BUFSIZE)
+    JsonWriter_endArray(&writer);
+
+    JsonWriter_endObject(&writer);
+
+    return jsonWriterResult(&writer);
+}
+
+static void *getGetBusLatency(const char *args)
+{
+    uint8_t bus = MB_PRIMARY_BUS;
+    if (!parseBus(args, &bus))
+        return JSON_ERROR("invalid bus");
+
+    static char jsonBuffer[JSON_BUFSIZE] = {0};
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, jsonBuffer, JSON_BUFSIZE);
+    JsonWriter_beginObject(&writer);
+
+    for (int p = 0; p < BusPriority_NUM; p++)
     {
-        strcat(jsonBuffer, "}");
-        finalBracketFits = true;
+        BusLatencyStats_t stats;
+        BusArbiter_getLatencyStats(bus, p, &stats);
+        JsonWriter_key(&writer, BUS_PRIORITIES_NAMES[p]);
+        JsonWriter_beginObject(&writer);
+        JsonWriter_key(&writer, "targetMs");
+        JsonWriter_uint(&writer, stats.targetUs / 1000);
+        JsonWriter_key(&writer, "requests");
+        JsonWriter_uint(&writer, stats.requests);
+        JsonWriter_key(&writer, "missed");
+        JsonWriter_uint(&writer, stats.missed);
+        JsonWriter_key(&writer, "avgWaitUs");
+        JsonWriter_uint(&writer, stats.requests > 0 ? stats.totalWaitUs / stats.requests : 0);
+        JsonWriter_key(&writer, "maxWaitUs");
+        JsonWriter_uint(&writer, stats.maxWaitUs);
+        JsonWriter_endObject(&writer);
     }
+    JsonWriter_key(&writer, "queued");
+    JsonWriter_int(&writer, BusArbiter_queued(bus));
 
-    if (i < knownRegistersCount || !finalBracketFits)
-        return "{}";
+    JsonWriter_endObject(&writer);
 
-    return jsonBuffer;
+    return jsonWriterResult(&writer);
 }
 
 void CloudCb_registerCallbacks()
@@ -1111,19 +2315,39 @@ void CloudCb_registerCallbacks()
     tracklePost(trackle_s, "EnableMonitorOnChange", postEnableMonitorOnChange, ALL_USERS);
     tracklePost(trackle_s, "SetRegisterChangeCheckInterval", postSetRegisterChangeCheckInterval, ALL_USERS);
     tracklePost(trackle_s, "SetRegisterMaxPublishDelay", postSetRegisterMaxPublishDelay, ALL_USERS);
+    tracklePost(trackle_s, "SetRegisterPollInterval", postSetRegisterPollInterval, ALL_USERS);
     tracklePost(trackle_s, "MakeRegisterWritable", postMakeRegisterWritable, ALL_USERS);
     tracklePost(trackle_s, "MakeRegisterSigned", postMakeRegisterSigned, ALL_USERS);
     tracklePost(trackle_s, "WriteRegisterValue", postWriteRegisterValue, ALL_USERS);
+    tracklePost(trackle_s, "WriteRegistersValues", postWriteRegistersValues, ALL_USERS);
     tracklePost(trackle_s, "WriteRawRegisterValue", postWriteRawRegisterValue, ALL_USERS);
     tracklePost(trackle_s, "SetRegisterCoefficients", postSetRegisterCoefficients, ALL_USERS);
+    tracklePost(trackle_s, "SetRegisterDeadband", postSetRegisterDeadband, ALL_USERS);
     tracklePost(trackle_s, "SetRegisterDecimals", postSetRegisterDecimals, ALL_USERS);
     tracklePost(trackle_s, "SetRegisterLength", postSetRegisterLength, ALL_USERS);
     tracklePost(trackle_s, "SetMbConfig", postSetMbConfig, ALL_USERS);
     tracklePost(trackle_s, "SetMbInterCmdsDelayMs", postSetMbInterCmdsDelayMs, ALL_USERS);
     tracklePost(trackle_s, "SetMbReadPeriod", postSetMbReadPeriod, ALL_USERS);
+    tracklePost(trackle_s, "SetMaxRegisters", postSetMaxRegisters, ALL_USERS);
+    tracklePost(trackle_s, "SetPayloadEncoding", postSetPayloadEncoding, ALL_USERS);
+    tracklePost(trackle_s, "SetCompactKeys", postSetCompactKeys, ALL_USERS);
+    tracklePost(trackle_s, "SetTrimTrailingZeros", postSetTrimTrailingZeros, ALL_USERS);
+    tracklePost(trackle_s, "SetMbAdaptiveInterCmdsDelay", postSetMbAdaptiveInterCmdsDelay, ALL_USERS);
+    tracklePost(trackle_s, "ReleaseQuarantinedRegisters", postReleaseQuarantinedRegisters, ALL_USERS);
+    tracklePost(trackle_s, "SetMbLatencyTarget", postSetMbLatencyTarget, ALL_USERS);
+    tracklePost(trackle_s, "SetMbBusConfig", postSetMbBusConfig, ALL_USERS);
+    tracklePost(trackle_s, "SetMbBusPins", postSetMbBusPins, ALL_USERS);
+    tracklePost(trackle_s, "DisableMbBus", postDisableMbBus, ALL_USERS);
+    tracklePost(trackle_s, "SetMbBusCore", postSetMbBusCore, ALL_USERS);
+    tracklePost(trackle_s, "SetMbTcpBus", postSetMbTcpBus, ALL_USERS);
+    tracklePost(trackle_s, "SetRegisterBus", postSetRegisterBus, ALL_USERS);
+    tracklePost(trackle_s, "ImportRegisters", postImportRegisters, ALL_USERS);
+    tracklePost(trackle_s, "CommitRegistersImport", postCommitRegistersImport, ALL_USERS);
 
     trackleGet(trackle_s, "GetRegistersList", getGetRegistersList, VAR_JSON);
+    trackleGet(trackle_s, "GetSlaveRegistersList", getGetSlaveRegistersList, VAR_JSON);
     trackleGet(trackle_s, "GetRegisterDetails", getGetRegisterDetails, VAR_JSON);
+    trackleGet(trackle_s, "GetRegistersDictionary", getGetRegistersDictionary, VAR_JSON);
     trackleGet(trackle_s, "ReadRegisterValue", getReadRegisterValue, VAR_JSON);
     trackleGet(trackle_s, "ReadRawRegisterValue", getReadRawRegisterValue, VAR_JSON);
     trackleGet(trackle_s, "ReadAllRegistersValues", getReadAllRegistersValues, VAR_JSON);
@@ -1131,4 +2355,12 @@ void CloudCb_registerCallbacks()
     trackleGet(trackle_s, "GetRegisterNameByMbDetails", getGetRegisterNameByMbDetails, VAR_JSON);
     trackleGet(trackle_s, "GetActualModbusConfig", getGetActualModbusConfig, VAR_JSON);
     trackleGet(trackle_s, "GetNextModbusConfig", getGetNextModbusConfig, VAR_JSON);
+    trackleGet(trackle_s, "GetModbusTrace", getGetModbusTrace, VAR_JSON);
+    trackleGet(trackle_s, "GetSlavesHealth", getGetSlavesHealth, VAR_JSON);
+    trackleGet(trackle_s, "GetBusLatency", getGetBusLatency, VAR_JSON);
+    trackleGet(trackle_s, "GetMbTcpBuses", getGetMbTcpBuses, VAR_JSON);
+    trackleGet(trackle_s, "GetLatestWriteResults", getGetLatestWriteResults, VAR_JSON);
+    trackleGet(trackle_s, "ExportRegisters", getExportRegisters, VAR_JSON);
+    trackleGet(trackle_s, "GetConfigFingerprint", getGetConfigFingerprint, VAR_JSON);
+    trackleGet(trackle_s, "GetRegistersHashes", getGetRegistersHashes, VAR_JSON);
 }
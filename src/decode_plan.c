@@ -0,0 +1,182 @@
+#include "decode_plan.h"
+
+#include <string.h>
+
+#include "num_format.h"
+
+#define MAX_NUMBER_WORDS 4
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+// Words assemblers, for each width: msb has the most significant word first, lsb the least significant one
+
+static uint64_t assembleNone(const uint16_t *words)
+{
+    return 0;
+}
+
+static uint64_t assemble1(const uint16_t *words)
+{
+    return words[0];
+}
+
+static uint64_t assembleMsb2(const uint16_t *words)
+{
+    return ((uint64_t)words[0] << 16) | words[1];
+}
+
+static uint64_t assembleMsb3(const uint16_t *words)
+{
+    return ((uint64_t)words[0] << 32) | ((uint64_t)words[1] << 16) | words[2];
+}
+
+static uint64_t assembleMsb4(const uint16_t *words)
+{
+    return ((uint64_t)words[0] << 48) | ((uint64_t)words[1] << 32) | ((uint64_t)words[2] << 16) | words[3];
+}
+
+static uint64_t assembleLsb2(const uint16_t *words)
+{
+    return ((uint64_t)words[1] << 16) | words[0];
+}
+
+static uint64_t assembleLsb3(const uint16_t *words)
+{
+    return ((uint64_t)words[2] << 32) | ((uint64_t)words[1] << 16) | words[0];
+}
+
+static uint64_t assembleLsb4(const uint16_t *words)
+{
+    return ((uint64_t)words[3] << 48) | ((uint64_t)words[2] << 32) | ((uint64_t)words[1] << 16) | words[0];
+}
+
+static uint64_t (*const MSB_ASSEMBLERS[MAX_NUMBER_WORDS + 1])(const uint16_t *) = {assembleNone, assemble1, assembleMsb2, assembleMsb3, assembleMsb4};
+static uint64_t (*const LSB_ASSEMBLERS[MAX_NUMBER_WORDS + 1])(const uint16_t *) = {assembleNone, assemble1, assembleLsb2, assembleLsb3, assembleLsb4};
+
+// Interpretations of assembled words
+
+static double asZero(uint64_t bits)
+{
+    return 0;
+}
+
+static double asUnsigned(uint64_t bits)
+{
+    return (double)bits;
+}
+
+static double asInt16(uint64_t bits)
+{
+    return (int16_t)bits;
+}
+
+static double asInt32(uint64_t bits)
+{
+    return (int32_t)bits;
+}
+
+static double asInt48(uint64_t bits)
+{
+    return (double)((int64_t)(bits << 16) >> 16);
+}
+
+static double asInt64(uint64_t bits)
+{
+    return (double)(int64_t)bits;
+}
+
+static double asFloat32(uint64_t bits)
+{
+    const uint32_t bits32 = (uint32_t)bits;
+    float value = 0;
+    memcpy(&value, &bits32, sizeof(value));
+    return value;
+}
+
+static double asFloat64(uint64_t bits)
+{
+    double value = 0;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static double (*const SIGNED_INTERPRETERS[MAX_NUMBER_WORDS + 1])(uint64_t) = {asZero, asInt16, asInt32, asInt48, asInt64};
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+void DecodePlan_build(DecodePlan_t *plan, const RegisterAccessData_t *rad, uint8_t bitPosition)
+{
+    const uint8_t words = rad->regNumber <= MAX_NUMBER_WORDS ? rad->regNumber : 0;
+
+    plan->assemble = bitPosition == 1 ? LSB_ASSEMBLERS[words] : MSB_ASSEMBLERS[words];
+    plan->toDouble = asZero;
+    plan->signShift = 64 - 16 * (words > 0 ? words : MAX_NUMBER_WORDS);
+    plan->exactInteger = false;
+    plan->valueType = RegValueType_FLOAT64;
+    plan->regNumber = rad->regNumber;
+    plan->factor = rad->factor;
+    plan->offset = rad->offset;
+    plan->decimals = rad->decimals;
+
+    switch (rad->type)
+    {
+    case RADType_NUMBER:
+        plan->toDouble = rad->interpretAsSigned ? SIGNED_INTERPRETERS[words] : asUnsigned;
+        plan->exactInteger = rad->factor == 1 && rad->offset == 0;
+        if (plan->exactInteger)
+            plan->valueType = rad->interpretAsSigned ? RegValueType_INT : RegValueType_UINT;
+        break;
+    case RADType_FLOAT:
+        if (words == 2)
+            plan->toDouble = asFloat32;
+        else if (words == 4)
+            plan->toDouble = asFloat64;
+        if (words == 2 && rad->factor == 1 && rad->offset == 0)
+            plan->valueType = RegValueType_FLOAT32;
+        break;
+    case RADType_RAW:
+        plan->assemble = assemble1;
+        plan->toDouble = asUnsigned;
+        plan->exactInteger = true;
+        plan->valueType = RegValueType_UINT;
+        plan->factor = 1;
+        plan->offset = 0;
+        plan->decimals = 0;
+        break;
+    case RADType_STRING:
+        plan->assemble = assembleNone;
+        plan->valueType = RegValueType_TEXT;
+        plan->factor = 0;
+        plan->offset = 0;
+        break;
+    }
+}
+
+// Plans decode the same words to the same values
+bool DecodePlan_equals(const DecodePlan_t *a, const DecodePlan_t *b)
+{
+    return a->assemble == b->assemble && a->toDouble == b->toDouble && a->signShift == b->signShift && a->exactInteger == b->exactInteger &&
+           a->valueType == b->valueType && a->regNumber == b->regNumber && a->factor == b->factor && a->offset == b->offset &&
+           a->decimals == b->decimals;
+}
+
+uint64_t DecodePlan_unsigned(const DecodePlan_t *plan, const uint16_t *words)
+{
+    return plan->assemble(words);
+}
+
+int64_t DecodePlan_signed(const DecodePlan_t *plan, const uint16_t *words)
+{
+    return (int64_t)(plan->assemble(words) << plan->signShift) >> plan->signShift;
+}
+
+double DecodePlan_native(const DecodePlan_t *plan, const uint16_t *words)
+{
+    return plan->toDouble(plan->assemble(words));
+}
+
+// Value after factor, offset and decimals are applied
+double DecodePlan_scaled(const DecodePlan_t *plan, const uint16_t *words)
+{
+    return NumFormat_round(plan->toDouble(plan->assemble(words)) * plan->factor + plan->offset, plan->decimals);
+}
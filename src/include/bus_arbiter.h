@@ -0,0 +1,78 @@
+#ifndef BUS_ARBITER_H_
+#define BUS_ARBITER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+
+#include <trackle_modbus.h>
+
+#include "mb_buses.h"
+
+#define BUS_ARBITER_QUEUE_LEN 8   // Requests of each priority waiting for the bus: when full, submitters wait
+#define BUS_ARBITER_MAX_WORKERS 8 // Transactions a bus can have in flight
+
+// Classes of bus requests, from the most urgent one. At every transaction boundary, the bus is given to the most urgent request.
+typedef enum
+{
+    BusPriority_CONTROL = 0, // Writes of registers
+    BusPriority_FORWARDED,   // Requests forwarded from an upstream master
+    BusPriority_INTERACTIVE, // Reads requested by cloud calls
+    BusPriority_POLLING,     // Background reads of monitored registers
+    BusPriority_NUM,
+} BusPriority_t;
+
+// Executes a Modbus transaction on a bus. Transports of buses with several tasks are called by them at the same time.
+typedef ModbusError (*BusTransport_t)(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, void *value);
+
+// Time requests waited for a bus, since its task started
+typedef struct BusLatencyStats_s
+{
+    uint32_t requests;
+    uint32_t missed; // Requests that waited more than the latency target
+    uint64_t totalWaitUs;
+    uint32_t maxWaitUs;
+    uint32_t targetUs; // 0 if not set
+} BusLatencyStats_t;
+
+// Modbus transaction submitted to the task that owns the bus. It must stay valid until it's completed.
+typedef struct BusRequest_s
+{
+    uint8_t bus;
+    BusPriority_t priority;
+    uint8_t function;
+    uint8_t slaveAddr;
+    uint16_t regId;
+    uint16_t regNumber;
+    void *value;       // Words (or bits) to write, or buffer for the ones read
+    bool valueIsWords; // Value is recorded in the trace only if it contains registers
+    QueueHandle_t completions; // If set, the request is also sent there when completed, so that many can be waited for at once
+
+    // Set by the arbiter
+    int64_t submitUs;
+    ModbusError result;
+    SemaphoreHandle_t done; // Given when the transaction is completed
+    StaticSemaphore_t doneBuffer;
+} BusRequest_t;
+
+bool BusArbiter_init(uint8_t bus, BusTransport_t transport, BaseType_t coreId, int workersNum);
+bool BusArbiter_isRunning(uint8_t bus);
+int BusArbiter_workers(uint8_t bus);
+void BusArbiter_prepare(BusRequest_t *req, uint8_t bus, BusPriority_t priority, uint8_t function, uint8_t slaveAddr, uint16_t regId,
+                        uint16_t regNumber, void *value, bool valueIsWords);
+bool BusArbiter_submit(BusRequest_t *req, TickType_t wait);
+bool BusArbiter_wait(BusRequest_t *req, TickType_t wait);
+bool BusArbiter_poll(BusRequest_t *req);
+ModbusError BusArbiter_execute(uint8_t bus, BusPriority_t priority, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber,
+                               void *value, bool valueIsWords);
+ModbusError BusArbiter_sharedRead(uint8_t bus, BusPriority_t priority, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber,
+                                  uint16_t *words);
+int BusArbiter_queued(uint8_t bus);
+void BusArbiter_setLatencyTargetMs(BusPriority_t priority, uint16_t targetMs);
+void BusArbiter_getLatencyStats(uint8_t bus, BusPriority_t priority, BusLatencyStats_t *stats);
+void BusArbiter_stop(uint8_t bus);
+
+#endif
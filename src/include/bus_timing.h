@@ -0,0 +1,19 @@
+#ifndef BUS_TIMING_H_
+#define BUS_TIMING_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "mb_buses.h"
+
+void BusTiming_init(uint8_t bus, int baudrate, uint8_t serialDataBits, uint8_t serialParity, uint8_t serialStopBits, uint16_t interCmdsDelayMs);
+void BusTiming_initUnpaced(uint8_t bus);
+void BusTiming_setAdaptive(bool adaptive);
+bool BusTiming_isAdaptive();
+uint32_t BusTiming_minGapUs(uint8_t bus);
+uint32_t BusTiming_typicalGapUs(uint8_t bus);
+uint32_t BusTiming_gapUs(uint8_t bus, uint8_t slaveAddr);
+void BusTiming_waitGap(uint8_t bus, uint8_t slaveAddr);
+void BusTiming_frameDone(uint8_t bus, uint8_t slaveAddr, bool ok, int64_t startUs);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef CBOR_WRITER_H_
+#define CBOR_WRITER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct CborWriter_s
+{
+    uint8_t *buf;
+    int capacity;
+    int len;
+    bool overflow;
+} CborWriter_t;
+
+typedef int CborWriterMark_t;
+
+void CborWriter_init(CborWriter_t *writer, uint8_t *buf, int capacity);
+void CborWriter_beginMap(CborWriter_t *writer);
+void CborWriter_beginArray(CborWriter_t *writer);
+void CborWriter_end(CborWriter_t *writer);
+void CborWriter_uint(CborWriter_t *writer, uint64_t value);
+void CborWriter_int(CborWriter_t *writer, int64_t value);
+void CborWriter_float32(CborWriter_t *writer, float value);
+void CborWriter_float64(CborWriter_t *writer, double value);
+void CborWriter_double(CborWriter_t *writer, double value);
+void CborWriter_text(CborWriter_t *writer, const char *value, int valueLen);
+void CborWriter_bool(CborWriter_t *writer, bool value);
+void CborWriter_null(CborWriter_t *writer);
+bool CborWriter_overflowed(const CborWriter_t *writer);
+int CborWriter_length(const CborWriter_t *writer);
+CborWriterMark_t CborWriter_mark(const CborWriter_t *writer);
+void CborWriter_rollback(CborWriter_t *writer, CborWriterMark_t mark);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef DECODE_PLAN_H_
+#define DECODE_PLAN_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "register_access_data.h"
+#include "payload_writer.h"
+
+// How to decode the words of a register. It's chosen when the configuration of the register changes, so that decoding
+// a value takes no decisions on type, width, signedness and word order.
+typedef struct DecodePlan_s
+{
+    uint64_t (*assemble)(const uint16_t *words); // Integer made by the words of the register, in the configured word order
+    double (*toDouble)(uint64_t bits);           // Native value of the register, before coefficients
+    uint8_t signShift;                           // Integers are sign extended shifting their top bit to bit 63 and back
+    bool exactInteger;                           // Integer without coefficients: its value doesn't need a double
+    RegValueType_t valueType;                    // Type of the value in binary payloads
+    uint8_t regNumber;                           // Words of the register, as read
+    double factor;
+    double offset;
+    uint8_t decimals;
+} DecodePlan_t;
+
+void DecodePlan_build(DecodePlan_t *plan, const RegisterAccessData_t *rad, uint8_t bitPosition);
+bool DecodePlan_equals(const DecodePlan_t *a, const DecodePlan_t *b);
+uint64_t DecodePlan_unsigned(const DecodePlan_t *plan, const uint16_t *words);
+int64_t DecodePlan_signed(const DecodePlan_t *plan, const uint16_t *words);
+double DecodePlan_native(const DecodePlan_t *plan, const uint16_t *words);
+double DecodePlan_scaled(const DecodePlan_t *plan, const uint16_t *words);
+
+#endif
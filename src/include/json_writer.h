@@ -0,0 +1,47 @@
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define JSON_WRITER_MAX_DEPTH 16
+
+typedef struct JsonWriter_s
+{
+    char *buf;
+    int capacity; // Including null char
+    int len;
+    bool overflow;
+    bool afterKey;
+    uint8_t depth;
+    uint16_t hasItems; // Bit n is set if the container at depth n already contains an item
+} JsonWriter_t;
+
+// State of a writer, to drop what was written after it if it doesn't fit
+typedef struct JsonWriterMark_s
+{
+    int len;
+    bool afterKey;
+    uint8_t depth;
+    uint16_t hasItems;
+} JsonWriterMark_t;
+
+void JsonWriter_init(JsonWriter_t *writer, char *buf, int capacity);
+void JsonWriter_beginObject(JsonWriter_t *writer);
+void JsonWriter_endObject(JsonWriter_t *writer);
+void JsonWriter_beginArray(JsonWriter_t *writer);
+void JsonWriter_endArray(JsonWriter_t *writer);
+void JsonWriter_key(JsonWriter_t *writer, const char *key);
+void JsonWriter_string(JsonWriter_t *writer, const char *value);
+void JsonWriter_raw(JsonWriter_t *writer, const char *value);
+void JsonWriter_int(JsonWriter_t *writer, int64_t value);
+void JsonWriter_uint(JsonWriter_t *writer, uint64_t value);
+void JsonWriter_double(JsonWriter_t *writer, double value, uint8_t decimals);
+void JsonWriter_bool(JsonWriter_t *writer, bool value);
+void JsonWriter_null(JsonWriter_t *writer);
+bool JsonWriter_overflowed(const JsonWriter_t *writer);
+int JsonWriter_length(const JsonWriter_t *writer);
+JsonWriterMark_t JsonWriter_mark(const JsonWriter_t *writer);
+void JsonWriter_rollback(JsonWriter_t *writer, JsonWriterMark_t mark);
+
+#endif
@@ -1,33 +1,118 @@
 #ifndef KNOWN_REGISTERS_H_
 #define KNOWN_REGISTERS_H_
 
+#include <sdkconfig.h>
+
 #include "register_access_data.h"
+#include "decode_plan.h"
+
+#define MAX_REGISTERS_LIMIT 4096
+
+#ifdef CONFIG_GW_MASTER_MODBUS_MAX_REGISTERS
+#define DEFAULT_MAX_REGISTERS_NUM CONFIG_GW_MASTER_MODBUS_MAX_REGISTERS
+#else
+#define DEFAULT_MAX_REGISTERS_NUM 60
+#endif
+
+#define INVALID_REG_HANDLE (-1)
+
+// Identifies a register for as long as it exists, unlike its index that changes when other registers are removed
+typedef int16_t KnownRegHandle_t;
+
+// Register details needed to schedule and plan reads, kept in internal RAM even when registers are in external RAM
+typedef struct RegisterPollData_s
+{
+    uint8_t bus;
+    uint16_t regId;
+    uint8_t slaveAddr;
+    uint8_t readFunction;
+    uint8_t regNumber;
+    bool monitored;
+    bool publishOnChange;
+    Seconds_t changeCheckInterval;
+    Seconds_t maxPublishDelay;
+    Seconds_t pollInterval;
+} RegisterPollData_t;
+
+// Register details and state needed to decide whether to publish a read value, kept in internal RAM like poll data
+typedef struct RegisterPublishData_s
+{
+    char regName[MAX_REG_NAME_SIZE];
+    uint16_t keyId;
+    double deadbandAbs;
+    double deadbandRel;
+    DecodePlan_t decodePlan; // Built from details every time they change
+
+    // Latest published value is kept as read, and formatted only when requested
+    uint16_t latestPublishedRaw[MAX_REG_LENGTH];
+    double latestPublishedNumber; // Scaled value, used to detect changes of numeric registers
+    Seconds_t latestPublishSec;
+    bool mustPublish;
+} RegisterPublishData_t;
+
+// Called with the registry locked: rad is valid, and must not be kept, until the visitor returns. Return false to stop iterating.
+typedef bool (*KnownRegistersVisitor_t)(int idx, const RegisterAccessData_t *rad, void *arg);
 
-#define MAX_REGISTERS_NUM 60
+// Like KnownRegistersVisitor_t, for the copies of the details of a register kept in internal RAM
+typedef bool (*KnownRegistersPublishVisitor_t)(int idx, const RegisterPollData_t *poll, const RegisterPublishData_t *publish, void *arg);
 
-void KnownRegisters_init();
+bool KnownRegisters_init(int maxRegisters);
+int KnownRegisters_capacity();
 bool KnownRegisters_remove(char *regName);
 bool KnownRegisters_add(const RegisterAccessData_t *rad);
+bool KnownRegisters_import(const RegisterAccessData_t *rads, int radsNum, const char (*removedNames)[MAX_REG_NAME_SIZE], int removedNum,
+                           bool replace);
 int KnownRegisters_count();
+uint32_t KnownRegisters_getGeneration();
+uint32_t KnownRegisters_getKeysVersion();
+uint32_t KnownRegisters_getMapHash();
+KnownRegHandle_t KnownRegisters_handleOf(const char *regName);
+KnownRegHandle_t KnownRegisters_handleAt(int idx);
+int KnownRegisters_indexOf(KnownRegHandle_t handle);
+int KnownRegisters_countOfSlave(uint8_t bus, uint8_t slaveAddr);
+int KnownRegisters_handlesOfSlave(uint8_t bus, uint8_t slaveAddr, KnownRegHandle_t *handlesOut, int maxHandles);
 void KnownRegisters_clear();
 bool KnownRegisters_find(char *regName, RegisterAccessData_t *radOut);
-bool KnownRegisters_findByModbus(uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, RegisterAccessData_t *radOut);
+bool KnownRegisters_findByModbus(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, RegisterAccessData_t *radOut);
 bool KnownRegisters_at(int idx, RegisterAccessData_t *radOut);
+bool KnownRegisters_getPollDataAt(int idx, RegisterPollData_t *pollOut);
+int KnownRegisters_forEach(KnownRegistersVisitor_t visitor, void *arg);
+int KnownRegisters_forEachOfSlave(uint8_t bus, uint8_t slaveAddr, KnownRegistersVisitor_t visitor, void *arg);
+bool KnownRegisters_visitAt(int idx, KnownRegistersVisitor_t visitor, void *arg);
+bool KnownRegisters_visitHandle(KnownRegHandle_t handle, KnownRegistersVisitor_t visitor, void *arg);
+bool KnownRegisters_visitPublishData(KnownRegHandle_t handle, KnownRegistersPublishVisitor_t visitor, void *arg);
+bool KnownRegisters_visitByName(const char *regName, KnownRegistersVisitor_t visitor, void *arg);
+bool KnownRegisters_visitByModbus(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, KnownRegistersVisitor_t visitor, void *arg);
 bool KnownRegisters_setMonitored(char *regName, bool monitored);
 bool KnownRegisters_setWritable(char *regName, bool writable, uint8_t writeFunction);
 bool KnownRegisters_setInterpretedAsSigned(char *regName, bool asSigned);
 bool KnownRegisters_setFactor(char *regName, double factor);
 bool KnownRegisters_setOffset(char *regName, double offset);
+bool KnownRegisters_setDeadband(char *regName, double deadbandAbs, double deadbandRel);
 bool KnownRegisters_setDecimals(char *regName, uint8_t decimals);
 bool KnownRegisters_setLength(char *regName, uint8_t length);
 bool KnownRegisters_setOnChange(char *regName, bool onChange);
 bool KnownRegisters_setChangeCheckInterval(char *regName, Seconds_t changeCheckInterval);
 bool KnownRegisters_setMaxPublishDelay(char *regName, Seconds_t maxPublishDelay);
-const char *KnownRegisters_getLatestPublishedValueAt(int idx);
-bool KnownRegisters_setLatestPublishedValueAt(int idx, const char *value);
+bool KnownRegisters_setPollInterval(char *regName, Seconds_t pollInterval);
+bool KnownRegisters_setBus(char *regName, uint8_t bus);
+void KnownRegisters_setWordOrder(uint8_t bitPosition);
+const DecodePlan_t *KnownRegisters_getDecodePlanAt(int idx); // Only valid inside visitors
+const uint16_t *KnownRegisters_getLatestPublishedRawAt(int idx); // Only valid inside visitors, MAX_REG_LENGTH words
+bool KnownRegisters_getLatestPublishedNumberAt(int idx, double *number);
+bool KnownRegisters_setLatestPublishedValueAt(int idx, const uint16_t *raw, double number);
 bool KnownRegisters_getLatestPublishedTimeAt(int idx, Seconds_t *latestPublish);
 bool KnownRegisters_setLatestPublishedTimeAt(int idx, Seconds_t latestPublishedTime);
 bool KnownRegisters_getMustPublish(int idx, bool *mustPublish);
 bool KnownRegisters_setMustPublish(int idx, bool mustPublish);
+bool KnownRegisters_getNextPollTimeAt(int idx, Seconds_t *nextPoll);
+bool KnownRegisters_setNextPollTimeAt(int idx, Seconds_t nextPoll);
+bool KnownRegisters_recordRefusedReadAt(int idx, bool refused, uint8_t *refusedReads);
+bool KnownRegisters_getQuarantinedAt(int idx, bool *quarantined);
+bool KnownRegisters_setQuarantinedAt(int idx, bool quarantined);
+int KnownRegisters_releaseQuarantined();
+bool KnownRegisters_setCachedValueAt(int idx, const uint16_t *raw, int64_t readUs);
+bool KnownRegisters_getCachedValueAt(int idx, uint16_t *raw, int64_t *readUs);
+int KnownRegisters_invalidateCachedValues(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber);
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef MB_BUSES_H_
+#define MB_BUSES_H_
+
+#include <trackle_modbus.h>
+
+// Modbus buses the gateway can be master of: a serial one for each UART of the ESP32, then the Modbus TCP ones. The primary
+// bus is driven by the Trackle Modbus library, the other ones by the gateway itself.
+#define MB_SERIAL_BUSES_NUM 3
+#define MB_TCP_BUSES_NUM 2
+#define MB_BUSES_NUM (MB_SERIAL_BUSES_NUM + MB_TCP_BUSES_NUM)
+#define MB_PRIMARY_BUS 0
+#define MB_FIRST_TCP_BUS MB_SERIAL_BUSES_NUM
+
+#define MB_BUS_IS_TCP(bus) ((bus) >= MB_FIRST_TCP_BUS)
+
+// Results of transactions that fail without reaching the Trackle library. They're negative, so that they're told apart
+// from its errors in traces and health reports.
+#define MB_BUS_ERR_NOT_RUNNING ((ModbusError)-1)      // Bus wasn't started
+#define MB_BUS_ERR_INVALID_REQUEST ((ModbusError)-2)  // Function not supported, or too many registers
+#define MB_BUS_ERR_IO ((ModbusError)-3)               // Request couldn't be sent (or, on TCP, no connection)
+#define MB_BUS_ERR_TIMEOUT ((ModbusError)-4)          // Slave didn't answer, or answered partially
+#define MB_BUS_ERR_INVALID_RESPONSE ((ModbusError)-5) // Wrong CRC, or response not matching the request
+
+// Exception responses carry their code: e.g. MB_BUS_ERR_EXCEPTION(MB_EXCEPTION_ILLEGAL_DATA_ADDRESS) is -18. Codes above
+// MB_BUS_MAX_EXCEPTION_CODE (none is standard) are reported as invalid responses, so that results fit a byte.
+#define MB_BUS_ERR_EXCEPTION_BASE -16
+#define MB_BUS_MAX_EXCEPTION_CODE 112
+#define MB_BUS_ERR_EXCEPTION(code) ((ModbusError)(MB_BUS_ERR_EXCEPTION_BASE - (code)))
+#define MB_BUS_EXCEPTION_CODE(err) ((int)(err) < MB_BUS_ERR_EXCEPTION_BASE ? MB_BUS_ERR_EXCEPTION_BASE - (int)(err) : 0) // 0 if not an exception
+
+#define MB_EXCEPTION_ILLEGAL_FUNCTION 1
+#define MB_EXCEPTION_ILLEGAL_DATA_ADDRESS 2
+#define MB_EXCEPTION_ILLEGAL_DATA_VALUE 3
+
+// Slave answered the transaction, even if with an exception
+#define MB_BUS_ANSWERED(err) ((err) == MODBUS_OK || MB_BUS_EXCEPTION_CODE(err) != 0)
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef MB_PDU_H_
+#define MB_PDU_H_
+
+#include <inttypes.h>
+
+#include "mb_buses.h"
+
+#define MB_PDU_MAX_LEN 253
+#define MB_PDU_EXCEPTION_FLAG 0x80
+
+int MbPdu_buildRequest(uint8_t *pdu, uint8_t function, uint16_t regId, uint16_t regNumber, const void *value);
+int MbPdu_responseLen(uint8_t function, uint16_t regNumber);
+ModbusError MbPdu_exception(uint8_t code);
+ModbusError MbPdu_parseResponse(const uint8_t *pdu, int pduLen, uint8_t function, uint16_t regNumber, void *value);
+
+#endif
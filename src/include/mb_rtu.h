@@ -7,6 +7,11 @@
 
 #include <trackle_modbus.h>
 
+#include "payload_writer.h"
+#include "bus_arbiter.h"
+#include "mb_serial.h"
+#include "mb_tcp.h"
+
 typedef enum
 {
     RegError_OK = 0,
@@ -27,15 +32,40 @@ typedef enum
     RegError_STRING_NOT_DOUBLE,
 } RegError_t;
 
+#define MB_BATCH_WRITE_MAX 16 // Registers that can be written at once
+
+// Write of a register in a batch
+typedef struct MbRegWrite_s
+{
+    char *regName;
+    char *valueString;
+    RegError_t result; // Set when the batch is written
+} MbRegWrite_t;
+
 bool MbRtu_init(uart_port_t uartPort, int baudrate, uint8_t txPin, uint8_t rxPin, bool onRS485, uint8_t dirPin, uint16_t mbInterCmdsDelayMs,
                 uint8_t mbReadPeriod, uint8_t serialDataBits, uint8_t serialParity, uint8_t serialStopBits, uint8_t bitPosition,
-                void (*mbReqFailedCallback)());
+                uint8_t busCoreId, void (*mbReqFailedCallback)());
 bool MbRtu_wasStartedSuccesfully();
-RegError_t MbRtu_readTypedRegisterByName(char *regName, char *valueString, int valueStringLen);
-RegError_t MbRtu_readRawRegisterByAddr(uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t *value);
+bool MbRtu_initBus(uint8_t bus, const MbSerialConfig_t *serial, uint16_t interCmdsDelayMs, uint8_t coreId);
+bool MbRtu_initTcpBus(uint8_t bus, const MbTcpConfig_t *tcp, uint8_t coreId);
+bool MbRtu_isBusRunning(uint8_t bus);
+RegError_t MbRtu_readTypedRegisterByName(char *regName, uint32_t maxAgeMs, char *valueString, int valueStringLen, uint32_t *ageMs);
+RegError_t MbRtu_readRawRegisterByAddr(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t *value);
 RegError_t MbRtu_writeTypedRegisterByName(char *regName, char *valueString);
-RegError_t MbRtu_writeRawRegisterByAddr(uint8_t writeFunction, uint8_t slaveAddr, uint16_t regId, uint16_t value);
-bool MbRtu_readAllRegistersJson(char *publishString, int publishStringMaxLen);
+int MbRtu_writeTypedRegistersByName(MbRegWrite_t *writes, int writesNum);
+RegError_t MbRtu_writeRawRegisterByAddr(uint8_t bus, uint8_t writeFunction, uint8_t slaveAddr, uint16_t regId, uint16_t value);
+bool MbRtu_readAllRegisters(uint32_t maxAgeMs, char *publishString, int publishStringMaxLen);
+bool MbRtu_getLatestPublishedValues(char *publishString, int publishStringMaxLen);
+void MbRtu_setPayloadEncoding(PayloadEncoding_t encoding);
+PayloadEncoding_t MbRtu_getPayloadEncoding();
+void MbRtu_setCompactKeys(bool compact);
+bool MbRtu_getCompactKeys();
+void MbRtu_setTrimTrailingZeros(bool trim);
+bool MbRtu_getTrimTrailingZeros();
+void MbRtu_setAdaptiveInterCmdsDelay(bool adaptive);
+bool MbRtu_getAdaptiveInterCmdsDelay();
+uint32_t MbRtu_getMinInterFrameGapUs();
+void MbRtu_setLatencyTargetMs(BusPriority_t priority, uint16_t targetMs);
 void MbRtu_stop();
 ModbusError MbRtu_forwardRequestToSlaves(TrackleModbusFunction function, uint8_t slaveAddr, uint16_t regId, uint16_t size, void *value);
 
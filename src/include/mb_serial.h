@@ -0,0 +1,25 @@
+#ifndef MB_SERIAL_H_
+#define MB_SERIAL_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "mb_buses.h"
+
+// Serial line of a bus driven by the gateway. Saved to flash: fields have fixed sizes.
+typedef struct MbSerialConfig_s
+{
+    uint8_t uartPort;
+    int8_t txPin;
+    int8_t rxPin;
+    int8_t dirPin; // Pin driving the direction of the RS485 transceiver, -1 if the bus is not on RS485
+    int32_t baudrate;
+    uint8_t dataBits;
+    uint8_t parity;
+    uint8_t stopBits;
+} MbSerialConfig_t;
+
+bool MbSerial_init(uint8_t bus, const MbSerialConfig_t *config);
+ModbusError MbSerial_execute(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, void *value);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef MB_TCP_H_
+#define MB_TCP_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "mb_buses.h"
+
+#define MB_TCP_DEFAULT_PORT 502
+#define MB_TCP_MAX_CONNECTIONS 4
+#define MB_TCP_MAX_DEPTH 4
+
+// Modbus TCP server a bus is bound to. Saved to flash: fields have fixed sizes.
+typedef struct MbTcpConfig_s
+{
+    uint8_t ip[4];
+    uint16_t port;
+    uint8_t connectionsNum; // Connections opened to the server
+    uint8_t depth;          // Transactions in flight on each connection
+} MbTcpConfig_t;
+
+bool MbTcp_init(uint8_t bus, const MbTcpConfig_t *config);
+int MbTcp_transactionsInFlight(const MbTcpConfig_t *config);
+ModbusError MbTcp_execute(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, void *value);
+
+#endif
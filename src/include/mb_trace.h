@@ -0,0 +1,40 @@
+#ifndef MB_TRACE_H_
+#define MB_TRACE_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <sdkconfig.h>
+
+#ifdef CONFIG_GW_MASTER_MODBUS_TRACE_ENTRIES
+#define MB_TRACE_ENTRIES CONFIG_GW_MASTER_MODBUS_TRACE_ENTRIES
+#else
+#define MB_TRACE_ENTRIES 64
+#endif
+
+#define MB_TRACE_MAX_WORDS 10 // Words kept of each transaction: the first ones read or written
+
+// Modbus transaction, as recorded by the trace
+typedef struct MbTraceEntry_s
+{
+    uint32_t seq;        // Sequence number, incremented at every transaction
+    uint32_t startUs;    // Microseconds from boot, modulo 2^32
+    uint32_t durationUs;
+    uint16_t regId;
+    uint16_t regNumber;
+    uint8_t bus;
+    uint8_t function;
+    uint8_t slaveAddr;
+    int8_t result;    // ModbusError
+    uint8_t wordsNum; // Number of words kept, 0 for failed reads
+    uint16_t words[MB_TRACE_MAX_WORDS];
+} MbTraceEntry_t;
+
+void MbTrace_record(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, const uint16_t *words, uint16_t wordsNum,
+                    int result, int64_t startUs, int64_t durationUs);
+uint32_t MbTrace_nextSeq();
+uint32_t MbTrace_oldestSeq();
+bool MbTrace_read(uint32_t seq, MbTraceEntry_t *entry);
+void MbTrace_dump();
+
+#endif
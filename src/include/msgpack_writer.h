@@ -0,0 +1,40 @@
+#ifndef MSGPACK_WRITER_H_
+#define MSGPACK_WRITER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// MessagePack has no indefinite length maps: the map being written has a 16 bit count, patched at every pair
+typedef struct MsgpackWriter_s
+{
+    uint8_t *buf;
+    int capacity;
+    int len;
+    bool overflow;
+    int mapPos;       // Position of the head of the map being written, -1 if none
+    uint32_t mapItems; // Keys and values written in the map
+} MsgpackWriter_t;
+
+typedef struct MsgpackWriterMark_s
+{
+    int len;
+    uint32_t mapItems;
+} MsgpackWriterMark_t;
+
+void MsgpackWriter_init(MsgpackWriter_t *writer, uint8_t *buf, int capacity);
+void MsgpackWriter_beginMap(MsgpackWriter_t *writer);
+void MsgpackWriter_endMap(MsgpackWriter_t *writer);
+void MsgpackWriter_uint(MsgpackWriter_t *writer, uint64_t value);
+void MsgpackWriter_int(MsgpackWriter_t *writer, int64_t value);
+void MsgpackWriter_float32(MsgpackWriter_t *writer, float value);
+void MsgpackWriter_float64(MsgpackWriter_t *writer, double value);
+void MsgpackWriter_double(MsgpackWriter_t *writer, double value);
+void MsgpackWriter_text(MsgpackWriter_t *writer, const char *value, int valueLen);
+void MsgpackWriter_bool(MsgpackWriter_t *writer, bool value);
+void MsgpackWriter_null(MsgpackWriter_t *writer);
+bool MsgpackWriter_overflowed(const MsgpackWriter_t *writer);
+int MsgpackWriter_length(const MsgpackWriter_t *writer);
+MsgpackWriterMark_t MsgpackWriter_mark(const MsgpackWriter_t *writer);
+void MsgpackWriter_rollback(MsgpackWriter_t *writer, MsgpackWriterMark_t mark);
+
+#endif
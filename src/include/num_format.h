@@ -0,0 +1,18 @@
+#ifndef NUM_FORMAT_H_
+#define NUM_FORMAT_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define NUM_FORMAT_MAX_FAST_DECIMALS 18 // More decimals than this are formatted with printf
+
+// All functions return the length of the formatted number, or -1 if it doesn't fit bufLen chars (null char included).
+// With decimals > 0, the fractional part is written with exactly that number of digits, unless trimZeros is set: then
+// its trailing zeros are removed, together with the point if no digit is left.
+
+int NumFormat_int(int64_t value, uint8_t decimals, bool trimZeros, char *buf, int bufLen);
+int NumFormat_uint(uint64_t value, uint8_t decimals, bool trimZeros, char *buf, int bufLen);
+int NumFormat_fixed(double value, uint8_t decimals, bool trimZeros, char *buf, int bufLen);
+double NumFormat_round(double value, uint8_t decimals);
+
+#endif
@@ -4,6 +4,27 @@
 #include <esp_types.h>
 #include <driver/uart.h>
 
+#include "payload_writer.h"
+#include "bus_arbiter.h"
+#include "mb_buses.h"
+#include "mb_serial.h"
+#include "mb_tcp.h"
+
+// Bus driven besides the primary one
+typedef struct ExtraBusConfig_s
+{
+    bool enabled;
+    MbSerialConfig_t serial;
+} ExtraBusConfig_t;
+
+// Modbus TCP bus
+typedef struct TcpBusConfig_s
+{
+    bool enabled;
+    uint8_t coreId; // Core the tasks of the bus are pinned to
+    MbTcpConfig_t tcp;
+} TcpBusConfig_t;
+
 typedef struct FirmwareConfig_s
 {
     uint8_t fwVersion;
@@ -15,6 +36,17 @@ typedef struct FirmwareConfig_s
     uint8_t serialStopBits;
     uint8_t serialParity;
     uint8_t bitPosition;
+
+    // New fields are appended, so that configurations saved by previous versions can still be loaded
+    uint32_t maxRegisters; // 0: default set at build time
+    uint8_t payloadEncoding; // PayloadEncoding_t
+    bool compactKeys;
+    bool trimTrailingZeros;
+    bool adaptiveInterCmdsDelay; // false: fixed delay between commands, as saved by previous versions
+    uint16_t latencyTargetsMs[BusPriority_NUM]; // Max time requests of each priority should wait for the bus, 0: not set
+    uint8_t busCores[MB_SERIAL_BUSES_NUM];             // Core the task of each serial bus is pinned to
+    ExtraBusConfig_t extraBuses[MB_SERIAL_BUSES_NUM - 1]; // Serial buses after the primary one, disabled as saved by previous versions
+    TcpBusConfig_t tcpBuses[MB_TCP_BUSES_NUM];         // Disabled as saved by previous versions
 } FirmwareConfig_t;
 
 bool NvsFwCfg_loadFromNvs();
@@ -23,10 +55,22 @@ bool NvsFwCfg_setInterCmdsDelayMs(uint16_t delay);
 void NvsFwCfg_setMbReadPeriod(uint8_t period);
 void NvsFwCfg_getActualFirmwareConfig(FirmwareConfig_t *fwConfig);
 void NvsFwCfg_getNextFirmwareConfig(FirmwareConfig_t *fwConfig);
+uint32_t NvsFwCfg_getNextFirmwareConfigHash();
 bool NvsFwCfg_saveToNvs();
 void NvsFwCfg_setMbParity(uart_parity_t parity);
 void NvsFwCfg_setMbStopBits(uart_stop_bits_t stopBits);
 void NvsFwCfg_setMbDataBits(uart_word_length_t stopBits);
 void NvsFwCfg_setMbBitPosition(int8_t bitPosition);
+bool NvsFwCfg_setMaxRegisters(uint32_t maxRegisters);
+void NvsFwCfg_setPayloadEncoding(PayloadEncoding_t encoding);
+void NvsFwCfg_setCompactKeys(bool compact);
+void NvsFwCfg_setTrimTrailingZeros(bool trim);
+void NvsFwCfg_setAdaptiveInterCmdsDelay(bool adaptive);
+void NvsFwCfg_setLatencyTargetMs(BusPriority_t priority, uint16_t targetMs);
+bool NvsFwCfg_setBusCore(uint8_t bus, uint8_t coreId);
+bool NvsFwCfg_setBusSerial(uint8_t bus, int32_t baudrate, uart_word_length_t dataBits, uart_parity_t parity, uart_stop_bits_t stopBits);
+bool NvsFwCfg_setBusPins(uint8_t bus, uint8_t uartPort, int8_t txPin, int8_t rxPin, int8_t dirPin);
+bool NvsFwCfg_setTcpBus(uint8_t bus, const uint8_t ip[4], uint16_t port, uint8_t connectionsNum, uint8_t depth);
+bool NvsFwCfg_disableBus(uint8_t bus);
 
 #endif
@@ -0,0 +1,78 @@
+#ifndef PAYLOAD_WRITER_H_
+#define PAYLOAD_WRITER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "register_access_data.h"
+#include "json_writer.h"
+#include "cbor_writer.h"
+#include "msgpack_writer.h"
+
+#define REG_VALUE_TEXT_SIZE (2 * MAX_REG_LENGTH + 1) // String registers hold two chars per Modbus register
+
+typedef enum
+{
+    PayloadEncoding_JSON = 0,
+    PayloadEncoding_CBOR = 1,    // base64 encoded, since payloads are sent as strings
+    PayloadEncoding_MSGPACK = 2, // base64 encoded, like CBOR
+} PayloadEncoding_t;
+
+typedef enum
+{
+    RegValueType_NULL,
+    RegValueType_INT,
+    RegValueType_UINT,
+    RegValueType_FLOAT32,
+    RegValueType_FLOAT64,
+    RegValueType_TEXT,
+} RegValueType_t;
+
+// Value of a register in its native width
+typedef struct RegValue_s
+{
+    RegValueType_t type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        float f32;
+        double f64;
+    };
+    char text[REG_VALUE_TEXT_SIZE];
+} RegValue_t;
+
+// Writes an object of register values, either as JSON, as CBOR or as MessagePack
+typedef struct PayloadWriter_s
+{
+    PayloadEncoding_t encoding;
+    const char *wrapKey; // Binary encodings only: if not NULL, base64 is wrapped in a JSON object with this key
+    char *buf;
+    int capacity;
+    JsonWriter_t json;
+    CborWriter_t cbor;
+    MsgpackWriter_t msgpack;
+} PayloadWriter_t;
+
+typedef struct PayloadWriterMark_s
+{
+    JsonWriterMark_t json;
+    CborWriterMark_t cbor;
+    MsgpackWriterMark_t msgpack;
+} PayloadWriterMark_t;
+
+bool PayloadEncoding_isBinary(PayloadEncoding_t encoding);
+const char *PayloadEncoding_name(PayloadEncoding_t encoding);
+
+void PayloadWriter_init(PayloadWriter_t *writer, PayloadEncoding_t encoding, const char *wrapKey, char *buf, int capacity, uint8_t *scratch, int scratchLen);
+void PayloadWriter_key(PayloadWriter_t *writer, const char *key);
+void PayloadWriter_keyId(PayloadWriter_t *writer, uint16_t keyId);
+void PayloadWriter_value(PayloadWriter_t *writer, const RegValue_t *value, const char *jsonValue);
+void PayloadWriter_uint(PayloadWriter_t *writer, uint64_t value);
+void PayloadWriter_null(PayloadWriter_t *writer);
+bool PayloadWriter_overflowed(const PayloadWriter_t *writer);
+PayloadWriterMark_t PayloadWriter_mark(const PayloadWriter_t *writer);
+void PayloadWriter_rollback(PayloadWriter_t *writer, PayloadWriterMark_t mark);
+bool PayloadWriter_finish(PayloadWriter_t *writer);
+
+#endif
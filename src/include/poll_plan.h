@@ -0,0 +1,42 @@
+#ifndef POLL_PLAN_H_
+#define POLL_PLAN_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "known_registers.h"
+#include "mb_buses.h"
+
+#define MAX_BLOCK_REGS_NUM 125 // Max number of registers that can be read with a single FC3/FC4 request
+
+typedef struct PollEntry_s
+{
+    KnownRegHandle_t handle;
+    uint8_t bus;
+    uint8_t readFunction;
+    uint8_t slaveAddr;
+    uint16_t regId;       // First Modbus register
+    uint8_t regNumber;    // Number of Modbus registers
+    uint16_t offset;      // Position of the first Modbus register inside the block
+} PollEntry_t;
+
+typedef struct PollBlock_s
+{
+    uint8_t bus;
+    uint8_t readFunction;
+    uint8_t slaveAddr;
+    uint16_t regId;      // First Modbus register of the block
+    uint16_t regNumber;  // Number of Modbus registers read with the block
+    int firstEntry;      // Index of the first entry of the block
+    int entriesNum;      // Number of entries contained in the block
+} PollBlock_t;
+
+bool PollPlan_init(int maxEntries);
+void PollPlan_clear();
+bool PollPlan_add(KnownRegHandle_t handle, const RegisterPollData_t *poll);
+int PollPlan_build(const uint16_t *maxGapRegs); // Max gap of each bus
+const PollBlock_t *PollPlan_blockAt(int blockIdx);
+const PollEntry_t *PollPlan_entryAt(int entryIdx);
+Seconds_t PollPlan_intervalOf(const RegisterPollData_t *poll, Seconds_t minInterval);
+
+#endif
@@ -45,6 +45,19 @@ typedef struct RegisterAccessData_s
     double factor;
     double offset;
     uint8_t decimals;
+
+    // Polling fields (new fields are appended, so that registers saved by previous versions can still be loaded)
+    Seconds_t pollInterval; // 0: derived from changeCheckInterval or maxPublishDelay
+
+    // Short id used as key in compact payloads, assigned when the register is added and kept when saved to flash. 0: not assigned.
+    uint16_t keyId;
+
+    // Publish on change deadbands, applied to the scaled value of numeric registers. 0: any change is published.
+    double deadbandAbs;
+    double deadbandRel; // Percentage of the latest published value
+
+    // Bus the slave is connected to. Registers saved by previous versions are on the primary bus.
+    uint8_t bus;
 } RegisterAccessData_t;
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef REGISTER_MAP_H_
+#define REGISTER_MAP_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "register_access_data.h"
+
+// Compact format of the register map: a record for each register, separated by ';', with these fields separated by ','
+//   name,readFunction,slaveAddr,regId,type,length,bus,writeFunction,signed,factor,offset,decimals,monitor,
+//   changeCheckInterval,maxPublishDelay,pollInterval,deadbandAbs,deadbandRel,keyId
+// writeFunction is 0 if the register isn't writable. monitor is 0 if the register isn't monitored, 1 if it's monitored
+// periodically, 2 if it's monitored on change. signed is 0 or 1. keyId is 0 if it must be assigned.
+// A record made of a name only, when imported, removes that register.
+#define REGISTER_MAP_RECORDS_SEPARATOR ';'
+#define REGISTER_MAP_FIELDS_SEPARATOR ','
+#define REGISTER_MAP_FIELDS_NUM 19
+#define REGISTER_MAP_MAX_CHUNK_RECORDS 32
+#define REGISTER_MAP_RECORD_MAX_LEN 255
+
+typedef enum
+{
+    RegisterMapRes_OK = 0,
+    RegisterMapRes_INVALID_RECORD,
+    RegisterMapRes_TOO_MANY_RECORDS, // In a chunk
+    RegisterMapRes_FULL,             // More registers than the known registers can hold
+    RegisterMapRes_NO_MEMORY,
+} RegisterMapRes_t;
+
+bool RegisterMap_parseRecord(char *record, RegisterAccessData_t *rad);
+int RegisterMap_formatRecord(const RegisterAccessData_t *rad, char *buf, int bufLen);
+uint32_t RegisterMap_recordHash(const RegisterAccessData_t *rad);
+RegisterMapRes_t RegisterMap_stageChunk(char *chunk, int *invalidRecord);
+int RegisterMap_stagedCount();
+bool RegisterMap_commit(bool replace);
+void RegisterMap_discard();
+
+#endif
@@ -28,4 +28,20 @@
     if (xSemaphoreGive(sem) != pdTRUE) \
         abort();
 
+/**
+ * @brief Take/lock a FreeRTOS recursive mutex blocking on it forever. If it's not possible, abort.
+ * @param sem Recursive mutex to take/lock.
+ */
+#define BLOCKING_RECURSIVE_LOCK_OR_ABORT(sem)                  \
+    if (xSemaphoreTakeRecursive(sem, portMAX_DELAY) != pdTRUE) \
+        abort();
+
+/**
+ * @brief Give/unblock a FreeRTOS recursive mutex. If it's not possible, abort.
+ * @param sem Recursive mutex to give/unlock.
+ */
+#define RECURSIVE_UNLOCK_OR_ABORT(sem)          \
+    if (xSemaphoreGiveRecursive(sem) != pdTRUE) \
+        abort();
+
 #endif
\ No newline at end of file
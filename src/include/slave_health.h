@@ -0,0 +1,35 @@
+#ifndef SLAVE_HEALTH_H_
+#define SLAVE_HEALTH_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "mb_buses.h"
+
+#define SLAVE_FAILURES_TO_BACKOFF 3 // Consecutive unanswered transactions after which a slave is only probed
+#define SLAVE_MIN_BACKOFF_S 2
+#define SLAVE_MAX_BACKOFF_S 300
+
+// Exception responses are answers: only transactions the slave didn't answer (timeouts, I/O and CRC errors) are failures
+typedef struct SlaveHealth_s
+{
+    uint32_t successes;
+    uint32_t exceptions;
+    uint32_t failures;
+    uint16_t consecutiveFailures;
+    int8_t lastError;      // ModbusError of the latest failed transaction
+    uint8_t lastException; // Code of the latest exception response, 0 if none
+    uint8_t backoffExp;    // Backoff doubles at every failed probe
+    bool backingOff;       // Slave is only probed, when its backoff expires
+    int64_t lastAnswerUs;  // 0 if slave never answered
+    int64_t probeAtUs;     // While backing off, time of next probe
+} SlaveHealth_t;
+
+bool SlaveHealth_reset(uint8_t bus);
+void SlaveHealth_record(uint8_t bus, uint8_t slaveAddr, ModbusError result);
+bool SlaveHealth_isBackingOff(uint8_t bus, uint8_t slaveAddr);
+bool SlaveHealth_probeDue(uint8_t bus, uint8_t slaveAddr);
+bool SlaveHealth_answeredSince(uint8_t bus, uint8_t slaveAddr, int64_t sinceUs);
+bool SlaveHealth_get(uint8_t bus, uint8_t slaveAddr, SlaveHealth_t *health);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <string.h>
 #include <stdbool.h>
+#include <inttypes.h>
 
 #define MAX_U16_STR "65535"
 #define MAX_U8_STR "255"
@@ -19,6 +20,10 @@
 #define STREQ(s1, s2) \
     (strcmp(s1, s2) == 0)
 
+// Number of chars (without null char) needed to encode n bytes in base64
+#define BASE64_ENCODED_LEN(n) \
+    ((((n) + 2) / 3) * 4)
+
 typedef enum
 {
     SplitRes_OK,              //< Parsing performed successfully
@@ -30,5 +35,6 @@ SplitRes_t splitInPlace(char *strIn, char separatorIn, char *tokensOut[], int ma
 bool strContainsOnlyDigits(char *string);
 bool strValLessThan(char *string1, char *string2);
 bool strContainsValidDouble(char *string);
+int base64Encode(const uint8_t *data, int dataLen, char *out, int outBuffLen);
 
 #endif
\ No newline at end of file
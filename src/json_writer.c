@@ -0,0 +1,232 @@
+#include "json_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define NUMBER_STRING_LEN 32
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static void append(JsonWriter_t *writer, const char *data, int dataLen)
+{
+    if (writer->overflow)
+        return;
+
+    if (writer->len + dataLen + 1 > writer->capacity)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(&writer->buf[writer->len], data, dataLen);
+    writer->len += dataLen;
+    writer->buf[writer->len] = '\0';
+}
+
+static void appendChar(JsonWriter_t *writer, char c)
+{
+    append(writer, &c, 1);
+}
+
+// Write separator needed before a new item of current container, if any
+static void beginItem(JsonWriter_t *writer)
+{
+    if (writer->afterKey)
+    {
+        writer->afterKey = false;
+        return;
+    }
+
+    const uint16_t depthBit = 1u << writer->depth;
+    if (writer->hasItems & depthBit)
+        appendChar(writer, ',');
+    writer->hasItems |= depthBit;
+}
+
+static void beginContainer(JsonWriter_t *writer, char open)
+{
+    beginItem(writer);
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH)
+    {
+        writer->overflow = true;
+        return;
+    }
+    appendChar(writer, open);
+    writer->depth++;
+    writer->hasItems &= ~(1u << writer->depth);
+}
+
+static void endContainer(JsonWriter_t *writer, char close)
+{
+    if (writer->depth > 0)
+        writer->depth--;
+    appendChar(writer, close);
+}
+
+static void appendEscaped(JsonWriter_t *writer, const char *value)
+{
+    appendChar(writer, '"');
+
+    // Copy runs of characters that don't need escaping at once
+    const char *run = value;
+    for (const char *c = value; *c != '\0' && !writer->overflow; c++)
+    {
+        const unsigned char uc = (unsigned char)*c;
+        if (uc >= 0x20 && uc != '"' && uc != '\\')
+            continue;
+
+        append(writer, run, c - run);
+        run = c + 1;
+
+        char escaped[8];
+        int escapedLen = 0;
+        switch (uc)
+        {
+        case '"':
+            escapedLen = sprintf(escaped, "\\\"");
+            break;
+        case '\\':
+            escapedLen = sprintf(escaped, "\\\\");
+            break;
+        case '\n':
+            escapedLen = sprintf(escaped, "\\n");
+            break;
+        case '\r':
+            escapedLen = sprintf(escaped, "\\r");
+            break;
+        case '\t':
+            escapedLen = sprintf(escaped, "\\t");
+            break;
+        default:
+            escapedLen = sprintf(escaped, "\\u%04x", uc);
+            break;
+        }
+        append(writer, escaped, escapedLen);
+    }
+    append(writer, run, strlen(run));
+
+    appendChar(writer, '"');
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+void JsonWriter_init(JsonWriter_t *writer, char *buf, int capacity)
+{
+    writer->buf = buf;
+    writer->capacity = capacity;
+    writer->len = 0;
+    writer->overflow = capacity < 1;
+    writer->afterKey = false;
+    writer->depth = 0;
+    writer->hasItems = 0;
+    if (capacity > 0)
+        buf[0] = '\0';
+}
+
+void JsonWriter_beginObject(JsonWriter_t *writer)
+{
+    beginContainer(writer, '{');
+}
+
+void JsonWriter_endObject(JsonWriter_t *writer)
+{
+    endContainer(writer, '}');
+}
+
+void JsonWriter_beginArray(JsonWriter_t *writer)
+{
+    beginContainer(writer, '[');
+}
+
+void JsonWriter_endArray(JsonWriter_t *writer)
+{
+    endContainer(writer, ']');
+}
+
+void JsonWriter_key(JsonWriter_t *writer, const char *key)
+{
+    beginItem(writer);
+    appendEscaped(writer, key);
+    appendChar(writer, ':');
+    writer->afterKey = true;
+}
+
+void JsonWriter_string(JsonWriter_t *writer, const char *value)
+{
+    beginItem(writer);
+    appendEscaped(writer, value);
+}
+
+void JsonWriter_raw(JsonWriter_t *writer, const char *value)
+{
+    beginItem(writer);
+    append(writer, value, strlen(value));
+}
+
+void JsonWriter_int(JsonWriter_t *writer, int64_t value)
+{
+    char numberString[NUMBER_STRING_LEN];
+    const int numberLen = snprintf(numberString, NUMBER_STRING_LEN, "%" PRIi64, value);
+    beginItem(writer);
+    append(writer, numberString, numberLen);
+}
+
+void JsonWriter_uint(JsonWriter_t *writer, uint64_t value)
+{
+    char numberString[NUMBER_STRING_LEN];
+    const int numberLen = snprintf(numberString, NUMBER_STRING_LEN, "%" PRIu64, value);
+    beginItem(writer);
+    append(writer, numberString, numberLen);
+}
+
+void JsonWriter_double(JsonWriter_t *writer, double value, uint8_t decimals)
+{
+    char numberString[NUMBER_STRING_LEN];
+    const int numberLen = snprintf(numberString, NUMBER_STRING_LEN, "%.*f", decimals, value);
+    beginItem(writer);
+    if (numberLen >= NUMBER_STRING_LEN)
+        writer->overflow = true;
+    else
+        append(writer, numberString, numberLen);
+}
+
+void JsonWriter_bool(JsonWriter_t *writer, bool value)
+{
+    JsonWriter_raw(writer, value ? "true" : "false");
+}
+
+void JsonWriter_null(JsonWriter_t *writer)
+{
+    JsonWriter_raw(writer, "null");
+}
+
+bool JsonWriter_overflowed(const JsonWriter_t *writer)
+{
+    return writer->overflow;
+}
+
+int JsonWriter_length(const JsonWriter_t *writer)
+{
+    return writer->len;
+}
+
+JsonWriterMark_t JsonWriter_mark(const JsonWriter_t *writer)
+{
+    const JsonWriterMark_t mark = {
+        .len = writer->len,
+        .afterKey = writer->afterKey,
+        .depth = writer->depth,
+        .hasItems = writer->hasItems,
+    };
+    return mark;
+}
+
+void JsonWriter_rollback(JsonWriter_t *writer, JsonWriterMark_t mark)
+{
+    writer->len = mark.len;
+    writer->afterKey = mark.afterKey;
+    writer->depth = mark.depth;
+    writer->hasItems = mark.hasItems;
+    writer->overflow = false;
+    writer->buf[writer->len] = '\0';
+}
@@ -1,308 +1,1041 @@
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <assert.h>
 
-#include <sys/queue.h>
-
 #include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 
 #include "known_registers.h"
+#include "sem_utils.h"
 #include "str_utils.h"
+#include "decode_plan.h"
+#include "mb_buses.h"
+#include "register_map.h"
 
-// BEGIN ----------------------------------------------- QUEUE TYPES DEFINITIONS -----------------------------------------------------------
-
-#define MAX_LATEST_PUBLISHED_SIZE 24
+// BEGIN ----------------------------------------------- SLOTS TYPES DEFINITIONS -----------------------------------------------------------
 
+// Details of a register that the monitoring task doesn't access at every period. They can be kept in external RAM.
 typedef struct Slot_s
 {
     // Register details (saved to flash)
     RegisterAccessData_t rad;
 
+    uint32_t recordHash; // Contribution of the register to mapHash, updated every time its details change
+} Slot_t;
+
+// Details of a register that the monitoring task accesses at every period. They're always kept in internal RAM.
+typedef struct HotSlot_s
+{
+    // Copies of the register details needed for polling and publishing, with the latest published value
+    RegisterPollData_t poll;
+    RegisterPublishData_t publish;
+
     // Current execution details (NOT saved to flash)
-    char latestPublishedValue[MAX_LATEST_PUBLISHED_SIZE];
-    Seconds_t latestPublishSec;
-    bool mustPublish;
+    Seconds_t nextPollSec;
+    uint8_t refusedReads; // Consecutive reads that failed while the slave was answering
+    bool quarantined;     // Slave refuses reads of the register: it's no longer polled
 
-    // Structure holding pointers to other elements of the queue
-    STAILQ_ENTRY(Slot_s)
-    ptrs;
-} Slot_t;
+    // Latest value read from the slave, by polling or on request, and start time of its read (0 if none)
+    uint16_t cachedRaw[MAX_REG_LENGTH];
+    int64_t cachedReadUs;
+    int64_t invalidatedUs; // Values read before this time may be older than a write, or than the register's details
+} HotSlot_t;
+
+#define BUCKET_EMPTY (-1)
+#define BUCKET_DELETED (-2)
+
+typedef struct HashIndex_s
+{
+    KnownRegHandle_t *buckets;
+    uint32_t bucketsNum; // Power of two, at least twice the max number of registers, so that probing sequences stay short
+    int tombstonesNum;
+} HashIndex_t;
+
+#define SLAVES_NUM 256
 
-typedef STAILQ_HEAD(SlotsQueue_s, Slot_s) SlotsQueue_t;
+#ifdef CONFIG_GW_MASTER_MODBUS_REGISTERS_IN_PSRAM
+#define SLOTS_MEMORY_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define SLOTS_MEMORY_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#endif
+#define HOT_MEMORY_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
 
 // BEGIN --------------------------------------------------- STATIC DECLARATIONS -----------------------------------------------------------
 
-// Queues
-static SlotsQueue_t availableSlots;
-static SlotsQueue_t inUseSlots;
+static const char *TAG = "known_registers";
+
+// Max number of registers, set at initialization
+static int maxRegistersNum = 0;
+
+// Memory pools, allocated at initialization. The handle of a register is the position of its slots in the pools, and never changes
+// while the register exists.
+static Slot_t *slotsMemoryPool = NULL;
+static HotSlot_t *hotSlotsMemoryPool = NULL;
+
+// Handles of registers in use, densely packed in insertion order, so that the idx-th register is found in constant time
+static KnownRegHandle_t *inUseSlots = NULL;
+static int inUseSlotsNum = 0;
+
+// Position in inUseSlots of each slot of the pool, or -1 if slot is available
+static KnownRegHandle_t *slotsPositions = NULL;
+
+// Stack of handles of available slots
+static KnownRegHandle_t *availableSlots = NULL;
+static int availableSlotsNum = 0;
+
+// Open addressing hash indexes (linear probing), by name and by Modbus details. Buckets contain handles of registers.
+static HashIndex_t nameIndex;
+static HashIndex_t modbusIndex;
+
+// Hash index of registers by key id, and next key id to assign, so that ids of removed registers are not reused soon
+static HashIndex_t keyIdIndex;
+static uint16_t nextKeyId = 1;
+
+// Version of the key id -> name dictionary: XOR of the hashes of its entries, so that it's updated in constant time
+static uint32_t keysVersion = 0;
+
+// Fingerprint of the register map: XOR of the hashes of the records of its registers, updated in constant time like keysVersion
+static uint32_t mapHash = 0;
+
+// Lists of the registers of each slave of each bus, linked through handles
+#define SLAVE_LIST(bus, slaveAddr) ((bus) * SLAVES_NUM + (slaveAddr))
+static KnownRegHandle_t slavesHeads[MB_BUSES_NUM * SLAVES_NUM];
+static KnownRegHandle_t slavesTails[MB_BUSES_NUM * SLAVES_NUM];
+static int slavesCounts[MB_BUSES_NUM * SLAVES_NUM];
+static KnownRegHandle_t *slavesNext = NULL;
+static KnownRegHandle_t *slavesPrev = NULL;
+
+// Incremented every time a register is added, removed or reconfigured
+static uint32_t generation = 0;
 
-// Raw static memory allocation
-static Slot_t slotsMemoryPool[MAX_REGISTERS_NUM];
+// Word order of multi-register values (0: msb first, 1: lsb first), used to build decode plans
+static uint8_t wordOrder = 0;
 
-// BEGIN ---------------------------------------------------- QUEUES FUNCTIONS --------------------------------------------------------------
+// Protects registers from concurrent access by the monitoring task and cloud callbacks. It's recursive, so that visitors
+// can call other functions of this module.
+static SemaphoreHandle_t registryMutex = NULL;
+static StaticSemaphore_t registryMutexBuffer;
 
-static void queuePush(SlotsQueue_t *queue, Slot_t *element)
+// BEGIN ------------------------------------------------- HASH INDEXES FUNCTIONS ----------------------------------------------------------
+
+typedef struct ModbusKey_s
+{
+    uint8_t bus;
+    uint8_t readFunction;
+    uint8_t slaveAddr;
+    uint16_t regId;
+} ModbusKey_t;
+
+typedef bool (*IndexMatch_t)(KnownRegHandle_t handle, const void *key);
+
+static uint32_t nameHash(const char *regName)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char *c = regName; *c != '\0'; c++)
+    {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t modbusHash(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId)
+{
+    // Murmur3 finalizer
+    uint32_t hash = (((uint32_t)bus * 8 + readFunction) << 24) | ((uint32_t)slaveAddr << 16) | regId;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static uint32_t keyIdHash(uint32_t keyId)
+{
+    // Murmur3 finalizer
+    uint32_t hash = keyId;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static uint32_t dictionaryEntryHash(const RegisterAccessData_t *rad)
 {
-    STAILQ_INSERT_TAIL(queue, element, ptrs);
+    return keyIdHash(nameHash(rad->regName) + rad->keyId);
 }
 
-static Slot_t *queueRemove(SlotsQueue_t *queue, char *regName)
+static bool nameMatches(KnownRegHandle_t handle, const void *key)
 {
-    Slot_t *slot = NULL;
-    STAILQ_FOREACH(slot, queue, ptrs)
+    return STREQ(slotsMemoryPool[handle].rad.regName, (const char *)key);
+}
+
+static bool modbusMatches(KnownRegHandle_t handle, const void *key)
+{
+    const RegisterAccessData_t *rad = &slotsMemoryPool[handle].rad;
+    const ModbusKey_t *mbKey = (const ModbusKey_t *)key;
+    return rad->bus == mbKey->bus && rad->readFunction == mbKey->readFunction && rad->slaveAddr == mbKey->slaveAddr && rad->regId == mbKey->regId;
+}
+
+static bool keyIdMatches(KnownRegHandle_t handle, const void *key)
+{
+    return slotsMemoryPool[handle].rad.keyId == *(const uint16_t *)key;
+}
+
+static void indexClear(HashIndex_t *index)
+{
+    for (uint32_t i = 0; i < index->bucketsNum; i++)
+        index->buckets[i] = BUCKET_EMPTY;
+    index->tombstonesNum = 0;
+}
+
+static KnownRegHandle_t indexFind(const HashIndex_t *index, uint32_t hash, IndexMatch_t match, const void *key)
+{
+    for (uint32_t probe = 0; probe < index->bucketsNum; probe++)
     {
-        if (STREQ(slot->rad.regName, regName))
+        const KnownRegHandle_t handle = index->buckets[(hash + probe) & (index->bucketsNum - 1)];
+        if (handle == BUCKET_EMPTY)
             break;
+        if (handle != BUCKET_DELETED && match(handle, key))
+            return handle;
     }
+    return INVALID_REG_HANDLE;
+}
 
-    if (slot != NULL)
-        STAILQ_REMOVE(queue, slot, Slot_s, ptrs);
-    return slot;
+static void indexInsert(HashIndex_t *index, uint32_t hash, KnownRegHandle_t handle)
+{
+    for (uint32_t probe = 0; probe < index->bucketsNum; probe++)
+    {
+        KnownRegHandle_t *bucket = &index->buckets[(hash + probe) & (index->bucketsNum - 1)];
+        if (*bucket == BUCKET_EMPTY || *bucket == BUCKET_DELETED)
+        {
+            if (*bucket == BUCKET_DELETED)
+                index->tombstonesNum--;
+            *bucket = handle;
+            return;
+        }
+    }
+    assert(false); // Index has at least twice the buckets than registers, so it can't be full
 }
 
-static bool queueIsEmpty(SlotsQueue_t *queue)
+static void indexRemove(HashIndex_t *index, uint32_t hash, KnownRegHandle_t handle)
 {
-    return STAILQ_EMPTY(queue);
+    for (uint32_t probe = 0; probe < index->bucketsNum; probe++)
+    {
+        KnownRegHandle_t *bucket = &index->buckets[(hash + probe) & (index->bucketsNum - 1)];
+        if (*bucket == BUCKET_EMPTY)
+            return;
+        if (*bucket == handle)
+        {
+            *bucket = BUCKET_DELETED;
+            index->tombstonesNum++;
+            return;
+        }
+    }
 }
 
-static Slot_t *queuePop(SlotsQueue_t *queue)
+static void indexesInsert(KnownRegHandle_t handle)
 {
-    Slot_t *slot = STAILQ_FIRST(queue);
-    if (slot != NULL)
-        STAILQ_REMOVE_HEAD(queue, ptrs);
-    return slot;
+    const RegisterAccessData_t *rad = &slotsMemoryPool[handle].rad;
+    indexInsert(&nameIndex, nameHash(rad->regName), handle);
+    indexInsert(&modbusIndex, modbusHash(rad->bus, rad->readFunction, rad->slaveAddr, rad->regId), handle);
+    indexInsert(&keyIdIndex, keyIdHash(rad->keyId), handle);
 }
 
-static int queueSize(SlotsQueue_t *queue)
+// Rebuild indexes from scratch, to get rid of deleted buckets that make probing longer
+static void indexesRebuild()
 {
-    int size = 0;
-    Slot_t *slot = NULL;
-    STAILQ_FOREACH(slot, queue, ptrs)
+    indexClear(&nameIndex);
+    indexClear(&modbusIndex);
+    indexClear(&keyIdIndex);
+    for (int i = 0; i < inUseSlotsNum; i++)
+        indexesInsert(inUseSlots[i]);
+}
+
+static void indexesRemove(KnownRegHandle_t handle)
+{
+    const RegisterAccessData_t *rad = &slotsMemoryPool[handle].rad;
+    indexRemove(&nameIndex, nameHash(rad->regName), handle);
+    indexRemove(&modbusIndex, modbusHash(rad->bus, rad->readFunction, rad->slaveAddr, rad->regId), handle);
+    indexRemove(&keyIdIndex, keyIdHash(rad->keyId), handle);
+}
+
+static void slavesListAppend(KnownRegHandle_t handle)
+{
+    const int slaveAddr = SLAVE_LIST(slotsMemoryPool[handle].rad.bus, slotsMemoryPool[handle].rad.slaveAddr);
+    slavesNext[handle] = INVALID_REG_HANDLE;
+    slavesPrev[handle] = slavesTails[slaveAddr];
+    if (slavesTails[slaveAddr] != INVALID_REG_HANDLE)
+        slavesNext[slavesTails[slaveAddr]] = handle;
+    else
+        slavesHeads[slaveAddr] = handle;
+    slavesTails[slaveAddr] = handle;
+    slavesCounts[slaveAddr]++;
+}
+
+static void slavesListRemove(KnownRegHandle_t handle)
+{
+    const int slaveAddr = SLAVE_LIST(slotsMemoryPool[handle].rad.bus, slotsMemoryPool[handle].rad.slaveAddr);
+    if (slavesPrev[handle] != INVALID_REG_HANDLE)
+        slavesNext[slavesPrev[handle]] = slavesNext[handle];
+    else
+        slavesHeads[slaveAddr] = slavesNext[handle];
+    if (slavesNext[handle] != INVALID_REG_HANDLE)
+        slavesPrev[slavesNext[handle]] = slavesPrev[handle];
+    else
+        slavesTails[slaveAddr] = slavesPrev[handle];
+    slavesCounts[slaveAddr]--;
+}
+
+static void slavesListsClear()
+{
+    for (int i = 0; i < MB_BUSES_NUM * SLAVES_NUM; i++)
     {
-        size++;
+        slavesHeads[i] = INVALID_REG_HANDLE;
+        slavesTails[i] = INVALID_REG_HANDLE;
+        slavesCounts[i] = 0;
     }
-    return size;
 }
 
-static RegisterAccessData_t *queueFind(SlotsQueue_t *queue, char *regName)
+// BEGIN ------------------------------------------------- SLOTS TABLE FUNCTIONS -----------------------------------------------------------
+
+static Slot_t *tableSlotAt(int idx)
+{
+    if (idx < 0 || idx >= inUseSlotsNum)
+        return NULL;
+    return &slotsMemoryPool[inUseSlots[idx]];
+}
+
+static HotSlot_t *tableHotSlotAt(int idx)
 {
-    Slot_t *slot = NULL;
-    STAILQ_FOREACH(slot, queue, ptrs)
+    if (idx < 0 || idx >= inUseSlotsNum)
+        return NULL;
+    return &hotSlotsMemoryPool[inUseSlots[idx]];
+}
+
+static KnownRegHandle_t tableFindHandle(const char *regName)
+{
+    return indexFind(&nameIndex, nameHash(regName), nameMatches, regName);
+}
+
+static RegisterAccessData_t *tableAt(int idx)
+{
+    Slot_t *slot = tableSlotAt(idx);
+    return slot != NULL ? &slot->rad : NULL;
+}
+
+static int tableFindIdx(const char *regName)
+{
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    if (handle == INVALID_REG_HANDLE)
+        return -1;
+    return slotsPositions[handle];
+}
+
+static RegisterAccessData_t *tableFind(const char *regName)
+{
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    return handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
+}
+
+// Must be called every time the details of a register change, to keep the copies used for polling and publishing up to date
+static void tableRegisterChanged(KnownRegHandle_t handle, bool reschedule)
+{
+    const RegisterAccessData_t *rad = &slotsMemoryPool[handle].rad;
+    HotSlot_t *hotSlot = &hotSlotsMemoryPool[handle];
+    RegisterPollData_t *poll = &hotSlot->poll;
+    RegisterPublishData_t *publish = &hotSlot->publish;
+    const DecodePlan_t previousPlan = publish->decodePlan;
+    poll->bus = rad->bus;
+    poll->regId = rad->regId;
+    poll->slaveAddr = rad->slaveAddr;
+    poll->readFunction = rad->readFunction;
+    poll->regNumber = rad->regNumber;
+    poll->monitored = rad->monitored;
+    poll->publishOnChange = rad->publishOnChange;
+    poll->changeCheckInterval = rad->changeCheckInterval;
+    poll->maxPublishDelay = rad->maxPublishDelay;
+    poll->pollInterval = rad->pollInterval;
+    memcpy(publish->regName, rad->regName, sizeof(publish->regName));
+    publish->keyId = rad->keyId;
+    publish->deadbandAbs = rad->deadbandAbs;
+    publish->deadbandRel = rad->deadbandRel;
+    DecodePlan_build(&publish->decodePlan, rad, wordOrder);
+
+    // Once decoded differently, the latest published value is out of date even if the slave's words don't change: it's published
+    // again at next read, and compared with new values in the new scale meanwhile
+    if (!DecodePlan_equals(&previousPlan, &publish->decodePlan))
     {
-        if (STREQ(slot->rad.regName, regName))
-            return &slot->rad;
+        publish->latestPublishedNumber = DecodePlan_scaled(&publish->decodePlan, publish->latestPublishedRaw);
+        publish->mustPublish = true;
     }
-    return NULL;
+
+    hotSlot->cachedReadUs = 0;
+    hotSlot->invalidatedUs = esp_timer_get_time();
+
+    // Reconfigured registers get another chance
+    hotSlot->refusedReads = 0;
+    hotSlot->quarantined = false;
+
+    if (reschedule)
+        hotSlot->nextPollSec = 0; // Apply new polling settings immediately
+
+    mapHash ^= slotsMemoryPool[handle].recordHash;
+    slotsMemoryPool[handle].recordHash = RegisterMap_recordHash(rad);
+    mapHash ^= slotsMemoryPool[handle].recordHash;
+    generation++;
+}
+
+static KnownRegHandle_t tableFindHandleByModbus(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId)
+{
+    const ModbusKey_t key = {.bus = bus, .readFunction = readFunction, .slaveAddr = slaveAddr, .regId = regId};
+    return indexFind(&modbusIndex, modbusHash(bus, readFunction, slaveAddr, regId), modbusMatches, &key);
+}
+
+static RegisterAccessData_t *tableFindByModbus(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId)
+{
+    const KnownRegHandle_t handle = tableFindHandleByModbus(bus, readFunction, slaveAddr, regId);
+    if (handle == INVALID_REG_HANDLE)
+        return NULL;
+    return &slotsMemoryPool[handle].rad;
+}
+
+static bool tableKeyIdInUse(uint16_t keyId)
+{
+    return indexFind(&keyIdIndex, keyIdHash(keyId), keyIdMatches, &keyId) != INVALID_REG_HANDLE;
+}
+
+// Key id for a new register: the one it was saved with, unless it's not assigned or already used by another register
+static uint16_t tableAssignKeyId(uint16_t savedKeyId)
+{
+    uint16_t keyId = savedKeyId;
+    while (keyId == 0 || tableKeyIdInUse(keyId))
+        keyId = nextKeyId++;
+    if (keyId >= nextKeyId)
+        nextKeyId = keyId + 1;
+    return keyId;
 }
 
-static RegisterAccessData_t *queueFindByModbus(SlotsQueue_t *queue, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId)
+// Remove the idx-th register, keeping the others in insertion order
+static void tableRemoveAt(int idx)
 {
-    Slot_t *slot = NULL;
-    STAILQ_FOREACH(slot, queue, ptrs)
+    const KnownRegHandle_t handle = inUseSlots[idx];
+    keysVersion ^= dictionaryEntryHash(&slotsMemoryPool[handle].rad);
+    mapHash ^= slotsMemoryPool[handle].recordHash;
+    indexesRemove(handle);
+    slavesListRemove(handle);
+    for (int i = idx; i < inUseSlotsNum - 1; i++)
     {
-        if (slot->rad.readFunction == readFunction && slot->rad.slaveAddr == slaveAddr && slot->rad.regId == regId)
-            return &slot->rad;
+        inUseSlots[i] = inUseSlots[i + 1];
+        slotsPositions[inUseSlots[i]] = i;
     }
-    return NULL;
+    inUseSlotsNum--;
+    slotsPositions[handle] = -1;
+    availableSlots[availableSlotsNum++] = handle;
+
+    if (nameIndex.tombstonesNum > nameIndex.bucketsNum / 4 || modbusIndex.tombstonesNum > modbusIndex.bucketsNum / 4 ||
+        keyIdIndex.tombstonesNum > keyIdIndex.bucketsNum / 4)
+        indexesRebuild();
 }
 
-static RegisterAccessData_t *queueAt(SlotsQueue_t *queue, int idx)
+static bool importContains(const RegisterAccessData_t *rads, int radsNum, const char *regName)
 {
-    Slot_t *slot = STAILQ_FIRST(queue);
-    for (int i = 0; slot != NULL; i++)
+    for (int i = 0; i < radsNum; i++)
     {
-        if (i == idx)
-            return &slot->rad;
-        slot = STAILQ_NEXT(slot, ptrs);
+        if (strncmp(rads[i].regName, regName, MAX_REG_NAME_SIZE) == 0)
+            return true;
     }
-    return NULL;
+    return false;
 }
 
-static Slot_t *queueSlotAt(SlotsQueue_t *queue, int idx)
+static bool importRemoves(const char (*removedNames)[MAX_REG_NAME_SIZE], int removedNum, const char *regName)
 {
-    Slot_t *slot = STAILQ_FIRST(queue);
-    for (int i = 0; slot != NULL; i++)
+    for (int i = 0; i < removedNum; i++)
     {
-        if (i == idx)
-            return slot;
-        slot = STAILQ_NEXT(slot, ptrs);
+        if (strncmp(removedNames[i], regName, MAX_REG_NAME_SIZE) == 0)
+            return true;
     }
-    return NULL;
+    return false;
+}
+
+// Imported registers must not clash with each other, nor with the known registers they don't replace or remove, and they
+// must fit
+static bool importIsConsistent(const RegisterAccessData_t *rads, int radsNum, const char (*removedNames)[MAX_REG_NAME_SIZE], int removedNum,
+                               bool replace)
+{
+    int replacedNum = 0;
+    for (int i = 0; i < removedNum && !replace; i++)
+    {
+        if (importContains(rads, radsNum, removedNames[i]) || importRemoves(removedNames, i, removedNames[i]))
+            return false;
+        if (tableFind(removedNames[i]) != NULL)
+            replacedNum++;
+    }
+    for (int i = 0; i < radsNum; i++)
+    {
+        const RegisterAccessData_t *rad = &rads[i];
+        if (rad->bus >= MB_BUSES_NUM || importContains(rads, i, rad->regName))
+            return false;
+        for (int j = 0; j < i; j++)
+        {
+            if (rads[j].bus == rad->bus && rads[j].readFunction == rad->readFunction && rads[j].slaveAddr == rad->slaveAddr && rads[j].regId == rad->regId)
+                return false;
+        }
+        if (replace)
+            continue;
+
+        if (tableFind(rad->regName) != NULL)
+            replacedNum++;
+        const RegisterAccessData_t *clash = tableFindByModbus(rad->bus, rad->readFunction, rad->slaveAddr, rad->regId);
+        if (clash != NULL && !importContains(rads, radsNum, clash->regName) && !importRemoves(removedNames, removedNum, clash->regName))
+            return false;
+    }
+    const int resultingNum = (replace ? 0 : inUseSlotsNum - replacedNum) + radsNum;
+    return resultingNum <= maxRegistersNum;
 }
 
 // BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
 
-void KnownRegisters_init()
+static void *allocArray(int num, size_t size, uint32_t caps)
+{
+    return heap_caps_calloc(num, size, caps);
+}
+
+static uint32_t bucketsNumFor(int registersNum)
+{
+    uint32_t bucketsNum = 1;
+    while (bucketsNum < 2 * (uint32_t)registersNum)
+        bucketsNum <<= 1;
+    return bucketsNum;
+}
+
+bool KnownRegisters_init(int maxRegisters)
 {
-    STAILQ_INIT(&availableSlots);
-    STAILQ_INIT(&inUseSlots);
+    if (maxRegisters < 1 || maxRegisters > MAX_REGISTERS_LIMIT)
+        return false;
+
+    if (registryMutex == NULL)
+    {
+        registryMutex = xSemaphoreCreateRecursiveMutexStatic(&registryMutexBuffer);
+        configASSERT(registryMutex != NULL);
+    }
+
+    // Allocate new memory before releasing the old one, so that the previous capacity is kept if allocation fails
+    const uint32_t bucketsNum = bucketsNumFor(maxRegisters);
+    Slot_t *newSlots = allocArray(maxRegisters, sizeof(Slot_t), SLOTS_MEMORY_CAPS);
+    HotSlot_t *newHotSlots = allocArray(maxRegisters, sizeof(HotSlot_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newInUse = allocArray(maxRegisters, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newPositions = allocArray(maxRegisters, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newAvailable = allocArray(maxRegisters, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newSlavesNext = allocArray(maxRegisters, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newSlavesPrev = allocArray(maxRegisters, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newNameBuckets = allocArray(bucketsNum, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newModbusBuckets = allocArray(bucketsNum, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+    KnownRegHandle_t *newKeyIdBuckets = allocArray(bucketsNum, sizeof(KnownRegHandle_t), HOT_MEMORY_CAPS);
+
+    if (newSlots == NULL || newHotSlots == NULL || newInUse == NULL || newPositions == NULL || newAvailable == NULL ||
+        newSlavesNext == NULL || newSlavesPrev == NULL || newNameBuckets == NULL || newModbusBuckets == NULL ||
+        newKeyIdBuckets == NULL)
+    {
+        heap_caps_free(newSlots);
+        heap_caps_free(newHotSlots);
+        heap_caps_free(newInUse);
+        heap_caps_free(newPositions);
+        heap_caps_free(newAvailable);
+        heap_caps_free(newSlavesNext);
+        heap_caps_free(newSlavesPrev);
+        heap_caps_free(newNameBuckets);
+        heap_caps_free(newModbusBuckets);
+        heap_caps_free(newKeyIdBuckets);
+        ESP_LOGE(TAG, "Can't allocate memory for %d registers", maxRegisters);
+        return false;
+    }
 
-    for (int i = 0; i < MAX_REGISTERS_NUM; i++)
-        queuePush(&availableSlots, &slotsMemoryPool[i]);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+
+    heap_caps_free(slotsMemoryPool);
+    heap_caps_free(hotSlotsMemoryPool);
+    heap_caps_free(inUseSlots);
+    heap_caps_free(slotsPositions);
+    heap_caps_free(availableSlots);
+    heap_caps_free(slavesNext);
+    heap_caps_free(slavesPrev);
+    heap_caps_free(nameIndex.buckets);
+    heap_caps_free(modbusIndex.buckets);
+    heap_caps_free(keyIdIndex.buckets);
+
+    maxRegistersNum = maxRegisters;
+    slotsMemoryPool = newSlots;
+    hotSlotsMemoryPool = newHotSlots;
+    inUseSlots = newInUse;
+    slotsPositions = newPositions;
+    availableSlots = newAvailable;
+    slavesNext = newSlavesNext;
+    slavesPrev = newSlavesPrev;
+    nameIndex.buckets = newNameBuckets;
+    nameIndex.bucketsNum = bucketsNum;
+    modbusIndex.buckets = newModbusBuckets;
+    modbusIndex.bucketsNum = bucketsNum;
+    keyIdIndex.buckets = newKeyIdBuckets;
+    keyIdIndex.bucketsNum = bucketsNum;
+
+    inUseSlotsNum = 0;
+    availableSlotsNum = 0;
+
+    // Push handles in reverse order, so that the first ones are used first
+    for (int i = maxRegistersNum - 1; i >= 0; i--)
+    {
+        slotsPositions[i] = -1;
+        availableSlots[availableSlotsNum++] = i;
+    }
+
+    indexClear(&nameIndex);
+    indexClear(&modbusIndex);
+    indexClear(&keyIdIndex);
+    slavesListsClear();
+    keysVersion = 0;
+    mapHash = 0;
+    generation++;
+
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return true;
+}
+
+int KnownRegisters_capacity()
+{
+    return maxRegistersNum;
 }
 
 void KnownRegisters_clear()
 {
-    Slot_t *slot = NULL;
-    while (!queueIsEmpty(&inUseSlots))
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    while (inUseSlotsNum > 0)
     {
-        slot = queuePop(&inUseSlots);
-        queuePush(&availableSlots, slot);
+        const KnownRegHandle_t handle = inUseSlots[--inUseSlotsNum];
+        slotsPositions[handle] = -1;
+        availableSlots[availableSlotsNum++] = handle;
     }
+    indexClear(&nameIndex);
+    indexClear(&modbusIndex);
+    indexClear(&keyIdIndex);
+    slavesListsClear();
+    keysVersion = 0;
+    mapHash = 0;
+    generation++;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
 }
 
 bool KnownRegisters_remove(char *regName)
 {
-    Slot_t *slot = queueRemove(&inUseSlots, regName);
-    if (slot == NULL)
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const int idx = tableFindIdx(regName);
+    if (idx < 0)
+    {
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return false;
-    queuePush(&availableSlots, slot);
+    }
+    tableRemoveAt(idx);
+    generation++;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return true;
 }
 
 bool KnownRegisters_add(const RegisterAccessData_t *rad)
 {
-    if (queueFind(&inUseSlots, rad->regName) != NULL || queueFindByModbus(&inUseSlots, rad->readFunction, rad->slaveAddr, rad->regId) != NULL)
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    if (rad->bus >= MB_BUSES_NUM || tableFind(rad->regName) != NULL || tableFindByModbus(rad->bus, rad->readFunction, rad->slaveAddr, rad->regId) != NULL)
+    {
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return false;
+    }
 
-    Slot_t *slot = queuePop(&availableSlots);
-    if (slot == NULL)
+    if (availableSlotsNum == 0)
+    {
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return false;
+    }
+    const KnownRegHandle_t handle = availableSlots[--availableSlotsNum];
+
+    Slot_t *slot = &slotsMemoryPool[handle];
     slot->rad = *rad;
-    queuePush(&inUseSlots, slot);
+    slot->rad.keyId = tableAssignKeyId(rad->keyId);
+    slot->recordHash = 0; // Set by tableRegisterChanged
+    keysVersion ^= dictionaryEntryHash(&slot->rad);
+
+    // Nothing was published yet: the register is published at its first read, not because its plan was built
+    RegisterPublishData_t *publish = &hotSlotsMemoryPool[handle].publish;
+    memset(publish, 0, sizeof(*publish));
+    DecodePlan_build(&publish->decodePlan, &slot->rad, wordOrder);
+
+    slotsPositions[handle] = inUseSlotsNum;
+    inUseSlots[inUseSlotsNum++] = handle;
+    indexesInsert(handle);
+    slavesListAppend(handle);
+    tableRegisterChanged(handle, true);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return true;
 }
 
+// Add many registers at once: all of them, or none if any is invalid or clashes. If replace is set, they replace all known
+// registers; otherwise they replace the known registers with the same names, the ones named in removedNames are removed (if
+// known), and the others are kept. Replaced registers keep their key id, unless the imported ones have their own.
+bool KnownRegisters_import(const RegisterAccessData_t *rads, int radsNum, const char (*removedNames)[MAX_REG_NAME_SIZE], int removedNum,
+                           bool replace)
+{
+    uint16_t *keyIds = calloc(radsNum > 0 ? radsNum : 1, sizeof(uint16_t));
+    if (keyIds == NULL)
+        return false;
+
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    if (!importIsConsistent(rads, radsNum, removedNames, removedNum, replace))
+    {
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        free(keyIds);
+        return false;
+    }
+
+    // Replaced registers are removed before any is added, since they may clash with imported registers that come first
+    if (replace)
+        KnownRegisters_clear();
+    for (int i = 0; i < removedNum && !replace; i++)
+    {
+        const int idx = tableFindIdx(removedNames[i]);
+        if (idx >= 0)
+            tableRemoveAt(idx);
+    }
+    for (int i = 0; i < radsNum && !replace; i++)
+    {
+        const int idx = tableFindIdx(rads[i].regName);
+        if (idx < 0)
+            continue;
+        keyIds[i] = tableAt(idx)->keyId;
+        tableRemoveAt(idx);
+    }
+    for (int i = 0; i < radsNum; i++)
+    {
+        RegisterAccessData_t rad = rads[i];
+        if (rad.keyId == 0)
+            rad.keyId = keyIds[i];
+        if (!KnownRegisters_add(&rad))
+            abort(); // Checked above
+    }
+    generation++;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    free(keyIds);
+    return true;
+}
+
+uint32_t KnownRegisters_getGeneration()
+{
+    return generation;
+}
+
+uint32_t KnownRegisters_getKeysVersion()
+{
+    return keysVersion;
+}
+
+uint32_t KnownRegisters_getMapHash()
+{
+    return mapHash;
+}
+
 int KnownRegisters_count()
 {
-    return queueSize(&inUseSlots);
+    return inUseSlotsNum;
+}
+
+KnownRegHandle_t KnownRegisters_handleOf(const char *regName)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t res = tableFindHandle(regName);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return res;
+}
+
+KnownRegHandle_t KnownRegisters_handleAt(int idx)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    if (idx < 0 || idx >= inUseSlotsNum)
+    {
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return INVALID_REG_HANDLE;
+    }
+    const KnownRegHandle_t res = inUseSlots[idx];
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return res;
+}
+
+int KnownRegisters_indexOf(KnownRegHandle_t handle)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    if (handle < 0 || handle >= maxRegistersNum)
+    {
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return -1;
+    }
+    const int res = slotsPositions[handle];
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return res;
+}
+
+int KnownRegisters_countOfSlave(uint8_t bus, uint8_t slaveAddr)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const int res = slavesCounts[SLAVE_LIST(bus, slaveAddr)];
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return res;
+}
+
+int KnownRegisters_handlesOfSlave(uint8_t bus, uint8_t slaveAddr, KnownRegHandle_t *handlesOut, int maxHandles)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    int handlesNum = 0;
+    for (KnownRegHandle_t handle = slavesHeads[SLAVE_LIST(bus, slaveAddr)]; handle != INVALID_REG_HANDLE && handlesNum < maxHandles; handle = slavesNext[handle])
+        handlesOut[handlesNum++] = handle;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return handlesNum;
 }
 
 bool KnownRegisters_find(char *regName, RegisterAccessData_t *radOut)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
     if (rad != NULL)
     {
         *radOut = *rad;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
-bool KnownRegisters_findByModbus(uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, RegisterAccessData_t *radOut)
+bool KnownRegisters_findByModbus(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, RegisterAccessData_t *radOut)
 {
-    RegisterAccessData_t *rad = queueFindByModbus(&inUseSlots, readFunction, slaveAddr, regId);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    RegisterAccessData_t *rad = tableFindByModbus(bus, readFunction, slaveAddr, regId);
     if (rad != NULL)
     {
         *radOut = *rad;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setMonitored(char *regName, bool monitored)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
-    if (rad != NULL)
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    Slot_t *slot = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle] : NULL;
+    if (slot != NULL)
     {
-        rad->monitored = monitored;
+        slot->rad.monitored = monitored;
+        tableRegisterChanged(handle, true);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setOnChange(char *regName, bool onChange)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
-    if (rad != NULL && rad->monitored)
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    Slot_t *slot = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle] : NULL;
+    if (slot != NULL && slot->rad.monitored)
     {
-        rad->publishOnChange = onChange;
+        slot->rad.publishOnChange = onChange;
+        tableRegisterChanged(handle, true);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setChangeCheckInterval(char *regName, Seconds_t changeCheckInterval)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
-    if (rad != NULL && rad->monitored && rad->publishOnChange)
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    Slot_t *slot = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle] : NULL;
+    if (slot != NULL && slot->rad.monitored && slot->rad.publishOnChange)
     {
-        rad->changeCheckInterval = changeCheckInterval;
+        slot->rad.changeCheckInterval = changeCheckInterval;
+        tableRegisterChanged(handle, true);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setMaxPublishDelay(char *regName, Seconds_t maxPublishDelay)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
-    if (rad != NULL && rad->monitored)
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    Slot_t *slot = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle] : NULL;
+    if (slot != NULL && slot->rad.monitored)
+    {
+        slot->rad.maxPublishDelay = maxPublishDelay;
+        tableRegisterChanged(handle, true);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+bool KnownRegisters_setPollInterval(char *regName, Seconds_t pollInterval)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    Slot_t *slot = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle] : NULL;
+    if (slot != NULL && slot->rad.monitored)
     {
-        rad->maxPublishDelay = maxPublishDelay;
+        slot->rad.pollInterval = pollInterval;
+        tableRegisterChanged(handle, true);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
+// Move a register to another bus. Fails if that bus already has a register with the same Modbus details.
+bool KnownRegisters_setBus(char *regName, uint8_t bus)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
+    if (rad == NULL || bus >= MB_BUSES_NUM || (rad->bus != bus && tableFindByModbus(bus, rad->readFunction, rad->slaveAddr, rad->regId) != NULL))
+    {
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return false;
+    }
+    indexesRemove(handle);
+    slavesListRemove(handle);
+    rad->bus = bus;
+    indexesInsert(handle);
+    slavesListAppend(handle);
+    tableRegisterChanged(handle, true);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return true;
+}
+
 bool KnownRegisters_setWritable(char *regName, bool writable, uint8_t writeFunction)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
     if (rad != NULL)
     {
         rad->writable = writable;
         rad->writeFunction = writeFunction;
+        tableRegisterChanged(handle, false);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setInterpretedAsSigned(char *regName, bool asSigned)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
     if (rad != NULL && rad->type == RADType_NUMBER)
     {
         rad->interpretAsSigned = asSigned;
+        tableRegisterChanged(handle, false);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setFactor(char *regName, double factor)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
     if (rad != NULL && factor != 0 && (rad->type == RADType_NUMBER || rad->type == RADType_FLOAT))
     {
         rad->factor = factor;
+        tableRegisterChanged(handle, false);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+bool KnownRegisters_setDeadband(char *regName, double deadbandAbs, double deadbandRel)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
+    if (rad != NULL && deadbandAbs >= 0 && deadbandRel >= 0 && rad->type != RADType_STRING)
+    {
+        rad->deadbandAbs = deadbandAbs;
+        rad->deadbandRel = deadbandRel;
+        tableRegisterChanged(handle, false);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setOffset(char *regName, double offset)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
     if (rad != NULL && (rad->type == RADType_NUMBER || rad->type == RADType_FLOAT))
     {
         rad->offset = offset;
+        tableRegisterChanged(handle, false);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setDecimals(char *regName, uint8_t decimals)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
     if (rad != NULL && (rad->type == RADType_NUMBER || rad->type == RADType_FLOAT))
     {
         rad->decimals = decimals;
+        tableRegisterChanged(handle, false);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setLength(char *regName, uint8_t length)
 {
-    RegisterAccessData_t *rad = queueFind(&inUseSlots, regName);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    RegisterAccessData_t *rad = handle != INVALID_REG_HANDLE ? &slotsMemoryPool[handle].rad : NULL;
     if (rad != NULL)
     {
 
@@ -316,6 +1049,7 @@ bool KnownRegisters_setLength(char *regName, uint8_t length)
             }
             else
             {
+                RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
                 return false;
             }
         }
@@ -328,93 +1062,392 @@ bool KnownRegisters_setLength(char *regName, uint8_t length)
             }
             else
             {
+                RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
                 return false;
             }
         }
         else
         {
             // RAW or other
+            RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
             return false;
         }
 
+        tableRegisterChanged(handle, false);
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
 
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+int KnownRegisters_forEach(KnownRegistersVisitor_t visitor, void *arg)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    int visitedNum = 0;
+    while (visitedNum < inUseSlotsNum)
+    {
+        const int idx = visitedNum++;
+        if (!visitor(idx, &slotsMemoryPool[inUseSlots[idx]].rad, arg))
+            break;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return visitedNum;
+}
+
+int KnownRegisters_forEachOfSlave(uint8_t bus, uint8_t slaveAddr, KnownRegistersVisitor_t visitor, void *arg)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    int visitedNum = 0;
+    for (KnownRegHandle_t handle = slavesHeads[SLAVE_LIST(bus, slaveAddr)]; handle != INVALID_REG_HANDLE; handle = slavesNext[handle])
+    {
+        visitedNum++;
+        if (!visitor(slotsPositions[handle], &slotsMemoryPool[handle].rad, arg))
+            break;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return visitedNum;
+}
+
+bool KnownRegisters_visitAt(int idx, KnownRegistersVisitor_t visitor, void *arg)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const RegisterAccessData_t *rad = tableAt(idx);
+    if (rad != NULL)
+        visitor(idx, rad, arg);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return rad != NULL;
+}
+
+bool KnownRegisters_visitHandle(KnownRegHandle_t handle, KnownRegistersVisitor_t visitor, void *arg)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const int idx = handle >= 0 && handle < maxRegistersNum ? slotsPositions[handle] : -1;
+    if (idx >= 0)
+        visitor(idx, &slotsMemoryPool[handle].rad, arg);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return idx >= 0;
+}
+
+// Visit the copies of the details of a register kept in internal RAM, which are enough to check and publish its values
+bool KnownRegisters_visitPublishData(KnownRegHandle_t handle, KnownRegistersPublishVisitor_t visitor, void *arg)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const int idx = handle >= 0 && handle < maxRegistersNum ? slotsPositions[handle] : -1;
+    if (idx >= 0)
+        visitor(idx, &hotSlotsMemoryPool[handle].poll, &hotSlotsMemoryPool[handle].publish, arg);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return idx >= 0;
+}
+
+bool KnownRegisters_visitByName(const char *regName, KnownRegistersVisitor_t visitor, void *arg)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandle(regName);
+    if (handle != INVALID_REG_HANDLE)
+        visitor(slotsPositions[handle], &slotsMemoryPool[handle].rad, arg);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return handle != INVALID_REG_HANDLE;
+}
+
+bool KnownRegisters_visitByModbus(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, KnownRegistersVisitor_t visitor, void *arg)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    const KnownRegHandle_t handle = tableFindHandleByModbus(bus, readFunction, slaveAddr, regId);
+    if (handle != INVALID_REG_HANDLE)
+        visitor(slotsPositions[handle], &slotsMemoryPool[handle].rad, arg);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return handle != INVALID_REG_HANDLE;
+}
+
+bool KnownRegisters_getPollDataAt(int idx, RegisterPollData_t *pollOut)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        *pollOut = slot->poll;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_at(int idx, RegisterAccessData_t *radOut)
 {
-    RegisterAccessData_t *rad = queueAt(&inUseSlots, idx);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    RegisterAccessData_t *rad = tableAt(idx);
     if (rad != NULL)
     {
         *radOut = *rad;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
-const char *KnownRegisters_getLatestPublishedValueAt(int idx)
+void KnownRegisters_setWordOrder(uint8_t bitPosition)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    wordOrder = bitPosition;
+    for (int i = 0; i < inUseSlotsNum; i++)
+        tableRegisterChanged(inUseSlots[i], false);
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+}
+
+const DecodePlan_t *KnownRegisters_getDecodePlanAt(int idx)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    const DecodePlan_t *res = slot != NULL ? &slot->publish.decodePlan : NULL;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return res;
+}
+
+const uint16_t *KnownRegisters_getLatestPublishedRawAt(int idx)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    const uint16_t *res = slot != NULL ? slot->publish.latestPublishedRaw : NULL;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return res;
+}
+
+bool KnownRegisters_getLatestPublishedNumberAt(int idx, double *number)
 {
-    Slot_t *slot = queueSlotAt(&inUseSlots, idx);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
     if (slot != NULL)
     {
-        return slot->latestPublishedValue;
+        *number = slot->publish.latestPublishedNumber;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
     }
-    return NULL;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
 }
 
-bool KnownRegisters_setLatestPublishedValueAt(int idx, const char *value)
+bool KnownRegisters_setLatestPublishedValueAt(int idx, const uint16_t *raw, double number)
 {
-    Slot_t *slot = queueSlotAt(&inUseSlots, idx);
-    if (slot != NULL && strlen(value) < MAX_LATEST_PUBLISHED_SIZE - NULL_CHAR_LEN)
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
     {
-        strcpy(slot->latestPublishedValue, value);
+        memcpy(slot->publish.latestPublishedRaw, raw, sizeof(slot->publish.latestPublishedRaw));
+        slot->publish.latestPublishedNumber = number;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_getLatestPublishedTimeAt(int idx, Seconds_t *latestPublish)
 {
-    Slot_t *slot = queueSlotAt(&inUseSlots, idx);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
     if (slot != NULL)
     {
-        *latestPublish = slot->latestPublishSec;
+        *latestPublish = slot->publish.latestPublishSec;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_getMustPublish(int idx, bool *mustPublish)
 {
-    Slot_t *slot = queueSlotAt(&inUseSlots, idx);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
     if (slot != NULL)
     {
-        *mustPublish = slot->mustPublish;
+        *mustPublish = slot->publish.mustPublish;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setLatestPublishedTimeAt(int idx, Seconds_t latestPublishedTime)
 {
-    Slot_t *slot = queueSlotAt(&inUseSlots, idx);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
     if (slot != NULL)
     {
-        slot->latestPublishSec = latestPublishedTime;
+        slot->publish.latestPublishSec = latestPublishedTime;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
 
 bool KnownRegisters_setMustPublish(int idx, bool mustPublish)
 {
-    Slot_t *slot = queueSlotAt(&inUseSlots, idx);
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        slot->publish.mustPublish = mustPublish;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+bool KnownRegisters_getNextPollTimeAt(int idx, Seconds_t *nextPoll)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        *nextPoll = slot->nextPollSec;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+bool KnownRegisters_setNextPollTimeAt(int idx, Seconds_t nextPoll)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        slot->nextPollSec = nextPoll;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+// Update the count of consecutive refused reads of a register: a read that didn't refuse it resets it
+bool KnownRegisters_recordRefusedReadAt(int idx, bool refused, uint8_t *refusedReads)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        if (!refused)
+            slot->refusedReads = 0;
+        else if (slot->refusedReads < UINT8_MAX)
+            slot->refusedReads++;
+        *refusedReads = slot->refusedReads;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+bool KnownRegisters_getQuarantinedAt(int idx, bool *quarantined)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        *quarantined = slot->quarantined;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+bool KnownRegisters_setQuarantinedAt(int idx, bool quarantined)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
     if (slot != NULL)
     {
-        slot->mustPublish = mustPublish;
+        slot->quarantined = quarantined;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
         return true;
     }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
     return false;
 }
+
+// Cache the value of a register, read by a transaction started at the given time. Values read before the latest write of
+// the register are discarded.
+bool KnownRegisters_setCachedValueAt(int idx, const uint16_t *raw, int64_t readUs)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        if (readUs >= slot->invalidatedUs && readUs >= slot->cachedReadUs)
+        {
+            memcpy(slot->cachedRaw, raw, slot->poll.regNumber * sizeof(uint16_t));
+            slot->cachedReadUs = readUs;
+        }
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+// Copy the cached value of a register (MAX_REG_LENGTH words). Read time is 0 if no value is cached.
+bool KnownRegisters_getCachedValueAt(int idx, uint16_t *raw, int64_t *readUs)
+{
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    HotSlot_t *slot = tableHotSlotAt(idx);
+    if (slot != NULL)
+    {
+        memcpy(raw, slot->cachedRaw, sizeof(slot->cachedRaw));
+        *readUs = slot->cachedReadUs;
+        RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+        return true;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return false;
+}
+
+// Forget cached values of the registers of a slave of a bus that overlap the given ones, e.g. because they were written. Returns the
+// number of values forgotten.
+int KnownRegisters_invalidateCachedValues(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber)
+{
+    int invalidated = 0;
+    const int64_t nowUs = esp_timer_get_time();
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    for (KnownRegHandle_t handle = slavesHeads[SLAVE_LIST(bus, slaveAddr)]; handle != INVALID_REG_HANDLE; handle = slavesNext[handle])
+    {
+        HotSlot_t *slot = &hotSlotsMemoryPool[handle];
+        if (slot->poll.readFunction != readFunction || slot->poll.regId >= regId + regNumber || slot->poll.regId + slot->poll.regNumber <= regId)
+            continue;
+        slot->cachedReadUs = 0;
+        slot->invalidatedUs = nowUs;
+        invalidated++;
+    }
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return invalidated;
+}
+
+// Put quarantined registers back in the poll schedule. Returns the number of registers released.
+int KnownRegisters_releaseQuarantined()
+{
+    int released = 0;
+    BLOCKING_RECURSIVE_LOCK_OR_ABORT(registryMutex);
+    for (int i = 0; i < inUseSlotsNum; i++)
+    {
+        HotSlot_t *slot = &hotSlotsMemoryPool[inUseSlots[i]];
+        if (!slot->quarantined)
+            continue;
+        slot->quarantined = false;
+        slot->refusedReads = 0;
+        released++;
+    }
+    if (released > 0)
+        generation++;
+    RECURSIVE_UNLOCK_OR_ABORT(registryMutex);
+    return released;
+}
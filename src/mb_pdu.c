@@ -0,0 +1,128 @@
+#include "mb_pdu.h"
+
+#include <string.h>
+
+#define MAX_READ_BITS 2000
+#define MAX_READ_REGS 125
+#define MAX_WRITE_BITS 1968
+#define MAX_WRITE_REGS 123
+
+#define READ_HEADER_LEN 2 // Function, byte count
+#define WRITE_RESPONSE_LEN 5 // Function, address, quantity (or value)
+#define EXCEPTION_LEN 2      // Function, exception code
+
+// Protocol data units, shared by the transports the gateway implements itself (RTU on additional buses, TCP): they only
+// differ in how PDUs are framed.
+
+static int putWord(uint8_t *pdu, int len, uint16_t word)
+{
+    pdu[len++] = word >> 8;
+    pdu[len++] = word & 0xFF;
+    return len;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+// Request PDU of a transaction. Returns its length, 0 if the request is not valid. Coils are written from bytes packed as
+// in Modbus frames, registers from words.
+int MbPdu_buildRequest(uint8_t *pdu, uint8_t function, uint16_t regId, uint16_t regNumber, const void *value)
+{
+    int len = 0;
+    pdu[len++] = function;
+    len = putWord(pdu, len, regId);
+
+    switch (function)
+    {
+    case 1:
+    case 2:
+        if (regNumber == 0 || regNumber > MAX_READ_BITS)
+            return 0;
+        return putWord(pdu, len, regNumber);
+    case 3:
+    case 4:
+        if (regNumber == 0 || regNumber > MAX_READ_REGS)
+            return 0;
+        return putWord(pdu, len, regNumber);
+    case 5:
+        return putWord(pdu, len, *(const uint16_t *)value != 0 ? 0xFF00 : 0x0000);
+    case 6:
+        return putWord(pdu, len, *(const uint16_t *)value);
+    case 15:
+    {
+        if (regNumber == 0 || regNumber > MAX_WRITE_BITS)
+            return 0;
+        const int bytesNum = (regNumber + 7) / 8;
+        len = putWord(pdu, len, regNumber);
+        pdu[len++] = bytesNum;
+        memcpy(&pdu[len], value, bytesNum);
+        return len + bytesNum;
+    }
+    case 16:
+    {
+        if (regNumber == 0 || regNumber > MAX_WRITE_REGS)
+            return 0;
+        len = putWord(pdu, len, regNumber);
+        pdu[len++] = 2 * regNumber;
+        for (int r = 0; r < regNumber; r++)
+            len = putWord(pdu, len, ((const uint16_t *)value)[r]);
+        return len;
+    }
+    default:
+        return 0;
+    }
+}
+
+// Length of the PDU of a successful response
+int MbPdu_responseLen(uint8_t function, uint16_t regNumber)
+{
+    switch (function)
+    {
+    case 1:
+    case 2:
+        return READ_HEADER_LEN + (regNumber + 7) / 8;
+    case 3:
+    case 4:
+        return READ_HEADER_LEN + 2 * regNumber;
+    default:
+        return WRITE_RESPONSE_LEN;
+    }
+}
+
+// Result of an exception response with the given code
+ModbusError MbPdu_exception(uint8_t code)
+{
+    return code > 0 && code <= MB_BUS_MAX_EXCEPTION_CODE ? MB_BUS_ERR_EXCEPTION(code) : MB_BUS_ERR_INVALID_RESPONSE;
+}
+
+// Check the response PDU of a transaction and copy the data read: words for registers, coils and discrete inputs as bytes
+// packed as in Modbus frames.
+ModbusError MbPdu_parseResponse(const uint8_t *pdu, int pduLen, uint8_t function, uint16_t regNumber, void *value)
+{
+    if (pduLen < 2 || (pdu[0] & ~MB_PDU_EXCEPTION_FLAG) != function)
+        return MB_BUS_ERR_INVALID_RESPONSE;
+    if (pdu[0] & MB_PDU_EXCEPTION_FLAG)
+        return pduLen == EXCEPTION_LEN ? MbPdu_exception(pdu[1]) : MB_BUS_ERR_INVALID_RESPONSE;
+    if (pduLen != MbPdu_responseLen(function, regNumber))
+        return MB_BUS_ERR_INVALID_RESPONSE;
+
+    const int dataLen = pduLen - READ_HEADER_LEN;
+    switch (function)
+    {
+    case 1:
+    case 2:
+        if (pdu[1] != dataLen)
+            return MB_BUS_ERR_INVALID_RESPONSE;
+        memcpy(value, &pdu[READ_HEADER_LEN], dataLen);
+        break;
+    case 3:
+    case 4:
+        if (pdu[1] != dataLen)
+            return MB_BUS_ERR_INVALID_RESPONSE;
+        for (int r = 0; r < regNumber; r++)
+            ((uint16_t *)value)[r] = ((uint16_t)pdu[READ_HEADER_LEN + 2 * r] << 8) | pdu[READ_HEADER_LEN + 2 * r + 1];
+        break;
+    default:
+        break;
+    }
+    return MODBUS_OK;
+}
@@ -1,213 +1,751 @@
 #include "mb_rtu.h"
 
 #include <math.h>
+#include <stdlib.h>
 
 #include <esp_log.h>
+#include <esp_timer.h>
 
 #include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 
 #include <trackle_esp32.h>
 
 #include "sem_utils.h"
 #include "str_utils.h"
 #include "num_utils.h"
+#include "num_format.h"
+#include "decode_plan.h"
+#include "bus_arbiter.h"
+#include "bus_timing.h"
+#include "slave_health.h"
+#include "mb_serial.h"
+#include "mb_tcp.h"
 #include "known_registers.h"
+#include "poll_plan.h"
+#include "json_writer.h"
+#include "payload_writer.h"
 
 #define PUBLISH_STRING_LEN 2048
 #define VALUE_STRING_LEN 128
-#define KEYVALUE_STRING_LEN 144
+#define MAX_VALUES_PER_MESSAGE (PUBLISH_STRING_LEN / 4) // Shortest values take at least 4 chars, e.g. "1":0, in compact JSON
 
 #define MON_REGS_TASK_NAME "mon-regs-task"
 #define MON_REGS_TASK_STACKSIZE 8192
 #define MON_REGS_TASK_PRIORITY (tskIDLE_PRIORITY + 6)
 #define MON_REGS_TASK_CORE_ID 0
 
-#define ROUND_TO_NTH_DECIMAL(v, n) \
-    (round(v * pow(10, n)) / pow(10, n))
+#define MB_BITS_PER_CHAR 11       // start bit, 8 data bits, parity/stop bit and stop bit
+#define MB_READ_OVERHEAD_CHARS 20 // request frame (8), response header and CRC (5), two silent intervals (2 * 3.5)
+#define MB_TCP_BRIDGED_GAP_REGS 64 // On TCP, a transaction costs a round trip: a few more registers in a segment cost almost nothing
 
-static const char *TAG = MON_REGS_TASK_NAME;
+#define POLL_WINDOW 16              // Block reads waiting for their buses at the same time
+#define POLL_READ_TIMEOUT_MS 10000 // Max wait for any block read to be completed, before giving up on the ones in flight
+
+#define MB_WRITE_MULTIPLE_MAX_REGS 123 // Max number of registers that can be written with a single FC16 request
+
+#define REFUSED_READS_TO_QUARANTINE 3 // Consecutive reads refused by a slave, after which a register is no longer polled
 
-static SemaphoreHandle_t mbSem;
-static StaticSemaphore_t mbSemBuffer;
+static const char *TAG = MON_REGS_TASK_NAME;
 
 static TaskHandle_t monRegTaskHandle = NULL;
 static StackType_t monRegsTaskStackBuffer[MON_REGS_TASK_STACKSIZE];
 static StaticTask_t monRegsTaskBuffer;
 
 static bool startedSuccessfully = false;
-static uint16_t mbInterCmdsDelayMs = 10;
+static int busesBaudrates[MB_BUSES_NUM] = {9600};
 static uint8_t mbReadPeriod = 1;
 static uint8_t mbBitPosition = 0; // 0: msb, 1: lsb
+static PayloadEncoding_t payloadEncoding = PayloadEncoding_JSON;
+static bool compactKeys = false; // Publish key ids instead of names
+static bool trimTrailingZeros = false; // Drop trailing zeros of decimals from JSON values
 
 static void (*mbRequestFailedCallback)() = NULL;
 
-static bool numberToString(uint16_t *num, const RegisterAccessData_t *rad, char *valueString, int valueStringBuffLen)
+typedef struct PollDeadline_s
 {
-    double value = 0;
-
-    if (rad->type == RADType_NUMBER)
-        value = registersToNumber(num, rad->regNumber, mbBitPosition, rad->interpretAsSigned);
-    else if (rad->type == RADType_FLOAT)
-        value = registersToFloat(num, rad->regNumber, mbBitPosition, rad->interpretAsSigned);
-
-    value *= rad->factor;
-    value += rad->offset;
-    value = ROUND_TO_NTH_DECIMAL(value, rad->decimals);
-
-    char valueStringFmt[10];
-    sprintf(valueStringFmt, "%%.%" PRIu8 "f", rad->decimals);
-    if (snprintf(valueString, valueStringBuffLen, valueStringFmt, value) > valueStringBuffLen - NULL_CHAR_LEN)
-        return false;
-    return true;
-}
-
-static bool rawToString(uint16_t *num, char *valueString, int valueStringBuffLen)
+    Seconds_t due;
+    KnownRegHandle_t handle;
+} PollDeadline_t;
+
+// Min-heap of the deadlines of monitored registers, ordered by time of next poll
+static PollDeadline_t *pollHeap = NULL;
+static int pollHeapSize = 0;
+static int pollHeapCapacity = 0;
+
+// Registers read during current period, and the ones whose reads were refused
+static KnownRegHandle_t *dueHandles = NULL;
+static KnownRegHandle_t *failedHandles = NULL;
+static int failedNum = 0;
+
+// Integers without coefficients are formatted exactly, even when they don't fit a double (e.g. 64 bit energy counters)
+static bool numberToString(uint16_t *num, const DecodePlan_t *plan, char *valueString, int valueStringBuffLen)
 {
-    if (snprintf(valueString, valueStringBuffLen, "%" PRIu16, num[0]) > valueStringBuffLen - NULL_CHAR_LEN)
-        return false;
-    return true;
+    int len = 0;
+    if (!plan->exactInteger)
+        len = NumFormat_fixed(DecodePlan_scaled(plan, num), plan->decimals, trimTrailingZeros, valueString, valueStringBuffLen);
+    else if (plan->valueType == RegValueType_INT)
+        len = NumFormat_int(DecodePlan_signed(plan, num), plan->decimals, trimTrailingZeros, valueString, valueStringBuffLen);
+    else
+        len = NumFormat_uint(DecodePlan_unsigned(plan, num), plan->decimals, trimTrailingZeros, valueString, valueStringBuffLen);
+    return len >= 0;
 }
 
-static bool stringBufferToString(uint16_t *num, const RegisterAccessData_t *rad, char *valueString, int valueStringBuffLen)
+// Put the registers of a string in reading order. Result is null terminated, if less than MAX_REG_LENGTH registers are ordered.
+static void orderStringRegisters(uint16_t *num, uint8_t regNumber, uint16_t *orderedRegisters)
 {
-    uint16_t orderedRegisters[VALUE_STRING_LEN] = {0};
-
     if (mbBitPosition == 0)
-        memcpy(orderedRegisters, num, rad->regNumber * 2); // copy bytes (2 per register) to dest buffer
+        memcpy(orderedRegisters, num, regNumber * 2); // copy bytes (2 per register) to dest buffer
     else if (mbBitPosition == 1)
     {
-        for (int i = 0; i < rad->regNumber; i++)
-            orderedRegisters[i] = num[rad->regNumber - i - 1];
+        for (int i = 0; i < regNumber; i++)
+            orderedRegisters[i] = num[regNumber - i - 1];
     }
+}
 
-    if (snprintf(valueString, valueStringBuffLen, "\"%s\"", (char *)orderedRegisters) > valueStringBuffLen - NULL_CHAR_LEN)
-        return false;
-    return true;
+static bool stringBufferToString(uint16_t *num, uint8_t regNumber, char *valueString, int valueStringBuffLen)
+{
+    uint16_t orderedRegisters[VALUE_STRING_LEN] = {0};
+    orderStringRegisters(num, regNumber, orderedRegisters);
+
+    // Strings read from slaves may contain any character: escape them, so that they can be published as they are
+    JsonWriter_t writer;
+    JsonWriter_init(&writer, valueString, valueStringBuffLen);
+    JsonWriter_string(&writer, (char *)orderedRegisters);
+    return !JsonWriter_overflowed(&writer);
 }
 
-static RegError_t readTypedRegister(RegisterAccessData_t *rad, char *valueString, int valueStringBuffLen)
+// Read registers from a running bus, returning the result of the transaction
+static ModbusError busRead(uint8_t bus, BusPriority_t priority, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber,
+                           uint16_t *rawRegValue)
 {
-    if (!startedSuccessfully)
+    const ModbusError err = BusArbiter_sharedRead(bus, priority, readFunction, slaveAddr, regId, regNumber, rawRegValue);
+    if (err != MODBUS_OK && mbRequestFailedCallback != NULL)
+        mbRequestFailedCallback();
+    return err;
+}
+
+static RegError_t readRegisters(uint8_t bus, BusPriority_t priority, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber,
+                                uint16_t *rawRegValue)
+{
+    if (!startedSuccessfully || bus >= MB_BUSES_NUM || !BusArbiter_isRunning(bus))
         return RegError_MB_NOT_INIT;
+    return busRead(bus, priority, readFunction, slaveAddr, regId, regNumber, rawRegValue) == MODBUS_OK ? RegError_OK : RegError_MB_READ_ERR;
+}
 
-    uint16_t rawRegValue[MAX_REG_LENGTH] = {0};
-    if (Trackle_Modbus_execute_command(rad->readFunction, rad->slaveAddr, rad->regId, rad->regNumber, &rawRegValue) != MODBUS_OK)
+// Read a known register on request: its cached value is used if it was read at most maxAgeMs ago (never if 0), otherwise
+// it's read from the slave and cached. Age of the value is returned in milliseconds.
+static RegError_t readCachedRegister(KnownRegHandle_t handle, const RegisterPollData_t *poll, uint32_t maxAgeMs, uint16_t *rawRegValue, uint32_t *ageMs)
+{
+    const int64_t nowUs = esp_timer_get_time();
+    int64_t readUs = 0;
+    if (maxAgeMs > 0 && KnownRegisters_getCachedValueAt(KnownRegisters_indexOf(handle), rawRegValue, &readUs) && readUs > 0 &&
+        nowUs - readUs <= (int64_t)maxAgeMs * 1000)
     {
-        if (mbRequestFailedCallback != NULL)
-            mbRequestFailedCallback();
-        vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-        return RegError_MB_READ_ERR;
+        *ageMs = (nowUs - readUs) / 1000;
+        return RegError_OK;
     }
 
-    ESP_LOG_BUFFER_HEX_LEVEL("MODBUS", rawRegValue, 2 * rad->regNumber, ESP_LOG_WARN);
+    memset(rawRegValue, 0, MAX_REG_LENGTH * sizeof(uint16_t));
+    const RegError_t regError = readRegisters(poll->bus, BusPriority_INTERACTIVE, poll->readFunction, poll->slaveAddr, poll->regId, poll->regNumber, rawRegValue);
+    if (regError == RegError_OK)
+        KnownRegisters_setCachedValueAt(KnownRegisters_indexOf(handle), rawRegValue, nowUs);
+    *ageMs = 0;
+    return regError;
+}
+
+// Writes change the cached values of the registers they overlap: coils (FC=05, FC=15) are read with FC=01, holding
+// registers (FC=06, FC=16) with FC=03
+static void invalidateWrittenRegisters(uint8_t bus, uint8_t writeFunction, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber)
+{
+    if (writeFunction == 5 || writeFunction == 15)
+        KnownRegisters_invalidateCachedValues(bus, 1, slaveAddr, regId, regNumber);
+    else if (writeFunction == 6 || writeFunction == 16)
+        KnownRegisters_invalidateCachedValues(bus, 3, slaveAddr, regId, regNumber);
+}
 
+static RegError_t decodeTypedRegister(const DecodePlan_t *plan, uint16_t *rawRegValue, char *valueString, int valueStringBuffLen)
+{
     bool valueFitsString = false;
-    switch (rad->type)
+    if (plan->valueType == RegValueType_TEXT)
+        valueFitsString = stringBufferToString(rawRegValue, plan->regNumber, valueString, valueStringBuffLen);
+    else
+        valueFitsString = numberToString(rawRegValue, plan, valueString, valueStringBuffLen);
+    if (!valueFitsString)
+        return RegError_STRING_TOO_LONG;
+    return RegError_OK;
+}
+
+// Decode the value of a register in its native width, for binary payloads: unscaled numbers are kept as integers,
+// scaled ones are published as they are formatted in JSON.
+static void decodeRegisterValue(const DecodePlan_t *plan, uint16_t *rawRegValue, RegValue_t *value)
+{
+    uint16_t orderedRegisters[MAX_REG_LENGTH + 1] = {0};
+
+    value->type = plan->valueType;
+    switch (plan->valueType)
     {
-    case RADType_NUMBER:
-        valueFitsString = numberToString(rawRegValue, rad, valueString, valueStringBuffLen);
+    case RegValueType_INT:
+        value->i = DecodePlan_signed(plan, rawRegValue);
         break;
-    case RADType_FLOAT:
-        valueFitsString = numberToString(rawRegValue, rad, valueString, valueStringBuffLen);
+    case RegValueType_UINT:
+        value->u = DecodePlan_unsigned(plan, rawRegValue);
         break;
-    case RADType_RAW:
-        valueFitsString = rawToString(rawRegValue, valueString, valueStringBuffLen);
+    case RegValueType_FLOAT32:
+        value->f32 = (float)DecodePlan_native(plan, rawRegValue);
         break;
-    case RADType_STRING:
-        valueFitsString = stringBufferToString(rawRegValue, rad, valueString, valueStringBuffLen);
+    case RegValueType_FLOAT64:
+        value->f64 = DecodePlan_scaled(plan, rawRegValue);
+        break;
+    case RegValueType_TEXT:
+        orderStringRegisters(rawRegValue, plan->regNumber, orderedRegisters);
+        memcpy(value->text, orderedRegisters, sizeof(value->text) - NULL_CHAR_LEN);
+        value->text[sizeof(value->text) - NULL_CHAR_LEN] = '\0';
+        break;
+    case RegValueType_NULL:
         break;
     }
-    if (!valueFitsString)
-        return RegError_STRING_TOO_LONG;
+}
 
-    vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-    return RegError_OK;
+// Registers read on request aren't decoded often enough to keep their plan: it's built for the copy of their details
+static RegError_t readTypedRegister(KnownRegHandle_t handle, const RegisterAccessData_t *rad, uint32_t maxAgeMs, char *valueString,
+                                    int valueStringBuffLen, uint32_t *ageMs)
+{
+    const RegisterPollData_t poll = {.bus = rad->bus, .readFunction = rad->readFunction, .slaveAddr = rad->slaveAddr, .regId = rad->regId, .regNumber = rad->regNumber};
+    uint16_t rawRegValue[MAX_REG_LENGTH] = {0};
+    const RegError_t regError = readCachedRegister(handle, &poll, maxAgeMs, rawRegValue, ageMs);
+    if (regError != RegError_OK)
+        return regError;
+
+    DecodePlan_t plan;
+    DecodePlan_build(&plan, rad, mbBitPosition);
+    return decodeTypedRegister(&plan, rawRegValue, valueString, valueStringBuffLen);
 }
 
-static void monitoredRegistersTask(void *args)
+// A block read saves the fixed cost of a transaction (request frame, response header and CRC, silent intervals and
+// gap between frames). Unused registers between two monitored ones are worth reading as long as they cost less than that.
+static uint16_t maxBridgedGapRegs(uint8_t bus)
 {
-    static char publishString[PUBLISH_STRING_LEN] = {0};
-    TickType_t prevWakeTicks = xTaskGetTickCount();
-    BaseType_t xWasDelayed;
-    Seconds_t seconds = 0;
+    if (MB_BUS_IS_TCP(bus))
+        return MB_TCP_BRIDGED_GAP_REGS;
+    const uint32_t charsPerDelay = ((uint64_t)BusTiming_typicalGapUs(bus) * busesBaudrates[bus]) / (MB_BITS_PER_CHAR * 1000000);
+    const uint32_t gapRegs = (MB_READ_OVERHEAD_CHARS + charsPerDelay) / 2;
+    return gapRegs < MAX_BLOCK_REGS_NUM ? gapRegs : MAX_BLOCK_REGS_NUM;
+}
+
+// Slaves that stopped answering are not polled until their backoff expires, then they're probed with a single register read.
+// Any answer to the probe, even an exception, ends the backoff.
+static bool slaveReachable(const PollBlock_t *block)
+{
+    if (!SlaveHealth_isBackingOff(block->bus, block->slaveAddr))
+        return true;
+    if (!SlaveHealth_probeDue(block->bus, block->slaveAddr))
+        return false;
+
+    uint16_t probeValue = 0;
+    busRead(block->bus, BusPriority_POLLING, block->readFunction, block->slaveAddr, block->regId, 1, &probeValue);
+    return !SlaveHealth_isBackingOff(block->bus, block->slaveAddr);
+}
+
+// Reads refused by the slave: illegal data address exceptions. The Modbus library of the primary bus doesn't report exception
+// codes, so there any failed read is a candidate, and it's taken as refused only if the slave answered in the same period.
+static bool readRefused(uint8_t bus, ModbusError err)
+{
+    if (bus == MB_PRIMARY_BUS)
+        return err != MODBUS_OK;
+    return MB_BUS_EXCEPTION_CODE(err) == MB_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+}
+
+// Handle the result of the transaction that read a block of the poll plan. If the slave refused the whole block, fall back to
+// reading its registers one by one, so that a single unreadable register (or gap) doesn't prevent the others from being read.
+// Registers whose own read was refused are collected, to be quarantined.
+static void completePollBlock(const PollBlock_t *block, ModbusError err, uint16_t *blockValue, bool *entryReadOk)
+{
+    for (int e = 0; e < block->entriesNum; e++)
+        entryReadOk[e] = err == MODBUS_OK;
+
+    if (err == MODBUS_OK || err == MB_BUS_ERR_NOT_RUNNING)
+        return;
+
+    if (block->entriesNum == 1)
+    {
+        if (readRefused(block->bus, err))
+            failedHandles[failedNum++] = PollPlan_entryAt(block->firstEntry)->handle;
+        return;
+    }
+
+    // Registers of a slave that stopped answering are not worth a timeout each
+    for (int e = 0; e < block->entriesNum && !SlaveHealth_isBackingOff(block->bus, block->slaveAddr); e++)
+    {
+        const PollEntry_t *entry = PollPlan_entryAt(block->firstEntry + e);
+        err = busRead(block->bus, BusPriority_POLLING, block->readFunction, block->slaveAddr, entry->regId, entry->regNumber, &blockValue[entry->offset]);
+        entryReadOk[e] = err == MODBUS_OK;
+        if (readRefused(block->bus, err))
+            failedHandles[failedNum++] = entry->handle;
+    }
+}
+
+// Registers whose reads were refused while their slave answered in the same period are quarantined after some consecutive
+// refusals, and reported, instead of being read at every period.
+static void quarantineRefusedRegisters(int64_t periodStartUs)
+{
+    for (int f = 0; f < failedNum; f++)
+    {
+        const int i = KnownRegisters_indexOf(failedHandles[f]);
+        RegisterPollData_t poll = {0};
+        uint8_t refusedReads = 0;
+        if (!KnownRegisters_getPollDataAt(i, &poll) || !SlaveHealth_answeredSince(poll.bus, poll.slaveAddr, periodStartUs) ||
+            !KnownRegisters_recordRefusedReadAt(i, true, &refusedReads) || refusedReads < REFUSED_READS_TO_QUARANTINE)
+            continue;
 
+        RegisterAccessData_t rad = {0};
+        if (!KnownRegisters_at(i, &rad) || !KnownRegisters_setQuarantinedAt(i, true))
+            continue;
+        ESP_LOGW(TAG, "Register %s quarantined: slave %" PRIu8 " of bus %" PRIu8 " refuses to read it", rad.regName, rad.slaveAddr, rad.bus);
+        tracklePublishSecure("mbQuarantine", rad.regName);
+    }
+    failedNum = 0;
+}
+
+// BEGIN ---------------------------------------------------- POLL SCHEDULER --------------------------------------------------------------
+
+static void pollHeapSwap(int a, int b)
+{
+    const PollDeadline_t tmp = pollHeap[a];
+    pollHeap[a] = pollHeap[b];
+    pollHeap[b] = tmp;
+}
+
+static void pollHeapPush(PollDeadline_t deadline)
+{
+    if (pollHeapSize >= pollHeapCapacity)
+        return;
+
+    int child = pollHeapSize++;
+    pollHeap[child] = deadline;
+    while (child > 0)
+    {
+        const int parent = (child - 1) / 2;
+        if (pollHeap[parent].due <= pollHeap[child].due)
+            break;
+        pollHeapSwap(parent, child);
+        child = parent;
+    }
+}
+
+static PollDeadline_t pollHeapPop()
+{
+    const PollDeadline_t top = pollHeap[0];
+    pollHeap[0] = pollHeap[--pollHeapSize];
+
+    int parent = 0;
     for (;;)
     {
-        const int knownRegistersCount = KnownRegisters_count();
-        publishString[0] = '\0';
-        strcat(publishString, "{");
-        int iAdded = 0;
-        int i;
-        for (i = 0; i < knownRegistersCount; i++)
+        const int left = 2 * parent + 1;
+        const int right = left + 1;
+        int smallest = parent;
+        if (left < pollHeapSize && pollHeap[left].due < pollHeap[smallest].due)
+            smallest = left;
+        if (right < pollHeapSize && pollHeap[right].due < pollHeap[smallest].due)
+            smallest = right;
+        if (smallest == parent)
+            break;
+        pollHeapSwap(parent, smallest);
+        parent = smallest;
+    }
+    return top;
+}
+
+// Rebuild deadlines of all the monitored registers, keeping the ones they already had.
+static void rebuildPollSchedule()
+{
+    pollHeapSize = 0;
+    const int knownRegistersCount = KnownRegisters_count();
+    for (int i = 0; i < knownRegistersCount; i++)
+    {
+        RegisterPollData_t poll = {0};
+        Seconds_t nextPoll = 0;
+        bool quarantined = false;
+        if (!KnownRegisters_getPollDataAt(i, &poll) || !poll.monitored || !KnownRegisters_getNextPollTimeAt(i, &nextPoll) ||
+            !KnownRegisters_getQuarantinedAt(i, &quarantined) || quarantined)
+            continue;
+        const PollDeadline_t deadline = {.due = nextPoll, .handle = KnownRegisters_handleAt(i)};
+        pollHeapPush(deadline);
+    }
+}
+
+// BEGIN ---------------------------------------------------- MONITORING TASK -------------------------------------------------------------
+
+// Value added to the message being built, whose bookkeeping is updated only once the message is sent
+typedef struct PendingValue_s
+{
+    KnownRegHandle_t handle;
+    uint16_t rawRegValue[MAX_REG_LENGTH];
+    double number;
+} PendingValue_t;
+
+typedef struct MonitorCtx_s
+{
+    uint16_t rawRegValue[MAX_REG_LENGTH]; // Value read for the visited register
+    char *publishString;
+    uint8_t *binaryScratch;
+    PayloadWriter_t writer;
+    Seconds_t seconds;
+    int pendingNum;   // Number of values in the message being built
+    bool messageFull; // The visited value didn't fit the message being built
+} MonitorCtx_t;
+
+// Values added to the message being built
+static PendingValue_t *pendingValues = NULL;
+static int pendingValuesCapacity = 0;
+
+static void startMessage(MonitorCtx_t *ctx)
+{
+    PayloadWriter_init(&ctx->writer, payloadEncoding, NULL, ctx->publishString, PUBLISH_STRING_LEN, ctx->binaryScratch, PUBLISH_STRING_LEN);
+    ctx->pendingNum = 0;
+
+    // Key ids are resolved with the dictionary of this version
+    if (compactKeys)
+    {
+        PayloadWriter_key(&ctx->writer, "v");
+        PayloadWriter_uint(&ctx->writer, KnownRegisters_getKeysVersion());
+    }
+}
+
+// Detect changes without formatting values. Registers whose words didn't change are skipped right away, numeric ones must
+// differ from the published value by more than both deadbands (0 if not set) after scaling and rounding.
+static bool valueChanged(const RegisterPublishData_t *publish, uint16_t *rawRegValue)
+{
+    const DecodePlan_t *plan = &publish->decodePlan;
+    if (memcmp(rawRegValue, publish->latestPublishedRaw, plan->regNumber * sizeof(uint16_t)) == 0)
+        return false;
+    if (plan->valueType == RegValueType_TEXT)
+        return true;
+
+    const double delta = fabs(DecodePlan_scaled(plan, rawRegValue) - publish->latestPublishedNumber);
+    return delta > publish->deadbandAbs && delta > fabs(publish->latestPublishedNumber) * publish->deadbandRel / 100;
+}
+
+// Check if the value read for a monitored register must be published and, if so, append it to the message being built. Only
+// details kept in internal RAM are accessed.
+static bool appendMonitoredValue(int idx, const RegisterPollData_t *poll, const RegisterPublishData_t *publish, void *arg)
+{
+    MonitorCtx_t *ctx = (MonitorCtx_t *)arg;
+    ctx->messageFull = false;
+
+    const Seconds_t latestPublishTime = publish->latestPublishSec;
+    const DecodePlan_t *plan = &publish->decodePlan;
+    if (!(poll->publishOnChange && ctx->seconds - latestPublishTime >= poll->changeCheckInterval && valueChanged(publish, ctx->rawRegValue)) &&
+        !(poll->maxPublishDelay > 0 && ctx->seconds - latestPublishTime >= poll->maxPublishDelay) &&
+        !(latestPublishTime == 0) &&
+        !publish->mustPublish)
+        return true;
+
+    // Only values that are published are formatted, as text for JSON and in native width for binary encodings
+    char valueString[VALUE_STRING_LEN] = {0};
+    RegValue_t value = {0};
+    if (PayloadEncoding_isBinary(payloadEncoding))
+        decodeRegisterValue(plan, ctx->rawRegValue, &value);
+    else if (decodeTypedRegister(plan, ctx->rawRegValue, valueString, VALUE_STRING_LEN) != RegError_OK)
+        return true;
+
+    const PayloadWriterMark_t mark = PayloadWriter_mark(&ctx->writer);
+    if (compactKeys)
+        PayloadWriter_keyId(&ctx->writer, publish->keyId);
+    else
+        PayloadWriter_key(&ctx->writer, publish->regName);
+    PayloadWriter_value(&ctx->writer, &value, valueString);
+
+    // A value that doesn't fit even an empty message is never published
+    if (PayloadWriter_overflowed(&ctx->writer) || ctx->pendingNum >= pendingValuesCapacity)
+    {
+        PayloadWriter_rollback(&ctx->writer, mark);
+        ctx->messageFull = ctx->pendingNum > 0;
+        return false;
+    }
+
+    PendingValue_t *pending = &pendingValues[ctx->pendingNum++];
+    pending->handle = KnownRegisters_handleAt(idx);
+    memcpy(pending->rawRegValue, ctx->rawRegValue, sizeof(pending->rawRegValue));
+    pending->number = DecodePlan_scaled(plan, ctx->rawRegValue);
+    return true;
+}
+
+// Publish the message being built. Registers whose values were sent are marked as published, the others will be published
+// as soon as possible.
+static void publishMessage(MonitorCtx_t *ctx)
+{
+    if (ctx->pendingNum == 0)
+        return;
+
+    const bool sent = PayloadWriter_finish(&ctx->writer) && tracklePublishSecure("trackle/p", ctx->publishString);
+
+    for (int p = 0; p < ctx->pendingNum; p++)
+    {
+        const PendingValue_t *pending = &pendingValues[p];
+        const int i = KnownRegisters_indexOf(pending->handle);
+        if (sent)
         {
-            // To make error handling lighter inside the "for" body, we simply "break" when an error occurs.
-            // Then we detect outside if an error occurred here by checking if all known registers were considered.
-            // Place where this is done is marked by a comment in next lines.
-            RegisterAccessData_t rad = {0};
-            bool mustPublish = false;
+            KnownRegisters_setLatestPublishedTimeAt(i, ctx->seconds);
+            KnownRegisters_setLatestPublishedValueAt(i, pending->rawRegValue, pending->number);
+        }
+        KnownRegisters_setMustPublish(i, !sent);
+    }
 
-            configASSERT(KnownRegisters_at(i, &rad));
-            configASSERT(KnownRegisters_getMustPublish(i, &mustPublish));
+    startMessage(ctx);
+}
 
-            if (!rad.monitored)
-                continue;
+// Check the values of the registers read with a block and append the ones to publish to the message being built
+static void processPollBlock(MonitorCtx_t *ctx, const PollBlock_t *block, const uint16_t *blockValue, const bool *entryReadOk, int64_t blockReadUs)
+{
+    for (int e = 0; e < block->entriesNum; e++)
+    {
+        if (!entryReadOk[e])
+            continue;
 
-            char valueString[VALUE_STRING_LEN] = {0};
+        const PollEntry_t *entry = PollPlan_entryAt(block->firstEntry + e);
+        uint8_t refusedReads = 0;
+        KnownRegisters_recordRefusedReadAt(KnownRegisters_indexOf(entry->handle), false, &refusedReads);
 
-            BLOCKING_LOCK_OR_ABORT(mbSem);
-            RegError_t res = readTypedRegister(&rad, valueString, VALUE_STRING_LEN);
-            UNLOCK_OR_ABORT(mbSem);
+        // Copy the slice of the block, so that decoding never reads past the register's own words. Cloud reads may use it.
+        memset(ctx->rawRegValue, 0, sizeof(ctx->rawRegValue));
+        memcpy(ctx->rawRegValue, &blockValue[entry->offset], entry->regNumber * sizeof(uint16_t));
+        KnownRegisters_setCachedValueAt(KnownRegisters_indexOf(entry->handle), ctx->rawRegValue, blockReadUs);
 
-            if (res != RegError_OK)
-                continue;
+        // Register may have been removed while the block was being read
+        KnownRegisters_visitPublishData(entry->handle, appendMonitoredValue, ctx);
+        if (ctx->messageFull)
+        {
+            publishMessage(ctx);
+            KnownRegisters_visitPublishData(entry->handle, appendMonitoredValue, ctx);
+        }
+    }
+}
 
-            Seconds_t latestPublishTime = 0;
-            configASSERT(KnownRegisters_getLatestPublishedTimeAt(i, &latestPublishTime));
-            const char *latestPublishedValue = KnownRegisters_getLatestPublishedValueAt(i);
-            if (!(rad.publishOnChange && seconds - latestPublishTime >= rad.changeCheckInterval && !STREQ(latestPublishedValue, valueString)) &&
-                !(rad.maxPublishDelay > 0 && seconds - latestPublishTime >= rad.maxPublishDelay) &&
-                !(latestPublishTime == 0) &&
-                !mustPublish)
-                continue;
+// Block read submitted to the task of its bus, so that buses are read at the same time
+typedef enum
+{
+    PollReadState_FREE = 0,
+    PollReadState_IN_FLIGHT,
+    PollReadState_ABANDONED, // Given up on in a previous period: the slot is freed when its transaction is completed
+} PollReadState_t;
 
-            if (iAdded > 0)
-            {
-                if (strlen(publishString) + CT_STRLEN(",") + NULL_CHAR_LEN > PUBLISH_STRING_LEN)
-                    break;
-                strcat(publishString, ",");
-            }
+typedef struct PollRead_s
+{
+    BusRequest_t req; // First member, so that completed requests lead back to their read
+    PollReadState_t state;
+    const PollBlock_t *block;
+    int64_t readUs;
+    uint16_t words[MAX_BLOCK_REGS_NUM];
+} PollRead_t;
+
+// Reads in flight, completed in the order their transactions end, so that a slow bus doesn't hold back the others
+static PollRead_t pollReads[POLL_WINDOW];
+static int pollReadsInFlight = 0;
+static int busesReadsInFlight[MB_BUSES_NUM];
+static QueueHandle_t pollCompletions = NULL;
+static StaticQueue_t pollCompletionsBuffer;
+static uint8_t pollCompletionsStorage[POLL_WINDOW * sizeof(BusRequest_t *)];
+
+// Buffers of batch writes, too large for the stack of the tasks calling them
+static SemaphoreHandle_t batchWriteMutex = NULL;
+static StaticSemaphore_t batchWriteMutexBuffer;
+static RegisterAccessData_t batchRads[MB_BATCH_WRITE_MAX];
+static uint16_t batchRawValues[MB_BATCH_WRITE_MAX][MAX_REG_LENGTH];
+static int batchValid[MB_BATCH_WRITE_MAX]; // Writes whose values could be encoded, in requested order
+static uint16_t batchWords[MB_WRITE_MULTIPLE_MAX_REGS];
+
+// Blocks of each bus still to be read in current period. Blocks of a bus are contiguous in the poll plan.
+static int busesNextBlock[MB_BUSES_NUM];
+static int busesEndBlock[MB_BUSES_NUM];
+
+static void splitBlocksByBus(int blocksNum)
+{
+    for (int bus = 0; bus < MB_BUSES_NUM; bus++)
+    {
+        busesNextBlock[bus] = 0;
+        busesEndBlock[bus] = 0;
+    }
+    for (int b = blocksNum - 1; b >= 0; b--)
+    {
+        const uint8_t bus = PollPlan_blockAt(b)->bus;
+        if (busesEndBlock[bus] == 0)
+            busesEndBlock[bus] = b + 1;
+        busesNextBlock[bus] = b;
+    }
+}
 
-            char keyValueString[KEYVALUE_STRING_LEN] = {0};
-            const int kvLen = snprintf(keyValueString, KEYVALUE_STRING_LEN - NULL_CHAR_LEN, "\"%s\":%s", rad.regName, valueString);
-            if (kvLen + NULL_CHAR_LEN > KEYVALUE_STRING_LEN)
-                break;
+// A bus gets one read more than the transactions it executes at the same time, so that it never waits for the next one
+static bool busHasRoom(uint8_t bus)
+{
+    return busesReadsInFlight[bus] <= BusArbiter_workers(bus) && busesReadsInFlight[bus] < BUS_ARBITER_QUEUE_LEN;
+}
 
-            if (strlen(publishString) + strlen(keyValueString) + NULL_CHAR_LEN > PUBLISH_STRING_LEN)
-                break;
-            strcat(publishString, keyValueString);
+static PollRead_t *freePollRead()
+{
+    for (int r = 0; r < POLL_WINDOW; r++)
+    {
+        if (pollReads[r].state == PollReadState_FREE)
+            return &pollReads[r];
+    }
+    return NULL;
+}
 
-            KnownRegisters_setLatestPublishedTimeAt(i, seconds);
-            KnownRegisters_setLatestPublishedValueAt(i, valueString);
-            KnownRegisters_setMustPublish(i, true);
-            iAdded++;
+// Submit the next reachable block of a bus, if any. Returns false if the bus has no blocks left, or no read is free. Blocks
+// of buses that aren't running are completed right away.
+static bool submitPollBlock(MonitorCtx_t *ctx, uint8_t bus, bool *entryReadOk)
+{
+    PollRead_t *read = freePollRead();
+    while (read != NULL && busesNextBlock[bus] < busesEndBlock[bus])
+    {
+        const PollBlock_t *block = PollPlan_blockAt(busesNextBlock[bus]++);
+        if (!slaveReachable(block))
+            continue;
+
+        memset(read->words, 0, sizeof(read->words));
+        read->block = block;
+        read->readUs = esp_timer_get_time();
+        BusArbiter_prepare(&read->req, bus, BusPriority_POLLING, block->readFunction, block->slaveAddr, block->regId, block->regNumber,
+                           read->words, true);
+        read->req.completions = pollCompletions;
+        if (!BusArbiter_submit(&read->req, 0))
+        {
+            completePollBlock(block, MB_BUS_ERR_NOT_RUNNING, read->words, entryReadOk);
+            processPollBlock(ctx, block, read->words, entryReadOk, read->readUs);
+            continue;
         }
-        bool finalBracketFits = false;
-        if (strlen(publishString) + CT_STRLEN("}") + NULL_CHAR_LEN <= PUBLISH_STRING_LEN)
+        read->state = PollReadState_IN_FLIGHT;
+        pollReadsInFlight++;
+        busesReadsInFlight[bus]++;
+        return true;
+    }
+    return false;
+}
+
+// Keep the window full, taking blocks from the buses in turn, starting from the given one
+static void fillPollWindow(MonitorCtx_t *ctx, uint8_t firstBus, bool *entryReadOk)
+{
+    bool submitted = true;
+    while (submitted)
+    {
+        submitted = false;
+        for (int b = 0; b < MB_BUSES_NUM && pollReadsInFlight < POLL_WINDOW; b++)
         {
-            strcat(publishString, "}");
-            finalBracketFits = true;
+            const uint8_t bus = (firstBus + b) % MB_BUSES_NUM;
+            if (busHasRoom(bus))
+                submitted |= submitPollBlock(ctx, bus, entryReadOk);
         }
+    }
+}
 
-        // We check if an error occurred in the previous for loop with the second term of the condition in next line.
-        if (iAdded > 0 && i == knownRegistersCount && finalBracketFits)
+// Wait for any read in flight to be completed, handle its result and publish the values it read. Returns the bus it was read
+// from, or -1 if no read was completed in time: then the reads in flight are abandoned, and their registers aren't published
+// in this period (nor counted as refused, since their slaves didn't answer).
+static int completeNextPollRead(MonitorCtx_t *ctx, bool *entryReadOk)
+{
+    BusRequest_t *req = NULL;
+    while (xQueueReceive(pollCompletions, &req, pdMS_TO_TICKS(POLL_READ_TIMEOUT_MS)) == pdTRUE)
+    {
+        PollRead_t *read = (PollRead_t *)req;
+        busesReadsInFlight[req->bus]--;
+        if (read->state == PollReadState_ABANDONED)
         {
-            if (tracklePublishSecure("trackle/p", publishString))
-            {
-                for (int i = 0; i < knownRegistersCount; i++)
-                    KnownRegisters_setMustPublish(i, false);
-            }
+            read->state = PollReadState_FREE;
+            continue;
+        }
+        read->state = PollReadState_FREE;
+        pollReadsInFlight--;
+
+        if (req->result != MODBUS_OK && mbRequestFailedCallback != NULL)
+            mbRequestFailedCallback();
+        completePollBlock(read->block, req->result, read->words, entryReadOk);
+        processPollBlock(ctx, read->block, read->words, entryReadOk, read->readUs);
+        return req->bus;
+    }
+
+    ESP_LOGE(TAG, "No block read completed in %d ms: abandoning %d reads", POLL_READ_TIMEOUT_MS, pollReadsInFlight);
+    for (int r = 0; r < POLL_WINDOW; r++)
+    {
+        PollRead_t *read = &pollReads[r];
+        if (read->state != PollReadState_IN_FLIGHT)
+            continue;
+        read->state = PollReadState_ABANDONED;
+    }
+    pollReadsInFlight = 0;
+    return -1;
+}
+
+static void monitoredRegistersTask(void *args)
+{
+    static char publishString[PUBLISH_STRING_LEN] = {0};
+    static uint8_t binaryScratch[PUBLISH_STRING_LEN];
+    static bool entryReadOk[MAX_BLOCK_REGS_NUM];
+    static uint16_t maxGapRegs[MB_BUSES_NUM];
+    TickType_t prevWakeTicks = xTaskGetTickCount();
+    BaseType_t xWasDelayed;
+    Seconds_t seconds = 0;
+    uint32_t schedulerGeneration = KnownRegisters_getGeneration() - 1;
+
+    static MonitorCtx_t monitorCtx = {.publishString = publishString, .binaryScratch = binaryScratch};
+
+    for (;;)
+    {
+        // Registers were added, removed or reconfigured: reschedule them
+        if (schedulerGeneration != KnownRegisters_getGeneration())
+        {
+            schedulerGeneration = KnownRegisters_getGeneration();
+            rebuildPollSchedule();
+        }
+
+        // Plan reads of monitored registers that are due, grouping them in blocks. Quarantined ones leave the schedule.
+        const int64_t periodStartUs = esp_timer_get_time();
+        PollPlan_clear();
+        int dueNum = 0;
+        while (pollHeapSize > 0 && pollHeap[0].due <= seconds)
+        {
+            const KnownRegHandle_t handle = pollHeapPop().handle;
+            const int i = KnownRegisters_indexOf(handle);
+            RegisterPollData_t poll = {0};
+            bool quarantined = false;
+            if (!KnownRegisters_getPollDataAt(i, &poll) || !KnownRegisters_getQuarantinedAt(i, &quarantined) || quarantined)
+                continue;
+            dueHandles[dueNum++] = handle;
+            PollPlan_add(handle, &poll);
+        }
+        for (uint8_t bus = 0; bus < MB_BUSES_NUM; bus++)
+            maxGapRegs[bus] = maxBridgedGapRegs(bus);
+        const int blocksNum = PollPlan_build(maxGapRegs);
+
+        // Blocks of different buses are read at the same time. Values to publish are split in as many messages as needed.
+        monitorCtx.seconds = seconds;
+        startMessage(&monitorCtx);
+        splitBlocksByBus(blocksNum);
+        fillPollWindow(&monitorCtx, MB_PRIMARY_BUS, entryReadOk);
+        while (pollReadsInFlight > 0)
+        {
+            const int servedBus = completeNextPollRead(&monitorCtx, entryReadOk);
+            if (servedBus >= 0)
+                fillPollWindow(&monitorCtx, servedBus + 1, entryReadOk);
+        }
+        publishMessage(&monitorCtx);
+        quarantineRefusedRegisters(periodStartUs);
+
+        // Schedule next poll of the registers that were due. The ones still waiting to be published are polled again at next period.
+        for (int d = 0; d < dueNum; d++)
+        {
+            const KnownRegHandle_t handle = dueHandles[d];
+            const int i = KnownRegisters_indexOf(handle);
+            RegisterPollData_t poll = {0};
+            bool mustPublish = false;
+            bool quarantined = false;
+            if (!KnownRegisters_getPollDataAt(i, &poll) || !KnownRegisters_getMustPublish(i, &mustPublish) ||
+                !KnownRegisters_getQuarantinedAt(i, &quarantined) || quarantined)
+                continue;
+            const Seconds_t interval = mustPublish ? mbReadPeriod : PollPlan_intervalOf(&poll, mbReadPeriod);
+            const PollDeadline_t deadline = {.due = seconds + interval, .handle = handle};
+            pollHeapPush(deadline);
+            KnownRegisters_setNextPollTimeAt(i, deadline.due);
         }
 
         xWasDelayed = xTaskDelayUntil(&prevWakeTicks, (mbReadPeriod * 1000) / portTICK_PERIOD_MS);
@@ -222,24 +760,52 @@ static void monitoredRegistersTask(void *args)
 
 bool MbRtu_init(uart_port_t uartPort, int baudrate, uint8_t txPin, uint8_t rxPin, bool onRS485, uint8_t dirPin, uint16_t interCmdsDelayMs,
                 uint8_t readPeriod, uint8_t serialDataBits, uint8_t serialParity, uint8_t serialStopBits, uint8_t bitPosition,
-                void (*mbReqFailedCallback)())
+                uint8_t busCoreId, void (*mbReqFailedCallback)())
 {
     // Save modbus request failure callback
     mbRequestFailedCallback = mbReqFailedCallback;
 
-    // Init semaphore dedicated to modbus
-    mbSem = xSemaphoreCreateBinaryStatic(&mbSemBuffer);
-    configASSERT(mbSem != NULL);
-    configASSERT(xSemaphoreGive(mbSem) == pdTRUE);
+    // Set gap between frames, from serial settings and delay between commands
+    BusTiming_init(MB_PRIMARY_BUS, baudrate, serialDataBits, serialParity, serialStopBits, interCmdsDelayMs);
 
-    // Set delay between commands
-    mbInterCmdsDelayMs = interCmdsDelayMs;
+    // Forget health of slaves
+    if (!SlaveHealth_reset(MB_PRIMARY_BUS))
+        return false;
+
+    // Set baudrate, used to estimate the cost of transactions
+    busesBaudrates[MB_PRIMARY_BUS] = baudrate;
 
     // Set modbus loop period
     mbReadPeriod = readPeriod;
 
-    // Set modbus bit position MSB or LSB
+    // Set modbus bit position MSB or LSB, and decode registers accordingly
     mbBitPosition = bitPosition;
+    KnownRegisters_setWordOrder(bitPosition);
+
+    // Allocate scheduling structures, sized on the max number of registers
+    const int maxRegisters = KnownRegisters_capacity();
+    free(pollHeap);
+    free(dueHandles);
+    free(failedHandles);
+    free(pendingValues);
+    pollHeap = calloc(maxRegisters, sizeof(PollDeadline_t));
+    dueHandles = calloc(maxRegisters, sizeof(KnownRegHandle_t));
+    failedHandles = calloc(maxRegisters, sizeof(KnownRegHandle_t));
+    failedNum = 0;
+    pendingValuesCapacity = maxRegisters < MAX_VALUES_PER_MESSAGE ? maxRegisters : MAX_VALUES_PER_MESSAGE;
+    pendingValues = calloc(pendingValuesCapacity, sizeof(PendingValue_t));
+    pollHeapSize = 0;
+    pollHeapCapacity = pollHeap != NULL ? maxRegisters : 0;
+    if (pollHeap == NULL || dueHandles == NULL || failedHandles == NULL || pendingValues == NULL || !PollPlan_init(maxRegisters))
+        return false;
+    if (pollCompletions == NULL)
+        pollCompletions = xQueueCreateStatic(POLL_WINDOW, sizeof(BusRequest_t *), pollCompletionsStorage, &pollCompletionsBuffer);
+    if (pollCompletions == NULL)
+        return false;
+    if (batchWriteMutex == NULL)
+        batchWriteMutex = xSemaphoreCreateMutexStatic(&batchWriteMutexBuffer);
+    if (batchWriteMutex == NULL)
+        return false;
 
     // Init modbus library and task
     modbus_config_t mbCfg = {
@@ -255,7 +821,7 @@ bool MbRtu_init(uart_port_t uartPort, int baudrate, uint8_t txPin, uint8_t rxPin
         .mode = onRS485 ? UART_MODE_RS485_HALF_DUPLEX : UART_MODE_UART,
     };
 
-    if (Trackle_Modbus_init(&mbCfg) == ESP_OK)
+    if (Trackle_Modbus_init(&mbCfg) == ESP_OK && BusArbiter_init(MB_PRIMARY_BUS, NULL, busCoreId, 1))
     {
         monRegTaskHandle = xTaskCreateStaticPinnedToCore(monitoredRegistersTask,
                                                          MON_REGS_TASK_NAME,
@@ -279,73 +845,187 @@ bool MbRtu_wasStartedSuccesfully()
     return startedSuccessfully;
 }
 
-RegError_t MbRtu_readTypedRegisterByName(char *regName, char *valueString, int valueStringBuffLen)
+// Start an additional bus, driven by the gateway's own RTU master since the Trackle library handles a single port. Its transactions
+// are executed by a task pinned to the given core. The primary bus must have been started.
+bool MbRtu_initBus(uint8_t bus, const MbSerialConfig_t *serial, uint16_t interCmdsDelayMs, uint8_t coreId)
+{
+    if (!startedSuccessfully || bus == MB_PRIMARY_BUS || bus >= MB_SERIAL_BUSES_NUM)
+        return false;
+
+    BusTiming_init(bus, serial->baudrate, serial->dataBits, serial->parity, serial->stopBits, interCmdsDelayMs);
+    busesBaudrates[bus] = serial->baudrate;
+    return SlaveHealth_reset(bus) && MbSerial_init(bus, serial) && BusArbiter_init(bus, MbSerial_execute, coreId, 1);
+}
+
+// Start a Modbus TCP bus, bound to a server. Its transactions are executed by as many tasks as it can have in flight, pinned
+// to the given core, so that the monitor's reads of its blocks are pipelined. The primary bus must have been started.
+bool MbRtu_initTcpBus(uint8_t bus, const MbTcpConfig_t *tcp, uint8_t coreId)
+{
+    if (!startedSuccessfully || !MB_BUS_IS_TCP(bus) || bus >= MB_BUSES_NUM)
+        return false;
+
+    BusTiming_initUnpaced(bus);
+    return SlaveHealth_reset(bus) && MbTcp_init(bus, tcp) && BusArbiter_init(bus, MbTcp_execute, coreId, MbTcp_transactionsInFlight(tcp));
+}
+
+bool MbRtu_isBusRunning(uint8_t bus)
 {
-    BLOCKING_LOCK_OR_ABORT(mbSem);
+    return bus < MB_BUSES_NUM && BusArbiter_isRunning(bus);
+}
 
+RegError_t MbRtu_readTypedRegisterByName(char *regName, uint32_t maxAgeMs, char *valueString, int valueStringBuffLen, uint32_t *ageMs)
+{
     RegisterAccessData_t rad = {0};
-    if (!KnownRegisters_find(regName, &rad))
-    {
-        UNLOCK_OR_ABORT(mbSem);
+    const KnownRegHandle_t handle = KnownRegisters_handleOf(regName);
+    if (handle == INVALID_REG_HANDLE || !KnownRegisters_at(KnownRegisters_indexOf(handle), &rad))
         return RegError_NOT_FOUND;
-    }
 
-    const RegError_t regError = readTypedRegister(&rad, valueString, valueStringBuffLen);
+    const RegError_t regError = readTypedRegister(handle, &rad, maxAgeMs, valueString, valueStringBuffLen, ageMs);
 
-    UNLOCK_OR_ABORT(mbSem);
     return regError;
 }
 
-bool MbRtu_readAllRegistersJson(char *publishString, int publishStringMaxLen)
+typedef struct ReadAllCtx_s
 {
+    uint16_t rawRegValue[MAX_REG_LENGTH]; // Value read for the visited register
+    bool readOk;
+    PayloadWriter_t *writer;
+} ReadAllCtx_t;
 
-    const int knownRegistersCount = KnownRegisters_count();
-    publishString[0] = '\0';
-    strcat(publishString, "{");
-    int iAdded = 0;
-    for (int i = 0; i < knownRegistersCount; i++)
+static bool appendReadValue(int idx, const RegisterAccessData_t *rad, void *arg)
+{
+    ReadAllCtx_t *ctx = (ReadAllCtx_t *)arg;
+
+    const DecodePlan_t *plan = KnownRegisters_getDecodePlanAt(idx);
+    char valueString[VALUE_STRING_LEN] = {0};
+    RegValue_t value = {0};
+    PayloadWriter_key(ctx->writer, rad->regName);
+    if (ctx->readOk && decodeTypedRegister(plan, ctx->rawRegValue, valueString, VALUE_STRING_LEN) == RegError_OK)
     {
-        RegisterAccessData_t rad = {0};
+        if (PayloadEncoding_isBinary(payloadEncoding))
+            decodeRegisterValue(plan, ctx->rawRegValue, &value);
+        PayloadWriter_value(ctx->writer, &value, valueString);
+    }
+    else
+    {
+        PayloadWriter_null(ctx->writer);
+    }
+
+    return !PayloadWriter_overflowed(ctx->writer);
+}
 
-        configASSERT(KnownRegisters_at(i, &rad));
+bool MbRtu_readAllRegisters(uint32_t maxAgeMs, char *publishString, int publishStringMaxLen)
+{
+    static uint8_t binaryScratch[PUBLISH_STRING_LEN];
+    PayloadWriter_t writer;
+    PayloadWriter_init(&writer, payloadEncoding, PayloadEncoding_name(payloadEncoding), publishString, publishStringMaxLen, binaryScratch, PUBLISH_STRING_LEN);
 
-        char valueString[VALUE_STRING_LEN] = {0};
+    ReadAllCtx_t ctx = {.writer = &writer};
+    for (int i = 0; i < KnownRegisters_count() && !PayloadWriter_overflowed(&writer); i++)
+    {
+        // Only Modbus details are copied for the read: the registry isn't locked during bus transactions
+        RegisterPollData_t poll = {0};
+        const KnownRegHandle_t handle = KnownRegisters_handleAt(i);
+        if (!KnownRegisters_getPollDataAt(KnownRegisters_indexOf(handle), &poll))
+            continue;
 
-        BLOCKING_LOCK_OR_ABORT(mbSem);
-        readTypedRegister(&rad, valueString, VALUE_STRING_LEN);
-        UNLOCK_OR_ABORT(mbSem);
+        uint32_t ageMs = 0;
+        ctx.readOk = readCachedRegister(handle, &poll, maxAgeMs, ctx.rawRegValue, &ageMs) == RegError_OK;
 
-        if (iAdded > 0)
-        {
-            if (strlen(publishString) + CT_STRLEN(",") + NULL_CHAR_LEN > publishStringMaxLen)
-            {
-                return false;
-            }
-            strcat(publishString, ",");
-        }
+        KnownRegisters_visitHandle(handle, appendReadValue, &ctx);
+    }
 
-        char keyValueString[KEYVALUE_STRING_LEN] = {0};
-        const int kvLen = snprintf(keyValueString, KEYVALUE_STRING_LEN - NULL_CHAR_LEN, "\"%s\":%s", rad.regName, valueString);
-        if (kvLen + NULL_CHAR_LEN > KEYVALUE_STRING_LEN)
-        {
-            return false;
-        }
+    return !PayloadWriter_overflowed(&writer) && PayloadWriter_finish(&writer);
+}
 
-        if (strlen(publishString) + strlen(keyValueString) + NULL_CHAR_LEN > publishStringMaxLen)
-        {
-            return false;
-        }
-        strcat(publishString, keyValueString);
+static bool appendLatestValue(int idx, const RegisterAccessData_t *rad, void *arg)
+{
+    PayloadWriter_t *writer = (PayloadWriter_t *)arg;
+    if (!rad->monitored)
+        return true;
+
+    Seconds_t latestPublishedTime = 0;
+    configASSERT(KnownRegisters_getLatestPublishedTimeAt(idx, &latestPublishedTime));
+    uint16_t rawRegValue[MAX_REG_LENGTH] = {0};
+    memcpy(rawRegValue, KnownRegisters_getLatestPublishedRawAt(idx), sizeof(rawRegValue));
 
-        iAdded++;
+    const DecodePlan_t *plan = KnownRegisters_getDecodePlanAt(idx);
+    char valueString[VALUE_STRING_LEN] = {0};
+    RegValue_t value = {0};
+    PayloadWriter_key(writer, rad->regName);
+    if (latestPublishedTime > 0 && decodeTypedRegister(plan, rawRegValue, valueString, VALUE_STRING_LEN) == RegError_OK)
+    {
+        if (PayloadEncoding_isBinary(payloadEncoding))
+            decodeRegisterValue(plan, rawRegValue, &value);
+        PayloadWriter_value(writer, &value, valueString);
     }
-    if (strlen(publishString) + CT_STRLEN("}") + NULL_CHAR_LEN > publishStringMaxLen)
+    else
     {
-        return false;
+        PayloadWriter_null(writer);
     }
-    strcat(publishString, "}");
 
-    return true;
+    return !PayloadWriter_overflowed(writer);
+}
+
+bool MbRtu_getLatestPublishedValues(char *publishString, int publishStringMaxLen)
+{
+    static uint8_t binaryScratch[PUBLISH_STRING_LEN];
+    PayloadWriter_t writer;
+    PayloadWriter_init(&writer, payloadEncoding, PayloadEncoding_name(payloadEncoding), publishString, publishStringMaxLen, binaryScratch, PUBLISH_STRING_LEN);
+
+    KnownRegisters_forEach(appendLatestValue, &writer);
+
+    return !PayloadWriter_overflowed(&writer) && PayloadWriter_finish(&writer);
+}
+
+void MbRtu_setPayloadEncoding(PayloadEncoding_t encoding)
+{
+    payloadEncoding = encoding;
+}
+
+PayloadEncoding_t MbRtu_getPayloadEncoding()
+{
+    return payloadEncoding;
+}
+
+void MbRtu_setCompactKeys(bool compact)
+{
+    compactKeys = compact;
+}
+
+bool MbRtu_getCompactKeys()
+{
+    return compactKeys;
+}
+
+void MbRtu_setTrimTrailingZeros(bool trim)
+{
+    trimTrailingZeros = trim;
+}
+
+bool MbRtu_getTrimTrailingZeros()
+{
+    return trimTrailingZeros;
+}
+
+void MbRtu_setAdaptiveInterCmdsDelay(bool adaptive)
+{
+    BusTiming_setAdaptive(adaptive);
+}
+
+bool MbRtu_getAdaptiveInterCmdsDelay()
+{
+    return BusTiming_isAdaptive();
+}
+
+uint32_t MbRtu_getMinInterFrameGapUs()
+{
+    return BusTiming_minGapUs(MB_PRIMARY_BUS);
+}
+
+void MbRtu_setLatencyTargetMs(BusPriority_t priority, uint16_t targetMs)
+{
+    BusArbiter_setLatencyTargetMs(priority, targetMs);
 }
 
 static RegError_t numberStringToRaw(const RegisterAccessData_t *rad, const char *valueString, uint16_t *rawRegValue)
@@ -419,8 +1099,6 @@ static RegError_t numberStringToRaw(const RegisterAccessData_t *rad, const char
         }
     }
 
-    ESP_LOG_BUFFER_HEX_LEVEL("numberStringToRaw", rawRegValue, 2 * rad->regNumber, ESP_LOG_WARN);
-
     return RegError_OK;
 }
 
@@ -436,7 +1114,6 @@ static RegError_t stringBufferToRaw(const RegisterAccessData_t *rad, char *value
 {
     char tempValueString[VALUE_STRING_LEN] = {0};
     memcpy(tempValueString, valueString, strlen(valueString));
-    ESP_LOGE("stringBufferToRaw", "strlen(valueString) %d", strlen(valueString));
 
     if (mbBitPosition == 0) // msb
     {
@@ -456,128 +1133,181 @@ static RegError_t stringBufferToRaw(const RegisterAccessData_t *rad, char *value
     return RegError_OK;
 }
 
-RegError_t MbRtu_writeTypedRegisterByName(char *regName, char *valueString)
+// Find a register to write, and encode its typed value
+static RegError_t encodeTypedRegister(char *regName, char *valueString, RegisterAccessData_t *rad, uint16_t *rawRegValue)
 {
-    BLOCKING_LOCK_OR_ABORT(mbSem);
-
-    RegisterAccessData_t rad = {0};
-    if (!KnownRegisters_find(regName, &rad))
-    {
-        UNLOCK_OR_ABORT(mbSem);
+    if (!KnownRegisters_find(regName, rad))
         return RegError_NOT_FOUND;
-    }
 
     if (!startedSuccessfully)
-    {
-        UNLOCK_OR_ABORT(mbSem);
         return RegError_MB_NOT_INIT;
-    }
 
-    uint16_t rawRegValue[MAX_REG_LENGTH] = {0};
     RegError_t regError = RegError_OK;
-    switch (rad.type)
+    switch (rad->type)
     {
     case RADType_NUMBER:
-        regError = numberStringToRaw(&rad, valueString, rawRegValue);
+        regError = numberStringToRaw(rad, valueString, rawRegValue);
         break;
     case RADType_FLOAT:
-        regError = numberStringToRaw(&rad, valueString, rawRegValue);
+        regError = numberStringToRaw(rad, valueString, rawRegValue);
         break;
     case RADType_RAW:
         regError = rawStringToRaw(valueString, rawRegValue);
         break;
     case RADType_STRING:
-        regError = stringBufferToRaw(&rad, valueString, rawRegValue);
+        regError = stringBufferToRaw(rad, valueString, rawRegValue);
         break;
     }
     if (regError != RegError_OK)
-    {
-        UNLOCK_OR_ABORT(mbSem);
         return regError;
-    }
 
-    if (!rad.writable)
-    {
-        UNLOCK_OR_ABORT(mbSem);
+    if (!rad->writable)
         return RegError_REG_NOT_WRITABLE;
-    }
 
-    if (Trackle_Modbus_execute_command(rad.writeFunction, rad.slaveAddr, rad.regId, rad.regNumber, rawRegValue) != MODBUS_OK)
-    {
-        if (mbRequestFailedCallback != NULL)
-            mbRequestFailedCallback();
-        vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-        UNLOCK_OR_ABORT(mbSem);
+    if (!BusArbiter_isRunning(rad->bus))
+        return RegError_MB_NOT_INIT;
+
+    return RegError_OK;
+}
+
+// Write registers with the priority of control requests. Returns false if the write failed.
+static bool executeWrite(uint8_t bus, uint8_t writeFunction, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, uint16_t *words)
+{
+    const ModbusError err = BusArbiter_execute(bus, BusPriority_CONTROL, writeFunction, slaveAddr, regId, regNumber, words, true);
+    invalidateWrittenRegisters(bus, writeFunction, slaveAddr, regId, regNumber);
+    if (err != MODBUS_OK && mbRequestFailedCallback != NULL)
+        mbRequestFailedCallback();
+    return err == MODBUS_OK;
+}
+
+// Next write of a batch can be coalesced with the previous ones, written with FC=16 starting at head: it must follow them
+// on the same slave, right after the registers they span.
+static bool canCoalesceWrite(const RegisterAccessData_t *head, uint16_t regNumber, const RegisterAccessData_t *next)
+{
+    return head->writeFunction == 16 && next->writeFunction == 16 && next->bus == head->bus && next->slaveAddr == head->slaveAddr &&
+           next->regId == head->regId + regNumber && regNumber + next->regNumber <= MB_WRITE_MULTIPLE_MAX_REGS;
+}
+
+RegError_t MbRtu_writeTypedRegisterByName(char *regName, char *valueString)
+{
+    RegisterAccessData_t rad = {0};
+    uint16_t rawRegValue[MAX_REG_LENGTH] = {0};
+    const RegError_t regError = encodeTypedRegister(regName, valueString, &rad, rawRegValue);
+    if (regError != RegError_OK)
+        return regError;
+
+    if (!executeWrite(rad.bus, rad.writeFunction, rad.slaveAddr, rad.regId, rad.regNumber, rawRegValue))
         return RegError_MB_WRITE_ERR;
-    }
 
-    vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-    UNLOCK_OR_ABORT(mbSem);
     return RegError_OK;
 }
 
-RegError_t MbRtu_readRawRegisterByAddr(uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t *value)
+// Write many registers at once, in the given order, setting the result of each write. Consecutive registers written with
+// FC=16 that are contiguous on the same slave are written with a single transaction (up to 123 registers): if it fails, all
+// of them fail. Other registers are written one by one, with their own function. Returns the number of registers written.
+int MbRtu_writeTypedRegistersByName(MbRegWrite_t *writes, int writesNum)
 {
-    BLOCKING_LOCK_OR_ABORT(mbSem);
+    if (writesNum > MB_BATCH_WRITE_MAX)
+        writesNum = MB_BATCH_WRITE_MAX;
+    if (batchWriteMutex == NULL)
+    {
+        for (int w = 0; w < writesNum; w++)
+            writes[w].result = RegError_MB_NOT_INIT;
+        return 0;
+    }
 
-    if (!startedSuccessfully)
+    BLOCKING_LOCK_OR_ABORT(batchWriteMutex);
+    memset(batchRawValues, 0, sizeof(batchRawValues));
+    int validNum = 0;
+    for (int w = 0; w < writesNum; w++)
     {
-        UNLOCK_OR_ABORT(mbSem);
-        return RegError_MB_NOT_INIT;
+        writes[w].result = encodeTypedRegister(writes[w].regName, writes[w].valueString, &batchRads[w], batchRawValues[w]);
+        if (writes[w].result == RegError_OK)
+            batchValid[validNum++] = w;
     }
 
-    if (Trackle_Modbus_execute_command(readFunction, slaveAddr, regId, 1, value) != MODBUS_OK)
+    int writtenNum = 0;
+    for (int first = 0; first < validNum;)
+    {
+        const RegisterAccessData_t *head = &batchRads[batchValid[first]];
+        int last = first;
+        uint16_t regNumber = head->regNumber;
+        while (last + 1 < validNum && canCoalesceWrite(head, regNumber, &batchRads[batchValid[last + 1]]))
+            regNumber += batchRads[batchValid[++last]].regNumber;
+
+        bool ok = false;
+        if (last == first)
+        {
+            ok = executeWrite(head->bus, head->writeFunction, head->slaveAddr, head->regId, head->regNumber, batchRawValues[batchValid[first]]);
+        }
+        else
+        {
+            int wordsNum = 0;
+            for (int i = first; i <= last; i++)
+            {
+                memcpy(&batchWords[wordsNum], batchRawValues[batchValid[i]], batchRads[batchValid[i]].regNumber * sizeof(uint16_t));
+                wordsNum += batchRads[batchValid[i]].regNumber;
+            }
+            ok = executeWrite(head->bus, 16, head->slaveAddr, head->regId, regNumber, batchWords);
+        }
+
+        for (int i = first; i <= last; i++)
+            writes[batchValid[i]].result = ok ? RegError_OK : RegError_MB_WRITE_ERR;
+        if (ok)
+            writtenNum += last - first + 1;
+        first = last + 1;
+    }
+    UNLOCK_OR_ABORT(batchWriteMutex);
+    return writtenNum;
+}
+
+RegError_t MbRtu_readRawRegisterByAddr(uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint16_t *value)
+{
+    if (!startedSuccessfully || !MbRtu_isBusRunning(bus))
+        return RegError_MB_NOT_INIT;
+
+    if (BusArbiter_execute(bus, BusPriority_INTERACTIVE, readFunction, slaveAddr, regId, 1, value, true) != MODBUS_OK)
     {
         if (mbRequestFailedCallback != NULL)
             mbRequestFailedCallback();
-        vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-        UNLOCK_OR_ABORT(mbSem);
         return RegError_MB_READ_ERR;
     }
 
-    vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-    UNLOCK_OR_ABORT(mbSem);
     return RegError_OK;
 }
 
-RegError_t MbRtu_writeRawRegisterByAddr(uint8_t writeFunction, uint8_t slaveAddr, uint16_t regId, uint16_t value)
+RegError_t MbRtu_writeRawRegisterByAddr(uint8_t bus, uint8_t writeFunction, uint8_t slaveAddr, uint16_t regId, uint16_t value)
 {
-    BLOCKING_LOCK_OR_ABORT(mbSem);
-
-    if (!startedSuccessfully)
-    {
-        UNLOCK_OR_ABORT(mbSem);
+    if (!startedSuccessfully || !MbRtu_isBusRunning(bus))
         return RegError_MB_NOT_INIT;
-    }
 
-    if (Trackle_Modbus_execute_command(writeFunction, slaveAddr, regId, 1, &value) != MODBUS_OK)
+    const ModbusError err = BusArbiter_execute(bus, BusPriority_CONTROL, writeFunction, slaveAddr, regId, 1, &value, true);
+    invalidateWrittenRegisters(bus, writeFunction, slaveAddr, regId, 1);
+    if (err != MODBUS_OK)
     {
         if (mbRequestFailedCallback != NULL)
             mbRequestFailedCallback();
-        vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-        UNLOCK_OR_ABORT(mbSem);
         return RegError_MB_WRITE_ERR;
     }
 
-    vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
-    UNLOCK_OR_ABORT(mbSem);
     return RegError_OK;
 }
 
 void MbRtu_stop()
 {
-    BLOCKING_LOCK_OR_ABORT(mbSem);
+    for (uint8_t bus = 0; bus < MB_BUSES_NUM; bus++)
+        BusArbiter_stop(bus);
 }
 
 ModbusError MbRtu_forwardRequestToSlaves(TrackleModbusFunction function, uint8_t slaveAddr, uint16_t regId, uint16_t size, void *value)
 {
-    BLOCKING_LOCK_OR_ABORT(mbSem);
-
-    ModbusError err = Trackle_Modbus_execute_command(function, slaveAddr, regId, size, value);
+    // Values of coils and discrete inputs are bits, not words
+    const bool valueIsWords = function == 3 || function == 4 || function == 6 || function == 16;
+    // Upstream masters reach the slaves of the primary bus only
+    ModbusError err = BusArbiter_execute(MB_PRIMARY_BUS, BusPriority_FORWARDED, function, slaveAddr, regId, size, value, valueIsWords);
+    invalidateWrittenRegisters(MB_PRIMARY_BUS, function, slaveAddr, regId, size);
     if (err != MODBUS_OK && mbRequestFailedCallback != NULL)
         mbRequestFailedCallback();
-    vTaskDelay(mbInterCmdsDelayMs / portTICK_PERIOD_MS);
 
-    UNLOCK_OR_ABORT(mbSem);
     return err;
 }
@@ -0,0 +1,107 @@
+#include "mb_serial.h"
+
+#include <string.h>
+
+#include <driver/uart.h>
+
+#include <freertos/FreeRTOS.h>
+
+#include "mb_pdu.h"
+
+#define RX_BUFFER_SIZE 512 // Fits the longest RTU frame (256 bytes), and more than the hardware FIFO as the driver requires
+#define RESPONSE_TIMEOUT_MS 1000
+
+#define MAX_FRAME_LEN 256
+#define ADDR_LEN 1
+#define CRC_LEN 2
+#define EXCEPTION_LEN (ADDR_LEN + 2 + CRC_LEN) // Address, function, exception code, CRC
+#define BROADCAST_ADDR 0
+
+// Minimal Modbus RTU master, for buses beyond the one driven by the Trackle library. Transactions on a bus are executed by
+// its own task only, so that its state needs no locks.
+
+static uart_port_t uartPorts[MB_BUSES_NUM];
+static bool initialized[MB_BUSES_NUM] = {false};
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static uint16_t crc16(const uint8_t *data, int len)
+{
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+bool MbSerial_init(uint8_t bus, const MbSerialConfig_t *config)
+{
+    if (initialized[bus])
+        return true;
+
+    const uart_port_t port = config->uartPort;
+    const uart_config_t uartConfig = {
+        .baud_rate = config->baudrate,
+        .data_bits = config->dataBits,
+        .parity = config->parity,
+        .stop_bits = config->stopBits,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+    };
+    const bool onRS485 = config->dirPin >= 0;
+    if (uart_param_config(port, &uartConfig) != ESP_OK ||
+        uart_set_pin(port, config->txPin, config->rxPin, onRS485 ? config->dirPin : UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK ||
+        uart_driver_install(port, RX_BUFFER_SIZE, 0, 0, NULL, 0) != ESP_OK ||
+        uart_set_mode(port, onRS485 ? UART_MODE_RS485_HALF_DUPLEX : UART_MODE_UART) != ESP_OK)
+        return false;
+
+    uartPorts[bus] = port;
+    initialized[bus] = true;
+    return true;
+}
+
+// Execute a transaction: send its request and, unless broadcast, wait for the response of the slave. Words read are
+// stored in value, coils and discrete inputs as bytes packed as in Modbus frames.
+ModbusError MbSerial_execute(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, void *value)
+{
+    if (!initialized[bus])
+        return MB_BUS_ERR_NOT_RUNNING;
+
+    uint8_t frame[MAX_FRAME_LEN];
+    frame[0] = slaveAddr;
+    const int pduLen = MbPdu_buildRequest(&frame[ADDR_LEN], function, regId, regNumber, value);
+    if (pduLen == 0)
+        return MB_BUS_ERR_INVALID_REQUEST;
+    int len = ADDR_LEN + pduLen;
+    const uint16_t crc = crc16(frame, len);
+    frame[len++] = crc & 0xFF;
+    frame[len++] = crc >> 8;
+
+    const uart_port_t port = uartPorts[bus];
+    uart_flush_input(port);
+    if (uart_write_bytes(port, frame, len) != len || uart_wait_tx_done(port, pdMS_TO_TICKS(RESPONSE_TIMEOUT_MS)) != ESP_OK)
+        return MB_BUS_ERR_IO;
+    if (slaveAddr == BROADCAST_ADDR)
+        return MODBUS_OK;
+
+    // Exceptions are the shortest responses: the rest of the frame is read only if it's not one
+    const int expectedLen = ADDR_LEN + MbPdu_responseLen(function, regNumber) + CRC_LEN;
+    if (uart_read_bytes(port, frame, EXCEPTION_LEN, pdMS_TO_TICKS(RESPONSE_TIMEOUT_MS)) != EXCEPTION_LEN)
+        return MB_BUS_ERR_TIMEOUT;
+    if (frame[0] != slaveAddr || (frame[1] & ~MB_PDU_EXCEPTION_FLAG) != function)
+        return MB_BUS_ERR_INVALID_RESPONSE;
+    if (frame[1] & MB_PDU_EXCEPTION_FLAG)
+        return crc16(frame, EXCEPTION_LEN) == 0 ? MbPdu_exception(frame[2]) : MB_BUS_ERR_INVALID_RESPONSE;
+
+    const int remainingLen = expectedLen - EXCEPTION_LEN;
+    if (uart_read_bytes(port, &frame[EXCEPTION_LEN], remainingLen, pdMS_TO_TICKS(RESPONSE_TIMEOUT_MS)) != remainingLen)
+        return MB_BUS_ERR_TIMEOUT;
+    if (crc16(frame, expectedLen) != 0) // CRC of a frame including its own CRC is 0
+        return MB_BUS_ERR_INVALID_RESPONSE;
+
+    return MbPdu_parseResponse(&frame[ADDR_LEN], expectedLen - ADDR_LEN - CRC_LEN, function, regNumber, value);
+}
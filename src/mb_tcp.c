@@ -0,0 +1,401 @@
+#include "mb_tcp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "sem_utils.h"
+#include "mb_pdu.h"
+
+#define MBAP_LEN 7 // Transaction id, protocol id, length, unit id
+#define MAX_ADU_LEN (MBAP_LEN + MB_PDU_MAX_LEN)
+#define PROTOCOL_ID 0
+
+#define RESPONSE_TIMEOUT_MS 1000
+#define CONNECT_TIMEOUT_MS 1000
+#define RECV_SLICE_MS 50      // Receivers give others the chance to check their own deadline this often
+#define RECONNECT_DELAY_MS 1000 // After a connection fails, transactions fail at once for this long instead of reconnecting
+
+// Modbus TCP master. Several tasks execute the transactions of a bus at the same time: each takes a free slot of a
+// connection, so that up to depth requests are in flight on it. Responses are matched to requests by transaction id,
+// since servers may answer out of order. Only one task at a time receives from a connection, and hands over the responses
+// of the others.
+
+typedef struct Slot_s
+{
+    bool inUse;
+    bool completed;
+    uint16_t transactionId;
+    ModbusError result; // Set when completed: MODBUS_OK if the response was received
+    uint8_t pdu[MB_PDU_MAX_LEN];
+    int pduLen;
+    uint8_t unitId;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t doneBuffer;
+} Slot_t;
+
+typedef struct Connection_s
+{
+    int sock; // -1 if not connected
+    int64_t retryAtUs;
+    uint16_t nextTransactionId;
+    Slot_t slots[MB_TCP_MAX_DEPTH];
+    int slotsInUse;
+
+    // Sockets are closed by who holds both, taken in this order. Only one task at a time connects, without holding them.
+    SemaphoreHandle_t connectLock;
+    StaticSemaphore_t connectLockBuffer;
+    SemaphoreHandle_t rxLock;
+    StaticSemaphore_t rxLockBuffer;
+    SemaphoreHandle_t txLock;
+    StaticSemaphore_t txLockBuffer;
+} Connection_t;
+
+typedef struct TcpBus_s
+{
+    MbTcpConfig_t config;
+    Connection_t *connections; // Allocated when the bus is started
+    SemaphoreHandle_t slotsMutex; // Protects slots of all connections
+    StaticSemaphore_t slotsMutexBuffer;
+} TcpBus_t;
+
+static TcpBus_t buses[MB_TCP_BUSES_NUM];
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static TcpBus_t *tcpBusOf(uint8_t bus)
+{
+    if (!MB_BUS_IS_TCP(bus) || bus >= MB_BUSES_NUM || buses[bus - MB_FIRST_TCP_BUS].connections == NULL)
+        return NULL;
+    return &buses[bus - MB_FIRST_TCP_BUS];
+}
+
+// Take a free slot on the least busy connection. There's always one, since each bus has as many tasks as slots.
+static Slot_t *takeSlot(TcpBus_t *tcpBus, Connection_t **connection)
+{
+    BLOCKING_LOCK_OR_ABORT(tcpBus->slotsMutex);
+    Connection_t *c = &tcpBus->connections[0];
+    for (int i = 1; i < tcpBus->config.connectionsNum; i++)
+    {
+        if (tcpBus->connections[i].slotsInUse < c->slotsInUse)
+            c = &tcpBus->connections[i];
+    }
+    Slot_t *slot = NULL;
+    for (int s = 0; s < tcpBus->config.depth && slot == NULL; s++)
+    {
+        if (!c->slots[s].inUse)
+            slot = &c->slots[s];
+    }
+    if (slot != NULL)
+    {
+        xSemaphoreTake(slot->done, 0); // Completion of a previous transaction that timed out
+        slot->inUse = true;
+        slot->completed = false;
+        slot->transactionId = c->nextTransactionId++;
+        c->slotsInUse++;
+    }
+    UNLOCK_OR_ABORT(tcpBus->slotsMutex);
+    *connection = c;
+    return slot;
+}
+
+static void releaseSlot(TcpBus_t *tcpBus, Connection_t *c, Slot_t *slot)
+{
+    BLOCKING_LOCK_OR_ABORT(tcpBus->slotsMutex);
+    slot->inUse = false;
+    c->slotsInUse--;
+    UNLOCK_OR_ABORT(tcpBus->slotsMutex);
+}
+
+// Complete a slot waiting for a response. Returns false if no slot waits for the transaction (e.g. it timed out).
+static bool completeSlot(TcpBus_t *tcpBus, Connection_t *c, uint16_t transactionId, ModbusError result, const uint8_t *adu, int pduLen)
+{
+    bool found = false;
+    BLOCKING_LOCK_OR_ABORT(tcpBus->slotsMutex);
+    for (int s = 0; s < tcpBus->config.depth; s++)
+    {
+        Slot_t *slot = &c->slots[s];
+        if (!slot->inUse || slot->completed || slot->transactionId != transactionId)
+            continue;
+        slot->result = result;
+        if (adu != NULL)
+        {
+            slot->unitId = adu[MBAP_LEN - 1];
+            slot->pduLen = pduLen;
+            memcpy(slot->pdu, &adu[MBAP_LEN], pduLen);
+        }
+        slot->completed = true;
+        xSemaphoreGive(slot->done);
+        found = true;
+        break;
+    }
+    UNLOCK_OR_ABORT(tcpBus->slotsMutex);
+    return found;
+}
+
+// Close a connection, unless it was already reconnected, and fail the transactions in flight on it
+static void closeConnection(TcpBus_t *tcpBus, Connection_t *c, int sock)
+{
+    BLOCKING_LOCK_OR_ABORT(c->rxLock);
+    BLOCKING_LOCK_OR_ABORT(c->txLock);
+    if (c->sock == sock)
+    {
+        shutdown(sock, SHUT_RDWR);
+        close(sock);
+        c->sock = -1;
+        c->retryAtUs = esp_timer_get_time() + RECONNECT_DELAY_MS * 1000;
+        for (int s = 0; s < tcpBus->config.depth; s++)
+            completeSlot(tcpBus, c, c->slots[s].transactionId, MB_BUS_ERR_IO, NULL, 0);
+    }
+    UNLOCK_OR_ABORT(c->txLock);
+    UNLOCK_OR_ABORT(c->rxLock);
+}
+
+// Open a socket to the server, waiting at most CONNECT_TIMEOUT_MS for it to be connected. Returns -1 if it failed.
+static int openSocket(const MbTcpConfig_t *config)
+{
+    const int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0)
+        return -1;
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port);
+    memcpy(&addr.sin_addr.s_addr, config->ip, sizeof(config->ip)); // Already in network order
+
+    // Connect without blocking, so that an unreachable server can't stall the task for the whole TCP connect timeout
+    const int flags = fcntl(sock, F_GETFL, 0);
+    bool connected = flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+    if (connected && connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(sock, &writable);
+        struct timeval connectTimeout = {.tv_sec = CONNECT_TIMEOUT_MS / 1000, .tv_usec = (CONNECT_TIMEOUT_MS % 1000) * 1000};
+        int sockError = 0;
+        socklen_t sockErrorLen = sizeof(sockError);
+        connected = errno == EINPROGRESS && select(sock + 1, NULL, &writable, NULL, &connectTimeout) == 1 &&
+                    getsockopt(sock, SOL_SOCKET, SO_ERROR, &sockError, &sockErrorLen) == 0 && sockError == 0;
+    }
+
+    const struct timeval rxTimeout = {.tv_sec = 0, .tv_usec = RECV_SLICE_MS * 1000};
+    const struct timeval txTimeout = {.tv_sec = RESPONSE_TIMEOUT_MS / 1000, .tv_usec = (RESPONSE_TIMEOUT_MS % 1000) * 1000};
+    const int noDelay = 1;
+    if (!connected || fcntl(sock, F_SETFL, flags) != 0 || setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &rxTimeout, sizeof(rxTimeout)) != 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &txTimeout, sizeof(txTimeout)) != 0 ||
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) != 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Open the connection if it's not. Tasks that need it meanwhile wait for the attempt, then fail at once if it failed.
+static int connectIfNeeded(const MbTcpConfig_t *config, Connection_t *c)
+{
+    BLOCKING_LOCK_OR_ABORT(c->connectLock);
+    BLOCKING_LOCK_OR_ABORT(c->txLock);
+    int sock = c->sock;
+    const bool mustConnect = sock < 0 && esp_timer_get_time() >= c->retryAtUs;
+    UNLOCK_OR_ABORT(c->txLock);
+
+    if (mustConnect)
+    {
+        sock = openSocket(config);
+        BLOCKING_LOCK_OR_ABORT(c->txLock);
+        if (sock >= 0)
+            c->sock = sock;
+        else
+            c->retryAtUs = esp_timer_get_time() + RECONNECT_DELAY_MS * 1000;
+        UNLOCK_OR_ABORT(c->txLock);
+    }
+    UNLOCK_OR_ABORT(c->connectLock);
+    return sock;
+}
+
+static bool sendAll(int sock, const uint8_t *data, int len)
+{
+    while (len > 0)
+    {
+        const int sent = send(sock, data, len, 0);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+// Receive len bytes. Returns 0 if nothing arrived within a receive slice, -1 if the connection failed or a frame was
+// interrupted (the stream can't be resynchronized).
+static int recvAll(int sock, uint8_t *data, int len, bool frameStarted)
+{
+    const int64_t deadlineUs = esp_timer_get_time() + RESPONSE_TIMEOUT_MS * 1000;
+    int received = 0;
+    while (received < len)
+    {
+        const int n = recv(sock, &data[received], len - received, 0);
+        if (n > 0)
+        {
+            received += n;
+            continue;
+        }
+        const bool timedOut = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        if (!timedOut)
+            return -1;
+        if (received == 0 && !frameStarted)
+            return 0;
+        if (esp_timer_get_time() >= deadlineUs)
+            return -1;
+    }
+    return received;
+}
+
+// Receive a response and hand it to the slot waiting for it. Called holding the rx lock of the connection. Returns false if
+// the connection failed.
+static bool receiveResponse(TcpBus_t *tcpBus, Connection_t *c, int sock)
+{
+    uint8_t adu[MAX_ADU_LEN];
+    const int headerLen = recvAll(sock, adu, MBAP_LEN, false);
+    if (headerLen <= 0)
+        return headerLen == 0;
+
+    const uint16_t transactionId = ((uint16_t)adu[0] << 8) | adu[1];
+    const uint16_t protocolId = ((uint16_t)adu[2] << 8) | adu[3];
+    const uint16_t length = ((uint16_t)adu[4] << 8) | adu[5]; // Unit id and PDU
+    if (protocolId != PROTOCOL_ID || length < 2 || length > MB_PDU_MAX_LEN + 1)
+        return false;
+    const int pduLen = length - 1;
+    if (recvAll(sock, &adu[MBAP_LEN], pduLen, true) != pduLen)
+        return false;
+
+    completeSlot(tcpBus, c, transactionId, MODBUS_OK, adu, pduLen);
+    return true;
+}
+
+// Wait for the response of a slot, receiving from the connection whenever no other task does. Returns false on timeout.
+static bool waitResponse(TcpBus_t *tcpBus, Connection_t *c, int sock, Slot_t *slot)
+{
+    const int64_t deadlineUs = esp_timer_get_time() + RESPONSE_TIMEOUT_MS * 1000;
+    while (esp_timer_get_time() < deadlineUs)
+    {
+        if (xSemaphoreTake(slot->done, 0) == pdTRUE)
+            return true;
+        if (xSemaphoreTake(c->rxLock, 0) != pdTRUE)
+        {
+            if (xSemaphoreTake(slot->done, pdMS_TO_TICKS(RECV_SLICE_MS)) == pdTRUE)
+                return true;
+            continue;
+        }
+        const bool connectionOk = c->sock != sock || slot->completed || receiveResponse(tcpBus, c, sock);
+        UNLOCK_OR_ABORT(c->rxLock);
+        if (!connectionOk)
+            closeConnection(tcpBus, c, sock);
+    }
+    return xSemaphoreTake(slot->done, 0) == pdTRUE;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+// Bind a bus to a server. Connections are opened by the first transactions, and reopened when they fail.
+bool MbTcp_init(uint8_t bus, const MbTcpConfig_t *config)
+{
+    if (!MB_BUS_IS_TCP(bus) || bus >= MB_BUSES_NUM || config->connectionsNum == 0 || config->connectionsNum > MB_TCP_MAX_CONNECTIONS ||
+        config->depth == 0 || config->depth > MB_TCP_MAX_DEPTH)
+        return false;
+    TcpBus_t *tcpBus = &buses[bus - MB_FIRST_TCP_BUS];
+    if (tcpBus->connections != NULL)
+        return true;
+
+    tcpBus->slotsMutex = xSemaphoreCreateMutexStatic(&tcpBus->slotsMutexBuffer);
+    Connection_t *connections = calloc(config->connectionsNum, sizeof(Connection_t));
+    if (tcpBus->slotsMutex == NULL || connections == NULL)
+    {
+        free(connections);
+        return false;
+    }
+    for (int i = 0; i < config->connectionsNum; i++)
+    {
+        Connection_t *c = &connections[i];
+        c->sock = -1;
+        c->connectLock = xSemaphoreCreateMutexStatic(&c->connectLockBuffer);
+        c->rxLock = xSemaphoreCreateMutexStatic(&c->rxLockBuffer);
+        c->txLock = xSemaphoreCreateMutexStatic(&c->txLockBuffer);
+        configASSERT(c->connectLock != NULL && c->rxLock != NULL && c->txLock != NULL);
+        for (int s = 0; s < MB_TCP_MAX_DEPTH; s++)
+        {
+            c->slots[s].done = xSemaphoreCreateBinaryStatic(&c->slots[s].doneBuffer);
+            configASSERT(c->slots[s].done != NULL);
+        }
+    }
+
+    tcpBus->config = *config;
+    tcpBus->connections = connections;
+    return true;
+}
+
+// Transactions a bus bound to a server can have in flight: as many tasks execute them
+int MbTcp_transactionsInFlight(const MbTcpConfig_t *config)
+{
+    return config->connectionsNum * config->depth;
+}
+
+// Execute a transaction on the server of a bus, waiting for its response. Words read are stored in value, coils and discrete
+// inputs as bytes packed as in Modbus frames. May be called by several tasks at the same time.
+ModbusError MbTcp_execute(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, void *value)
+{
+    TcpBus_t *tcpBus = tcpBusOf(bus);
+    if (tcpBus == NULL)
+        return MB_BUS_ERR_NOT_RUNNING;
+
+    uint8_t adu[MAX_ADU_LEN];
+    const int pduLen = MbPdu_buildRequest(&adu[MBAP_LEN], function, regId, regNumber, value);
+    if (pduLen == 0)
+        return MB_BUS_ERR_INVALID_REQUEST;
+
+    Connection_t *c = NULL;
+    Slot_t *slot = takeSlot(tcpBus, &c);
+    if (slot == NULL)
+        return MB_BUS_ERR_IO;
+    adu[0] = slot->transactionId >> 8;
+    adu[1] = slot->transactionId & 0xFF;
+    adu[2] = PROTOCOL_ID >> 8;
+    adu[3] = PROTOCOL_ID & 0xFF;
+    adu[4] = (pduLen + 1) >> 8;
+    adu[5] = (pduLen + 1) & 0xFF;
+    adu[6] = slaveAddr;
+
+    const int sock = connectIfNeeded(&tcpBus->config, c);
+    bool sent = false;
+    if (sock >= 0)
+    {
+        BLOCKING_LOCK_OR_ABORT(c->txLock);
+        sent = c->sock == sock && sendAll(sock, adu, MBAP_LEN + pduLen); // Not closed meanwhile
+        UNLOCK_OR_ABORT(c->txLock);
+    }
+    if (!sent)
+    {
+        if (sock >= 0)
+            closeConnection(tcpBus, c, sock);
+        releaseSlot(tcpBus, c, slot);
+        return MB_BUS_ERR_IO;
+    }
+
+    ModbusError err = MB_BUS_ERR_TIMEOUT;
+    if (waitResponse(tcpBus, c, sock, slot))
+    {
+        err = slot->result;
+        if (err == MODBUS_OK)
+            err = slot->unitId == slaveAddr ? MbPdu_parseResponse(slot->pdu, slot->pduLen, function, regNumber, value) : MB_BUS_ERR_INVALID_RESPONSE;
+    }
+    releaseSlot(tcpBus, c, slot);
+    return err;
+}
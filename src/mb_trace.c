@@ -0,0 +1,92 @@
+#include "mb_trace.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include <esp_log.h>
+
+// Entries are written by the tasks that own the buses and read by any other one, without locks: the stamp of a slot is 0
+// while its entry is being written, then the sequence number of the entry plus 1. A reader copies the entry and checks
+// that the stamp didn't change meanwhile.
+typedef struct MbTraceSlot_s
+{
+    atomic_uint_least32_t stamp;
+    MbTraceEntry_t entry;
+} MbTraceSlot_t;
+
+static const char *TAG = "mb_trace";
+
+static MbTraceSlot_t ring[MB_TRACE_ENTRIES];
+static atomic_uint_least32_t nextSeq = 0;
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+void MbTrace_record(uint8_t bus, uint8_t function, uint8_t slaveAddr, uint16_t regId, uint16_t regNumber, const uint16_t *words, uint16_t wordsNum,
+                    int result, int64_t startUs, int64_t durationUs)
+{
+    const uint32_t seq = atomic_fetch_add_explicit(&nextSeq, 1, memory_order_relaxed);
+    MbTraceSlot_t *slot = &ring[seq % MB_TRACE_ENTRIES];
+
+    atomic_store_explicit(&slot->stamp, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    MbTraceEntry_t *entry = &slot->entry;
+    entry->seq = seq;
+    entry->startUs = (uint32_t)startUs;
+    entry->durationUs = (uint32_t)durationUs;
+    entry->regId = regId;
+    entry->regNumber = regNumber;
+    entry->bus = bus;
+    entry->function = function;
+    entry->slaveAddr = slaveAddr;
+    entry->result = (int8_t)result;
+    entry->wordsNum = wordsNum < MB_TRACE_MAX_WORDS ? wordsNum : MB_TRACE_MAX_WORDS;
+    if (words != NULL)
+        memcpy(entry->words, words, entry->wordsNum * sizeof(uint16_t));
+    else
+        entry->wordsNum = 0;
+
+    atomic_store_explicit(&slot->stamp, seq + 1, memory_order_release);
+}
+
+// Sequence number the next transaction will have
+uint32_t MbTrace_nextSeq()
+{
+    return atomic_load_explicit(&nextSeq, memory_order_acquire);
+}
+
+// Sequence number of the oldest transaction that may still be in the trace
+uint32_t MbTrace_oldestSeq()
+{
+    const uint32_t next = MbTrace_nextSeq();
+    return next > MB_TRACE_ENTRIES ? next - MB_TRACE_ENTRIES : 0;
+}
+
+// Copy the entry of a transaction. Returns false if it's not in the trace, because it was overwritten or not yet recorded.
+bool MbTrace_read(uint32_t seq, MbTraceEntry_t *entry)
+{
+    const MbTraceSlot_t *slot = &ring[seq % MB_TRACE_ENTRIES];
+    if (atomic_load_explicit(&slot->stamp, memory_order_acquire) != seq + 1)
+        return false;
+
+    memcpy(entry, &slot->entry, sizeof(MbTraceEntry_t));
+
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->stamp, memory_order_relaxed) == seq + 1;
+}
+
+// Log the whole trace. Meant for debugging: it takes console time, but it's never called while the buses are in use.
+void MbTrace_dump()
+{
+    const uint32_t next = MbTrace_nextSeq();
+    for (uint32_t seq = MbTrace_oldestSeq(); seq != next; seq++)
+    {
+        MbTraceEntry_t entry;
+        if (!MbTrace_read(seq, &entry))
+            continue;
+        ESP_LOGI(TAG, "#%" PRIu32 " t=%" PRIu32 "us %" PRIu32 "us bus=%" PRIu8 " fc=%" PRIu8 " slave=%" PRIu8 " reg=%" PRIu16 " len=%" PRIu16 " res=%d",
+                 entry.seq, entry.startUs, entry.durationUs, entry.bus, entry.function, entry.slaveAddr, entry.regId, entry.regNumber, entry.result);
+        if (entry.wordsNum > 0)
+            ESP_LOG_BUFFER_HEX_LEVEL(TAG, entry.words, entry.wordsNum * sizeof(uint16_t), ESP_LOG_INFO);
+    }
+}
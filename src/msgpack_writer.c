@@ -0,0 +1,213 @@
+#include "msgpack_writer.h"
+
+#include <string.h>
+
+// Formats (MessagePack specification)
+#define MP_POSITIVE_FIXINT_MAX 0x7F
+#define MP_NEGATIVE_FIXINT_MIN (-32)
+#define MP_FIXSTR 0xA0
+#define MP_FIXSTR_MAX_LEN 31
+#define MP_NIL 0xC0
+#define MP_FALSE 0xC2
+#define MP_TRUE 0xC3
+#define MP_FLOAT32 0xCA
+#define MP_FLOAT64 0xCB
+#define MP_UINT8 0xCC
+#define MP_UINT16 0xCD
+#define MP_UINT32 0xCE
+#define MP_UINT64 0xCF
+#define MP_INT8 0xD0
+#define MP_INT16 0xD1
+#define MP_INT32 0xD2
+#define MP_INT64 0xD3
+#define MP_STR8 0xD9
+#define MP_STR16 0xDA
+#define MP_STR32 0xDB
+#define MP_MAP16 0xDE
+
+#define MAP16_HEAD_LEN 3
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static bool reserve(MsgpackWriter_t *writer, int dataLen)
+{
+    if (writer->overflow)
+        return false;
+
+    if (writer->len + dataLen > writer->capacity)
+    {
+        writer->overflow = true;
+        return false;
+    }
+    return true;
+}
+
+// Append a format byte followed by big endian bytes of value, all or nothing
+static void appendFormat(MsgpackWriter_t *writer, uint8_t format, uint64_t value, int bytesNum)
+{
+    if (!reserve(writer, 1 + bytesNum))
+        return;
+    writer->buf[writer->len++] = format;
+    for (int i = bytesNum - 1; i >= 0; i--)
+        writer->buf[writer->len++] = (value >> (8 * i)) & 0xFF;
+}
+
+// Count an item of the map being written, and keep its head up to date
+static void itemWritten(MsgpackWriter_t *writer)
+{
+    if (writer->overflow || writer->mapPos < 0)
+        return;
+    writer->mapItems++;
+    const uint16_t pairs = writer->mapItems / 2;
+    writer->buf[writer->mapPos + 1] = pairs >> 8;
+    writer->buf[writer->mapPos + 2] = pairs & 0xFF;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+void MsgpackWriter_init(MsgpackWriter_t *writer, uint8_t *buf, int capacity)
+{
+    writer->buf = buf;
+    writer->capacity = capacity;
+    writer->len = 0;
+    writer->overflow = false;
+    writer->mapPos = -1;
+    writer->mapItems = 0;
+}
+
+// Maps can't be nested. Their head always takes 3 bytes, since their size isn't known in advance.
+void MsgpackWriter_beginMap(MsgpackWriter_t *writer)
+{
+    const int mapPos = writer->len;
+    appendFormat(writer, MP_MAP16, 0, MAP16_HEAD_LEN - 1);
+    if (writer->overflow)
+        return;
+    writer->mapPos = mapPos;
+    writer->mapItems = 0;
+}
+
+void MsgpackWriter_endMap(MsgpackWriter_t *writer)
+{
+    writer->mapPos = -1;
+}
+
+void MsgpackWriter_uint(MsgpackWriter_t *writer, uint64_t value)
+{
+    if (value <= MP_POSITIVE_FIXINT_MAX)
+        appendFormat(writer, value, 0, 0);
+    else if (value <= UINT8_MAX)
+        appendFormat(writer, MP_UINT8, value, 1);
+    else if (value <= UINT16_MAX)
+        appendFormat(writer, MP_UINT16, value, 2);
+    else if (value <= UINT32_MAX)
+        appendFormat(writer, MP_UINT32, value, 4);
+    else
+        appendFormat(writer, MP_UINT64, value, 8);
+    itemWritten(writer);
+}
+
+void MsgpackWriter_int(MsgpackWriter_t *writer, int64_t value)
+{
+    if (value >= 0)
+    {
+        MsgpackWriter_uint(writer, value);
+        return;
+    }
+
+    if (value >= MP_NEGATIVE_FIXINT_MIN)
+        appendFormat(writer, (uint8_t)value, 0, 0);
+    else if (value >= INT8_MIN)
+        appendFormat(writer, MP_INT8, (uint8_t)value, 1);
+    else if (value >= INT16_MIN)
+        appendFormat(writer, MP_INT16, (uint16_t)value, 2);
+    else if (value >= INT32_MIN)
+        appendFormat(writer, MP_INT32, (uint32_t)value, 4);
+    else
+        appendFormat(writer, MP_INT64, (uint64_t)value, 8);
+    itemWritten(writer);
+}
+
+void MsgpackWriter_float32(MsgpackWriter_t *writer, float value)
+{
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    appendFormat(writer, MP_FLOAT32, bits, 4);
+    itemWritten(writer);
+}
+
+void MsgpackWriter_float64(MsgpackWriter_t *writer, double value)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    appendFormat(writer, MP_FLOAT64, bits, 8);
+    itemWritten(writer);
+}
+
+// Write a double using single precision, if it can represent it exactly
+void MsgpackWriter_double(MsgpackWriter_t *writer, double value)
+{
+    const float singleValue = (float)value;
+    if ((double)singleValue == value || value != value)
+        MsgpackWriter_float32(writer, singleValue);
+    else
+        MsgpackWriter_float64(writer, value);
+}
+
+void MsgpackWriter_text(MsgpackWriter_t *writer, const char *value, int valueLen)
+{
+    if (valueLen <= MP_FIXSTR_MAX_LEN)
+        appendFormat(writer, MP_FIXSTR | valueLen, 0, 0);
+    else if (valueLen <= UINT8_MAX)
+        appendFormat(writer, MP_STR8, valueLen, 1);
+    else if (valueLen <= UINT16_MAX)
+        appendFormat(writer, MP_STR16, valueLen, 2);
+    else
+        appendFormat(writer, MP_STR32, valueLen, 4);
+    if (reserve(writer, valueLen))
+    {
+        memcpy(&writer->buf[writer->len], value, valueLen);
+        writer->len += valueLen;
+    }
+    itemWritten(writer);
+}
+
+void MsgpackWriter_bool(MsgpackWriter_t *writer, bool value)
+{
+    appendFormat(writer, value ? MP_TRUE : MP_FALSE, 0, 0);
+    itemWritten(writer);
+}
+
+void MsgpackWriter_null(MsgpackWriter_t *writer)
+{
+    appendFormat(writer, MP_NIL, 0, 0);
+    itemWritten(writer);
+}
+
+bool MsgpackWriter_overflowed(const MsgpackWriter_t *writer)
+{
+    return writer->overflow;
+}
+
+int MsgpackWriter_length(const MsgpackWriter_t *writer)
+{
+    return writer->len;
+}
+
+MsgpackWriterMark_t MsgpackWriter_mark(const MsgpackWriter_t *writer)
+{
+    const MsgpackWriterMark_t mark = {.len = writer->len, .mapItems = writer->mapItems};
+    return mark;
+}
+
+void MsgpackWriter_rollback(MsgpackWriter_t *writer, MsgpackWriterMark_t mark)
+{
+    writer->len = mark.len;
+    writer->overflow = false;
+    writer->mapItems = mark.mapItems;
+    if (writer->mapPos >= 0)
+    {
+        const uint16_t pairs = writer->mapItems / 2;
+        writer->buf[writer->mapPos + 1] = pairs >> 8;
+        writer->buf[writer->mapPos + 2] = pairs & 0xFF;
+    }
+}
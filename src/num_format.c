@@ -0,0 +1,142 @@
+#include "num_format.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define UINT64_MAX_DIGITS 20
+
+// Scaled values are integers in a double only up to 2^53: larger ones are formatted with printf
+#define MAX_FAST_SCALED_VALUE 9007199254740992.0
+
+static const uint64_t POW10[NUM_FORMAT_MAX_FAST_DECIMALS + 1] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+};
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+// Write digits of value from the least significant one. Returns their number.
+static int reversedDigits(uint64_t value, char *digits)
+{
+    int len = 0;
+    do
+    {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    return len;
+}
+
+// Write sign and integer part, followed by the fractional part, given as the integer made by its decimals digits
+static int formatParts(bool negative, uint64_t intPart, uint64_t fracPart, uint8_t decimals, bool trimZeros, char *buf, int bufLen)
+{
+    char intDigits[UINT64_MAX_DIGITS];
+    const int intLen = reversedDigits(intPart, intDigits);
+
+    int fracLen = decimals;
+    if (trimZeros)
+    {
+        while (fracLen > 0 && fracPart % 10 == 0)
+        {
+            fracPart /= 10;
+            fracLen--;
+        }
+    }
+
+    negative = negative && (intPart > 0 || fracLen > 0); // no "-0"
+    const int len = (negative ? 1 : 0) + intLen + (fracLen > 0 ? 1 + fracLen : 0);
+    if (len + 1 > bufLen)
+        return -1;
+
+    char *c = buf;
+    if (negative)
+        *c++ = '-';
+    for (int i = intLen - 1; i >= 0; i--)
+        *c++ = intDigits[i];
+    if (fracLen > 0)
+    {
+        *c++ = '.';
+        for (int i = fracLen - 1; i >= 0; i--)
+        {
+            c[i] = '0' + fracPart % 10;
+            fracPart /= 10;
+        }
+        c += fracLen;
+    }
+    *c = '\0';
+    return len;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+int NumFormat_int(int64_t value, uint8_t decimals, bool trimZeros, char *buf, int bufLen)
+{
+    const bool negative = value < 0;
+    const uint64_t magnitude = negative ? 0 - (uint64_t)value : (uint64_t)value;
+    return formatParts(negative, magnitude, 0, decimals, trimZeros, buf, bufLen);
+}
+
+int NumFormat_uint(uint64_t value, uint8_t decimals, bool trimZeros, char *buf, int bufLen)
+{
+    return formatParts(false, value, 0, decimals, trimZeros, buf, bufLen);
+}
+
+// Value is scaled by 10^decimals and rounded to an integer, whose digits are then split by the point. Halves are rounded away from zero.
+int NumFormat_fixed(double value, uint8_t decimals, bool trimZeros, char *buf, int bufLen)
+{
+    if (decimals <= NUM_FORMAT_MAX_FAST_DECIMALS && isfinite(value))
+    {
+        const double scaled = value * (double)POW10[decimals];
+        if (fabs(scaled) < MAX_FAST_SCALED_VALUE)
+        {
+            const int64_t rounded = llround(scaled);
+            const bool negative = rounded < 0;
+            const uint64_t magnitude = negative ? 0 - (uint64_t)rounded : (uint64_t)rounded;
+            return formatParts(negative, magnitude / POW10[decimals], magnitude % POW10[decimals], decimals, trimZeros, buf, bufLen);
+        }
+    }
+
+    const int len = snprintf(buf, bufLen, "%.*f", decimals, value);
+    if (len < 0 || len > bufLen - 1)
+        return -1;
+    if (!trimZeros || strchr(buf, '.') == NULL)
+        return len;
+
+    int trimmedLen = len;
+    while (buf[trimmedLen - 1] == '0')
+        trimmedLen--;
+    if (buf[trimmedLen - 1] == '.')
+        trimmedLen--;
+    buf[trimmedLen] = '\0';
+    return trimmedLen;
+}
+
+// Same rounding used by NumFormat_fixed. Values too large to be scaled have no digits beyond decimals anyway.
+double NumFormat_round(double value, uint8_t decimals)
+{
+    if (decimals > NUM_FORMAT_MAX_FAST_DECIMALS || !isfinite(value))
+        return value;
+
+    const double scaled = value * (double)POW10[decimals];
+    if (fabs(scaled) >= MAX_FAST_SCALED_VALUE)
+        return value;
+    return round(scaled) / (double)POW10[decimals];
+}
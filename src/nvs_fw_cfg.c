@@ -1,5 +1,7 @@
 #include "nvs_fw_cfg.h"
 
+#include <string.h>
+
 #include <esp_log.h>
 #include <nvs_flash.h>
 #include <driver/uart.h>
@@ -10,17 +12,42 @@
 #define NVS_GATEWAY_FW_CFG_NAMESPACE "gateway-fw-cfg"
 #define NVS_FIRMWARE_CONFIG_STRUCT_KEY "firmware-config"
 
-#define DEFAULT_FIRMWARE_CONFIG              \
-    {                                        \
-        .fwVersion = FIRMWARE_VERSION,       \
-        .modbusBaudrate = 9600,              \
-        .modbusInterCmdsDelayMs = 50,        \
-        .knownRegistersAtStartup = 0,        \
-        .modbusReadPeriod = 1,               \
-        .serialDataBits = UART_DATA_8_BITS,  \
-        .serialParity = UART_PARITY_DISABLE, \
-        .serialStopBits = UART_STOP_BITS_1,  \
-        .bitPosition = 0                     \
+#define DEFAULT_EXTRA_BUS_CONFIG                                                                                      \
+    {                                                                                                                 \
+        .enabled = false,                                                                                             \
+        .serial = {.uartPort = 0, .txPin = -1, .rxPin = -1, .dirPin = -1, .baudrate = 9600, .dataBits = UART_DATA_8_BITS, \
+                   .parity = UART_PARITY_DISABLE, .stopBits = UART_STOP_BITS_1},                                       \
+    }
+
+#define DEFAULT_TCP_BUS_CONFIG                                                                                  \
+    {                                                                                                           \
+        .enabled = false,                                                                                       \
+        .coreId = 1,                                                                                            \
+        .tcp = {.ip = {0, 0, 0, 0}, .port = MB_TCP_DEFAULT_PORT, .connectionsNum = 1, .depth = 1},              \
+    }
+
+#define DEFAULT_FIRMWARE_CONFIG                  \
+    {                                            \
+        .fwVersion = FIRMWARE_VERSION,           \
+        .modbusBaudrate = 9600,                  \
+        .modbusInterCmdsDelayMs = 50,            \
+        .knownRegistersAtStartup = 0,            \
+        .modbusReadPeriod = 1,                   \
+        .serialDataBits = UART_DATA_8_BITS,      \
+        .serialParity = UART_PARITY_DISABLE,     \
+        .serialStopBits = UART_STOP_BITS_1,      \
+        .bitPosition = 0,                        \
+        .maxRegisters = 0,                       \
+        .payloadEncoding = PayloadEncoding_JSON, \
+        .compactKeys = false,                    \
+        .trimTrailingZeros = false,              \
+        .adaptiveInterCmdsDelay = true,          \
+        .latencyTargetsMs = {100, 250, 1000, 0}, \
+        .busCores = {0, 1, 1},                   \
+        .extraBuses = {DEFAULT_EXTRA_BUS_CONFIG, \
+                       DEFAULT_EXTRA_BUS_CONFIG}, \
+        .tcpBuses = {DEFAULT_TCP_BUS_CONFIG,     \
+                     DEFAULT_TCP_BUS_CONFIG}     \
     }
 
 static const char *TAG = "nvs_fw_cfg";
@@ -28,9 +55,134 @@ static const char *TAG = "nvs_fw_cfg";
 static FirmwareConfig_t actualFirmwareConfig = DEFAULT_FIRMWARE_CONFIG;
 static FirmwareConfig_t nextFirmwareConfig = DEFAULT_FIRMWARE_CONFIG;
 
+// Fields of the configuration that make its hash. Fields only set when it's saved (firmware version, registers at startup) are
+// left out. Values are appended: ids must never change, so that hashes stay comparable across versions.
+typedef enum
+{
+    ConfigField_MB_BAUDRATE,
+    ConfigField_MB_INTER_CMDS_DELAY_MS,
+    ConfigField_MB_READ_PERIOD,
+    ConfigField_SERIAL_DATA_BITS,
+    ConfigField_SERIAL_STOP_BITS,
+    ConfigField_SERIAL_PARITY,
+    ConfigField_BIT_POSITION,
+    ConfigField_MAX_REGISTERS,
+    ConfigField_PAYLOAD_ENCODING,
+    ConfigField_COMPACT_KEYS,
+    ConfigField_TRIM_TRAILING_ZEROS,
+    ConfigField_ADAPTIVE_INTER_CMDS_DELAY,
+    ConfigField_LATENCY_TARGET_MS, // Indexed by priority
+    ConfigField_BUS_CORE,          // Indexed by bus, for all buses
+    ConfigField_BUS_ENABLED,       // Indexed by bus, for the following ones too
+    ConfigField_BUS_UART_PORT,
+    ConfigField_BUS_TX_PIN,
+    ConfigField_BUS_RX_PIN,
+    ConfigField_BUS_DIR_PIN,
+    ConfigField_BUS_BAUDRATE,
+    ConfigField_BUS_DATA_BITS,
+    ConfigField_BUS_PARITY,
+    ConfigField_BUS_STOP_BITS,
+    ConfigField_BUS_IP, // Big endian
+    ConfigField_BUS_PORT,
+    ConfigField_BUS_CONNECTIONS_NUM,
+    ConfigField_BUS_DEPTH,
+} ConfigField_t;
+
+// Hash of the configuration that will be applied at next restart: XOR of the hashes of its fields, updated by setters like the
+// hash of the register map, so that it doesn't depend on the layout of the structure.
+static uint32_t nextConfigHash = 0;
+static bool nextConfigHashValid = false;
+
+// 32 bit FNV-1a of field id, index and value, as little endian bytes
+static uint32_t fieldHash(ConfigField_t field, uint8_t index, int64_t value)
+{
+    uint8_t bytes[2 + sizeof(value)] = {field, index};
+    for (int i = 0; i < sizeof(value); i++)
+        bytes[2 + i] = (uint64_t)value >> (8 * i);
+
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < sizeof(bytes); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t ipValue(const uint8_t ip[4])
+{
+    return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+}
+
+static uint32_t serialBusHash(uint8_t bus, const ExtraBusConfig_t *extraBus)
+{
+    return fieldHash(ConfigField_BUS_ENABLED, bus, extraBus->enabled) ^ fieldHash(ConfigField_BUS_UART_PORT, bus, extraBus->serial.uartPort) ^
+           fieldHash(ConfigField_BUS_TX_PIN, bus, extraBus->serial.txPin) ^ fieldHash(ConfigField_BUS_RX_PIN, bus, extraBus->serial.rxPin) ^
+           fieldHash(ConfigField_BUS_DIR_PIN, bus, extraBus->serial.dirPin) ^ fieldHash(ConfigField_BUS_BAUDRATE, bus, extraBus->serial.baudrate) ^
+           fieldHash(ConfigField_BUS_DATA_BITS, bus, extraBus->serial.dataBits) ^ fieldHash(ConfigField_BUS_PARITY, bus, extraBus->serial.parity) ^
+           fieldHash(ConfigField_BUS_STOP_BITS, bus, extraBus->serial.stopBits);
+}
+
+static uint32_t tcpBusHash(uint8_t bus, const TcpBusConfig_t *tcpBus)
+{
+    return fieldHash(ConfigField_BUS_ENABLED, bus, tcpBus->enabled) ^ fieldHash(ConfigField_BUS_CORE, bus, tcpBus->coreId) ^
+           fieldHash(ConfigField_BUS_IP, bus, ipValue(tcpBus->tcp.ip)) ^ fieldHash(ConfigField_BUS_PORT, bus, tcpBus->tcp.port) ^
+           fieldHash(ConfigField_BUS_CONNECTIONS_NUM, bus, tcpBus->tcp.connectionsNum) ^ fieldHash(ConfigField_BUS_DEPTH, bus, tcpBus->tcp.depth);
+}
+
+static uint32_t configHash(const FirmwareConfig_t *fwConfig)
+{
+    uint32_t hash = fieldHash(ConfigField_MB_BAUDRATE, 0, fwConfig->modbusBaudrate) ^
+                    fieldHash(ConfigField_MB_INTER_CMDS_DELAY_MS, 0, fwConfig->modbusInterCmdsDelayMs) ^
+                    fieldHash(ConfigField_MB_READ_PERIOD, 0, fwConfig->modbusReadPeriod) ^
+                    fieldHash(ConfigField_SERIAL_DATA_BITS, 0, fwConfig->serialDataBits) ^
+                    fieldHash(ConfigField_SERIAL_STOP_BITS, 0, fwConfig->serialStopBits) ^
+                    fieldHash(ConfigField_SERIAL_PARITY, 0, fwConfig->serialParity) ^
+                    fieldHash(ConfigField_BIT_POSITION, 0, fwConfig->bitPosition) ^
+                    fieldHash(ConfigField_MAX_REGISTERS, 0, fwConfig->maxRegisters) ^
+                    fieldHash(ConfigField_PAYLOAD_ENCODING, 0, fwConfig->payloadEncoding) ^
+                    fieldHash(ConfigField_COMPACT_KEYS, 0, fwConfig->compactKeys) ^
+                    fieldHash(ConfigField_TRIM_TRAILING_ZEROS, 0, fwConfig->trimTrailingZeros) ^
+                    fieldHash(ConfigField_ADAPTIVE_INTER_CMDS_DELAY, 0, fwConfig->adaptiveInterCmdsDelay);
+    for (int p = 0; p < BusPriority_NUM; p++)
+        hash ^= fieldHash(ConfigField_LATENCY_TARGET_MS, p, fwConfig->latencyTargetsMs[p]);
+    for (uint8_t bus = 0; bus < MB_SERIAL_BUSES_NUM; bus++)
+        hash ^= fieldHash(ConfigField_BUS_CORE, bus, fwConfig->busCores[bus]);
+    for (uint8_t bus = MB_PRIMARY_BUS + 1; bus < MB_SERIAL_BUSES_NUM; bus++)
+        hash ^= serialBusHash(bus, &fwConfig->extraBuses[bus - 1]);
+    for (uint8_t bus = MB_FIRST_TCP_BUS; bus < MB_BUSES_NUM; bus++)
+        hash ^= tcpBusHash(bus, &fwConfig->tcpBuses[bus - MB_FIRST_TCP_BUS]);
+    return hash;
+}
+
+// The hash is computed whole only the first time, when the configuration hasn't been loaded from NVS
+static void hashNextConfigIfNeeded()
+{
+    if (!nextConfigHashValid)
+    {
+        nextConfigHash = configHash(&nextFirmwareConfig);
+        nextConfigHashValid = true;
+    }
+}
+
+// Replace the contribution of a field to the hash: called by setters before the field changes
+static void fieldChanging(ConfigField_t field, uint8_t index, int64_t oldValue, int64_t newValue)
+{
+    hashNextConfigIfNeeded();
+    nextConfigHash ^= fieldHash(field, index, oldValue) ^ fieldHash(field, index, newValue);
+}
+
+// Set a field of the next configuration, updating its hash
+#define SET_FIELD(field, index, member, value)                  \
+    do                                                           \
+    {                                                            \
+        fieldChanging((field), (index), (member), (value));      \
+        (member) = (value);                                      \
+    } while (0)
+
 bool NvsFwCfg_loadFromNvs()
 {
-    FirmwareConfig_t loadedFirmwareConfig;
+    FirmwareConfig_t loadedFirmwareConfig = {0};
 
     // Open NVS
     nvs_handle_t nvsHandle = NULL;
@@ -47,6 +199,11 @@ bool NvsFwCfg_loadFromNvs()
         return false;
     }
 
+    // Resize known registers, if saved configuration asks for a different max number of them
+    const int maxRegisters = loadedFirmwareConfig.maxRegisters > 0 ? loadedFirmwareConfig.maxRegisters : DEFAULT_MAX_REGISTERS_NUM;
+    if (maxRegisters != KnownRegisters_capacity() && !KnownRegisters_init(maxRegisters))
+        ESP_LOGE(TAG, "Can't resize known registers to %d, keeping %d", maxRegisters, KnownRegisters_capacity());
+
     // Read registers access data
     int i;
     for (i = 0; i < loadedFirmwareConfig.knownRegistersAtStartup; i++)
@@ -75,6 +232,8 @@ bool NvsFwCfg_loadFromNvs()
     // Copy read configuration if success
     actualFirmwareConfig = loadedFirmwareConfig;
     nextFirmwareConfig = loadedFirmwareConfig;
+    nextConfigHash = configHash(&nextFirmwareConfig);
+    nextConfigHashValid = true;
     return true;
 }
 
@@ -82,7 +241,7 @@ bool NvsFwCfg_setMbBaudrate(int32_t baudrate)
 {
     if (baudrate <= 0)
         return false;
-    nextFirmwareConfig.modbusBaudrate = baudrate;
+    SET_FIELD(ConfigField_MB_BAUDRATE, 0, nextFirmwareConfig.modbusBaudrate, baudrate);
     return true;
 }
 
@@ -90,33 +249,150 @@ bool NvsFwCfg_setInterCmdsDelayMs(uint16_t delay)
 {
     if (delay <= 0)
         return false;
-    nextFirmwareConfig.modbusInterCmdsDelayMs = delay;
+    SET_FIELD(ConfigField_MB_INTER_CMDS_DELAY_MS, 0, nextFirmwareConfig.modbusInterCmdsDelayMs, delay);
     return true;
 }
 
 void NvsFwCfg_setMbParity(uart_parity_t parity)
 {
-    nextFirmwareConfig.serialParity = parity;
+    SET_FIELD(ConfigField_SERIAL_PARITY, 0, nextFirmwareConfig.serialParity, parity);
 }
 
 void NvsFwCfg_setMbStopBits(uart_stop_bits_t stopBits)
 {
-    nextFirmwareConfig.serialStopBits = stopBits;
+    SET_FIELD(ConfigField_SERIAL_STOP_BITS, 0, nextFirmwareConfig.serialStopBits, stopBits);
 }
 
 void NvsFwCfg_setMbDataBits(uart_word_length_t dataBits)
 {
-    nextFirmwareConfig.serialDataBits = dataBits;
+    SET_FIELD(ConfigField_SERIAL_DATA_BITS, 0, nextFirmwareConfig.serialDataBits, dataBits);
 }
 
 void NvsFwCfg_setMbBitPosition(int8_t bitPosition)
 {
-    nextFirmwareConfig.bitPosition = bitPosition;
+    SET_FIELD(ConfigField_BIT_POSITION, 0, nextFirmwareConfig.bitPosition, bitPosition);
+}
+
+bool NvsFwCfg_setMaxRegisters(uint32_t maxRegisters)
+{
+    // Registers already known must still fit after restart
+    const uint32_t effectiveMaxRegisters = maxRegisters > 0 ? maxRegisters : DEFAULT_MAX_REGISTERS_NUM;
+    if (effectiveMaxRegisters > MAX_REGISTERS_LIMIT || effectiveMaxRegisters < KnownRegisters_count())
+        return false;
+    SET_FIELD(ConfigField_MAX_REGISTERS, 0, nextFirmwareConfig.maxRegisters, maxRegisters);
+    return true;
+}
+
+void NvsFwCfg_setPayloadEncoding(PayloadEncoding_t encoding)
+{
+    SET_FIELD(ConfigField_PAYLOAD_ENCODING, 0, nextFirmwareConfig.payloadEncoding, encoding);
+}
+
+void NvsFwCfg_setCompactKeys(bool compact)
+{
+    SET_FIELD(ConfigField_COMPACT_KEYS, 0, nextFirmwareConfig.compactKeys, compact);
+}
+
+void NvsFwCfg_setTrimTrailingZeros(bool trim)
+{
+    SET_FIELD(ConfigField_TRIM_TRAILING_ZEROS, 0, nextFirmwareConfig.trimTrailingZeros, trim);
+}
+
+void NvsFwCfg_setAdaptiveInterCmdsDelay(bool adaptive)
+{
+    SET_FIELD(ConfigField_ADAPTIVE_INTER_CMDS_DELAY, 0, nextFirmwareConfig.adaptiveInterCmdsDelay, adaptive);
+}
+
+void NvsFwCfg_setLatencyTargetMs(BusPriority_t priority, uint16_t targetMs)
+{
+    SET_FIELD(ConfigField_LATENCY_TARGET_MS, priority, nextFirmwareConfig.latencyTargetsMs[priority], targetMs);
+}
+
+bool NvsFwCfg_setBusCore(uint8_t bus, uint8_t coreId)
+{
+    if (bus >= MB_BUSES_NUM || coreId >= portNUM_PROCESSORS)
+        return false;
+    if (MB_BUS_IS_TCP(bus))
+        SET_FIELD(ConfigField_BUS_CORE, bus, nextFirmwareConfig.tcpBuses[bus - MB_FIRST_TCP_BUS].coreId, coreId);
+    else
+        SET_FIELD(ConfigField_BUS_CORE, bus, nextFirmwareConfig.busCores[bus], coreId);
+    return true;
+}
+
+// Serial settings of the primary bus have their own setters
+bool NvsFwCfg_setBusSerial(uint8_t bus, int32_t baudrate, uart_word_length_t dataBits, uart_parity_t parity, uart_stop_bits_t stopBits)
+{
+    if (bus == MB_PRIMARY_BUS || bus >= MB_SERIAL_BUSES_NUM || baudrate <= 0)
+        return false;
+    MbSerialConfig_t *serial = &nextFirmwareConfig.extraBuses[bus - 1].serial;
+    SET_FIELD(ConfigField_BUS_BAUDRATE, bus, serial->baudrate, baudrate);
+    SET_FIELD(ConfigField_BUS_DATA_BITS, bus, serial->dataBits, dataBits);
+    SET_FIELD(ConfigField_BUS_PARITY, bus, serial->parity, parity);
+    SET_FIELD(ConfigField_BUS_STOP_BITS, bus, serial->stopBits, stopBits);
+    return true;
+}
+
+// Setting the pins of a bus enables it. Buses saved by previous versions have no serial settings yet: they get the default ones.
+bool NvsFwCfg_setBusPins(uint8_t bus, uint8_t uartPort, int8_t txPin, int8_t rxPin, int8_t dirPin)
+{
+    if (bus == MB_PRIMARY_BUS || bus >= MB_SERIAL_BUSES_NUM)
+        return false;
+    ExtraBusConfig_t *extraBus = &nextFirmwareConfig.extraBuses[bus - 1];
+    // Many fields may change: the hash of the whole bus is replaced
+    hashNextConfigIfNeeded();
+    nextConfigHash ^= serialBusHash(bus, extraBus);
+    if (extraBus->serial.baudrate <= 0)
+    {
+        const ExtraBusConfig_t defaultBus = DEFAULT_EXTRA_BUS_CONFIG;
+        extraBus->serial = defaultBus.serial;
+    }
+    extraBus->serial.uartPort = uartPort;
+    extraBus->serial.txPin = txPin;
+    extraBus->serial.rxPin = rxPin;
+    extraBus->serial.dirPin = dirPin;
+    extraBus->enabled = true;
+    nextConfigHash ^= serialBusHash(bus, extraBus);
+    return true;
+}
+
+// Binding a bus to a server enables it. Buses saved by previous versions are pinned to the default core.
+bool NvsFwCfg_setTcpBus(uint8_t bus, const uint8_t ip[4], uint16_t port, uint8_t connectionsNum, uint8_t depth)
+{
+    if (!MB_BUS_IS_TCP(bus) || bus >= MB_BUSES_NUM || connectionsNum == 0 || connectionsNum > MB_TCP_MAX_CONNECTIONS || depth == 0 ||
+        depth > MB_TCP_MAX_DEPTH)
+        return false;
+    TcpBusConfig_t *tcpBus = &nextFirmwareConfig.tcpBuses[bus - MB_FIRST_TCP_BUS];
+    // Many fields may change: the hash of the whole bus is replaced
+    hashNextConfigIfNeeded();
+    nextConfigHash ^= tcpBusHash(bus, tcpBus);
+    if (tcpBus->tcp.connectionsNum == 0)
+    {
+        const TcpBusConfig_t defaultBus = DEFAULT_TCP_BUS_CONFIG;
+        tcpBus->coreId = defaultBus.coreId;
+    }
+    memcpy(tcpBus->tcp.ip, ip, sizeof(tcpBus->tcp.ip));
+    tcpBus->tcp.port = port;
+    tcpBus->tcp.connectionsNum = connectionsNum;
+    tcpBus->tcp.depth = depth;
+    tcpBus->enabled = true;
+    nextConfigHash ^= tcpBusHash(bus, tcpBus);
+    return true;
+}
+
+bool NvsFwCfg_disableBus(uint8_t bus)
+{
+    if (bus == MB_PRIMARY_BUS || bus >= MB_BUSES_NUM)
+        return false;
+    if (MB_BUS_IS_TCP(bus))
+        SET_FIELD(ConfigField_BUS_ENABLED, bus, nextFirmwareConfig.tcpBuses[bus - MB_FIRST_TCP_BUS].enabled, false);
+    else
+        SET_FIELD(ConfigField_BUS_ENABLED, bus, nextFirmwareConfig.extraBuses[bus - 1].enabled, false);
+    return true;
 }
 
 void NvsFwCfg_setMbReadPeriod(uint8_t period)
 {
-    nextFirmwareConfig.modbusReadPeriod = period;
+    SET_FIELD(ConfigField_MB_READ_PERIOD, 0, nextFirmwareConfig.modbusReadPeriod, period);
 }
 
 void NvsFwCfg_getActualFirmwareConfig(FirmwareConfig_t *fwConfig)
@@ -129,6 +405,13 @@ void NvsFwCfg_getNextFirmwareConfig(FirmwareConfig_t *fwConfig)
     *fwConfig = nextFirmwareConfig;
 }
 
+// Hash of the configuration that will be applied at next restart, kept up to date by setters
+uint32_t NvsFwCfg_getNextFirmwareConfigHash()
+{
+    hashNextConfigIfNeeded();
+    return nextConfigHash;
+}
+
 bool NvsFwCfg_saveToNvs()
 {
     // Set number of registers saved to NVS
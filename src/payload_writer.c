@@ -0,0 +1,262 @@
+#include "payload_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "str_utils.h"
+
+#define MAP_END_LEN 1 // '}' in JSON, break in CBOR, nothing in MessagePack
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static int wrapOverheadLen(const char *wrapKey)
+{
+    if (wrapKey == NULL)
+        return 0;
+    return strlen(wrapKey) + CT_STRLEN("{\"\":\"\"}");
+}
+
+static void cborRegValue(CborWriter_t *cbor, const RegValue_t *value)
+{
+    switch (value->type)
+    {
+    case RegValueType_NULL:
+        CborWriter_null(cbor);
+        break;
+    case RegValueType_INT:
+        CborWriter_int(cbor, value->i);
+        break;
+    case RegValueType_UINT:
+        CborWriter_uint(cbor, value->u);
+        break;
+    case RegValueType_FLOAT32:
+        CborWriter_float32(cbor, value->f32);
+        break;
+    case RegValueType_FLOAT64:
+        CborWriter_double(cbor, value->f64);
+        break;
+    case RegValueType_TEXT:
+        CborWriter_text(cbor, value->text, strlen(value->text));
+        break;
+    }
+}
+
+static void msgpackRegValue(MsgpackWriter_t *msgpack, const RegValue_t *value)
+{
+    switch (value->type)
+    {
+    case RegValueType_NULL:
+        MsgpackWriter_null(msgpack);
+        break;
+    case RegValueType_INT:
+        MsgpackWriter_int(msgpack, value->i);
+        break;
+    case RegValueType_UINT:
+        MsgpackWriter_uint(msgpack, value->u);
+        break;
+    case RegValueType_FLOAT32:
+        MsgpackWriter_float32(msgpack, value->f32);
+        break;
+    case RegValueType_FLOAT64:
+        MsgpackWriter_double(msgpack, value->f64);
+        break;
+    case RegValueType_TEXT:
+        MsgpackWriter_text(msgpack, value->text, strlen(value->text));
+        break;
+    }
+}
+
+// Length of the binary payload
+static int binaryLength(const PayloadWriter_t *writer)
+{
+    if (writer->encoding == PayloadEncoding_MSGPACK)
+        return MsgpackWriter_length(&writer->msgpack);
+    return CborWriter_length(&writer->cbor);
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+bool PayloadEncoding_isBinary(PayloadEncoding_t encoding)
+{
+    return encoding == PayloadEncoding_CBOR || encoding == PayloadEncoding_MSGPACK;
+}
+
+const char *PayloadEncoding_name(PayloadEncoding_t encoding)
+{
+    switch (encoding)
+    {
+    case PayloadEncoding_JSON:
+        return "json";
+    case PayloadEncoding_CBOR:
+        return "cbor";
+    case PayloadEncoding_MSGPACK:
+        return "msgpack";
+    default:
+        return "invalid";
+    }
+}
+
+void PayloadWriter_init(PayloadWriter_t *writer, PayloadEncoding_t encoding, const char *wrapKey, char *buf, int capacity, uint8_t *scratch, int scratchLen)
+{
+    writer->encoding = encoding;
+    writer->wrapKey = wrapKey;
+    writer->buf = buf;
+    writer->capacity = capacity;
+
+    // Room to close the map is reserved, so that values can be appended until they don't fit
+    if (PayloadEncoding_isBinary(encoding))
+    {
+        const int textLen = capacity - NULL_CHAR_LEN - wrapOverheadLen(wrapKey);
+        int binaryLen = textLen > 0 ? (textLen / 4) * 3 : 0;
+        if (binaryLen > scratchLen)
+            binaryLen = scratchLen;
+        if (encoding == PayloadEncoding_MSGPACK)
+        {
+            MsgpackWriter_init(&writer->msgpack, scratch, binaryLen - MAP_END_LEN);
+            MsgpackWriter_beginMap(&writer->msgpack);
+        }
+        else
+        {
+            CborWriter_init(&writer->cbor, scratch, binaryLen - MAP_END_LEN);
+            CborWriter_beginMap(&writer->cbor);
+        }
+    }
+    else
+    {
+        JsonWriter_init(&writer->json, buf, capacity - MAP_END_LEN);
+        JsonWriter_beginObject(&writer->json);
+    }
+}
+
+void PayloadWriter_key(PayloadWriter_t *writer, const char *key)
+{
+    if (writer->encoding == PayloadEncoding_CBOR)
+        CborWriter_text(&writer->cbor, key, strlen(key));
+    else if (writer->encoding == PayloadEncoding_MSGPACK)
+        MsgpackWriter_text(&writer->msgpack, key, strlen(key));
+    else
+        JsonWriter_key(&writer->json, key);
+}
+
+// Numeric key of compact payloads: CBOR and MessagePack map keys can be integers, JSON ones are always strings
+void PayloadWriter_keyId(PayloadWriter_t *writer, uint16_t keyId)
+{
+    if (writer->encoding == PayloadEncoding_CBOR)
+    {
+        CborWriter_uint(&writer->cbor, keyId);
+    }
+    else if (writer->encoding == PayloadEncoding_MSGPACK)
+    {
+        MsgpackWriter_uint(&writer->msgpack, keyId);
+    }
+    else
+    {
+        char key[sizeof(MAX_U16_STR)];
+        sprintf(key, "%" PRIu16, keyId);
+        JsonWriter_key(&writer->json, key);
+    }
+}
+
+// JSON payloads use the value formatted as JSON, binary payloads use the native one
+void PayloadWriter_value(PayloadWriter_t *writer, const RegValue_t *value, const char *jsonValue)
+{
+    if (writer->encoding == PayloadEncoding_CBOR)
+        cborRegValue(&writer->cbor, value);
+    else if (writer->encoding == PayloadEncoding_MSGPACK)
+        msgpackRegValue(&writer->msgpack, value);
+    else
+        JsonWriter_raw(&writer->json, jsonValue);
+}
+
+void PayloadWriter_uint(PayloadWriter_t *writer, uint64_t value)
+{
+    if (writer->encoding == PayloadEncoding_CBOR)
+        CborWriter_uint(&writer->cbor, value);
+    else if (writer->encoding == PayloadEncoding_MSGPACK)
+        MsgpackWriter_uint(&writer->msgpack, value);
+    else
+        JsonWriter_uint(&writer->json, value);
+}
+
+void PayloadWriter_null(PayloadWriter_t *writer)
+{
+    if (writer->encoding == PayloadEncoding_CBOR)
+        CborWriter_null(&writer->cbor);
+    else if (writer->encoding == PayloadEncoding_MSGPACK)
+        MsgpackWriter_null(&writer->msgpack);
+    else
+        JsonWriter_null(&writer->json);
+}
+
+bool PayloadWriter_overflowed(const PayloadWriter_t *writer)
+{
+    if (writer->encoding == PayloadEncoding_CBOR)
+        return CborWriter_overflowed(&writer->cbor);
+    if (writer->encoding == PayloadEncoding_MSGPACK)
+        return MsgpackWriter_overflowed(&writer->msgpack);
+    return JsonWriter_overflowed(&writer->json);
+}
+
+PayloadWriterMark_t PayloadWriter_mark(const PayloadWriter_t *writer)
+{
+    PayloadWriterMark_t mark = {0};
+    if (writer->encoding == PayloadEncoding_CBOR)
+        mark.cbor = CborWriter_mark(&writer->cbor);
+    else if (writer->encoding == PayloadEncoding_MSGPACK)
+        mark.msgpack = MsgpackWriter_mark(&writer->msgpack);
+    else
+        mark.json = JsonWriter_mark(&writer->json);
+    return mark;
+}
+
+void PayloadWriter_rollback(PayloadWriter_t *writer, PayloadWriterMark_t mark)
+{
+    if (writer->encoding == PayloadEncoding_CBOR)
+        CborWriter_rollback(&writer->cbor, mark.cbor);
+    else if (writer->encoding == PayloadEncoding_MSGPACK)
+        MsgpackWriter_rollback(&writer->msgpack, mark.msgpack);
+    else
+        JsonWriter_rollback(&writer->json, mark.json);
+}
+
+// Close the map and write the payload to the buffer. Returns false if it didn't fit.
+bool PayloadWriter_finish(PayloadWriter_t *writer)
+{
+    if (!PayloadEncoding_isBinary(writer->encoding))
+    {
+        writer->json.capacity += MAP_END_LEN;
+        JsonWriter_endObject(&writer->json);
+        return !JsonWriter_overflowed(&writer->json);
+    }
+
+    const uint8_t *binary = NULL;
+    if (writer->encoding == PayloadEncoding_MSGPACK)
+    {
+        MsgpackWriter_endMap(&writer->msgpack);
+        binary = writer->msgpack.buf;
+    }
+    else
+    {
+        writer->cbor.capacity += MAP_END_LEN;
+        CborWriter_end(&writer->cbor);
+        binary = writer->cbor.buf;
+    }
+    if (PayloadWriter_overflowed(writer))
+        return false;
+
+    int prefixLen = 0;
+    if (writer->wrapKey != NULL)
+        prefixLen = snprintf(writer->buf, writer->capacity, "{\"%s\":\"", writer->wrapKey);
+
+    const int encodedLen = base64Encode(binary, binaryLength(writer), &writer->buf[prefixLen], writer->capacity - prefixLen);
+    if (encodedLen < 0)
+        return false;
+
+    if (writer->wrapKey != NULL)
+    {
+        if (prefixLen + encodedLen + (int)CT_STRLEN("\"}") + NULL_CHAR_LEN > writer->capacity)
+            return false;
+        strcpy(&writer->buf[prefixLen + encodedLen], "\"}");
+    }
+    return true;
+}
@@ -0,0 +1,160 @@
+#include "poll_plan.h"
+
+#include <stdlib.h>
+
+// BEGIN --------------------------------------------------- STATIC DECLARATIONS -----------------------------------------------------------
+
+static int maxEntriesNum = 0;
+
+static PollEntry_t *entries = NULL;
+static int entriesNum = 0;
+
+static PollBlock_t *blocks = NULL;
+static int blocksNum = 0;
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static int compareEntries(const void *a, const void *b)
+{
+    const PollEntry_t *e1 = (const PollEntry_t *)a;
+    const PollEntry_t *e2 = (const PollEntry_t *)b;
+
+    if (e1->bus != e2->bus)
+        return e1->bus - e2->bus;
+    if (e1->readFunction != e2->readFunction)
+        return e1->readFunction - e2->readFunction;
+    if (e1->slaveAddr != e2->slaveAddr)
+        return e1->slaveAddr - e2->slaveAddr;
+    if (e1->regId != e2->regId)
+        return e1->regId < e2->regId ? -1 : 1;
+    return e1->handle - e2->handle;
+}
+
+// Coils and discrete inputs are packed as bits by the slave, so they are never merged together
+static bool isRegistersFunction(uint8_t readFunction)
+{
+    return readFunction == 3 || readFunction == 4;
+}
+
+static bool canJoinBlock(const PollBlock_t *block, const PollEntry_t *entry, uint16_t maxGapRegs)
+{
+    if (block->bus != entry->bus || block->readFunction != entry->readFunction || block->slaveAddr != entry->slaveAddr || !isRegistersFunction(entry->readFunction))
+        return false;
+
+    const uint32_t blockEnd = (uint32_t)block->regId + block->regNumber;
+    const uint32_t entryEnd = (uint32_t)entry->regId + entry->regNumber;
+    if (entry->regId > blockEnd && entry->regId - blockEnd > maxGapRegs)
+        return false;
+
+    const uint32_t newEnd = entryEnd > blockEnd ? entryEnd : blockEnd;
+    return newEnd - block->regId <= MAX_BLOCK_REGS_NUM;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+// Polling period of a monitored register: the shortest of its periods that are set, since the register must be read in time
+// for each of them, but never shorter than the Modbus polling period.
+Seconds_t PollPlan_intervalOf(const RegisterPollData_t *poll, Seconds_t minInterval)
+{
+    const Seconds_t periods[] = {poll->pollInterval, poll->publishOnChange ? poll->changeCheckInterval : 0, poll->maxPublishDelay};
+    Seconds_t interval = 0;
+    for (int i = 0; i < (int)(sizeof(periods) / sizeof(periods[0])); i++)
+    {
+        if (periods[i] > 0 && (interval == 0 || periods[i] < interval))
+            interval = periods[i];
+    }
+    return interval > minInterval ? interval : minInterval;
+}
+
+bool PollPlan_init(int maxEntries)
+{
+    PollEntry_t *newEntries = calloc(maxEntries, sizeof(PollEntry_t));
+    PollBlock_t *newBlocks = calloc(maxEntries, sizeof(PollBlock_t));
+    if (newEntries == NULL || newBlocks == NULL)
+    {
+        free(newEntries);
+        free(newBlocks);
+        return false;
+    }
+
+    free(entries);
+    free(blocks);
+    entries = newEntries;
+    blocks = newBlocks;
+    maxEntriesNum = maxEntries;
+    entriesNum = 0;
+    blocksNum = 0;
+    return true;
+}
+
+void PollPlan_clear()
+{
+    entriesNum = 0;
+    blocksNum = 0;
+}
+
+bool PollPlan_add(KnownRegHandle_t handle, const RegisterPollData_t *poll)
+{
+    if (entriesNum >= maxEntriesNum)
+        return false;
+
+    PollEntry_t *entry = &entries[entriesNum++];
+    entry->handle = handle;
+    entry->bus = poll->bus;
+    entry->readFunction = poll->readFunction;
+    entry->slaveAddr = poll->slaveAddr;
+    entry->regId = poll->regId;
+    entry->regNumber = poll->regNumber;
+    entry->offset = 0;
+    return true;
+}
+
+// Sort entries and group them in blocks, each one read with a single request. Blocks of a bus are contiguous.
+int PollPlan_build(const uint16_t *maxGapRegs)
+{
+    blocksNum = 0;
+    if (entriesNum == 0)
+        return 0;
+
+    qsort(entries, entriesNum, sizeof(PollEntry_t), compareEntries);
+
+    PollBlock_t *block = NULL;
+    for (int i = 0; i < entriesNum; i++)
+    {
+        PollEntry_t *entry = &entries[i];
+
+        if (block == NULL || !canJoinBlock(block, entry, maxGapRegs[entry->bus]))
+        {
+            block = &blocks[blocksNum++];
+            block->bus = entry->bus;
+            block->readFunction = entry->readFunction;
+            block->slaveAddr = entry->slaveAddr;
+            block->regId = entry->regId;
+            block->regNumber = entry->regNumber;
+            block->firstEntry = i;
+            block->entriesNum = 0;
+        }
+
+        const uint32_t entryEnd = (uint32_t)entry->regId + entry->regNumber;
+        if (entryEnd - block->regId > block->regNumber)
+            block->regNumber = entryEnd - block->regId;
+        entry->offset = entry->regId - block->regId;
+        block->entriesNum++;
+    }
+
+    return blocksNum;
+}
+
+const PollBlock_t *PollPlan_blockAt(int blockIdx)
+{
+    if (blockIdx < 0 || blockIdx >= blocksNum)
+        return NULL;
+    return &blocks[blockIdx];
+}
+
+const PollEntry_t *PollPlan_entryAt(int entryIdx)
+{
+    if (entryIdx < 0 || entryIdx >= entriesNum)
+        return NULL;
+    return &entries[entryIdx];
+}
@@ -0,0 +1,297 @@
+#include "register_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str_utils.h"
+#include "num_format.h"
+#include "known_registers.h"
+#include "mb_buses.h"
+
+#define DOUBLE_DECIMALS 9 // Factors, offsets and deadbands are exported with up to this many decimals
+
+#define MONITOR_NONE 0
+#define MONITOR_PERIODIC 1
+#define MONITOR_ON_CHANGE 2
+
+// Registers imported in chunks, added to the known registers only when the import is committed, and names of the registers
+// to remove then. Allocated by the first chunk.
+static RegisterAccessData_t *staged = NULL;
+static int stagedNum = 0;
+static char (*stagedRemovals)[MAX_REG_NAME_SIZE] = NULL;
+static int stagedRemovalsNum = 0;
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static bool parseUint(char *field, char *maxStr, uint32_t *value)
+{
+    if (!strContainsOnlyDigits(field) || !strValLessThan(field, maxStr))
+        return false;
+    *value = strtoul(field, NULL, 10);
+    return true;
+}
+
+static bool isValidName(const char *name)
+{
+    return strlen(name) >= 1 && strlen(name) <= MAX_REG_NAME_SIZE - 1;
+}
+
+static bool parseDouble(char *field, double *value)
+{
+    if (!strContainsValidDouble(field))
+        return false;
+    *value = strtod(field, NULL);
+    return true;
+}
+
+static bool parseType(const char *field, RADType_t *type)
+{
+    if (STREQ(field, TYPE_NUMBER_STR))
+        *type = RADType_NUMBER;
+    else if (STREQ(field, TYPE_RAW_STR))
+        *type = RADType_RAW;
+    else if (STREQ(field, TYPE_FLOAT_STR))
+        *type = RADType_FLOAT;
+    else if (STREQ(field, TYPE_STRING_STR))
+        *type = RADType_STRING;
+    else
+        return false;
+    return true;
+}
+
+static const char *typeToString(RADType_t type)
+{
+    switch (type)
+    {
+    case RADType_NUMBER:
+        return TYPE_NUMBER_STR;
+    case RADType_FLOAT:
+        return TYPE_FLOAT_STR;
+    case RADType_STRING:
+        return TYPE_STRING_STR;
+    default:
+        return TYPE_RAW_STR;
+    }
+}
+
+// Same constraints as the calls that set each detail of a register
+static bool isValid(const RegisterAccessData_t *rad)
+{
+    const bool scaled = rad->type == RADType_NUMBER || rad->type == RADType_FLOAT;
+    if (rad->readFunction > 5 || rad->bus >= MB_BUSES_NUM)
+        return false;
+    if (rad->writable && rad->writeFunction != 5 && rad->writeFunction != 6 && rad->writeFunction != 15 && rad->writeFunction != 16)
+        return false;
+    if ((scaled && (rad->regNumber < 1 || rad->regNumber > 4)) || (rad->type == RADType_STRING && (rad->regNumber < 1 || rad->regNumber > MAX_REG_LENGTH)) ||
+        (rad->type == RADType_RAW && rad->regNumber != 1))
+        return false;
+    if (rad->interpretAsSigned && rad->type != RADType_NUMBER)
+        return false;
+    if (scaled && rad->factor == 0)
+        return false;
+    if (!scaled && (rad->factor != 0 || rad->offset != 0 || rad->decimals != 0))
+        return false;
+    if (rad->type == RADType_STRING && (rad->deadbandAbs != 0 || rad->deadbandRel != 0))
+        return false;
+    return true;
+}
+
+static int appendUint(char *buf, int bufLen, int len, uint32_t value)
+{
+    const int n = snprintf(&buf[len], bufLen - len, "%" PRIu32 "%c", value, REGISTER_MAP_FIELDS_SEPARATOR);
+    return n < 0 || n >= bufLen - len ? -1 : len + n;
+}
+
+static int appendDouble(char *buf, int bufLen, int len, double value)
+{
+    const int n = NumFormat_fixed(value, DOUBLE_DECIMALS, true, &buf[len], bufLen - len - 1);
+    if (n < 0)
+        return -1;
+    buf[len + n] = REGISTER_MAP_FIELDS_SEPARATOR;
+    buf[len + n + 1] = '\0';
+    return len + n + 1;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+// Parse a record of the register map (modified in place). Returns false if it's not valid.
+bool RegisterMap_parseRecord(char *record, RegisterAccessData_t *rad)
+{
+    char *fields[REGISTER_MAP_FIELDS_NUM] = {0};
+    int fieldsNum = 0;
+    if (splitInPlace(record, REGISTER_MAP_FIELDS_SEPARATOR, fields, REGISTER_MAP_FIELDS_NUM, &fieldsNum) != SplitRes_OK ||
+        fieldsNum != REGISTER_MAP_FIELDS_NUM)
+        return false;
+
+    memset(rad, 0, sizeof(*rad));
+    if (!isValidName(fields[0]))
+        return false;
+    strcpy(rad->regName, fields[0]);
+
+    uint32_t readFunction, slaveAddr, regId, length, bus, writeFunction, isSigned, decimals, monitor, keyId;
+    if (!parseUint(fields[1], MAX_U8_STR, &readFunction) || !parseUint(fields[2], MAX_U8_STR, &slaveAddr) ||
+        !parseUint(fields[3], MAX_U16_STR, &regId) || !parseType(fields[4], &rad->type) || !parseUint(fields[5], MAX_U8_STR, &length) ||
+        !parseUint(fields[6], MAX_U8_STR, &bus) || !parseUint(fields[7], MAX_U8_STR, &writeFunction) || !parseUint(fields[8], "1", &isSigned) ||
+        !parseDouble(fields[9], &rad->factor) || !parseDouble(fields[10], &rad->offset) || !parseUint(fields[11], MAX_U8_STR, &decimals) ||
+        !parseUint(fields[12], "2", &monitor) || !parseUint(fields[13], MAX_U32_STR, &rad->changeCheckInterval) ||
+        !parseUint(fields[14], MAX_U32_STR, &rad->maxPublishDelay) || !parseUint(fields[15], MAX_U32_STR, &rad->pollInterval) ||
+        !parseDouble(fields[16], &rad->deadbandAbs) || !parseDouble(fields[17], &rad->deadbandRel) || !parseUint(fields[18], MAX_U16_STR, &keyId))
+        return false;
+
+    rad->readFunction = readFunction;
+    rad->slaveAddr = slaveAddr;
+    rad->regId = regId;
+    rad->regNumber = length;
+    rad->bus = bus;
+    rad->writable = writeFunction != 0;
+    rad->writeFunction = writeFunction;
+    rad->interpretAsSigned = isSigned != 0;
+    rad->decimals = decimals;
+    rad->monitored = monitor != MONITOR_NONE;
+    rad->publishOnChange = monitor == MONITOR_ON_CHANGE;
+    rad->keyId = keyId;
+    return rad->deadbandAbs >= 0 && rad->deadbandRel >= 0 && isValid(rad);
+}
+
+// Format a register as a record of the register map. Returns its length, or -1 if it doesn't fit bufLen chars (null char included).
+int RegisterMap_formatRecord(const RegisterAccessData_t *rad, char *buf, int bufLen)
+{
+    int len = snprintf(buf, bufLen, "%s%c", rad->regName, REGISTER_MAP_FIELDS_SEPARATOR);
+    if (len < 0 || len >= bufLen)
+        return -1;
+    len = appendUint(buf, bufLen, len, rad->readFunction);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->slaveAddr);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->regId);
+    if (len >= 0)
+    {
+        const int n = snprintf(&buf[len], bufLen - len, "%s%c", typeToString(rad->type), REGISTER_MAP_FIELDS_SEPARATOR);
+        len = n < 0 || n >= bufLen - len ? -1 : len + n;
+    }
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->regNumber);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->bus);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->writable ? rad->writeFunction : 0);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->interpretAsSigned ? 1 : 0);
+    if (len >= 0)
+        len = appendDouble(buf, bufLen, len, rad->factor);
+    if (len >= 0)
+        len = appendDouble(buf, bufLen, len, rad->offset);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->decimals);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, !rad->monitored ? MONITOR_NONE : (rad->publishOnChange ? MONITOR_ON_CHANGE : MONITOR_PERIODIC));
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->changeCheckInterval);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->maxPublishDelay);
+    if (len >= 0)
+        len = appendUint(buf, bufLen, len, rad->pollInterval);
+    if (len >= 0)
+        len = appendDouble(buf, bufLen, len, rad->deadbandAbs);
+    if (len >= 0)
+        len = appendDouble(buf, bufLen, len, rad->deadbandRel);
+    if (len >= 0)
+    {
+        // No separator after the last field
+        const int n = snprintf(&buf[len], bufLen - len, "%" PRIu16, rad->keyId);
+        len = n < 0 || n >= bufLen - len ? -1 : len + n;
+    }
+    return len;
+}
+
+// Hash of the record of a register, with no key id (it's assigned by the gateway): 32 bit FNV-1a of its chars. Returns 0
+// if the record can't be formatted.
+uint32_t RegisterMap_recordHash(const RegisterAccessData_t *rad)
+{
+    RegisterAccessData_t unkeyed = *rad;
+    unkeyed.keyId = 0;
+    char record[REGISTER_MAP_RECORD_MAX_LEN + 1];
+    if (RegisterMap_formatRecord(&unkeyed, record, sizeof(record)) < 0)
+        return 0;
+
+    uint32_t hash = 2166136261u;
+    for (const char *c = record; *c != '\0'; c++)
+    {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Stage the records of a chunk (modified in place): all of them, or none if any is invalid. Then invalidRecord is its
+// position in the chunk. Records made of a name only stage the removal of that register.
+RegisterMapRes_t RegisterMap_stageChunk(char *chunk, int *invalidRecord)
+{
+    char *records[REGISTER_MAP_MAX_CHUNK_RECORDS] = {0};
+    int recordsNum = 0;
+    if (splitInPlace(chunk, REGISTER_MAP_RECORDS_SEPARATOR, records, REGISTER_MAP_MAX_CHUNK_RECORDS, &recordsNum) != SplitRes_OK)
+        return RegisterMapRes_TOO_MANY_RECORDS;
+
+    const int capacity = KnownRegisters_capacity();
+    if (staged == NULL)
+        staged = calloc(capacity, sizeof(RegisterAccessData_t));
+    if (stagedRemovals == NULL)
+        stagedRemovals = calloc(capacity, MAX_REG_NAME_SIZE);
+    if (staged == NULL || stagedRemovals == NULL)
+        return RegisterMapRes_NO_MEMORY;
+
+    int addedNum = 0;
+    int removedNum = 0;
+    for (int r = 0; r < recordsNum; r++)
+    {
+        const bool isRemoval = strchr(records[r], REGISTER_MAP_FIELDS_SEPARATOR) == NULL;
+        if ((isRemoval && stagedRemovalsNum + removedNum >= capacity) || (!isRemoval && stagedNum + addedNum >= capacity))
+            return RegisterMapRes_FULL;
+
+        bool valid;
+        if (isRemoval)
+        {
+            valid = isValidName(records[r]);
+            if (valid)
+                strcpy(stagedRemovals[stagedRemovalsNum + removedNum++], records[r]);
+        }
+        else
+        {
+            valid = RegisterMap_parseRecord(records[r], &staged[stagedNum + addedNum++]);
+        }
+        if (!valid)
+        {
+            *invalidRecord = r;
+            return RegisterMapRes_INVALID_RECORD;
+        }
+    }
+    stagedNum += addedNum;
+    stagedRemovalsNum += removedNum;
+    return RegisterMapRes_OK;
+}
+
+// Registers staged to be added, plus the ones staged to be removed
+int RegisterMap_stagedCount()
+{
+    return stagedNum + stagedRemovalsNum;
+}
+
+// Add the staged registers to the known registers, and remove the staged ones (see KnownRegisters_import), then forget them.
+// Returns false if nothing changed.
+bool RegisterMap_commit(bool replace)
+{
+    const bool committed = RegisterMap_stagedCount() > 0 && KnownRegisters_import(staged, stagedNum, stagedRemovals, stagedRemovalsNum, replace);
+    RegisterMap_discard();
+    return committed;
+}
+
+void RegisterMap_discard()
+{
+    free(staged);
+    free(stagedRemovals);
+    staged = NULL;
+    stagedRemovals = NULL;
+    stagedNum = 0;
+    stagedRemovalsNum = 0;
+}
@@ -0,0 +1,111 @@
+#include "slave_health.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_timer.h>
+
+#include <freertos/FreeRTOS.h>
+
+#define SLAVES_NUM 256
+#define BROADCAST_ADDR 0
+
+// Records are written by the tasks that hold the bus, under recordsLock since Modbus TCP buses have several. Readers that
+// don't hold it (e.g. cloud callbacks) may get fields updated by different transactions, that's fine for reporting. Records
+// of a bus are allocated when it's first used.
+static SlaveHealth_t *buses[MB_BUSES_NUM] = {NULL};
+static portMUX_TYPE recordsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+// After some consecutive failures, the slave is considered down: it's probed after a backoff that doubles at every failed
+// probe
+static void recordFailure(SlaveHealth_t *slave, int error, int64_t nowUs)
+{
+    slave->failures++;
+    slave->lastError = (int8_t)error;
+    if (slave->consecutiveFailures < UINT16_MAX)
+        slave->consecutiveFailures++;
+    if (slave->consecutiveFailures < SLAVE_FAILURES_TO_BACKOFF)
+        return;
+
+    // Failed probe, or slave just went down
+    if (slave->backingOff && (SLAVE_MIN_BACKOFF_S << slave->backoffExp) < SLAVE_MAX_BACKOFF_S)
+        slave->backoffExp++;
+    slave->backingOff = true;
+    const int64_t backoffS = SLAVE_MIN_BACKOFF_S << slave->backoffExp;
+    slave->probeAtUs = nowUs + (backoffS < SLAVE_MAX_BACKOFF_S ? backoffS : SLAVE_MAX_BACKOFF_S) * 1000000;
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+// Forget health of the slaves of a bus. Returns false if its records can't be allocated.
+bool SlaveHealth_reset(uint8_t bus)
+{
+    if (buses[bus] == NULL)
+        buses[bus] = calloc(SLAVES_NUM, sizeof(SlaveHealth_t));
+    if (buses[bus] == NULL)
+        return false;
+    memset(buses[bus], 0, SLAVES_NUM * sizeof(SlaveHealth_t));
+    return true;
+}
+
+// Update the record of a slave with the result of a transaction. Any answer, even an exception, ends the backoff. Requests
+// that never reached the slave (bus not running, invalid request) are not recorded.
+void SlaveHealth_record(uint8_t bus, uint8_t slaveAddr, ModbusError result)
+{
+    if (slaveAddr == BROADCAST_ADDR || buses[bus] == NULL || result == MB_BUS_ERR_NOT_RUNNING || result == MB_BUS_ERR_INVALID_REQUEST)
+        return;
+
+    SlaveHealth_t *slave = &buses[bus][slaveAddr];
+    const int64_t nowUs = esp_timer_get_time();
+
+    portENTER_CRITICAL(&recordsLock);
+    if (MB_BUS_ANSWERED(result))
+    {
+        const int exceptionCode = MB_BUS_EXCEPTION_CODE(result);
+        if (exceptionCode != 0)
+        {
+            slave->exceptions++;
+            slave->lastException = exceptionCode;
+        }
+        else
+        {
+            slave->successes++;
+        }
+        slave->consecutiveFailures = 0;
+        slave->backoffExp = 0;
+        slave->backingOff = false;
+        slave->lastAnswerUs = nowUs;
+    }
+    else
+    {
+        recordFailure(slave, result, nowUs);
+    }
+    portEXIT_CRITICAL(&recordsLock);
+}
+
+bool SlaveHealth_isBackingOff(uint8_t bus, uint8_t slaveAddr)
+{
+    return buses[bus] != NULL && buses[bus][slaveAddr].backingOff;
+}
+
+// Slave is backing off, and it's time to check if it answers again
+bool SlaveHealth_probeDue(uint8_t bus, uint8_t slaveAddr)
+{
+    return SlaveHealth_isBackingOff(bus, slaveAddr) && esp_timer_get_time() >= buses[bus][slaveAddr].probeAtUs;
+}
+
+bool SlaveHealth_answeredSince(uint8_t bus, uint8_t slaveAddr, int64_t sinceUs)
+{
+    return buses[bus] != NULL && buses[bus][slaveAddr].lastAnswerUs != 0 && buses[bus][slaveAddr].lastAnswerUs >= sinceUs;
+}
+
+// Copy the record of a slave. Returns false if no transaction was ever addressed to it.
+bool SlaveHealth_get(uint8_t bus, uint8_t slaveAddr, SlaveHealth_t *health)
+{
+    if (buses[bus] == NULL)
+        return false;
+    *health = buses[bus][slaveAddr];
+    return health->successes > 0 || health->exceptions > 0 || health->failures > 0;
+}
@@ -95,3 +95,27 @@ bool strContainsValidDouble(char *string)
         return false;
     return true;
 }
+
+int base64Encode(const uint8_t *data, int dataLen, char *out, int outBuffLen)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    const int outLen = BASE64_ENCODED_LEN(dataLen);
+    if (outLen + NULL_CHAR_LEN > outBuffLen)
+        return -1;
+
+    int o = 0;
+    for (int i = 0; i < dataLen; i += 3)
+    {
+        const int remaining = dataLen - i;
+        const uint32_t triple = ((uint32_t)data[i] << 16) |
+                                (remaining > 1 ? (uint32_t)data[i + 1] << 8 : 0) |
+                                (remaining > 2 ? (uint32_t)data[i + 2] : 0);
+        out[o++] = alphabet[(triple >> 18) & 0x3F];
+        out[o++] = alphabet[(triple >> 12) & 0x3F];
+        out[o++] = remaining > 1 ? alphabet[(triple >> 6) & 0x3F] : '=';
+        out[o++] = remaining > 2 ? alphabet[triple & 0x3F] : '=';
+    }
+    out[o] = '\0';
+    return outLen;
+}
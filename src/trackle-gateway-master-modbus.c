@@ -6,6 +6,7 @@
 #include "nvs_fw_cfg.h"
 #include "mb_rtu.h"
 #include "cloud_cb.h"
+#include "mb_trace.h"
 
 static const char *TAG = "gw-master-mb";
 
@@ -13,7 +14,8 @@ void GwMasterModbus_init(uart_port_t uartPort, int txPin, int rxPin, bool usesRs
 {
     FirmwareConfig_t fwConfig = {0};
 
-    KnownRegisters_init();
+    if (!KnownRegisters_init(DEFAULT_MAX_REGISTERS_NUM))
+        ESP_LOGE(TAG, "Can't allocate known registers");
 
     if (NvsFwCfg_loadFromNvs())
         ESP_LOGE(TAG, "Config loaded from NVS");
@@ -34,9 +36,30 @@ void GwMasterModbus_init(uart_port_t uartPort, int txPin, int rxPin, bool usesRs
                     fwConfig.serialParity,
                     fwConfig.serialStopBits,
                     fwConfig.bitPosition,
+                    fwConfig.busCores[MB_PRIMARY_BUS],
                     mbReqFailedCallback))
         ESP_LOGE(TAG, "Invalid modbus parameters. Modbus not started");
 
+    for (uint8_t bus = MB_PRIMARY_BUS + 1; bus < MB_SERIAL_BUSES_NUM; bus++)
+    {
+        const ExtraBusConfig_t *extraBus = &fwConfig.extraBuses[bus - 1];
+        if (extraBus->enabled && !MbRtu_initBus(bus, &extraBus->serial, fwConfig.modbusInterCmdsDelayMs, fwConfig.busCores[bus]))
+            ESP_LOGE(TAG, "Invalid parameters of modbus bus %d. Bus not started", bus);
+    }
+    for (uint8_t bus = MB_FIRST_TCP_BUS; bus < MB_BUSES_NUM; bus++)
+    {
+        const TcpBusConfig_t *tcpBus = &fwConfig.tcpBuses[bus - MB_FIRST_TCP_BUS];
+        if (tcpBus->enabled && !MbRtu_initTcpBus(bus, &tcpBus->tcp, tcpBus->coreId))
+            ESP_LOGE(TAG, "Invalid parameters of modbus TCP bus %d. Bus not started", bus);
+    }
+
+    MbRtu_setPayloadEncoding(fwConfig.payloadEncoding);
+    MbRtu_setCompactKeys(fwConfig.compactKeys);
+    MbRtu_setTrimTrailingZeros(fwConfig.trimTrailingZeros);
+    MbRtu_setAdaptiveInterCmdsDelay(fwConfig.adaptiveInterCmdsDelay);
+    for (int p = 0; p < BusPriority_NUM; p++)
+        MbRtu_setLatencyTargetMs(p, fwConfig.latencyTargetsMs[p]);
+
     CloudCb_registerCallbacks();
 }
 
@@ -54,3 +77,8 @@ ModbusError GwMasterModbus_forwardMbReqToSlaves(TrackleModbusFunction function,
 {
     return MbRtu_forwardRequestToSlaves(function, slaveAddr, regId, size, value);
 }
+
+void GwMasterModbus_dumpModbusTrace()
+{
+    MbTrace_dump();
+}
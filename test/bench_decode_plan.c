@@ -0,0 +1,93 @@
+// Time spent decoding register values with decode plans, against the decoding they replaced, that switched on type, width and
+// word order at every call. Usage: bench_decode_plan [values]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <esp_timer.h>
+
+#include "decode_plan.h"
+#include "legacy_decode.h"
+
+#define CONFIGS_NUM 64 // Registers, each with its own configuration
+#define RUNS 5
+
+typedef struct Register_s
+{
+    RegisterAccessData_t rad;
+    DecodePlan_t plan;
+    uint8_t bitPosition;
+} Register_t;
+
+static volatile double sink; // Keeps results alive
+
+static double legacyNative(const uint16_t *words, const RegisterAccessData_t *rad, uint8_t bitPosition)
+{
+    if (rad->type == RADType_NUMBER)
+        return legacyRegistersToNumber(words, rad->regNumber, bitPosition, rad->interpretAsSigned);
+    return legacyRegistersToFloat(words, rad->regNumber, bitPosition);
+}
+
+// Nanoseconds per value of the fastest of RUNS runs. Scaled values are also multiplied, offset and rounded.
+static double timeDecode(bool legacy, bool scaled, const Register_t *registers, const uint16_t (*words)[4], int valuesNum)
+{
+    double bestNs = INFINITY;
+    for (int run = 0; run < RUNS; run++)
+    {
+        double sum = 0;
+        const int64_t startUs = esp_timer_get_time();
+        for (int i = 0; i < valuesNum; i++)
+        {
+            const Register_t *r = &registers[i % CONFIGS_NUM];
+            if (scaled)
+                sum += legacy ? legacyScaledNumber(words[i], &r->rad, r->bitPosition) : DecodePlan_scaled(&r->plan, words[i]);
+            else
+                sum += legacy ? legacyNative(words[i], &r->rad, r->bitPosition) : DecodePlan_native(&r->plan, words[i]);
+        }
+        const double ns = (esp_timer_get_time() - startUs) * 1000.0 / valuesNum;
+        sink = sum;
+        if (ns < bestNs)
+            bestNs = ns;
+    }
+    return bestNs;
+}
+
+int main(int argc, char **argv)
+{
+    const int valuesNum = argc > 1 ? atoi(argv[1]) : 1000000;
+    uint16_t(*words)[4] = malloc(valuesNum * sizeof(*words));
+    if (words == NULL)
+        return 1;
+
+    static Register_t registers[CONFIGS_NUM];
+    srand(1);
+    for (int c = 0; c < CONFIGS_NUM; c++)
+    {
+        RegisterAccessData_t *rad = &registers[c].rad;
+        rad->type = rand() % 2 == 0 ? RADType_NUMBER : RADType_FLOAT;
+        rad->regNumber = rad->type == RADType_FLOAT ? 2 + 2 * (rand() % 2) : 1 + rand() % 4;
+        rad->interpretAsSigned = rand() % 2 == 0;
+        rad->factor = rand() % 2 == 0 ? 1 : 0.1;
+        rad->offset = 0;
+        rad->decimals = rand() % 3;
+        registers[c].bitPosition = rand() % 2;
+        DecodePlan_build(&registers[c].plan, rad, registers[c].bitPosition);
+    }
+    for (int i = 0; i < valuesNum; i++)
+    {
+        for (int w = 0; w < 4; w++)
+            words[i][w] = rand();
+    }
+
+    const double legacyNativeNs = timeDecode(true, false, registers, (const uint16_t(*)[4])words, valuesNum);
+    const double planNativeNs = timeDecode(false, false, registers, (const uint16_t(*)[4])words, valuesNum);
+    const double legacyScaledNs = timeDecode(true, true, registers, (const uint16_t(*)[4])words, valuesNum);
+    const double planScaledNs = timeDecode(false, true, registers, (const uint16_t(*)[4])words, valuesNum);
+
+    printf("%d values of %d registers (numbers and floats, 1 to 4 words), best of %d runs\n", valuesNum, CONFIGS_NUM, RUNS);
+    printf("native value: switches %6.1f ns, decode plan %6.1f ns, speedup %.1fx\n", legacyNativeNs, planNativeNs, legacyNativeNs / planNativeNs);
+    printf("scaled value: switches %6.1f ns, decode plan %6.1f ns, speedup %.1fx\n", legacyScaledNs, planScaledNs, legacyScaledNs / planScaledNs);
+    free(words);
+    return 0;
+}
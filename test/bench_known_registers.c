@@ -0,0 +1,280 @@
+// Cost of the operations of the register registry as its capacity grows: lookups and per-register accesses of the monitoring
+// task should take the same time with 60 registers as with thousands, and a whole monitoring period should grow linearly with
+// the number of registers. Usage: bench_known_registers [operations]
+//
+// On the host all memory is alike. To measure the cost of keeping registers details in external RAM, build this file into
+// an ESP-IDF app that depends on the component (it provides app_main there), and run it with
+// GW_MASTER_MODBUS_REGISTERS_IN_PSRAM enabled and disabled.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_timer.h>
+
+#include "known_registers.h"
+#include "num_format.h"
+#include "payload_writer.h"
+#include "poll_plan.h"
+
+#define RUNS 5
+#define DEFAULT_OPERATIONS 200000
+#define SLAVE_REGISTERS 64 // Registers of each slave
+#define PERIODS 16         // Monitoring periods of each run
+#define CHANGE_PERIODS 8   // Values of registers change once every CHANGE_PERIODS periods, at different periods
+#define PUBLISH_STRING_LEN 2048
+
+static const int CAPACITIES[] = {60, 250, 1000, MAX_REGISTERS_LIMIT};
+
+typedef enum
+{
+    Operation_FIND_BY_NAME,
+    Operation_FIND_BY_MODBUS,
+    Operation_POLL_DATA, // Hot slots, read and written by the monitoring task at every period
+    Operation_PUBLISHED_VALUE,
+    Operation_CACHED_VALUE,
+    Operation_NUM,
+} Operation_t;
+
+static const char *OPERATION_NAMES[Operation_NUM] = {"find by name", "find by Modbus", "poll data", "published value", "cached value"};
+
+static volatile int sink; // Keeps results alive
+
+static void registerAt(int i, RegisterAccessData_t *rad)
+{
+    *rad = (RegisterAccessData_t){0};
+    snprintf(rad->regName, MAX_REG_NAME_SIZE, "reg%d", i);
+    rad->slaveAddr = 1 + i / SLAVE_REGISTERS;
+    rad->regId = 2 * (i % SLAVE_REGISTERS);
+    rad->type = RADType_NUMBER;
+    rad->readFunction = 3;
+    rad->regNumber = 2;
+    rad->monitored = true;
+    rad->publishOnChange = true;
+    rad->maxPublishDelay = 60;
+    rad->factor = 1;
+}
+
+static void execute(Operation_t operation, int i, int registersNum)
+{
+    const int idx = i % registersNum;
+    RegisterAccessData_t rad;
+    switch (operation)
+    {
+    case Operation_FIND_BY_NAME:
+    {
+        char name[MAX_REG_NAME_SIZE];
+        snprintf(name, sizeof(name), "reg%d", idx);
+        sink += KnownRegisters_find(name, &rad);
+        break;
+    }
+    case Operation_FIND_BY_MODBUS:
+        sink += KnownRegisters_findByModbus(0, 3, 1 + idx / SLAVE_REGISTERS, 2 * (idx % SLAVE_REGISTERS), &rad);
+        break;
+    case Operation_POLL_DATA:
+    {
+        RegisterPollData_t poll;
+        Seconds_t nextPoll;
+        sink += KnownRegisters_getPollDataAt(idx, &poll) && KnownRegisters_getNextPollTimeAt(idx, &nextPoll) &&
+                KnownRegisters_setNextPollTimeAt(idx, nextPoll + poll.maxPublishDelay);
+        break;
+    }
+    case Operation_PUBLISHED_VALUE:
+    {
+        const uint16_t raw[MAX_REG_LENGTH] = {(uint16_t)i, 1};
+        double number;
+        sink += KnownRegisters_setLatestPublishedValueAt(idx, raw, i) && KnownRegisters_getLatestPublishedNumberAt(idx, &number);
+        break;
+    }
+    case Operation_CACHED_VALUE:
+    {
+        uint16_t raw[MAX_REG_LENGTH] = {(uint16_t)i, 1};
+        int64_t readUs;
+        sink += KnownRegisters_setCachedValueAt(idx, raw, i + 1) && KnownRegisters_getCachedValueAt(idx, raw, &readUs);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Nanoseconds per operation of the fastest of RUNS runs. Registers are visited in a scattered order, like lookups by the cloud.
+static double timeOperation(Operation_t operation, int registersNum, int operations)
+{
+    double bestNs = INFINITY;
+    for (int run = 0; run < RUNS; run++)
+    {
+        const int64_t startUs = esp_timer_get_time();
+        for (int i = 0; i < operations; i++)
+            execute(operation, (int)((uint32_t)i * 2654435761u % registersNum), registersNum);
+        const double ns = (esp_timer_get_time() - startUs) * 1000.0 / operations;
+        if (ns < bestNs)
+            bestNs = ns;
+    }
+    return bestNs;
+}
+
+// A monitoring period, as the monitoring task runs it once blocks are read: registers that are due are planned, and the value
+// read for each of them is cached, checked for changes and, if changed, formatted and published.
+typedef struct Period_s
+{
+    uint16_t rawRegValue[MAX_REG_LENGTH];
+    Seconds_t seconds;
+    PayloadWriter_t writer;
+    char publishString[PUBLISH_STRING_LEN];
+    uint8_t binaryScratch[PUBLISH_STRING_LEN];
+} Period_t;
+
+static void startMessage(Period_t *period)
+{
+    PayloadWriter_init(&period->writer, PayloadEncoding_JSON, NULL, period->publishString, PUBLISH_STRING_LEN, period->binaryScratch,
+                       PUBLISH_STRING_LEN);
+}
+
+// Same checks as the monitoring task. Messages are sent as soon as they're full.
+static bool appendIfChanged(int idx, const RegisterPollData_t *poll, const RegisterPublishData_t *publish, void *arg)
+{
+    Period_t *period = (Period_t *)arg;
+    const DecodePlan_t *plan = &publish->decodePlan;
+    bool changed = poll->publishOnChange && memcmp(period->rawRegValue, publish->latestPublishedRaw, plan->regNumber * sizeof(uint16_t)) != 0;
+    if (changed)
+    {
+        const double delta = fabs(DecodePlan_scaled(plan, period->rawRegValue) - publish->latestPublishedNumber);
+        changed = delta > publish->deadbandAbs && delta > fabs(publish->latestPublishedNumber) * publish->deadbandRel / 100;
+    }
+    if (!changed && period->seconds - publish->latestPublishSec < poll->maxPublishDelay && publish->latestPublishSec > 0 && !publish->mustPublish)
+        return true;
+
+    char valueString[24];
+    const RegValue_t value = {.type = plan->valueType, .u = DecodePlan_unsigned(plan, period->rawRegValue)};
+    NumFormat_uint(value.u, plan->decimals, true, valueString, sizeof(valueString));
+    const PayloadWriterMark_t mark = PayloadWriter_mark(&period->writer);
+    PayloadWriter_keyId(&period->writer, publish->keyId);
+    PayloadWriter_value(&period->writer, &value, valueString);
+    if (PayloadWriter_overflowed(&period->writer))
+    {
+        PayloadWriter_rollback(&period->writer, mark);
+        sink += PayloadWriter_finish(&period->writer);
+        startMessage(period);
+        PayloadWriter_keyId(&period->writer, publish->keyId);
+        PayloadWriter_value(&period->writer, &value, valueString);
+    }
+
+    KnownRegisters_setLatestPublishedTimeAt(idx, period->seconds);
+    KnownRegisters_setLatestPublishedValueAt(idx, period->rawRegValue, DecodePlan_scaled(plan, period->rawRegValue));
+    KnownRegisters_setMustPublish(idx, false);
+    return true;
+}
+
+static void runPeriod(Period_t *period, int registersNum)
+{
+    static const uint16_t maxGapRegs[MB_BUSES_NUM] = {0};
+
+    PollPlan_clear();
+    for (int i = 0; i < registersNum; i++)
+    {
+        RegisterPollData_t poll;
+        bool quarantined = false;
+        if (KnownRegisters_getPollDataAt(i, &poll) && KnownRegisters_getQuarantinedAt(i, &quarantined) && !quarantined)
+            PollPlan_add(KnownRegisters_handleAt(i), &poll);
+    }
+    const int blocksNum = PollPlan_build(maxGapRegs);
+
+    startMessage(period);
+    for (int b = 0; b < blocksNum; b++)
+    {
+        const PollBlock_t *block = PollPlan_blockAt(b);
+        for (int e = 0; e < block->entriesNum; e++)
+        {
+            const PollEntry_t *entry = PollPlan_entryAt(block->firstEntry + e);
+            const int idx = KnownRegisters_indexOf(entry->handle);
+            uint8_t refusedReads = 0;
+            memset(period->rawRegValue, 0, sizeof(period->rawRegValue));
+            period->rawRegValue[1] = (uint16_t)((idx + period->seconds) / CHANGE_PERIODS);
+            KnownRegisters_recordRefusedReadAt(idx, false, &refusedReads);
+            KnownRegisters_setCachedValueAt(idx, period->rawRegValue, (int64_t)period->seconds * 1000000);
+            KnownRegisters_visitPublishData(entry->handle, appendIfChanged, period);
+            KnownRegisters_setNextPollTimeAt(idx, period->seconds + 1);
+        }
+    }
+    sink += PayloadWriter_finish(&period->writer);
+}
+
+// Microseconds per period of the fastest of RUNS runs, with all the registers due at every period
+static double timePeriod(int registersNum)
+{
+    static Period_t period;
+    double bestUs = INFINITY;
+    for (int run = 0; run < RUNS; run++)
+    {
+        const int64_t startUs = esp_timer_get_time();
+        for (int p = 0; p < PERIODS; p++)
+        {
+            period.seconds++;
+            runPeriod(&period, registersNum);
+        }
+        const double us = (double)(esp_timer_get_time() - startUs) / PERIODS;
+        if (us < bestUs)
+            bestUs = us;
+    }
+    return bestUs;
+}
+
+static int runBenchmark(int operations)
+{
+    printf("ns per operation, best of %d runs of %d operations, registry full\n", RUNS, operations);
+    printf("%-16s", "registers");
+    for (int c = 0; c < (int)(sizeof(CAPACITIES) / sizeof(CAPACITIES[0])); c++)
+        printf("%8d", CAPACITIES[c]);
+    printf("\n");
+
+    double ns[Operation_NUM][sizeof(CAPACITIES) / sizeof(CAPACITIES[0])];
+    double periodUs[sizeof(CAPACITIES) / sizeof(CAPACITIES[0])];
+    for (int c = 0; c < (int)(sizeof(CAPACITIES) / sizeof(CAPACITIES[0])); c++)
+    {
+        if (!KnownRegisters_init(CAPACITIES[c]) || !PollPlan_init(CAPACITIES[c]))
+            return 1;
+        for (int i = 0; i < CAPACITIES[c]; i++)
+        {
+            RegisterAccessData_t rad;
+            registerAt(i, &rad);
+            if (!KnownRegisters_add(&rad))
+                return 1;
+        }
+        for (int o = 0; o < Operation_NUM; o++)
+            ns[o][c] = timeOperation(o, CAPACITIES[c], operations);
+        periodUs[c] = timePeriod(CAPACITIES[c]);
+    }
+
+    for (int o = 0; o < Operation_NUM; o++)
+    {
+        printf("%-16s", OPERATION_NAMES[o]);
+        for (int c = 0; c < (int)(sizeof(CAPACITIES) / sizeof(CAPACITIES[0])); c++)
+            printf("%8.1f", ns[o][c]);
+        printf("\n");
+    }
+
+    printf("\nus per monitoring period, all registers due, 1/%d of them changed\n", CHANGE_PERIODS);
+    printf("%-16s", "period");
+    for (int c = 0; c < (int)(sizeof(CAPACITIES) / sizeof(CAPACITIES[0])); c++)
+        printf("%8.0f", periodUs[c]);
+    printf("\n%-16s", "ns per register");
+    for (int c = 0; c < (int)(sizeof(CAPACITIES) / sizeof(CAPACITIES[0])); c++)
+        printf("%8.1f", periodUs[c] * 1000 / CAPACITIES[c]);
+    printf("\n");
+    return 0;
+}
+
+#ifdef ESP_PLATFORM
+void app_main()
+{
+    runBenchmark(DEFAULT_OPERATIONS / 10);
+}
+#else
+int main(int argc, char **argv)
+{
+    return runBenchmark(argc > 1 ? atoi(argv[1]) : DEFAULT_OPERATIONS);
+}
+#endif
@@ -0,0 +1,88 @@
+// Throughput of a Modbus TCP bus with a single connection and one transaction at a time, against the same bus with pooled,
+// pipelined connections. The loopback server answers each request after a fixed latency, like a device on the network.
+// Usage: bench_mb_tcp [latency us] [transactions]
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <esp_timer.h>
+
+#include "mb_tcp.h"
+#include "mb_tcp_server.h"
+
+#define SINGLE_BUS MB_FIRST_TCP_BUS
+#define POOLED_BUS (MB_FIRST_TCP_BUS + 1)
+#define BLOCK_REGS 20
+
+typedef struct Run_s
+{
+    uint8_t bus;
+    int transactions;
+    int failures;
+    pthread_mutex_t mutex;
+} Run_t;
+
+static void *worker(void *arg)
+{
+    Run_t *run = arg;
+    uint16_t words[BLOCK_REGS];
+    for (;;)
+    {
+        pthread_mutex_lock(&run->mutex);
+        const bool done = run->transactions == 0;
+        if (!done)
+            run->transactions--;
+        pthread_mutex_unlock(&run->mutex);
+        if (done)
+            return NULL;
+        if (MbTcp_execute(run->bus, 3, 1, 0, BLOCK_REGS, words) != MODBUS_OK)
+            __atomic_add_fetch(&run->failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Execute transactions with as many tasks as the bus can have in flight, like the bus arbiter. Returns transactions per second.
+static double measure(uint8_t bus, const MbTcpConfig_t *config, int transactions, int *failures)
+{
+    Run_t run = {.bus = bus, .transactions = transactions, .failures = 0, .mutex = PTHREAD_MUTEX_INITIALIZER};
+    const int workersNum = MbTcp_transactionsInFlight(config);
+    pthread_t workers[MB_TCP_MAX_CONNECTIONS * MB_TCP_MAX_DEPTH];
+
+    const int64_t startUs = esp_timer_get_time();
+    for (int w = 0; w < workersNum; w++)
+        pthread_create(&workers[w], NULL, worker, &run);
+    for (int w = 0; w < workersNum; w++)
+        pthread_join(workers[w], NULL);
+    const int64_t elapsedUs = esp_timer_get_time() - startUs;
+
+    *failures = run.failures;
+    return transactions * 1e6 / elapsedUs;
+}
+
+int main(int argc, char **argv)
+{
+    const uint32_t latencyUs = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    const int transactions = argc > 2 ? atoi(argv[2]) : 2000;
+    signal(SIGPIPE, SIG_IGN);
+
+    static MbTcpServer_t server;
+    if (!MbTcpServer_start(&server, latencyUs))
+        return 1;
+    const MbTcpConfig_t single = {.ip = {127, 0, 0, 1}, .port = server.port, .connectionsNum = 1, .depth = 1};
+    const MbTcpConfig_t pooled = {.ip = {127, 0, 0, 1}, .port = server.port, .connectionsNum = MB_TCP_MAX_CONNECTIONS, .depth = MB_TCP_MAX_DEPTH};
+    if (!MbTcp_init(SINGLE_BUS, &single) || !MbTcp_init(POOLED_BUS, &pooled))
+        return 1;
+
+    int singleFailures = 0;
+    int pooledFailures = 0;
+    const double singleRate = measure(SINGLE_BUS, &single, transactions, &singleFailures);
+    const double pooledRate = measure(POOLED_BUS, &pooled, transactions, &pooledFailures);
+
+    printf("server latency: %" PRIu32 " us, %d reads of %d registers\n", latencyUs, transactions, BLOCK_REGS);
+    printf("single connection, depth 1: %8.0f transactions/s (%d failed)\n", singleRate, singleFailures);
+    printf("%d connections, depth %d:    %8.0f transactions/s (%d failed)\n", MB_TCP_MAX_CONNECTIONS, MB_TCP_MAX_DEPTH, pooledRate,
+           pooledFailures);
+    printf("speedup: %.1fx\n", pooledRate / singleRate);
+    return singleFailures == 0 && pooledFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// Time spent formatting values with num_format, against the path it replaced: rounding with pow, then printf.
+// Usage: bench_num_format [values]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <esp_timer.h>
+
+#include "num_format.h"
+
+#define BUF_LEN 64
+#define RUNS 5
+
+#define ROUND_TO_NTH_DECIMAL(v, n) (round(v * pow(10, n)) / pow(10, n))
+
+static volatile int sink; // Keeps results alive
+
+static void legacyFixed(double value, uint8_t decimals, char *buf, int bufLen)
+{
+    char fmt[10];
+    sprintf(fmt, "%%.%" PRIu8 "f", decimals);
+    sink += snprintf(buf, bufLen, fmt, ROUND_TO_NTH_DECIMAL(value, decimals));
+}
+
+// Nanoseconds per value of the fastest of RUNS runs
+static double timeFormat(bool legacy, const double *values, const uint8_t *decimals, int valuesNum)
+{
+    char buf[BUF_LEN];
+    double bestNs = INFINITY;
+    for (int run = 0; run < RUNS; run++)
+    {
+        const int64_t startUs = esp_timer_get_time();
+        for (int i = 0; i < valuesNum; i++)
+        {
+            if (legacy)
+                legacyFixed(values[i], decimals[i], buf, BUF_LEN);
+            else
+                sink += NumFormat_fixed(values[i], decimals[i], false, buf, BUF_LEN);
+        }
+        const double ns = (esp_timer_get_time() - startUs) * 1000.0 / valuesNum;
+        if (ns < bestNs)
+            bestNs = ns;
+    }
+    return bestNs;
+}
+
+static double timeRound(bool legacy, const double *values, const uint8_t *decimals, int valuesNum)
+{
+    double bestNs = INFINITY;
+    for (int run = 0; run < RUNS; run++)
+    {
+        double sum = 0;
+        const int64_t startUs = esp_timer_get_time();
+        for (int i = 0; i < valuesNum; i++)
+            sum += legacy ? ROUND_TO_NTH_DECIMAL(values[i], decimals[i]) : NumFormat_round(values[i], decimals[i]);
+        const double ns = (esp_timer_get_time() - startUs) * 1000.0 / valuesNum;
+        sink += sum > 0;
+        if (ns < bestNs)
+            bestNs = ns;
+    }
+    return bestNs;
+}
+
+int main(int argc, char **argv)
+{
+    const int valuesNum = argc > 1 ? atoi(argv[1]) : 1000000;
+    double *values = malloc(valuesNum * sizeof(double));
+    uint8_t *decimals = malloc(valuesNum);
+    if (values == NULL || decimals == NULL)
+        return 1;
+
+    // Register values as scaled by factors: a few digits, with 0 to 3 decimals
+    srand(1);
+    for (int i = 0; i < valuesNum; i++)
+    {
+        values[i] = (rand() % 2000000 - 1000000) * 0.0137;
+        decimals[i] = rand() % 4;
+    }
+
+    const double legacyFormatNs = timeFormat(true, values, decimals, valuesNum);
+    const double formatNs = timeFormat(false, values, decimals, valuesNum);
+    const double legacyRoundNs = timeRound(true, values, decimals, valuesNum);
+    const double roundNs = timeRound(false, values, decimals, valuesNum);
+
+    printf("%d values, 0 to 3 decimals, best of %d runs\n", valuesNum, RUNS);
+    printf("format: pow + printf %7.1f ns, NumFormat_fixed %7.1f ns, speedup %.1fx\n", legacyFormatNs, formatNs, legacyFormatNs / formatNs);
+    printf("round:  pow          %7.1f ns, NumFormat_round %7.1f ns, speedup %.1fx\n", legacyRoundNs, roundNs, legacyRoundNs / roundNs);
+    free(values);
+    free(decimals);
+    return 0;
+}
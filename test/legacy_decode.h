@@ -0,0 +1,98 @@
+#ifndef LEGACY_DECODE_H_
+#define LEGACY_DECODE_H_
+
+#include <string.h>
+
+#include "num_format.h"
+#include "register_access_data.h"
+
+// Decoding of registers as done before decode plans, deciding type, width and word order at every call. Kept as the
+// reference decode plans are checked and timed against (debug logs left out).
+
+static inline uint64_t legacyRegistersToInteger(const uint16_t uints[], uint8_t len, uint8_t bitPosition)
+{
+    uint64_t intValue = 0;
+    if (bitPosition == 0) // msb
+    {
+        for (uint8_t index = 0; index < len; index++)
+        {
+            intValue <<= 16;
+            intValue |= uints[index];
+        }
+    }
+    else if (bitPosition == 1) // lsb
+    {
+        for (int8_t index = len - 1; index >= 0; index--)
+        {
+            intValue <<= 16;
+            intValue |= uints[index];
+        }
+    }
+    return intValue;
+}
+
+static inline int64_t legacyRegistersToSignedInteger(const uint16_t uints[], uint8_t len, uint8_t bitPosition)
+{
+    const uint64_t intValue = legacyRegistersToInteger(uints, len, bitPosition);
+    switch (len)
+    {
+    case 1: // int16
+        return (int16_t)intValue;
+    case 2: // int32
+        return (int32_t)intValue;
+    default: // int64
+        return (int64_t)intValue;
+    }
+}
+
+static inline double legacyRegistersToNumber(const uint16_t uints[], uint8_t len, uint8_t bitPosition, bool asSigned)
+{
+    const uint64_t intValue = legacyRegistersToInteger(uints, len, bitPosition);
+    if (!asSigned)
+        return intValue;
+    switch (len)
+    {
+    case 1: // int16
+        return (int16_t)intValue;
+    case 2: // int32
+        return (int32_t)intValue;
+    case 4: // int64
+        return (int64_t)intValue;
+    default:
+        return 0;
+    }
+}
+
+static inline double legacyRegistersToFloat(const uint16_t uints[], uint8_t len, uint8_t bitPosition)
+{
+    const uint64_t intValue = legacyRegistersToInteger(uints, len, bitPosition);
+    if (len == 2)
+    {
+        const uint32_t bits = (uint32_t)intValue;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    if (len == 4)
+    {
+        double value;
+        memcpy(&value, &intValue, sizeof(value));
+        return value;
+    }
+    return 0;
+}
+
+static inline double legacyScaledNumber(const uint16_t *num, const RegisterAccessData_t *rad, uint8_t bitPosition)
+{
+    double value = 0;
+    if (rad->type == RADType_NUMBER)
+        value = legacyRegistersToNumber(num, rad->regNumber, bitPosition, rad->interpretAsSigned);
+    else if (rad->type == RADType_FLOAT)
+        value = legacyRegistersToFloat(num, rad->regNumber, bitPosition);
+
+    value *= rad->factor;
+    value += rad->offset;
+    return NumFormat_round(value, rad->decimals);
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "mb_tcp_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MBAP_LEN 7
+#define MAX_ADU_LEN 260
+#define PENDING_RESPONSES_MAX 64
+
+typedef struct Response_s
+{
+    int64_t dueUs;
+    uint8_t adu[MAX_ADU_LEN];
+    int len;
+} Response_t;
+
+// A connection is served by a reader, that queues responses, and by a writer, that sends them when they're due
+typedef struct Connection_s
+{
+    MbTcpServer_t *server;
+    int sock;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    Response_t responses[PENDING_RESPONSES_MAX];
+    int first;
+    int count;
+    bool closed;
+} Connection_t;
+
+// BEGIN --------------------------------------------------- STATIC FUNCTIONS --------------------------------------------------------------
+
+static int64_t nowUs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static uint16_t wordAt(const uint8_t *data)
+{
+    return ((uint16_t)data[0] << 8) | data[1];
+}
+
+static bool recvAll(int sock, uint8_t *data, int len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = recv(sock, data, len, 0);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static int exceptionPdu(uint8_t *pdu, uint8_t function, uint8_t code)
+{
+    pdu[0] = function | 0x80;
+    pdu[1] = code;
+    return 2;
+}
+
+// Build the response PDU of a request. Returns its length.
+static int serve(MbTcpServer_t *server, const uint8_t *request, int requestLen, uint8_t *pdu)
+{
+    const uint8_t function = request[0];
+    if (requestLen < 5)
+        return exceptionPdu(pdu, function, 3);
+    const uint16_t regId = wordAt(&request[1]);
+    const uint16_t regNumber = function == 6 ? 1 : wordAt(&request[3]);
+    if (regNumber == 0 || regId + regNumber > MB_TCP_SERVER_REGS_NUM)
+        return exceptionPdu(pdu, function, 2);
+
+    switch (function)
+    {
+    case 3:
+    case 4:
+        pdu[0] = function;
+        pdu[1] = 2 * regNumber;
+        for (int r = 0; r < regNumber; r++)
+        {
+            pdu[2 + 2 * r] = server->registers[regId + r] >> 8;
+            pdu[3 + 2 * r] = server->registers[regId + r] & 0xFF;
+        }
+        return 2 + 2 * regNumber;
+    case 6:
+        server->registers[regId] = wordAt(&request[3]);
+        memcpy(pdu, request, 5);
+        return 5;
+    case 16:
+        if (requestLen != 6 + 2 * regNumber || request[5] != 2 * regNumber)
+            return exceptionPdu(pdu, function, 3);
+        for (int r = 0; r < regNumber; r++)
+            server->registers[regId + r] = wordAt(&request[6 + 2 * r]);
+        memcpy(pdu, request, 5);
+        return 5;
+    default:
+        return exceptionPdu(pdu, function, 1);
+    }
+}
+
+static void *writerTask(void *arg)
+{
+    Connection_t *c = arg;
+    pthread_mutex_lock(&c->mutex);
+    while (!c->closed || c->count > 0)
+    {
+        if (c->count == 0)
+        {
+            pthread_cond_wait(&c->changed, &c->mutex);
+            continue;
+        }
+        Response_t *response = &c->responses[c->first];
+        const int64_t waitUs = response->dueUs - nowUs();
+        if (waitUs > 0)
+        {
+            pthread_mutex_unlock(&c->mutex);
+            usleep(waitUs);
+            pthread_mutex_lock(&c->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&c->mutex);
+        const bool sent = send(c->sock, response->adu, response->len, MSG_NOSIGNAL) == response->len;
+        pthread_mutex_lock(&c->mutex);
+        c->first = (c->first + 1) % PENDING_RESPONSES_MAX;
+        c->count--;
+        pthread_cond_broadcast(&c->changed);
+        if (!sent)
+            break;
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return NULL;
+}
+
+static void *readerTask(void *arg)
+{
+    Connection_t *c = arg;
+    pthread_t writer;
+    pthread_create(&writer, NULL, writerTask, c);
+
+    uint8_t request[MAX_ADU_LEN];
+    while (recvAll(c->sock, request, MBAP_LEN))
+    {
+        const int pduLen = wordAt(&request[4]) - 1;
+        if (pduLen < 1 || MBAP_LEN + pduLen > MAX_ADU_LEN || !recvAll(c->sock, &request[MBAP_LEN], pduLen))
+            break;
+
+        pthread_mutex_lock(&c->mutex);
+        while (c->count == PENDING_RESPONSES_MAX)
+            pthread_cond_wait(&c->changed, &c->mutex);
+        Response_t *response = &c->responses[(c->first + c->count) % PENDING_RESPONSES_MAX];
+        const int responsePduLen = serve(c->server, &request[MBAP_LEN], pduLen, &response->adu[MBAP_LEN]);
+        memcpy(response->adu, request, MBAP_LEN); // Same transaction id and unit id
+        response->adu[4] = (responsePduLen + 1) >> 8;
+        response->adu[5] = (responsePduLen + 1) & 0xFF;
+        response->len = MBAP_LEN + responsePduLen;
+        response->dueUs = nowUs() + c->server->latencyUs;
+        c->count++;
+        pthread_cond_broadcast(&c->changed);
+        pthread_mutex_unlock(&c->mutex);
+    }
+
+    pthread_mutex_lock(&c->mutex);
+    c->closed = true;
+    pthread_cond_broadcast(&c->changed);
+    pthread_mutex_unlock(&c->mutex);
+    pthread_join(writer, NULL);
+    close(c->sock);
+    free(c);
+    return NULL;
+}
+
+static void *acceptTask(void *arg)
+{
+    MbTcpServer_t *server = arg;
+    for (;;)
+    {
+        const int sock = accept(server->listenSock, NULL, NULL);
+        if (sock < 0)
+            return NULL;
+        const int noDelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        Connection_t *c = calloc(1, sizeof(Connection_t));
+        c->server = server;
+        c->sock = sock;
+        pthread_mutex_init(&c->mutex, NULL);
+        pthread_cond_init(&c->changed, NULL);
+        pthread_t reader;
+        pthread_create(&reader, NULL, readerTask, c);
+        pthread_detach(reader);
+    }
+}
+
+// BEGIN ---------------------------------------------------- PUBLIC FUNCTIONS --------------------------------------------------------------
+
+// Listen on an ephemeral port of 127.0.0.1, set in server->port. Registers hold their own address until written.
+bool MbTcpServer_start(MbTcpServer_t *server, uint32_t latencyUs)
+{
+    for (int r = 0; r < MB_TCP_SERVER_REGS_NUM; r++)
+        server->registers[r] = r;
+    server->latencyUs = latencyUs;
+
+    server->listenSock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (server->listenSock < 0 || bind(server->listenSock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server->listenSock, 16) != 0 ||
+        getsockname(server->listenSock, (struct sockaddr *)&addr, &addrLen) != 0)
+        return false;
+    server->port = ntohs(addr.sin_port);
+
+    pthread_t acceptor;
+    if (pthread_create(&acceptor, NULL, acceptTask, server) != 0)
+        return false;
+    pthread_detach(acceptor);
+    return true;
+}
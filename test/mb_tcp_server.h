@@ -0,0 +1,22 @@
+#ifndef MB_TCP_SERVER_H_
+#define MB_TCP_SERVER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define MB_TCP_SERVER_REGS_NUM 1000
+
+// Modbus TCP server on the loopback interface, standing in for a device on the network. It serves holding and input registers
+// (FC3, FC4, FC6, FC16) from the same table, answering each request latencyUs after it arrived: requests pipelined on a
+// connection are served at the same time, like by a server with a queue.
+typedef struct MbTcpServer_s
+{
+    int listenSock;
+    uint16_t port;
+    uint32_t latencyUs;
+    uint16_t registers[MB_TCP_SERVER_REGS_NUM];
+} MbTcpServer_t;
+
+bool MbTcpServer_start(MbTcpServer_t *server, uint32_t latencyUs);
+
+#endif
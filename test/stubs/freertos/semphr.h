@@ -0,0 +1,88 @@
+// Host stand-in for FreeRTOS semaphores, made of POSIX ones. Mutexes are semaphores that start given, recursive ones also
+// count how many times their owner took them.
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct StaticSemaphore_s
+{
+    sem_t sem;
+    int maxCount;
+    pthread_t owner; // Recursive mutexes only
+    int depth;
+} StaticSemaphore_t;
+
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t hostSemaphoreCreate(StaticSemaphore_t *buffer, int maxCount, int initialCount)
+{
+    if (sem_init(&buffer->sem, 0, initialCount) != 0)
+        return NULL;
+    buffer->maxCount = maxCount;
+    buffer->depth = 0;
+    return buffer;
+}
+
+#define xSemaphoreCreateMutexStatic(buffer) hostSemaphoreCreate((buffer), 1, 1)
+#define xSemaphoreCreateRecursiveMutexStatic(buffer) hostSemaphoreCreate((buffer), 1, 1)
+#define xSemaphoreCreateBinaryStatic(buffer) hostSemaphoreCreate((buffer), 1, 0)
+#define xSemaphoreCreateCountingStatic(maxCount, initialCount, buffer) hostSemaphoreCreate((buffer), (maxCount), (initialCount))
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    if (ticks == 0)
+        return sem_trywait(&sem->sem) == 0 ? pdTRUE : pdFALSE;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while ((ticks == portMAX_DELAY ? sem_wait(&sem->sem) : sem_timedwait(&sem->sem, &deadline)) != 0)
+    {
+        if (errno != EINTR)
+            return pdFALSE;
+    }
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    int count = 0;
+    sem_getvalue(&sem->sem, &count);
+    if (count >= sem->maxCount)
+        return pdFALSE;
+    return sem_post(&sem->sem) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    if (sem->depth > 0 && pthread_equal(sem->owner, pthread_self()))
+    {
+        sem->depth++;
+        return pdTRUE;
+    }
+    if (xSemaphoreTake(sem, ticks) != pdTRUE)
+        return pdFALSE;
+    sem->owner = pthread_self();
+    sem->depth = 1;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+    if (sem->depth == 0 || !pthread_equal(sem->owner, pthread_self()))
+        return pdFALSE;
+    if (--sem->depth > 0)
+        return pdTRUE;
+    return xSemaphoreGive(sem);
+}
@@ -0,0 +1,10 @@
+// Host stand-in for lwip sockets: the BSD sockets of the host
+#pragma once
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
@@ -0,0 +1,2 @@
+// Host stand-in for the configuration generated by ESP-IDF: options keep their defaults
+#pragma once
@@ -0,0 +1,10 @@
+// Host stand-in for the Trackle Modbus library: only the types used by headers of the modules under test
+#pragma once
+
+typedef enum
+{
+    MODBUS_OK = 0,
+    MODBUS_ERR_TIMEOUT,
+    MODBUS_ERR_CRC,
+    MODBUS_ERR_EXCEPTION,
+} ModbusError;
@@ -0,0 +1,21 @@
+#ifndef TEST_CHECK_H_
+#define TEST_CHECK_H_
+
+#include <stdio.h>
+
+// Failed checks are reported and counted, so that a test run shows all of them. Tests return TEST_RESULT from main.
+static int testFailures = 0;
+
+#define CHECK(cond)                                                                     \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(cond))                                                                    \
+        {                                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);    \
+            testFailures++;                                                             \
+        }                                                                               \
+    } while (0)
+
+#define TEST_RESULT (testFailures == 0 ? 0 : 1)
+
+#endif
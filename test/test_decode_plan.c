@@ -0,0 +1,190 @@
+// Decode plans of each register type, width and word order, checked on known values and against the decoding they replaced
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode_plan.h"
+#include "legacy_decode.h"
+#include "test_check.h"
+
+#define MSB 0
+#define LSB 1
+#define RANDOM_CASES_NUM 500000
+
+static RegisterAccessData_t radOf(RADType_t type, uint8_t regNumber, bool asSigned, double factor, double offset, uint8_t decimals)
+{
+    RegisterAccessData_t rad = {0};
+    rad.type = type;
+    rad.regNumber = regNumber;
+    rad.interpretAsSigned = asSigned;
+    rad.factor = factor;
+    rad.offset = offset;
+    rad.decimals = decimals;
+    return rad;
+}
+
+// Words of a value, most significant first, reversed for lsb
+static void wordsOf(uint64_t value, uint8_t regNumber, uint8_t bitPosition, uint16_t *words)
+{
+    for (int i = 0; i < regNumber; i++)
+    {
+        const uint16_t word = value >> (16 * (regNumber - 1 - i));
+        words[bitPosition == MSB ? i : regNumber - 1 - i] = word;
+    }
+}
+
+static void testIntegers()
+{
+    static const struct
+    {
+        uint8_t regNumber;
+        uint64_t bits;
+        int64_t asSigned;
+    } cases[] = {
+        {1, 0x8000, INT16_MIN},
+        {1, 0x7FFF, INT16_MAX},
+        {2, 0xFFFFFFFF, -1},
+        {2, 0x80000000, INT32_MIN},
+        {3, 0x800000000000, -0x800000000000},
+        {3, 0x7FFFFFFFFFFF, 0x7FFFFFFFFFFF},
+        {4, 0x8000000000000000, INT64_MIN},
+        {4, 0xFFFFFFFFFFFFFFFE, -2},
+        {4, 0x0123456789ABCDEF, 0x0123456789ABCDEF},
+    };
+    for (int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++)
+    {
+        for (uint8_t bitPosition = MSB; bitPosition <= LSB; bitPosition++)
+        {
+            uint16_t words[4];
+            wordsOf(cases[c].bits, cases[c].regNumber, bitPosition, words);
+
+            DecodePlan_t plan;
+            RegisterAccessData_t rad = radOf(RADType_NUMBER, cases[c].regNumber, false, 1, 0, 0);
+            DecodePlan_build(&plan, &rad, bitPosition);
+            CHECK(plan.exactInteger && plan.valueType == RegValueType_UINT);
+            CHECK(DecodePlan_unsigned(&plan, words) == cases[c].bits);
+            CHECK(DecodePlan_native(&plan, words) == (double)cases[c].bits);
+
+            rad.interpretAsSigned = true;
+            DecodePlan_build(&plan, &rad, bitPosition);
+            CHECK(plan.exactInteger && plan.valueType == RegValueType_INT);
+            CHECK(DecodePlan_signed(&plan, words) == cases[c].asSigned);
+            CHECK(DecodePlan_native(&plan, words) == (double)cases[c].asSigned);
+
+            // With coefficients, values are doubles
+            rad = radOf(RADType_NUMBER, cases[c].regNumber, true, 0.5, -1, 1);
+            DecodePlan_build(&plan, &rad, bitPosition);
+            CHECK(!plan.exactInteger && plan.valueType == RegValueType_FLOAT64);
+            CHECK(DecodePlan_scaled(&plan, words) == NumFormat_round((double)cases[c].asSigned * 0.5 - 1, 1));
+        }
+    }
+}
+
+static void testFloats()
+{
+    for (uint8_t bitPosition = MSB; bitPosition <= LSB; bitPosition++)
+    {
+        uint16_t words[4];
+        const float f32 = -1234.5f;
+        uint32_t bits32;
+        memcpy(&bits32, &f32, sizeof(bits32));
+        wordsOf(bits32, 2, bitPosition, words);
+
+        DecodePlan_t plan;
+        RegisterAccessData_t rad = radOf(RADType_FLOAT, 2, false, 1, 0, 2);
+        DecodePlan_build(&plan, &rad, bitPosition);
+        CHECK(plan.valueType == RegValueType_FLOAT32 && !plan.exactInteger);
+        CHECK(DecodePlan_native(&plan, words) == -1234.5);
+        CHECK(DecodePlan_scaled(&plan, words) == -1234.5);
+
+        rad.factor = 2;
+        DecodePlan_build(&plan, &rad, bitPosition);
+        CHECK(plan.valueType == RegValueType_FLOAT64);
+        CHECK(DecodePlan_scaled(&plan, words) == -2469.0);
+
+        const double f64 = 0.1;
+        uint64_t bits64;
+        memcpy(&bits64, &f64, sizeof(bits64));
+        wordsOf(bits64, 4, bitPosition, words);
+        rad = radOf(RADType_FLOAT, 4, false, 1, 0, 3);
+        DecodePlan_build(&plan, &rad, bitPosition);
+        CHECK(plan.valueType == RegValueType_FLOAT64);
+        CHECK(DecodePlan_native(&plan, words) == 0.1);
+        CHECK(DecodePlan_scaled(&plan, words) == 0.1);
+
+        // Floats are 2 or 4 words
+        rad = radOf(RADType_FLOAT, 3, false, 1, 0, 0);
+        DecodePlan_build(&plan, &rad, bitPosition);
+        CHECK(DecodePlan_native(&plan, words) == 0);
+    }
+}
+
+static void testOtherTypes()
+{
+    const uint16_t words[MAX_REG_LENGTH] = {0xABCD, 0x1234, 0x5678};
+    DecodePlan_t plan;
+
+    // Raw registers are the first word, whatever the coefficients
+    RegisterAccessData_t rad = radOf(RADType_RAW, 1, true, 10, 5, 2);
+    DecodePlan_build(&plan, &rad, LSB);
+    CHECK(plan.exactInteger && plan.valueType == RegValueType_UINT && plan.decimals == 0);
+    CHECK(DecodePlan_unsigned(&plan, words) == 0xABCD);
+    CHECK(DecodePlan_scaled(&plan, words) == 0xABCD);
+
+    rad = radOf(RADType_STRING, MAX_REG_LENGTH, false, 1, 0, 0);
+    DecodePlan_build(&plan, &rad, MSB);
+    CHECK(plan.valueType == RegValueType_TEXT && !plan.exactInteger);
+    CHECK(DecodePlan_native(&plan, words) == 0);
+
+    // Numbers are at most 4 words
+    rad = radOf(RADType_NUMBER, 5, false, 1, 0, 0);
+    DecodePlan_build(&plan, &rad, MSB);
+    CHECK(DecodePlan_unsigned(&plan, words) == 0);
+}
+
+static bool sameDouble(double a, double b)
+{
+    return a == b || (isnan(a) && isnan(b));
+}
+
+// Random configurations and words decode as with the functions decode plans replaced. The only intended difference: signed
+// numbers of 3 words, that those functions didn't sign extend (and decoded as 0 when scaled).
+static void testMatchesLegacy()
+{
+    static const double FACTORS[] = {1, 1, 0.1, 0.01, 2.5, -1};
+    static const double OFFSETS[] = {0, 0, -40, 273.15};
+    int mismatches = 0;
+    srand(1);
+    for (int i = 0; i < RANDOM_CASES_NUM; i++)
+    {
+        const RADType_t type = rand() % 2 == 0 ? RADType_NUMBER : RADType_FLOAT;
+        const uint8_t regNumber = type == RADType_FLOAT ? 2 + 2 * (rand() % 2) : 1 + rand() % 4;
+        const bool asSigned = rand() % 2 == 0 && !(type == RADType_NUMBER && regNumber == 3);
+        const RegisterAccessData_t rad = radOf(type, regNumber, asSigned, FACTORS[rand() % 6], OFFSETS[rand() % 4], rand() % 4);
+        const uint8_t bitPosition = rand() % 2;
+        uint16_t words[4];
+        for (int w = 0; w < 4; w++)
+            words[w] = rand();
+
+        DecodePlan_t plan;
+        DecodePlan_build(&plan, &rad, bitPosition);
+        bool same = sameDouble(DecodePlan_scaled(&plan, words), legacyScaledNumber(words, &rad, bitPosition));
+        if (plan.exactInteger && asSigned)
+            same = same && DecodePlan_signed(&plan, words) == legacyRegistersToSignedInteger(words, regNumber, bitPosition);
+        else if (plan.exactInteger)
+            same = same && DecodePlan_unsigned(&plan, words) == legacyRegistersToInteger(words, regNumber, bitPosition);
+        if (!same && mismatches++ < 10)
+            fprintf(stderr, "type %d, %u words, signed %d, bit position %u: decoded differently\n", type, regNumber, asSigned, bitPosition);
+    }
+    CHECK(mismatches == 0);
+}
+
+int main()
+{
+    testIntegers();
+    testFloats();
+    testOtherTypes();
+    testMatchesLegacy();
+    return TEST_RESULT;
+}
@@ -0,0 +1,366 @@
+// Register registry: slot table, hash indexes and per-slave lists, checked against a simple model through random churn of
+// adds, removes, renames and bus moves
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode_plan.h"
+#include "known_registers.h"
+#include "register_map.h"
+#include "test_check.h"
+
+#define CAPACITY 48
+#define NAMES_NUM 96     // Twice the capacity, so that adds of known names clash
+#define SLAVES 3         // Few Modbus addresses, so that adds clash on them too
+#define REG_IDS 24
+#define OPERATIONS 20000 // Enough removals to fill indexes with deleted buckets, and rebuild them many times
+#define CHECK_EVERY 50
+
+// Register as the model knows it. Registers are kept in insertion order, like indexes of the registry.
+typedef struct ModelReg_s
+{
+    int name;
+    uint8_t bus;
+    uint8_t slaveAddr;
+    uint16_t regId;
+    KnownRegHandle_t handle;
+    uint32_t slaveSeq; // Registers of a slave are listed in the order they were added to it
+} ModelReg_t;
+
+static ModelReg_t model[CAPACITY];
+static int modelNum = 0;
+static uint32_t nextSlaveSeq = 0;
+
+static void nameOf(int name, char *buf)
+{
+    snprintf(buf, MAX_REG_NAME_SIZE, "reg%d", name);
+}
+
+static void registerOf(const ModelReg_t *reg, RegisterAccessData_t *rad)
+{
+    *rad = (RegisterAccessData_t){0};
+    nameOf(reg->name, rad->regName);
+    rad->bus = reg->bus;
+    rad->slaveAddr = reg->slaveAddr;
+    rad->regId = reg->regId;
+    rad->type = RADType_NUMBER;
+    rad->readFunction = 3;
+    rad->regNumber = 1;
+    rad->factor = 1;
+}
+
+static int modelFindName(int name)
+{
+    for (int i = 0; i < modelNum; i++)
+    {
+        if (model[i].name == name)
+            return i;
+    }
+    return -1;
+}
+
+static int modelFindModbus(uint8_t bus, uint8_t slaveAddr, uint16_t regId)
+{
+    for (int i = 0; i < modelNum; i++)
+    {
+        if (model[i].bus == bus && model[i].slaveAddr == slaveAddr && model[i].regId == regId)
+            return i;
+    }
+    return -1;
+}
+
+static void modelRemoveAt(int idx)
+{
+    memmove(&model[idx], &model[idx + 1], (modelNum - idx - 1) * sizeof(ModelReg_t));
+    modelNum--;
+}
+
+static bool addRegister(const ModelReg_t *reg)
+{
+    RegisterAccessData_t rad;
+    registerOf(reg, &rad);
+    const bool expected = modelNum < CAPACITY && modelFindName(reg->name) < 0 && modelFindModbus(reg->bus, reg->slaveAddr, reg->regId) < 0;
+    CHECK(KnownRegisters_add(&rad) == expected);
+    if (!expected)
+        return false;
+
+    model[modelNum] = *reg;
+    model[modelNum].handle = KnownRegisters_handleOf(rad.regName);
+    model[modelNum].slaveSeq = nextSlaveSeq++;
+    CHECK(model[modelNum].handle != INVALID_REG_HANDLE);
+    modelNum++;
+    return true;
+}
+
+static void removeRegister(int name)
+{
+    char regName[MAX_REG_NAME_SIZE];
+    nameOf(name, regName);
+    const int idx = modelFindName(name);
+    CHECK(KnownRegisters_remove(regName) == (idx >= 0));
+    if (idx >= 0)
+        modelRemoveAt(idx);
+}
+
+// Registers have no rename: the register is removed, and added again with the new name and the same Modbus address
+static void renameRegister(int idx, int newName)
+{
+    ModelReg_t reg = model[idx];
+    reg.name = newName;
+    if (modelFindName(newName) >= 0)
+        return;
+    removeRegister(model[idx].name);
+    CHECK(addRegister(&reg));
+}
+
+static void moveRegister(int idx, uint8_t bus)
+{
+    char regName[MAX_REG_NAME_SIZE];
+    nameOf(model[idx].name, regName);
+    const int clash = modelFindModbus(bus, model[idx].slaveAddr, model[idx].regId);
+    const bool expected = clash < 0 || clash == idx;
+    CHECK(KnownRegisters_setBus(regName, bus) == expected);
+    if (expected)
+    {
+        model[idx].bus = bus;
+        model[idx].slaveSeq = nextSlaveSeq++; // Moved to the end of the list of its slave, even if on the same bus
+    }
+}
+
+static void checkSlaveList(uint8_t bus, uint8_t slaveAddr)
+{
+    KnownRegHandle_t expected[CAPACITY];
+    uint32_t seqs[CAPACITY];
+    int expectedNum = 0;
+    for (int i = 0; i < modelNum; i++)
+    {
+        if (model[i].bus != bus || model[i].slaveAddr != slaveAddr)
+            continue;
+        // Insertion by sequence number
+        int pos = expectedNum++;
+        while (pos > 0 && seqs[pos - 1] > model[i].slaveSeq)
+        {
+            expected[pos] = expected[pos - 1];
+            seqs[pos] = seqs[pos - 1];
+            pos--;
+        }
+        expected[pos] = model[i].handle;
+        seqs[pos] = model[i].slaveSeq;
+    }
+
+    KnownRegHandle_t handles[CAPACITY];
+    CHECK(KnownRegisters_countOfSlave(bus, slaveAddr) == expectedNum);
+    CHECK(KnownRegisters_handlesOfSlave(bus, slaveAddr, handles, CAPACITY) == expectedNum);
+    CHECK(memcmp(handles, expected, expectedNum * sizeof(KnownRegHandle_t)) == 0);
+}
+
+// Everything the registry answers must match the model
+static void checkRegistry()
+{
+    CHECK(KnownRegisters_count() == modelNum);
+    uint32_t mapHash = 0;
+    for (int i = 0; i < modelNum; i++)
+    {
+        const ModelReg_t *reg = &model[i];
+        char regName[MAX_REG_NAME_SIZE];
+        nameOf(reg->name, regName);
+
+        // Handles don't change while registers exist, indexes follow insertion order
+        CHECK(KnownRegisters_handleOf(regName) == reg->handle);
+        CHECK(KnownRegisters_handleAt(i) == reg->handle);
+        CHECK(KnownRegisters_indexOf(reg->handle) == i);
+
+        RegisterAccessData_t rad;
+        CHECK(KnownRegisters_at(i, &rad) && strcmp(rad.regName, regName) == 0 && rad.bus == reg->bus);
+        CHECK(KnownRegisters_find(regName, &rad) && rad.slaveAddr == reg->slaveAddr && rad.regId == reg->regId);
+        CHECK(KnownRegisters_findByModbus(reg->bus, 3, reg->slaveAddr, reg->regId, &rad) && strcmp(rad.regName, regName) == 0);
+        CHECK(rad.keyId != 0);
+        mapHash ^= RegisterMap_recordHash(&rad);
+
+        RegisterPollData_t poll;
+        CHECK(KnownRegisters_getPollDataAt(i, &poll) && poll.bus == reg->bus && poll.slaveAddr == reg->slaveAddr && poll.regId == reg->regId);
+    }
+    CHECK(KnownRegisters_getMapHash() == mapHash);
+    CHECK(KnownRegisters_handleAt(modelNum) == INVALID_REG_HANDLE);
+
+    // Removed and never added names and addresses aren't found
+    for (int name = 0; name < NAMES_NUM; name++)
+    {
+        char regName[MAX_REG_NAME_SIZE];
+        nameOf(name, regName);
+        RegisterAccessData_t rad;
+        if (modelFindName(name) < 0)
+            CHECK(!KnownRegisters_find(regName, &rad) && KnownRegisters_handleOf(regName) == INVALID_REG_HANDLE);
+    }
+    for (uint8_t bus = 0; bus < 2; bus++)
+    {
+        for (uint8_t slaveAddr = 1; slaveAddr <= SLAVES; slaveAddr++)
+        {
+            checkSlaveList(bus, slaveAddr);
+            for (uint16_t regId = 0; regId < REG_IDS; regId++)
+            {
+                RegisterAccessData_t rad;
+                if (modelFindModbus(bus, slaveAddr, regId) < 0)
+                    CHECK(!KnownRegisters_findByModbus(bus, 3, slaveAddr, regId, &rad));
+            }
+        }
+    }
+}
+
+static void testChurn()
+{
+    CHECK(KnownRegisters_init(CAPACITY));
+    CHECK(KnownRegisters_capacity() == CAPACITY);
+    srand(1);
+    for (int op = 0; op < OPERATIONS; op++)
+    {
+        const int action = rand() % 10;
+        if (action < 4)
+        {
+            const ModelReg_t reg = {.name = rand() % NAMES_NUM, .bus = rand() % 2, .slaveAddr = 1 + rand() % SLAVES, .regId = rand() % REG_IDS};
+            addRegister(&reg);
+        }
+        else if (action < 7)
+        {
+            removeRegister(rand() % NAMES_NUM);
+        }
+        else if (action < 9 && modelNum > 0)
+        {
+            renameRegister(rand() % modelNum, rand() % NAMES_NUM);
+        }
+        else if (modelNum > 0)
+        {
+            moveRegister(rand() % modelNum, rand() % 2);
+        }
+
+        if (op % CHECK_EVERY == 0)
+            checkRegistry();
+    }
+    checkRegistry();
+
+    // Filled up, then emptied in a different order than insertion
+    for (int name = 0; name < NAMES_NUM; name++)
+    {
+        const ModelReg_t reg = {.name = name, .bus = name % 2, .slaveAddr = 1 + name % SLAVES, .regId = name % REG_IDS};
+        addRegister(&reg);
+    }
+    CHECK(modelNum == CAPACITY);
+    checkRegistry();
+    for (int name = NAMES_NUM - 1; name >= 0; name -= 2)
+        removeRegister(name);
+    checkRegistry();
+
+    KnownRegisters_clear();
+    modelNum = 0;
+    checkRegistry();
+    CHECK(KnownRegisters_getMapHash() == 0);
+}
+
+// Key ids are kept when given and free, assigned otherwise, and not reused right after removal
+static bool checkPublishCopy(int idx, const RegisterPollData_t *poll, const RegisterPublishData_t *publish, void *arg)
+{
+    const RegisterAccessData_t *rad = (const RegisterAccessData_t *)arg;
+    CHECK(strcmp(publish->regName, rad->regName) == 0 && publish->keyId == rad->keyId);
+    CHECK(poll->regId == rad->regId && publish->decodePlan.regNumber == rad->regNumber);
+    return true;
+}
+
+static void testKeyIds()
+{
+    CHECK(KnownRegisters_init(CAPACITY));
+    RegisterAccessData_t rad;
+    const ModelReg_t first = {.name = 1, .slaveAddr = 1, .regId = 1};
+    registerOf(&first, &rad);
+    rad.keyId = 7;
+    CHECK(KnownRegisters_add(&rad));
+
+    const ModelReg_t second = {.name = 2, .slaveAddr = 1, .regId = 2};
+    registerOf(&second, &rad);
+    rad.keyId = 7; // Already used
+    CHECK(KnownRegisters_add(&rad));
+    CHECK(KnownRegisters_find("reg2", &rad) && rad.keyId != 0 && rad.keyId != 7);
+    const uint16_t removedKeyId = rad.keyId;
+
+    CHECK(KnownRegisters_remove("reg2"));
+    const ModelReg_t third = {.name = 3, .slaveAddr = 1, .regId = 3};
+    registerOf(&third, &rad);
+    CHECK(KnownRegisters_add(&rad));
+    CHECK(KnownRegisters_find("reg3", &rad) && rad.keyId != 0 && rad.keyId != 7 && rad.keyId != removedKeyId);
+    CHECK(KnownRegisters_find("reg1", &rad) && rad.keyId == 7);
+
+    // The copy the monitoring task publishes with follows the register's details
+    CHECK(KnownRegisters_visitPublishData(KnownRegisters_handleOf("reg1"), checkPublishCopy, &rad));
+    CHECK(KnownRegisters_find("reg3", &rad));
+    CHECK(KnownRegisters_visitPublishData(KnownRegisters_handleOf("reg3"), checkPublishCopy, &rad));
+    KnownRegisters_clear();
+}
+
+// Simulate the monitoring task publishing the value of the idx-th register, as publishMessage does
+static void publishValue(int idx, uint16_t word, Seconds_t seconds)
+{
+    const uint16_t raw[MAX_REG_LENGTH] = {word};
+    CHECK(KnownRegisters_setLatestPublishedValueAt(idx, raw, DecodePlan_scaled(KnownRegisters_getDecodePlanAt(idx), raw)));
+    CHECK(KnownRegisters_setLatestPublishedTimeAt(idx, seconds));
+    CHECK(KnownRegisters_setMustPublish(idx, false));
+}
+
+static bool mustPublish(int idx)
+{
+    bool mustPublish = false;
+    CHECK(KnownRegisters_getMustPublish(idx, &mustPublish));
+    return mustPublish;
+}
+
+// A register decoded differently is published once more, even if its words don't change, and its latest published number
+// is in the new scale, so that deadbands compare values in the same scale
+static void testRescale()
+{
+    CHECK(KnownRegisters_init(CAPACITY));
+    RegisterAccessData_t rad;
+    const ModelReg_t reg = {.name = 1, .slaveAddr = 1, .regId = 1};
+    registerOf(&reg, &rad);
+    rad.monitored = true;
+    rad.publishOnChange = true;
+    CHECK(KnownRegisters_add(&rad));
+    publishValue(0, 1000, 10);
+    CHECK(!mustPublish(0));
+
+    // Settings that don't change decoding
+    CHECK(KnownRegisters_setDeadband("reg1", 5, 0));
+    CHECK(KnownRegisters_setMaxPublishDelay("reg1", 60));
+    CHECK(KnownRegisters_setPollInterval("reg1", 5));
+    CHECK(!mustPublish(0));
+
+    double number = 0;
+    CHECK(KnownRegisters_setFactor("reg1", 0.1));
+    CHECK(mustPublish(0));
+    CHECK(KnownRegisters_getLatestPublishedNumberAt(0, &number) && number == 100);
+    publishValue(0, 1000, 20);
+    CHECK(!mustPublish(0));
+    CHECK(KnownRegisters_setFactor("reg1", 0.1)); // Same factor
+    CHECK(!mustPublish(0));
+
+    CHECK(KnownRegisters_setOffset("reg1", -50));
+    CHECK(mustPublish(0));
+    CHECK(KnownRegisters_getLatestPublishedNumberAt(0, &number) && number == 50);
+    publishValue(0, 1000, 30);
+
+    CHECK(KnownRegisters_setDecimals("reg1", 2));
+    CHECK(mustPublish(0));
+    publishValue(0, 1000, 40);
+    CHECK(KnownRegisters_setInterpretedAsSigned("reg1", true));
+    CHECK(mustPublish(0));
+    publishValue(0, 1000, 50);
+    CHECK(KnownRegisters_setLength("reg1", 2));
+    CHECK(mustPublish(0));
+    KnownRegisters_clear();
+}
+
+int main()
+{
+    testChurn();
+    testKeyIds();
+    testRescale();
+    return TEST_RESULT;
+}
@@ -0,0 +1,139 @@
+// Modbus TCP master against a loopback server: transactions, pipelining on pooled connections, and servers that can't be reached
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <esp_timer.h>
+
+#include "mb_tcp.h"
+#include "mb_tcp_server.h"
+#include "test_check.h"
+
+#define SERVED_BUS MB_FIRST_TCP_BUS
+#define UNREACHABLE_BUS (MB_FIRST_TCP_BUS + 1)
+#define SERVED_CONNECTIONS 2
+#define SERVED_DEPTH 2
+#define WORKERS_NUM (SERVED_CONNECTIONS * SERVED_DEPTH) // Like the bus arbiter, as many tasks as transactions in flight
+#define WORKER_READS 50
+#define READ_REGS_FIRST 300 // Not written by other tests
+#define CONNECT_WAIT_MAX_US 3000000 // Connect timeout, with some margin
+
+static MbTcpServer_t server;
+
+static MbTcpConfig_t loopbackConfig(uint16_t port, uint8_t connectionsNum, uint8_t depth)
+{
+    MbTcpConfig_t config = {.ip = {127, 0, 0, 1}, .port = port, .connectionsNum = connectionsNum, .depth = depth};
+    return config;
+}
+
+static void testTransactions()
+{
+    uint16_t words[10] = {0};
+    CHECK(MbTcp_execute(SERVED_BUS, 3, 1, 100, 10, words) == MODBUS_OK);
+    for (int r = 0; r < 10; r++)
+        CHECK(words[r] == 100 + r);
+
+    const uint16_t written[3] = {0xBEEF, 0, 0xFFFF};
+    CHECK(MbTcp_execute(SERVED_BUS, 16, 1, 200, 3, (void *)written) == MODBUS_OK);
+    uint16_t single = 1234;
+    CHECK(MbTcp_execute(SERVED_BUS, 6, 1, 203, 1, &single) == MODBUS_OK);
+    CHECK(MbTcp_execute(SERVED_BUS, 4, 1, 200, 4, words) == MODBUS_OK);
+    CHECK(words[0] == 0xBEEF && words[1] == 0 && words[2] == 0xFFFF && words[3] == 1234);
+
+    CHECK(MbTcp_execute(SERVED_BUS, 3, 1, MB_TCP_SERVER_REGS_NUM - 2, 5, words) == MB_BUS_ERR_EXCEPTION(MB_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+    CHECK(MbTcp_execute(SERVED_BUS, 1, 1, 0, 8, words) == MB_BUS_ERR_EXCEPTION(MB_EXCEPTION_ILLEGAL_FUNCTION));
+    CHECK(MbTcp_execute(SERVED_BUS, 3, 1, 0, 126, words) == MB_BUS_ERR_INVALID_REQUEST);
+    CHECK(MbTcp_execute(MB_PRIMARY_BUS, 3, 1, 0, 1, words) == MB_BUS_ERR_NOT_RUNNING);
+}
+
+static void *readerWorker(void *arg)
+{
+    const int worker = (int)(intptr_t)arg;
+    int *failures = calloc(1, sizeof(int));
+    for (int i = 0; i < WORKER_READS; i++)
+    {
+        const uint16_t regId = READ_REGS_FIRST + worker * WORKER_READS + i;
+        uint16_t words[8] = {0};
+        if (MbTcp_execute(SERVED_BUS, 3, 1, regId, 8, words) != MODBUS_OK || words[0] != regId || words[7] != regId + 7)
+            (*failures)++;
+    }
+    return failures;
+}
+
+// Transactions of many tasks in flight on the same connections get their own responses
+static void testConcurrentTransactions()
+{
+    pthread_t workers[WORKERS_NUM];
+    for (int w = 0; w < WORKERS_NUM; w++)
+        pthread_create(&workers[w], NULL, readerWorker, (void *)(intptr_t)w);
+    for (int w = 0; w < WORKERS_NUM; w++)
+    {
+        int *failures = NULL;
+        pthread_join(workers[w], (void **)&failures);
+        CHECK(*failures == 0);
+        free(failures);
+    }
+}
+
+static void *unreachableWorker(void *arg)
+{
+    int64_t *elapsedUs = arg;
+    uint16_t words[1];
+    const int64_t startUs = esp_timer_get_time();
+    const ModbusError err = MbTcp_execute(UNREACHABLE_BUS, 3, 1, 0, 1, words);
+    *elapsedUs = err == MB_BUS_ERR_IO ? esp_timer_get_time() - startUs : -1;
+    return NULL;
+}
+
+// A server whose backlog is full never completes the handshake: transactions waiting to connect to it fail in bounded time
+static void testUnreachableServer()
+{
+    const int listenSock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    CHECK(bind(listenSock, (struct sockaddr *)&addr, sizeof(addr)) == 0 && listen(listenSock, 0) == 0);
+    CHECK(getsockname(listenSock, (struct sockaddr *)&addr, &addrLen) == 0);
+    const int backlogSock = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(connect(backlogSock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+    const MbTcpConfig_t config = loopbackConfig(ntohs(addr.sin_port), 1, 2);
+    CHECK(MbTcp_init(UNREACHABLE_BUS, &config));
+
+    pthread_t workers[2];
+    int64_t elapsedUs[2];
+    for (int w = 0; w < 2; w++)
+        pthread_create(&workers[w], NULL, unreachableWorker, &elapsedUs[w]);
+    for (int w = 0; w < 2; w++)
+    {
+        pthread_join(workers[w], NULL);
+        CHECK(elapsedUs[w] >= 0 && elapsedUs[w] < CONNECT_WAIT_MAX_US);
+    }
+
+    // Until the reconnect delay expires, transactions fail at once
+    unreachableWorker(&elapsedUs[0]);
+    CHECK(elapsedUs[0] >= 0 && elapsedUs[0] < 100000);
+
+    close(backlogSock);
+    close(listenSock);
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+    CHECK(MbTcpServer_start(&server, 0));
+    const MbTcpConfig_t config = loopbackConfig(server.port, SERVED_CONNECTIONS, SERVED_DEPTH);
+    CHECK(MbTcp_init(SERVED_BUS, &config));
+
+    testTransactions();
+    testConcurrentTransactions();
+    testUnreachableServer();
+    return TEST_RESULT;
+}
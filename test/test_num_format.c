@@ -0,0 +1,142 @@
+// Formatting of numbers: signs, rounding carries, trailing zeros, and agreement with the printf based path it replaced
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "num_format.h"
+#include "test_check.h"
+
+#define BUF_LEN 64
+#define RANDOM_VALUES_NUM 200000
+
+static char buf[BUF_LEN];
+
+static bool fixedIs(double value, uint8_t decimals, bool trimZeros, const char *expected)
+{
+    const int len = NumFormat_fixed(value, decimals, trimZeros, buf, BUF_LEN);
+    if (len != (int)strlen(expected) || strcmp(buf, expected) != 0)
+    {
+        fprintf(stderr, "%.17g with %u decimals%s: \"%s\", expected \"%s\"\n", value, decimals, trimZeros ? " trimmed" : "", buf, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool intIs(int64_t value, uint8_t decimals, bool trimZeros, const char *expected)
+{
+    const int len = NumFormat_int(value, decimals, trimZeros, buf, BUF_LEN);
+    return len == (int)strlen(expected) && strcmp(buf, expected) == 0;
+}
+
+static bool uintIs(uint64_t value, uint8_t decimals, bool trimZeros, const char *expected)
+{
+    const int len = NumFormat_uint(value, decimals, trimZeros, buf, BUF_LEN);
+    return len == (int)strlen(expected) && strcmp(buf, expected) == 0;
+}
+
+static void testNegativeZero()
+{
+    CHECK(fixedIs(-0.0, 2, false, "0.00"));
+    CHECK(fixedIs(-0.004, 2, false, "0.00"));
+    CHECK(fixedIs(-0.004, 2, true, "0"));
+    CHECK(fixedIs(-0.4, 0, false, "0"));
+    CHECK(fixedIs(-0.005, 2, false, "-0.01")); // Rounded away from zero: not zero anymore
+    CHECK(fixedIs(-0.5, 0, false, "-1"));
+    CHECK(fixedIs(-0.25, 1, false, "-0.3"));
+    CHECK(intIs(0, 3, false, "0.000"));
+}
+
+static void testCarry()
+{
+    CHECK(fixedIs(0.999, 2, false, "1.00"));
+    CHECK(fixedIs(9.9996, 3, false, "10.000"));
+    CHECK(fixedIs(-99.96, 1, false, "-100.0"));
+    CHECK(fixedIs(199.5, 0, false, "200"));
+    CHECK(fixedIs(0.0996, 3, false, "0.100"));
+    CHECK(fixedIs(0.0996, 3, true, "0.1"));
+    CHECK(fixedIs(1.25, 1, false, "1.3")); // Halves away from zero
+    CHECK(fixedIs(2.5, 0, false, "3"));
+}
+
+static void testTrailingZeros()
+{
+    CHECK(fixedIs(1.5, 3, false, "1.500"));
+    CHECK(fixedIs(1.5, 3, true, "1.5"));
+    CHECK(fixedIs(2.0, 3, true, "2"));
+    CHECK(fixedIs(-2.0, 3, true, "-2"));
+    CHECK(fixedIs(100.0, 2, true, "100")); // Zeros of the integer part stay
+    CHECK(fixedIs(0.105, 4, true, "0.105"));
+    CHECK(fixedIs(12.0, 0, true, "12"));
+    CHECK(intIs(1200, 2, false, "1200.00"));
+    CHECK(intIs(1200, 2, true, "1200"));
+    CHECK(uintIs(7, 1, true, "7"));
+
+    // Fallback to printf: too many decimals, or too large to be scaled
+    CHECK(fixedIs(0.5, 20, false, "0.50000000000000000000"));
+    CHECK(fixedIs(0.5, 20, true, "0.5"));
+    CHECK(fixedIs(1e20, 2, false, "100000000000000000000.00"));
+    CHECK(fixedIs(1e20, 2, true, "100000000000000000000"));
+}
+
+static void testLimits()
+{
+    CHECK(intIs(INT64_MIN, 0, false, "-9223372036854775808"));
+    CHECK(intIs(INT64_MAX, 0, false, "9223372036854775807"));
+    CHECK(uintIs(UINT64_MAX, 0, false, "18446744073709551615"));
+    CHECK(uintIs(UINT64_MAX, 1, false, "18446744073709551615.0"));
+    CHECK(fixedIs(9007199254740991.0, 0, false, "9007199254740991"));
+
+    CHECK(NumFormat_fixed(-12.5, 1, false, buf, 6) == 5 && strcmp(buf, "-12.5") == 0);
+    CHECK(NumFormat_fixed(-12.5, 1, false, buf, 5) == -1);
+    CHECK(NumFormat_fixed(1e20, 0, false, buf, 8) == -1);
+    CHECK(NumFormat_int(-100, 0, false, buf, 4) == -1);
+    CHECK(NumFormat_uint(100, 2, true, buf, 4) == 3 && strcmp(buf, "100") == 0);
+
+    CHECK(NumFormat_round(1.005, 0) == 1.0);
+    CHECK(NumFormat_round(-2.675, 1) == -2.7);
+    CHECK(NumFormat_round(1e300, 2) == 1e300);
+    CHECK(isnan(NumFormat_round(NAN, 2)));
+}
+
+// Output of the formatting path used before num_format: rounded with pow, then printed with printf
+static void legacyFixed(double value, uint8_t decimals, char *out, int outLen)
+{
+    const double rounded = round(value * pow(10, decimals)) / pow(10, decimals);
+    snprintf(out, outLen, "%.*f", decimals, rounded);
+}
+
+// Same digits as the printf based path, except for "-0"
+static void testMatchesLegacy()
+{
+    char legacy[BUF_LEN];
+    int mismatches = 0;
+    srand(1);
+    for (int i = 0; i < RANDOM_VALUES_NUM; i++)
+    {
+        const double magnitude = pow(10, rand() % 12 - 3);
+        const double value = ((double)rand() / RAND_MAX - 0.5) * 2 * magnitude;
+        const uint8_t decimals = rand() % 7;
+        NumFormat_fixed(value, decimals, false, buf, BUF_LEN);
+        legacyFixed(value, decimals, legacy, BUF_LEN);
+        const char *expected = legacy;
+        if (legacy[0] == '-' && strspn(&legacy[1], "0.") == strlen(&legacy[1]))
+            expected = &legacy[1];
+        if (strcmp(buf, expected) != 0 && mismatches++ < 10)
+            fprintf(stderr, "%.17g with %u decimals: \"%s\", printf path \"%s\"\n", value, decimals, buf, legacy);
+    }
+    CHECK(mismatches == 0);
+}
+
+int main()
+{
+    testNegativeZero();
+    testCarry();
+    testTrailingZeros();
+    testLimits();
+    testMatchesLegacy();
+    return TEST_RESULT;
+}
@@ -0,0 +1,429 @@
+// Payloads written by PayloadWriter are decoded on the host and compared with the values written, for both binary encodings
+
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "payload_writer.h"
+#include "test_check.h"
+
+#define PAYLOAD_LEN 1024
+#define MAX_ITEMS 64
+
+typedef enum
+{
+    ItemType_UINT,
+    ItemType_NEGINT, // Value is -1 - u, so that INT64_MIN and beyond fit
+    ItemType_FLOAT,
+    ItemType_TEXT,
+    ItemType_NULL,
+} ItemType_t;
+
+// Decoded item of a map, either a key or a value
+typedef struct Item_s
+{
+    ItemType_t type;
+    uint64_t u;
+    double f;
+    bool isFloat32;
+    char text[64];
+} Item_t;
+
+typedef struct Decoded_s
+{
+    Item_t items[MAX_ITEMS];
+    int itemsNum;
+} Decoded_t;
+
+// BEGIN ---------------------------------------------------- DECODERS --------------------------------------------------------------------
+
+static int base64Value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+static int base64Decode(const char *in, uint8_t *out)
+{
+    int len = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (const char *c = in; *c != '\0' && *c != '='; c++)
+    {
+        const int v = base64Value(*c);
+        if (v < 0)
+            return -1;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out[len++] = (acc >> bits) & 0xFF;
+        }
+    }
+    return len;
+}
+
+static uint64_t bigEndian(const uint8_t *data, int bytesNum)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytesNum; i++)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+static double float32At(const uint8_t *data)
+{
+    const uint32_t bits = bigEndian(data, 4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static double float64At(const uint8_t *data)
+{
+    const uint64_t bits = bigEndian(data, 8);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void textItem(Item_t *item, const uint8_t *data, uint64_t len)
+{
+    item->type = ItemType_TEXT;
+    memcpy(item->text, data, len);
+    item->text[len] = '\0';
+}
+
+// Decode a CBOR indefinite length map of scalars. Returns false if it's malformed.
+static bool decodeCbor(const uint8_t *data, int len, Decoded_t *out)
+{
+    out->itemsNum = 0;
+    int pos = 0;
+    if (len < 1 || data[pos++] != 0xBF)
+        return false;
+
+    while (pos < len)
+    {
+        const uint8_t head = data[pos++];
+        if (head == 0xFF)
+            return pos == len && out->itemsNum % 2 == 0;
+
+        Item_t *item = &out->items[out->itemsNum++];
+        memset(item, 0, sizeof(*item));
+        const uint8_t majorType = head >> 5;
+        const uint8_t info = head & 0x1F;
+        if (majorType == 7)
+        {
+            if (info == 22)
+                item->type = ItemType_NULL;
+            else if (info == 26)
+                item->type = ItemType_FLOAT, item->f = float32At(&data[pos]), item->isFloat32 = true, pos += 4;
+            else if (info == 27)
+                item->type = ItemType_FLOAT, item->f = float64At(&data[pos]), pos += 8;
+            else
+                return false;
+            continue;
+        }
+
+        uint64_t argument = info;
+        if (info >= 24 && info <= 27)
+        {
+            const int bytesNum = 1 << (info - 24);
+            argument = bigEndian(&data[pos], bytesNum);
+            pos += bytesNum;
+        }
+        else if (info > 27)
+        {
+            return false;
+        }
+
+        if (majorType == 0)
+            item->type = ItemType_UINT, item->u = argument;
+        else if (majorType == 1)
+            item->type = ItemType_NEGINT, item->u = argument;
+        else if (majorType == 3)
+            textItem(item, &data[pos], argument), pos += argument;
+        else
+            return false;
+    }
+    return false;
+}
+
+static void intItem(Item_t *item, int64_t value)
+{
+    if (value >= 0)
+        item->type = ItemType_UINT, item->u = value;
+    else
+        item->type = ItemType_NEGINT, item->u = (uint64_t)(-(value + 1));
+}
+
+// Decode a MessagePack map of scalars. Returns false if it's malformed.
+static bool decodeMsgpack(const uint8_t *data, int len, Decoded_t *out)
+{
+    out->itemsNum = 0;
+    int pos = 0;
+    if (len < 3 || data[pos++] != 0xDE)
+        return false;
+    const int itemsNum = 2 * bigEndian(&data[pos], 2);
+    pos += 2;
+
+    while (pos < len && out->itemsNum < itemsNum)
+    {
+        const uint8_t format = data[pos++];
+        Item_t *item = &out->items[out->itemsNum++];
+        memset(item, 0, sizeof(*item));
+        if (format <= 0x7F)
+            item->type = ItemType_UINT, item->u = format;
+        else if (format >= 0xE0)
+            intItem(item, (int8_t)format);
+        else if ((format & 0xE0) == 0xA0)
+            textItem(item, &data[pos], format & 0x1F), pos += format & 0x1F;
+        else if (format == 0xC0)
+            item->type = ItemType_NULL;
+        else if (format == 0xCA)
+            item->type = ItemType_FLOAT, item->f = float32At(&data[pos]), item->isFloat32 = true, pos += 4;
+        else if (format == 0xCB)
+            item->type = ItemType_FLOAT, item->f = float64At(&data[pos]), pos += 8;
+        else if (format >= 0xCC && format <= 0xCF)
+        {
+            const int bytesNum = 1 << (format - 0xCC);
+            item->type = ItemType_UINT, item->u = bigEndian(&data[pos], bytesNum), pos += bytesNum;
+        }
+        else if (format >= 0xD0 && format <= 0xD3)
+        {
+            const int bytesNum = 1 << (format - 0xD0);
+            const uint64_t bits = bigEndian(&data[pos], bytesNum);
+            const int shift = 64 - 8 * bytesNum;
+            intItem(item, (int64_t)(bits << shift) >> shift); // Sign extended
+            pos += bytesNum;
+        }
+        else if (format == 0xD9)
+            textItem(item, &data[pos + 1], data[pos]), pos += 1 + data[pos];
+        else
+            return false;
+    }
+    return pos == len && out->itemsNum == itemsNum;
+}
+
+// BEGIN ---------------------------------------------------- TEST DATA -------------------------------------------------------------------
+
+typedef struct Entry_s
+{
+    const char *key; // NULL: key id is used
+    uint16_t keyId;
+    RegValue_t value;
+} Entry_t;
+
+static Entry_t entries[] = {
+    {.key = "i64min", .value = {.type = RegValueType_INT, .i = INT64_MIN}},
+    {.key = "i64max", .value = {.type = RegValueType_INT, .i = INT64_MAX}},
+    {.key = "u64max", .value = {.type = RegValueType_UINT, .u = UINT64_MAX}},
+    {.key = "i32min", .value = {.type = RegValueType_INT, .i = INT32_MIN}},
+    {.key = "i16min", .value = {.type = RegValueType_INT, .i = INT16_MIN}},
+    {.key = "minus1", .value = {.type = RegValueType_INT, .i = -1}},
+    {.key = "minus33", .value = {.type = RegValueType_INT, .i = -33}},
+    {.key = "zero", .value = {.type = RegValueType_UINT, .u = 0}},
+    {.key = "u16max", .value = {.type = RegValueType_UINT, .u = UINT16_MAX}},
+    {.key = "u32max", .value = {.type = RegValueType_UINT, .u = UINT32_MAX}},
+    {.key = "f32", .value = {.type = RegValueType_FLOAT32, .f32 = -1.25e-3f}},
+    {.key = "f64exact", .value = {.type = RegValueType_FLOAT64, .f64 = 1.5}}, // Fits single precision
+    {.key = "f64tenth", .value = {.type = RegValueType_FLOAT64, .f64 = 0.1}},
+    {.key = "f64huge", .value = {.type = RegValueType_FLOAT64, .f64 = -DBL_MAX}},
+    {.key = "f64tiny", .value = {.type = RegValueType_FLOAT64, .f64 = DBL_MIN}},
+    {.key = "text", .value = {.type = RegValueType_TEXT, .text = "serial-0123456789"}},
+    {.key = "null", .value = {.type = RegValueType_NULL}},
+    {.key = NULL, .keyId = 7, .value = {.type = RegValueType_UINT, .u = 42}},
+    {.key = NULL, .keyId = 4000, .value = {.type = RegValueType_INT, .i = -4000}},
+};
+
+#define ENTRIES_NUM ((int)(sizeof(entries) / sizeof(entries[0])))
+
+static bool writePayload(PayloadEncoding_t encoding, const char *wrapKey, int entriesNum, char *payload, int payloadLen)
+{
+    static uint8_t scratch[PAYLOAD_LEN];
+    PayloadWriter_t writer;
+    PayloadWriter_init(&writer, encoding, wrapKey, payload, payloadLen, scratch, sizeof(scratch));
+    for (int e = 0; e < entriesNum; e++)
+    {
+        if (entries[e].key != NULL)
+            PayloadWriter_key(&writer, entries[e].key);
+        else
+            PayloadWriter_keyId(&writer, entries[e].keyId);
+        PayloadWriter_value(&writer, &entries[e].value, "0");
+    }
+    return !PayloadWriter_overflowed(&writer) && PayloadWriter_finish(&writer);
+}
+
+static bool decodePayload(PayloadEncoding_t encoding, const char *base64, Decoded_t *decoded)
+{
+    static uint8_t binary[PAYLOAD_LEN];
+    const int len = base64Decode(base64, binary);
+    if (len < 0)
+        return false;
+    if (encoding == PayloadEncoding_MSGPACK)
+        return decodeMsgpack(binary, len, decoded);
+    return decodeCbor(binary, len, decoded);
+}
+
+static bool valueMatches(const Item_t *item, const RegValue_t *value)
+{
+    switch (value->type)
+    {
+    case RegValueType_INT:
+        if (value->i >= 0)
+            return item->type == ItemType_UINT && item->u == (uint64_t)value->i;
+        return item->type == ItemType_NEGINT && item->u == (uint64_t)(-(value->i + 1));
+    case RegValueType_UINT:
+        return item->type == ItemType_UINT && item->u == value->u;
+    case RegValueType_FLOAT32:
+        return item->type == ItemType_FLOAT && item->isFloat32 && item->f == (double)value->f32;
+    case RegValueType_FLOAT64:
+        // Bit exact, in the shortest width that represents it
+        return item->type == ItemType_FLOAT && item->f == value->f64 && item->isFloat32 == ((double)(float)value->f64 == value->f64);
+    case RegValueType_TEXT:
+        return item->type == ItemType_TEXT && strcmp(item->text, value->text) == 0;
+    case RegValueType_NULL:
+        return item->type == ItemType_NULL;
+    }
+    return false;
+}
+
+static void checkEntries(const Decoded_t *decoded, int entriesNum)
+{
+    CHECK(decoded->itemsNum == 2 * entriesNum);
+    for (int e = 0; e < entriesNum && 2 * e + 1 < decoded->itemsNum; e++)
+    {
+        const Item_t *key = &decoded->items[2 * e];
+        if (entries[e].key != NULL)
+            CHECK(key->type == ItemType_TEXT && strcmp(key->text, entries[e].key) == 0);
+        else
+            CHECK(key->type == ItemType_UINT && key->u == entries[e].keyId);
+        if (!valueMatches(&decoded->items[2 * e + 1], &entries[e].value))
+        {
+            fprintf(stderr, "value of entry %d doesn't match\n", e);
+            CHECK(false);
+        }
+    }
+}
+
+// BEGIN ---------------------------------------------------- TESTS -----------------------------------------------------------------------
+
+static void testRoundTrip(PayloadEncoding_t encoding)
+{
+    static char payload[PAYLOAD_LEN * 2];
+    Decoded_t decoded;
+    CHECK(writePayload(encoding, NULL, ENTRIES_NUM, payload, sizeof(payload)));
+    CHECK(decodePayload(encoding, payload, &decoded));
+    checkEntries(&decoded, ENTRIES_NUM);
+}
+
+// Bulk GETs wrap base64 in a JSON object
+static void testWrapped(PayloadEncoding_t encoding)
+{
+    static char payload[PAYLOAD_LEN * 2];
+    Decoded_t decoded;
+    const char *name = PayloadEncoding_name(encoding);
+    CHECK(writePayload(encoding, name, 3, payload, sizeof(payload)));
+
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "{\"%s\":\"", name);
+    const size_t prefixLen = strlen(prefix);
+    const size_t len = strlen(payload);
+    CHECK(strncmp(payload, prefix, prefixLen) == 0);
+    CHECK(len > prefixLen + 2 && strcmp(&payload[len - 2], "\"}") == 0);
+
+    payload[len - 2] = '\0';
+    CHECK(decodePayload(encoding, &payload[prefixLen], &decoded));
+    checkEntries(&decoded, 3);
+}
+
+// Values that don't fit are rolled back, and the payload still contains the ones appended before
+static void testRollback(PayloadEncoding_t encoding)
+{
+    static uint8_t scratch[PAYLOAD_LEN];
+    char payload[96];
+    PayloadWriter_t writer;
+    PayloadWriter_init(&writer, encoding, NULL, payload, sizeof(payload), scratch, sizeof(scratch));
+    int written = 0;
+    for (int e = 0; e < ENTRIES_NUM; e++)
+    {
+        const PayloadWriterMark_t mark = PayloadWriter_mark(&writer);
+        PayloadWriter_key(&writer, entries[e].key != NULL ? entries[e].key : "id");
+        PayloadWriter_value(&writer, &entries[e].value, "0");
+        if (PayloadWriter_overflowed(&writer))
+        {
+            PayloadWriter_rollback(&writer, mark);
+            break;
+        }
+        written++;
+    }
+    CHECK(written > 0 && written < ENTRIES_NUM);
+    CHECK(PayloadWriter_finish(&writer));
+
+    Decoded_t decoded;
+    CHECK(decodePayload(encoding, payload, &decoded));
+    CHECK(decoded.itemsNum == 2 * written);
+}
+
+// Both binary encodings carry the same data
+static void testEncodingsAgree()
+{
+    static char cborPayload[PAYLOAD_LEN * 2];
+    static char msgpackPayload[PAYLOAD_LEN * 2];
+    static Decoded_t cbor;
+    static Decoded_t msgpack;
+    CHECK(writePayload(PayloadEncoding_CBOR, NULL, ENTRIES_NUM, cborPayload, sizeof(cborPayload)));
+    CHECK(writePayload(PayloadEncoding_MSGPACK, NULL, ENTRIES_NUM, msgpackPayload, sizeof(msgpackPayload)));
+    CHECK(decodePayload(PayloadEncoding_CBOR, cborPayload, &cbor));
+    CHECK(decodePayload(PayloadEncoding_MSGPACK, msgpackPayload, &msgpack));
+    CHECK(cbor.itemsNum == msgpack.itemsNum);
+    for (int i = 0; i < cbor.itemsNum && i < msgpack.itemsNum; i++)
+    {
+        const Item_t *a = &cbor.items[i];
+        const Item_t *b = &msgpack.items[i];
+        CHECK(a->type == b->type && a->u == b->u && a->isFloat32 == b->isFloat32 && strcmp(a->text, b->text) == 0);
+        CHECK(a->f == b->f || (isnan(a->f) && isnan(b->f)));
+    }
+}
+
+static void testJson()
+{
+    static uint8_t scratch[PAYLOAD_LEN];
+    char payload[64];
+    PayloadWriter_t writer;
+    const RegValue_t value = {.type = RegValueType_INT, .i = -5};
+    PayloadWriter_init(&writer, PayloadEncoding_JSON, NULL, payload, sizeof(payload), scratch, sizeof(scratch));
+    PayloadWriter_key(&writer, "v");
+    PayloadWriter_uint(&writer, 3);
+    PayloadWriter_keyId(&writer, 12);
+    PayloadWriter_value(&writer, &value, "-5");
+    PayloadWriter_key(&writer, "n");
+    PayloadWriter_null(&writer);
+    CHECK(PayloadWriter_finish(&writer));
+    CHECK(strcmp(payload, "{\"v\":3,\"12\":-5,\"n\":null}") == 0);
+}
+
+int main()
+{
+    testRoundTrip(PayloadEncoding_CBOR);
+    testRoundTrip(PayloadEncoding_MSGPACK);
+    testWrapped(PayloadEncoding_CBOR);
+    testWrapped(PayloadEncoding_MSGPACK);
+    testRollback(PayloadEncoding_CBOR);
+    testRollback(PayloadEncoding_MSGPACK);
+    testEncodingsAgree();
+    testJson();
+    return TEST_RESULT;
+}
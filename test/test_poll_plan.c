@@ -0,0 +1,94 @@
+// Polling periods of monitored registers, and grouping of their reads in blocks
+
+#include <string.h>
+
+#include "poll_plan.h"
+#include "test_check.h"
+
+#define READ_PERIOD 2
+
+static RegisterPollData_t pollData(bool publishOnChange, Seconds_t changeCheckInterval, Seconds_t maxPublishDelay, Seconds_t pollInterval)
+{
+    RegisterPollData_t poll = {0};
+    poll.monitored = true;
+    poll.publishOnChange = publishOnChange;
+    poll.changeCheckInterval = changeCheckInterval;
+    poll.maxPublishDelay = maxPublishDelay;
+    poll.pollInterval = pollInterval;
+    return poll;
+}
+
+static Seconds_t intervalOf(bool publishOnChange, Seconds_t changeCheckInterval, Seconds_t maxPublishDelay, Seconds_t pollInterval)
+{
+    const RegisterPollData_t poll = pollData(publishOnChange, changeCheckInterval, maxPublishDelay, pollInterval);
+    return PollPlan_intervalOf(&poll, READ_PERIOD);
+}
+
+static void testIntervals()
+{
+    // Published periodically
+    CHECK(intervalOf(false, 0, 60, 0) == 60);
+    CHECK(intervalOf(false, 5, 60, 0) == 60); // Change check interval doesn't apply
+    CHECK(intervalOf(false, 0, 0, 0) == READ_PERIOD);
+
+    // On change: checked for changes, but still published within the max publish delay
+    CHECK(intervalOf(true, 10, 60, 0) == 10);
+    CHECK(intervalOf(true, 60, 10, 0) == 10);
+    CHECK(intervalOf(true, 60, 0, 0) == 60);
+    CHECK(intervalOf(true, 0, 30, 0) == 30);
+
+    // Explicit poll interval: never later than the other periods
+    CHECK(intervalOf(false, 0, 60, 20) == 20);
+    CHECK(intervalOf(false, 0, 10, 20) == 10);
+    CHECK(intervalOf(true, 5, 60, 20) == 5);
+    CHECK(intervalOf(true, 0, 0, 20) == 20);
+
+    // Never more often than the Modbus polling period
+    CHECK(intervalOf(true, 1, 60, 0) == READ_PERIOD);
+    CHECK(intervalOf(false, 0, 60, 1) == READ_PERIOD);
+    CHECK(intervalOf(true, 60, 1, 0) == READ_PERIOD);
+}
+
+static void addEntry(KnownRegHandle_t handle, uint8_t bus, uint8_t readFunction, uint8_t slaveAddr, uint16_t regId, uint8_t regNumber)
+{
+    RegisterPollData_t poll = pollData(false, 0, 60, 0);
+    poll.bus = bus;
+    poll.readFunction = readFunction;
+    poll.slaveAddr = slaveAddr;
+    poll.regId = regId;
+    poll.regNumber = regNumber;
+    CHECK(PollPlan_add(handle, &poll));
+}
+
+static void testBlocks()
+{
+    const uint16_t maxGapRegs[MB_BUSES_NUM] = {4, 4, 4, 64, 64};
+    CHECK(PollPlan_init(16));
+
+    addEntry(0, 0, 3, 1, 112, 2); // Gap of 6 from the block at 100: new block
+    addEntry(1, 0, 3, 1, 100, 2);
+    addEntry(2, 0, 3, 1, 104, 2); // Gap of 2: same block
+    addEntry(3, 0, 1, 1, 101, 1); // Coils are never merged
+    addEntry(4, 0, 1, 1, 100, 1);
+    addEntry(5, 3, 3, 1, 100, 2);
+    addEntry(6, 3, 3, 1, 160, 2); // Gap of 58 on a TCP bus: same block
+    addEntry(7, 3, 3, 1, 220, 10); // Would make the block longer than 125 registers
+
+    CHECK(PollPlan_build(maxGapRegs) == 6);
+
+    const PollBlock_t *block = PollPlan_blockAt(2);
+    CHECK(block != NULL && block->bus == 0 && block->readFunction == 3 && block->regId == 100 && block->regNumber == 6 && block->entriesNum == 2);
+    const PollEntry_t *entry = PollPlan_entryAt(block->firstEntry + 1);
+    CHECK(entry != NULL && entry->handle == 2 && entry->offset == 4);
+
+    block = PollPlan_blockAt(4);
+    CHECK(block != NULL && block->bus == 3 && block->regId == 100 && block->regNumber == 62 && block->entriesNum == 2);
+    CHECK(PollPlan_blockAt(6) == NULL);
+}
+
+int main()
+{
+    testIntervals();
+    testBlocks();
+    return TEST_RESULT;
+}
@@ -0,0 +1,228 @@
+// Register map: records formatted and parsed back, and imports of registers, all or nothing, merged with the known ones or
+// replacing them
+
+#include <stdio.h>
+#include <string.h>
+
+#include "known_registers.h"
+#include "register_map.h"
+#include "test_check.h"
+
+#define CAPACITY 6
+
+static RegisterAccessData_t numberRegister(const char *name, uint8_t slaveAddr, uint16_t regId)
+{
+    RegisterAccessData_t rad = {0};
+    strcpy(rad.regName, name);
+    rad.type = RADType_NUMBER;
+    rad.readFunction = 3;
+    rad.slaveAddr = slaveAddr;
+    rad.regId = regId;
+    rad.regNumber = 1;
+    rad.factor = 1;
+    return rad;
+}
+
+static bool sameRegister(const RegisterAccessData_t *a, const RegisterAccessData_t *b)
+{
+    return strcmp(a->regName, b->regName) == 0 && a->readFunction == b->readFunction && a->slaveAddr == b->slaveAddr && a->regId == b->regId &&
+           a->type == b->type && a->regNumber == b->regNumber && a->bus == b->bus && a->writable == b->writable &&
+           a->writeFunction == b->writeFunction && a->interpretAsSigned == b->interpretAsSigned && a->factor == b->factor &&
+           a->offset == b->offset && a->decimals == b->decimals && a->monitored == b->monitored && a->publishOnChange == b->publishOnChange &&
+           a->changeCheckInterval == b->changeCheckInterval && a->maxPublishDelay == b->maxPublishDelay && a->pollInterval == b->pollInterval &&
+           a->deadbandAbs == b->deadbandAbs && a->deadbandRel == b->deadbandRel && a->keyId == b->keyId;
+}
+
+static bool parses(const char *record)
+{
+    char buf[REGISTER_MAP_RECORD_MAX_LEN + 1];
+    RegisterAccessData_t rad;
+    strcpy(buf, record);
+    return RegisterMap_parseRecord(buf, &rad);
+}
+
+static void testRoundTrip()
+{
+    RegisterAccessData_t rads[4];
+    rads[0] = numberRegister("power", 7, 40001);
+    rads[0].regNumber = 2;
+    rads[0].interpretAsSigned = true;
+    rads[0].factor = 0.001;
+    rads[0].offset = -273.15;
+    rads[0].decimals = 3;
+    rads[0].monitored = true;
+    rads[0].maxPublishDelay = 600;
+    rads[0].pollInterval = 10;
+    rads[0].deadbandAbs = 0.5;
+    rads[0].deadbandRel = 2.25;
+    rads[0].keyId = 42;
+
+    rads[1] = numberRegister("setpoint", 2, 100);
+    rads[1].type = RADType_FLOAT;
+    rads[1].regNumber = 4;
+    rads[1].bus = 1;
+    rads[1].writable = true;
+    rads[1].writeFunction = 16;
+    rads[1].monitored = true;
+    rads[1].publishOnChange = true;
+    rads[1].changeCheckInterval = 30;
+
+    rads[2] = numberRegister("alarms", 255, 65535);
+    rads[2].type = RADType_RAW;
+    rads[2].readFunction = 1;
+    rads[2].factor = 0;
+
+    rads[3] = numberRegister("serial", 1, 0);
+    rads[3].type = RADType_STRING;
+    rads[3].regNumber = MAX_REG_LENGTH;
+    rads[3].readFunction = 4;
+    rads[3].factor = 0;
+
+    for (int r = 0; r < (int)(sizeof(rads) / sizeof(rads[0])); r++)
+    {
+        char record[REGISTER_MAP_RECORD_MAX_LEN + 1];
+        const int len = RegisterMap_formatRecord(&rads[r], record, sizeof(record));
+        CHECK(len > 0 && len == (int)strlen(record));
+
+        char copy[REGISTER_MAP_RECORD_MAX_LEN + 1];
+        strcpy(copy, record);
+        RegisterAccessData_t parsed;
+        CHECK(RegisterMap_parseRecord(copy, &parsed));
+        CHECK(sameRegister(&parsed, &rads[r]));
+
+        // Records that don't fit aren't truncated
+        CHECK(RegisterMap_formatRecord(&rads[r], record, len) == -1);
+        CHECK(RegisterMap_formatRecord(&rads[r], record, len + 1) == len);
+    }
+
+    // Key ids are assigned by the gateway: they don't change the hash of a register
+    RegisterAccessData_t rekeyed = rads[0];
+    rekeyed.keyId = 43;
+    CHECK(RegisterMap_recordHash(&rekeyed) == RegisterMap_recordHash(&rads[0]) && RegisterMap_recordHash(&rads[0]) != 0);
+    rekeyed.factor = 0.01;
+    CHECK(RegisterMap_recordHash(&rekeyed) != RegisterMap_recordHash(&rads[0]));
+}
+
+static void testInvalidRecords()
+{
+    CHECK(parses("r,3,1,10,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0"));
+    CHECK(!parses("r,3,1,10,number,1,0,0,0,1,0,0,0,0,0,0,0,0"));      // Missing field
+    CHECK(!parses("r,3,1,10,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0,0"));  // Extra field
+    CHECK(!parses(",3,1,10,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0"));     // No name
+    CHECK(!parses("name_longer_than_20_,3,1,10,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0")); // Name too long
+    CHECK(!parses("r,3,1,10,integer,1,0,0,0,1,0,0,0,0,0,0,0,0,0"));   // Unknown type
+    CHECK(!parses("r,3,1,65536,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0")); // Register id out of range
+    CHECK(!parses("r,3,1,10,number,5,0,0,0,1,0,0,0,0,0,0,0,0,0"));    // Numbers are up to 4 words
+    CHECK(!parses("r,3,1,10,number,1,0,7,0,1,0,0,0,0,0,0,0,0,0"));    // Not a write function
+    CHECK(!parses("r,3,1,10,number,1,0,0,0,0,0,0,0,0,0,0,0,0,0"));    // Scaled by 0
+    CHECK(!parses("r,3,1,10,number,1,0,0,0,1,0,0,3,0,0,0,0,0,0"));    // Unknown monitoring
+    CHECK(!parses("r,3,1,10,number,1,0,0,0,1,0,0,0,0,0,0,-1,0,0"));   // Negative deadband
+    CHECK(!parses("r,3,1,10,float,2,0,0,1,1,0,0,0,0,0,0,0,0,0"));     // Only numbers are signed
+    CHECK(!parses("r,3,1,10,raw,1,0,0,0,1,0,0,0,0,0,0,0,0,0"));       // Raw values aren't scaled
+    CHECK(!parses("r,3,1,10,string,2,0,0,0,0,0,0,0,0,0,0,1,0,0"));    // Strings have no deadband
+}
+
+static bool knows(const char *name, RegisterAccessData_t *rad)
+{
+    char nameCpy[MAX_REG_NAME_SIZE];
+    strcpy(nameCpy, name);
+    return KnownRegisters_find(nameCpy, rad);
+}
+
+static void testImport()
+{
+    CHECK(KnownRegisters_init(CAPACITY));
+    RegisterAccessData_t a = numberRegister("a", 1, 1);
+    RegisterAccessData_t b = numberRegister("b", 1, 2);
+    RegisterAccessData_t c = numberRegister("c", 1, 3);
+    CHECK(KnownRegisters_add(&a) && KnownRegisters_add(&b) && KnownRegisters_add(&c));
+    RegisterAccessData_t rad;
+    CHECK(knows("a", &rad));
+    const uint16_t keyIdOfA = rad.keyId;
+    const uint32_t mapHash = KnownRegisters_getMapHash();
+
+    // Clashes change nothing: d takes the Modbus details of b, which is kept
+    RegisterAccessData_t imported[CAPACITY];
+    imported[0] = numberRegister("a", 1, 10);
+    imported[1] = numberRegister("d", 1, 2);
+    CHECK(!KnownRegisters_import(imported, 2, NULL, 0, false));
+    CHECK(KnownRegisters_count() == 3 && knows("a", &rad) && rad.regId == 1 && !knows("d", &rad));
+    CHECK(KnownRegisters_getMapHash() == mapHash);
+
+    // Nor do duplicates inside the import, or removals of imported registers
+    imported[1] = numberRegister("a", 1, 11);
+    CHECK(!KnownRegisters_import(imported, 2, NULL, 0, false));
+    imported[1] = numberRegister("d", 1, 10);
+    CHECK(!KnownRegisters_import(imported, 2, NULL, 0, false));
+    const char removeA[][MAX_REG_NAME_SIZE] = {"a"};
+    CHECK(!KnownRegisters_import(imported, 1, removeA, 1, false));
+    CHECK(KnownRegisters_getMapHash() == mapHash);
+
+    // Merge: a is replaced keeping its key id, b is removed so that d can take its place, c is kept
+    imported[1] = numberRegister("d", 1, 2);
+    const char removeB[][MAX_REG_NAME_SIZE] = {"b", "unknown"};
+    CHECK(KnownRegisters_import(imported, 2, removeB, 2, false));
+    CHECK(KnownRegisters_count() == 3 && !knows("b", &rad) && knows("c", &rad) && knows("d", &rad) && rad.regId == 2);
+    CHECK(knows("a", &rad) && rad.regId == 10 && rad.keyId == keyIdOfA);
+
+    // Imported key ids win over the ones of the replaced registers
+    imported[0] = numberRegister("a", 1, 10);
+    imported[0].keyId = 500;
+    CHECK(KnownRegisters_import(imported, 1, NULL, 0, false));
+    CHECK(knows("a", &rad) && rad.keyId == 500);
+
+    // Registers must fit, counting the ones that are kept
+    for (int i = 0; i < CAPACITY - 2; i++)
+    {
+        char name[MAX_REG_NAME_SIZE];
+        snprintf(name, sizeof(name), "e%d", i);
+        imported[i] = numberRegister(name, 2, i);
+    }
+    CHECK(!KnownRegisters_import(imported, CAPACITY - 2, NULL, 0, false));
+    CHECK(KnownRegisters_count() == 3);
+    CHECK(KnownRegisters_import(imported, CAPACITY - 3, NULL, 0, false) && KnownRegisters_count() == CAPACITY);
+
+    // Replace: known registers are forgotten, so imported ones can take their names and Modbus details
+    imported[0] = numberRegister("c", 1, 1);
+    imported[1] = numberRegister("f", 1, 3);
+    CHECK(KnownRegisters_import(imported, 2, NULL, 0, true));
+    CHECK(KnownRegisters_count() == 2 && knows("c", &rad) && rad.regId == 1 && knows("f", &rad) && !knows("a", &rad));
+    KnownRegisters_clear();
+}
+
+// Records are staged chunk by chunk, and applied by a commit
+static void testStagedImport()
+{
+    CHECK(KnownRegisters_init(CAPACITY));
+    RegisterAccessData_t a = numberRegister("a", 1, 1);
+    CHECK(KnownRegisters_add(&a));
+
+    char invalid[] = "b,3,1,2,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0;c,3,1,3,number,9,0,0,0,1,0,0,0,0,0,0,0,0,0";
+    int invalidRecord = -1;
+    CHECK(RegisterMap_stageChunk(invalid, &invalidRecord) == RegisterMapRes_INVALID_RECORD && invalidRecord == 1);
+    CHECK(RegisterMap_stagedCount() == 0);
+
+    char first[] = "b,3,1,2,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0";
+    char second[] = "c,3,1,3,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0;a";
+    CHECK(RegisterMap_stageChunk(first, &invalidRecord) == RegisterMapRes_OK);
+    CHECK(RegisterMap_stageChunk(second, &invalidRecord) == RegisterMapRes_OK && RegisterMap_stagedCount() == 3);
+    CHECK(RegisterMap_commit(false) && RegisterMap_stagedCount() == 0);
+
+    RegisterAccessData_t rad;
+    CHECK(KnownRegisters_count() == 2 && !knows("a", &rad) && knows("b", &rad) && knows("c", &rad));
+
+    // A failed commit forgets the staged records too
+    char clashing[] = "d,3,1,2,number,1,0,0,0,1,0,0,0,0,0,0,0,0,0";
+    CHECK(RegisterMap_stageChunk(clashing, &invalidRecord) == RegisterMapRes_OK);
+    CHECK(!RegisterMap_commit(false) && RegisterMap_stagedCount() == 0 && KnownRegisters_count() == 2);
+    KnownRegisters_clear();
+}
+
+int main()
+{
+    testRoundTrip();
+    testInvalidRecords();
+    testImport();
+    testStagedImport();
+    return TEST_RESULT;
+}
@@ -0,0 +1,85 @@
+// Health of slaves: exception responses are answers, only unanswered transactions lead to backoff
+
+#include <esp_timer.h>
+
+#include "mb_pdu.h"
+#include "slave_health.h"
+#include "test_check.h"
+
+#define BUS 1
+#define SLAVE 7
+
+static void testExceptionCodes()
+{
+    const uint8_t refused[] = {3 | MB_PDU_EXCEPTION_FLAG, MB_EXCEPTION_ILLEGAL_DATA_ADDRESS};
+    uint16_t words[2];
+    const ModbusError err = MbPdu_parseResponse(refused, sizeof(refused), 3, 2, words);
+    CHECK(err == MB_BUS_ERR_EXCEPTION(MB_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+    CHECK(MB_BUS_EXCEPTION_CODE(err) == MB_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    CHECK(MB_BUS_ANSWERED(err));
+
+    const uint8_t noCode[] = {3 | MB_PDU_EXCEPTION_FLAG, 0};
+    CHECK(MbPdu_parseResponse(noCode, sizeof(noCode), 3, 2, words) == MB_BUS_ERR_INVALID_RESPONSE);
+    const uint8_t tooLong[] = {3 | MB_PDU_EXCEPTION_FLAG, 2, 0};
+    CHECK(MbPdu_parseResponse(tooLong, sizeof(tooLong), 3, 2, words) == MB_BUS_ERR_INVALID_RESPONSE);
+    CHECK(MbPdu_exception(MB_BUS_MAX_EXCEPTION_CODE) == MB_BUS_ERR_EXCEPTION(MB_BUS_MAX_EXCEPTION_CODE));
+    CHECK((int8_t)MbPdu_exception(MB_BUS_MAX_EXCEPTION_CODE) == MbPdu_exception(MB_BUS_MAX_EXCEPTION_CODE)); // Fits a trace entry
+    CHECK(MbPdu_exception(MB_BUS_MAX_EXCEPTION_CODE + 1) == MB_BUS_ERR_INVALID_RESPONSE);
+
+    CHECK(MB_BUS_EXCEPTION_CODE(MODBUS_OK) == 0 && MB_BUS_ANSWERED(MODBUS_OK));
+    CHECK(MB_BUS_EXCEPTION_CODE(MB_BUS_ERR_TIMEOUT) == 0 && !MB_BUS_ANSWERED(MB_BUS_ERR_TIMEOUT));
+    CHECK(MB_BUS_EXCEPTION_CODE(MB_BUS_ERR_INVALID_RESPONSE) == 0 && !MB_BUS_ANSWERED(MB_BUS_ERR_INVALID_RESPONSE));
+}
+
+static void testExceptionsAreAnswers()
+{
+    CHECK(SlaveHealth_reset(BUS));
+    const int64_t startUs = esp_timer_get_time();
+
+    // A live slave refusing many registers in a row keeps being polled
+    for (int i = 0; i < 2 * SLAVE_FAILURES_TO_BACKOFF; i++)
+        SlaveHealth_record(BUS, SLAVE, MB_BUS_ERR_EXCEPTION(MB_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+    CHECK(!SlaveHealth_isBackingOff(BUS, SLAVE));
+    CHECK(SlaveHealth_answeredSince(BUS, SLAVE, startUs));
+
+    SlaveHealth_t health;
+    CHECK(SlaveHealth_get(BUS, SLAVE, &health));
+    CHECK(health.exceptions == 2 * SLAVE_FAILURES_TO_BACKOFF && health.successes == 0 && health.failures == 0);
+    CHECK(health.lastException == MB_EXCEPTION_ILLEGAL_DATA_ADDRESS && health.consecutiveFailures == 0);
+
+    // Requests that never reached the slave aren't recorded
+    SlaveHealth_record(BUS, SLAVE, MB_BUS_ERR_NOT_RUNNING);
+    SlaveHealth_record(BUS, SLAVE, MB_BUS_ERR_INVALID_REQUEST);
+    CHECK(SlaveHealth_get(BUS, SLAVE, &health) && health.failures == 0);
+    CHECK(!SlaveHealth_get(BUS, SLAVE + 1, &health));
+}
+
+static void testBackoff()
+{
+    CHECK(SlaveHealth_reset(BUS));
+    for (int i = 0; i < SLAVE_FAILURES_TO_BACKOFF - 1; i++)
+        SlaveHealth_record(BUS, SLAVE, MB_BUS_ERR_TIMEOUT);
+    CHECK(!SlaveHealth_isBackingOff(BUS, SLAVE));
+    SlaveHealth_record(BUS, SLAVE, MB_BUS_ERR_INVALID_RESPONSE);
+    CHECK(SlaveHealth_isBackingOff(BUS, SLAVE));
+    CHECK(!SlaveHealth_probeDue(BUS, SLAVE));
+
+    SlaveHealth_t health;
+    CHECK(SlaveHealth_get(BUS, SLAVE, &health));
+    CHECK(health.failures == SLAVE_FAILURES_TO_BACKOFF && health.lastError == MB_BUS_ERR_INVALID_RESPONSE && health.lastAnswerUs == 0);
+
+    // Answering the probe with an exception ends the backoff, and the failures count starts over
+    SlaveHealth_record(BUS, SLAVE, MB_BUS_ERR_EXCEPTION(MB_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+    CHECK(!SlaveHealth_isBackingOff(BUS, SLAVE));
+    SlaveHealth_record(BUS, SLAVE, MB_BUS_ERR_TIMEOUT);
+    CHECK(!SlaveHealth_isBackingOff(BUS, SLAVE));
+    CHECK(SlaveHealth_get(BUS, SLAVE, &health) && health.consecutiveFailures == 1 && health.backoffExp == 0);
+}
+
+int main()
+{
+    testExceptionCodes();
+    testExceptionsAreAnswers();
+    testBackoff();
+    return TEST_RESULT;
+}